@@ -0,0 +1,289 @@
+// ==============================
+// 连接压缩基准：压缩率与 CPU 开销（逐帧，按连接顺序模拟流式上下文）
+// ==============================
+// 语料：默认生成贴近线上的聊天流量——每个连接依次收到推送的 MESSAGE（带消息ID、时间戳、SEQ）、
+// 发送应答、ACK，偶尔一个捎带 50 条离线消息的登录应答；内容为中英文短句混合，长度长尾分布。
+// 也可以用 --corpus=文件 读取真实帧（每行一帧，按行号轮流分给各连接）。
+// 对比以下方案（同一阈值，低于阈值或压不小的帧按原样计入）：
+//   none            不压缩
+//   lz4/frame       每帧独立压缩（无历史、无字典）
+//   lz4/stream      连接级流式上下文（最近 32KB 历史）
+//   lz4/stream+dict 流式 + 内置字典
+//   lz4/stream+trained 流式 + 用前一半连接训练的字典（在后一半连接上评估）
+// 报告：线上字节比（压缩后/原始）、压缩的帧占比、压缩吞吐（按全部原始字节，含判定不压缩的帧）、
+// 解压吞吐（按压缩帧的原始字节）与每帧耗时。
+// 每个方案都会解压校验，结果不一致时进程返回 1。
+//
+// 用法: bench_compression [--conns=200] [--frames=400] [--min-bytes=48] [--seed=1]
+//                         [--corpus=frames.txt] [--save-dict=chat.dict]
+//   --save-dict 把训练得到的字典写入文件，服务器用 CHAT_COMPRESS_DICT 加载
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/common/Compression.hpp"
+#include "../src/network/tcp_socket.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    size_t conns = 200;
+    size_t frames = 400;
+    size_t minBytes = 48;
+    unsigned seed = 1;
+    std::string corpusPath;
+    std::string saveDictPath;
+};
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string key = arg;
+        std::string value;
+        size_t eq = arg.find('=');
+        if (eq != std::string::npos) {
+            key = arg.substr(0, eq);
+            value = arg.substr(eq + 1);
+        }
+        if (key == "--conns") opt.conns = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--frames") opt.frames = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--min-bytes") opt.minBytes = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--seed") opt.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        else if (key == "--corpus") opt.corpusPath = value;
+        else if (key == "--save-dict") opt.saveDictPath = value;
+        else {
+            std::cerr << "未知参数: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (opt.conns < 2) opt.conns = 2;
+    return true;
+}
+
+// ===== 语料生成 =====
+const char* const PHRASES[] = {
+    "好的", "收到", "没问题", "马上到", "稍等一下", "我看看", "谢谢", "辛苦了", "明天见", "晚安",
+    "今天下午开会吗", "文件发你了", "在吗", "哈哈哈", "这个方案我觉得可以", "周末一起吃饭吧",
+    "代码已经提交了", "帮忙 review 一下", "测试环境挂了", "线上有个告警", "已经修复了", "我先下线了",
+    "ok", "thanks", "sounds good", "see you tomorrow", "let me check", "on my way", "lol",
+    "can you send me the link", "the build is green now", "meeting moved to 4pm", "I'll take a look",
+};
+const size_t PHRASE_COUNT = sizeof(PHRASES) / sizeof(PHRASES[0]);
+
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(unsigned seed) : m_rng(seed), m_nextId(117462994532040705ULL), m_clock(1792300000) {}
+
+    // 一个连接按时间顺序收发的帧（服务器发给该连接的方向）
+    std::vector<std::string> connection(size_t frames) {
+        std::vector<std::string> out;
+        std::string self = "user" + std::to_string(m_rng() % 100000);
+        std::vector<std::string> friends;
+        for (int i = 0; i < 8; ++i) friends.push_back("user" + std::to_string(m_rng() % 100000));
+        std::vector<uint64_t> seqs(friends.size(), 1);
+
+        if (m_rng() % 4 == 0) out.push_back(loginBundle(self, friends, seqs));
+        while (out.size() < frames) {
+            unsigned kind = m_rng() % 10;
+            size_t f = m_rng() % friends.size();
+            if (kind < 6) {
+                out.push_back(message(friends[f], self, seqs[f]++));
+            } else if (kind < 9) {
+                out.push_back("RESPONSE|SUCCESS|MESSAGE_SENT|消息发送成功|SEQ:" + std::to_string(m_rng() % 100000));
+            } else {
+                out.push_back("ACK|" + std::to_string(nextId()) + "|" + friends[f] + "|" + timestamp());
+            }
+        }
+        return out;
+    }
+
+private:
+    uint64_t nextId() { return m_nextId += 1 + (m_rng() % 4096) * 4096; }
+
+    std::string timestamp() {
+        m_clock += m_rng() % 30;
+        time_t t = static_cast<time_t>(m_clock);
+        char buf[32];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::gmtime(&t));
+        return buf;
+    }
+
+    // 长尾：多数几个短语，少数是长段落，夹带数字、链接等不可预测的内容
+    std::string content() {
+        size_t parts = 1 + m_rng() % 3;
+        if (m_rng() % 10 == 0) parts = 8 + m_rng() % 40;
+        std::string text;
+        for (size_t i = 0; i < parts; ++i) {
+            if (i > 0) text += (m_rng() % 2) ? "，" : " ";
+            text += PHRASES[m_rng() % PHRASE_COUNT];
+            if (m_rng() % 6 == 0) text += " " + std::to_string(m_rng() % 1000000);
+            if (m_rng() % 20 == 0) text += " https://example.com/s/" + std::to_string(m_rng());
+        }
+        return text;
+    }
+
+    std::string message(const std::string& from, const std::string& to, uint64_t seq) {
+        return "MESSAGE|" + std::to_string(nextId()) + "|" + from + "|" + to + "|" + content() + "|" +
+               timestamp() + "|SEQ:" + std::to_string(seq);
+    }
+
+    std::string loginBundle(const std::string& self, const std::vector<std::string>& friends, std::vector<uint64_t>& seqs) {
+        size_t count = 1 + m_rng() % 50;
+        std::string frame = "RESPONSE|SUCCESS|LOGIN_OK|登录成功|OFFLINE_COUNT:" + std::to_string(count) + "|";
+        for (size_t i = 0; i < count; ++i) {
+            size_t f = m_rng() % friends.size();
+            if (i > 0) frame += "|";
+            frame += message(friends[f], self, seqs[f]++);
+        }
+        return frame;
+    }
+
+    std::mt19937 m_rng;
+    uint64_t m_nextId;
+    uint64_t m_clock;
+};
+
+// ===== 评估 =====
+struct Result {
+    std::string name;
+    uint64_t rawBytes = 0;
+    uint64_t wireBytes = 0;
+    uint64_t frames = 0;
+    uint64_t compressedFrames = 0;
+    uint64_t compressedRawBytes = 0;   // 压缩了的帧的原始字节（解压吞吐按它算）
+    double compressSec = 0;
+    double decompressSec = 0;
+    bool verified = true;
+};
+
+enum class Mode { None, PerFrame, Stream };
+
+Result evaluate(const std::string& name, Mode mode, const CompressionDictionary* dictionary,
+                const std::vector<std::vector<std::string>>& conns, size_t firstConn, size_t minBytes) {
+    Result r;
+    r.name = name;
+    std::string packed, restored;
+    for (size_t c = firstConn; c < conns.size(); ++c) {
+        FrameCompressor compressor(dictionary, minBytes);
+        FrameDecompressor decompressor(dictionary);
+        for (const std::string& frame : conns[c]) {
+            r.rawBytes += frame.size() + sizeof(uint32_t);
+            ++r.frames;
+            if (mode == Mode::None) {
+                r.wireBytes += frame.size() + sizeof(uint32_t);
+                continue;
+            }
+            if (mode == Mode::PerFrame) {
+                compressor.reset();
+                decompressor.reset();
+            }
+            auto start = Clock::now();
+            bool compressed = compressor.compress(frame.data(), frame.size(), packed);
+            auto mid = Clock::now();
+            r.compressSec += std::chrono::duration<double>(mid - start).count();
+            if (!compressed) {
+                r.wireBytes += frame.size() + sizeof(uint32_t);
+                continue;
+            }
+            ++r.compressedFrames;
+            r.compressedRawBytes += frame.size();
+            r.wireBytes += packed.size() + sizeof(uint32_t);
+
+            mid = Clock::now();
+            bool ok = decompressor.decompress(packed.data(), packed.size(), restored, TcpSocket::MAX_PIPE_MESSAGE_SIZE);
+            r.decompressSec += std::chrono::duration<double>(Clock::now() - mid).count();
+            if (!ok || restored != frame) r.verified = false;
+        }
+    }
+    return r;
+}
+
+void printResult(const Result& r) {
+    double ratio = r.rawBytes ? static_cast<double>(r.wireBytes) / static_cast<double>(r.rawBytes) : 1.0;
+    double mb = static_cast<double>(r.rawBytes) / (1024.0 * 1024.0);
+    std::cout << std::left << std::setw(20) << r.name << std::right << std::fixed
+              << std::setprecision(3) << std::setw(8) << ratio
+              << std::setprecision(1) << std::setw(9) << (r.frames ? 100.0 * r.compressedFrames / r.frames : 0.0) << "%";
+    if (r.compressSec > 0) {
+        std::cout << std::setw(11) << mb / r.compressSec << std::setw(11)
+                  << (r.decompressSec > 0 ? static_cast<double>(r.compressedRawBytes) / (1024.0 * 1024.0) / r.decompressSec : 0.0)
+                  << std::setw(10) << r.compressSec * 1e9 / r.frames
+                  << std::setw(10) << (r.compressedFrames ? r.decompressSec * 1e9 / r.compressedFrames : 0.0);
+    } else {
+        std::cout << std::setw(11) << "-" << std::setw(11) << "-" << std::setw(10) << "-" << std::setw(10) << "-";
+    }
+    std::cout << (r.verified ? "" : "  校验失败!") << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) return 1;
+
+    std::vector<std::vector<std::string>> conns(opt.conns);
+    if (!opt.corpusPath.empty()) {
+        std::ifstream in(opt.corpusPath);
+        if (!in) {
+            std::cerr << "无法读取 " << opt.corpusPath << std::endl;
+            return 1;
+        }
+        std::string line;
+        size_t n = 0;
+        while (std::getline(in, line)) {
+            if (!line.empty()) conns[n++ % conns.size()].push_back(line);
+        }
+    } else {
+        CorpusGenerator generator(opt.seed);
+        for (auto& conn : conns) conn = generator.connection(opt.frames);
+    }
+
+    // 前一半连接用于训练字典，所有方案都只在后一半上评估
+    size_t half = conns.size() / 2;
+    std::vector<std::string> samples;
+    for (size_t c = 0; c < half; ++c) samples.insert(samples.end(), conns[c].begin(), conns[c].end());
+    auto trainStart = Clock::now();
+    CompressionDictionary trained = CompressionDictionary::train(samples);
+    double trainMs = std::chrono::duration<double, std::milli>(Clock::now() - trainStart).count();
+    if (!opt.saveDictPath.empty() && !trained.saveFile(opt.saveDictPath)) {
+        std::cerr << "无法写入 " << opt.saveDictPath << std::endl;
+        return 1;
+    }
+
+    std::cout << "=== bench_compression ===" << std::endl;
+    std::cout << "connections=" << conns.size() - half << " (train " << half << ") min-bytes=" << opt.minBytes
+              << " builtin dict=" << CompressionDictionary::builtin().data().size() << "B trained dict="
+              << trained.data().size() << "B (" << std::fixed << std::setprecision(1) << trainMs << "ms, id "
+              << trained.id() << ")" << std::endl;
+    std::cout << std::left << std::setw(20) << "scheme" << std::right << std::setw(8) << "ratio" << std::setw(10)
+              << "compr%" << std::setw(11) << "comp MB/s" << std::setw(11) << "dec MB/s" << std::setw(10)
+              << "ns/frame" << std::setw(10) << "dec ns" << std::endl;
+
+    std::vector<Result> results;
+    results.push_back(evaluate("none", Mode::None, nullptr, conns, half, opt.minBytes));
+    results.push_back(evaluate("lz4/frame", Mode::PerFrame, nullptr, conns, half, opt.minBytes));
+    results.push_back(evaluate("lz4/stream", Mode::Stream, nullptr, conns, half, opt.minBytes));
+    results.push_back(evaluate("lz4/stream+dict", Mode::Stream, &CompressionDictionary::builtin(), conns, half, opt.minBytes));
+    results.push_back(evaluate("lz4/stream+trained", Mode::Stream, &trained, conns, half, opt.minBytes));
+
+    bool ok = true;
+    for (const auto& r : results) {
+        printResult(r);
+        ok = ok && r.verified;
+    }
+    std::cout << "(ratio = 线上字节/原始字节，含 4 字节长度前缀；ns/frame 为每帧平均压缩耗时，含未压缩的帧；"
+                 "dec ns 为每个压缩帧的解压耗时)" << std::endl;
+    return ok ? 0 : 1;
+}
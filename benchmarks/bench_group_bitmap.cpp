@@ -0,0 +1,87 @@
+// ==============================
+// 群在线成员（位图 AND）基准测试
+// ==============================
+// 对比：逐个成员查 unordered_set<string> 在线表 vs 群成员位图 AND 在线位图
+// 用法: bench_group_bitmap [users=200000] [groupSize=5000] [onlinePercent=30]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "../src/core/Platform.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template<class Fn>
+double measureNs(size_t rounds, Fn&& fn) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < rounds; ++i) fn();
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(rounds);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t userCount     = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    const size_t groupSize     = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5000;
+    const size_t onlinePercent = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 30;
+    const size_t rounds = 2000;
+
+    std::cout << "=== 群在线成员基准 ===" << std::endl;
+    std::cout << "users=" << userCount << " groupSize=" << groupSize << " online=" << onlinePercent << "%" << std::endl;
+
+    Platform platform;
+    std::vector<std::string> ids;
+    ids.reserve(userCount);
+    for (size_t i = 0; i < userCount; ++i) {
+        ids.push_back("u" + std::to_string(100000 + i));
+        platform.userHandles.intern(ids.back());
+    }
+
+    std::mt19937_64 rng(7);
+    Group group("9001", GroupType::QQ);
+    while (group.members().size() < groupSize) group.addMember(ids[rng() % userCount]);
+    group.enableMemberBitmap(&platform.userHandles);
+
+    std::unordered_set<std::string> onlineSet;
+    RoaringBitmap onlineBitmap;
+    for (size_t i = 0; i < userCount; ++i) {
+        if (rng() % 100 < onlinePercent) {
+            onlineSet.insert(ids[i]);
+            onlineBitmap.add(platform.userHandles.lookup(ids[i]));
+        }
+    }
+
+    size_t checksum = 0;
+    double scanNs = measureNs(rounds, [&] {
+        size_t n = 0;
+        for (const auto& uid : group.members()) n += onlineSet.count(uid);
+        checksum += n;
+    });
+    double andNs = measureNs(rounds, [&] {
+        checksum += RoaringBitmap::andOf(group.memberBitmap(), onlineBitmap).cardinality();
+    });
+    double andCardNs = measureNs(rounds, [&] {
+        checksum += RoaringBitmap::andCardinality(group.memberBitmap(), onlineBitmap);
+    });
+    double andNotNs = measureNs(rounds, [&] {
+        checksum += RoaringBitmap::andNotOf(group.memberBitmap(), onlineBitmap).cardinality();
+    });
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "scan members + string set   : " << scanNs / 1000.0 << " us" << std::endl;
+    std::cout << "bitmap AND (materialized)   : " << andNs / 1000.0 << " us" << std::endl;
+    std::cout << "bitmap AND (cardinality)    : " << andCardNs / 1000.0 << " us" << std::endl;
+    std::cout << "bitmap ANDNOT (offline)     : " << andNotNs / 1000.0 << " us" << std::endl;
+    std::cout << "member bitmap memory        : " << group.memberBitmap().memoryUsage() / 1024.0 << " KB" << std::endl;
+    std::cout << "online bitmap memory        : " << onlineBitmap.memoryUsage() / 1024.0 << " KB" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+    return 0;
+}
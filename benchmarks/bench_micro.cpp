@@ -0,0 +1,432 @@
+// ==============================
+// 热路径微基准：协议编解码 / 长度前缀分帧 / 线程池提交 / 消息追踪埋点
+// ==============================
+// 每个用例先自动标定迭代次数（单次采样 ≥ min-ms），再采集多次样本，报告：
+//   ns/op（样本中位数）、离散度（MAD/中位数）、allocs/op、bytes/op（替换全局 operator new 统计）
+// 消息相关用例按内容长度扫描：16B ~ 1000 字符（协议允许的最大内容长度）
+//
+// 用法: bench_micro [--filter=子串] [--samples=11] [--min-ms=20]
+//                   [--json=result.json] [--baseline=baseline.json] [--threshold=10]
+//   --json      结果写入文件（每个用例一行，便于 diff 和保存为基线）
+//   --baseline  与基线对比 ns/op，变慢超过 threshold% 的用例标记为回退，进程返回 1
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/common/MessageBuffer.hpp"
+#include "../src/common/MessageId.hpp"
+#include "../src/common/Protocol.hpp"
+#include "../src/common/ThreadPool.hpp"
+#include "../src/common/Tracer.hpp"
+#include "../src/network/tcp_socket.hpp"
+
+// ===== 分配统计：替换全局 operator new/delete =====
+// GCC 会把 malloc/free 与 operator new/delete 视为不匹配而误报，这里是有意替换
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+namespace {
+std::atomic<uint64_t> g_allocCount{0};
+std::atomic<uint64_t> g_allocBytes{0};
+}
+
+void* operator new(std::size_t size) {
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    g_allocBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { operator delete(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template<class T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+// 基准体内部的 std::cout 输出（ThreadPool 日志等）重定向到这里
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+struct Options {
+    std::string filter;
+    size_t samples = 11;
+    double minMs = 20.0;
+    std::string jsonPath;
+    std::string baselinePath;
+    double threshold = 10.0;
+};
+
+struct Result {
+    std::string name;
+    double nsPerOp = 0;
+    double spreadPct = 0;     // MAD / 中位数
+    double allocsPerOp = 0;
+    double bytesPerOp = 0;
+    uint64_t iterations = 0;  // 每个样本的迭代次数
+};
+
+class Runner {
+public:
+    explicit Runner(const Options& opt) : m_opt(opt) {}
+
+    // body(n) 执行 n 次被测操作
+    void run(const std::string& name, const std::function<void(uint64_t)>& body) {
+        if (!m_opt.filter.empty() && name.find(m_opt.filter) == std::string::npos) return;
+
+        std::streambuf* original = std::cout.rdbuf(&m_null);
+
+        // 标定：迭代次数翻倍直到单次采样达到 min-ms
+        uint64_t iters = 1;
+        for (;;) {
+            double ms = timeOnce(body, iters) / 1e6;
+            if (ms >= m_opt.minMs || iters >= (uint64_t(1) << 40)) break;
+            iters = ms <= 0.01 ? iters * 16 : static_cast<uint64_t>(iters * std::max(2.0, m_opt.minMs * 1.2 / ms));
+        }
+
+        std::vector<double> perOp;
+        perOp.reserve(m_opt.samples);
+        uint64_t allocs = 0, bytes = 0;
+        for (size_t s = 0; s < m_opt.samples; ++s) {
+            uint64_t a0 = g_allocCount.load(std::memory_order_relaxed);
+            uint64_t b0 = g_allocBytes.load(std::memory_order_relaxed);
+            double ns = timeOnce(body, iters);
+            allocs += g_allocCount.load(std::memory_order_relaxed) - a0;
+            bytes += g_allocBytes.load(std::memory_order_relaxed) - b0;
+            perOp.push_back(ns / static_cast<double>(iters));
+        }
+
+        std::cout.rdbuf(original);
+
+        Result r;
+        r.name = name;
+        r.iterations = iters;
+        r.nsPerOp = median(perOp);
+        std::vector<double> deviations;
+        for (double v : perOp) deviations.push_back(std::abs(v - r.nsPerOp));
+        r.spreadPct = r.nsPerOp > 0 ? median(deviations) / r.nsPerOp * 100.0 : 0.0;
+        double totalOps = static_cast<double>(iters) * static_cast<double>(m_opt.samples);
+        r.allocsPerOp = static_cast<double>(allocs) / totalOps;
+        r.bytesPerOp = static_cast<double>(bytes) / totalOps;
+
+        std::cout << std::left << std::setw(40) << r.name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(12) << r.nsPerOp << " ns/op"
+                  << std::setw(7) << std::setprecision(1) << r.spreadPct << "%"
+                  << std::setw(10) << std::setprecision(2) << r.allocsPerOp << " allocs/op"
+                  << std::setw(10) << std::setprecision(0) << r.bytesPerOp << " B/op" << std::endl;
+        m_results.push_back(r);
+    }
+
+    const std::vector<Result>& results() const { return m_results; }
+
+private:
+    static double timeOnce(const std::function<void(uint64_t)>& body, uint64_t iters) {
+        auto start = Clock::now();
+        body(iters);
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    static double median(std::vector<double> v) {
+        if (v.empty()) return 0;
+        std::sort(v.begin(), v.end());
+        size_t mid = v.size() / 2;
+        return v.size() % 2 ? v[mid] : (v[mid - 1] + v[mid]) / 2.0;
+    }
+
+    const Options& m_opt;
+    NullBuffer m_null;
+    std::vector<Result> m_results;
+};
+
+MessageData makeMessage(size_t contentSize) {
+    MessageData msg("1715000000000_42", "u100001", "u100002", std::string(contentSize, 'x'));
+    msg.timestamp = "2024-05-06 12:34:56";
+    return msg;
+}
+
+// ===== 用例 =====
+const size_t CONTENT_SIZES[] = { 16, 64, 256, 1000 };
+
+void benchProtocol(Runner& runner) {
+    for (size_t size : CONTENT_SIZES) {
+        std::string suffix = "/" + std::to_string(size);
+        MessageData msg = makeMessage(size);
+        std::string wire = ProtocolProcessor::serializeMessage(msg);
+
+        runner.run("protocol/serialize" + suffix, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                std::string out = ProtocolProcessor::serializeMessage(msg);
+                doNotOptimize(out);
+            }
+        });
+        runner.run("protocol/encode_buffer" + suffix, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                MessageBuffer out = ProtocolProcessor::encodeMessage(msg);
+                doNotOptimize(out);
+            }
+        });
+        runner.run("protocol/deserialize" + suffix, [&](uint64_t n) {
+            MessageData parsed;
+            for (uint64_t i = 0; i < n; ++i) {
+                bool ok = ProtocolProcessor::deserializeMessage(wire, parsed);
+                doNotOptimize(ok);
+            }
+        });
+    }
+
+    runner.run("protocol/generate_id", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            std::string id = ProtocolProcessor::generateMessageId();
+            doNotOptimize(id);
+        }
+    });
+    runner.run("protocol/generate_id_u64", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t id = MessageId::next();
+            doNotOptimize(id);
+        }
+    });
+    // 时间戳留空：由编码时取当前时间，ACK 路径每条都这样
+    runner.run("protocol/serialize_ack", [](uint64_t n) {
+        const AckData ack("740490560495976448", "u100002");
+        for (uint64_t i = 0; i < n; ++i) {
+            std::string out = ProtocolProcessor::serializeAck(ack);
+            doNotOptimize(out);
+        }
+    });
+    runner.run("protocol/parse_type", [](uint64_t n) {
+        const std::string frame = "ACK|1715000000000_42|u100002|2024-05-06 12:34:56";
+        for (uint64_t i = 0; i < n; ++i) {
+            Type t = ProtocolProcessor::parseProtocolType(frame);
+            doNotOptimize(t);
+        }
+    });
+}
+
+#ifndef _WIN32
+// 同一线程在 socketpair 上写一帧再读回：长度前缀 + 负载的完整收发路径
+void benchFraming(Runner& runner) {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cerr << "socketpair 失败，跳过 framing 用例" << std::endl;
+        return;
+    }
+    TcpSocket writer, reader;
+    writer.setHandle(fds[0]);
+    reader.setHandle(fds[1]);
+
+    for (size_t size : CONTENT_SIZES) {
+        std::string suffix = "/" + std::to_string(size);
+        std::string frame = ProtocolProcessor::serializeMessage(makeMessage(size));
+        MessageBuffer buffer = MessageBuffer::copyOf(frame);
+
+        runner.run("framing/pipe_roundtrip" + suffix, [&](uint64_t n) {
+            std::string in;
+            for (uint64_t i = 0; i < n; ++i) {
+                writer.sendPipeMessage(frame);
+                reader.receivePipeMessage(in, 1);
+                doNotOptimize(in);
+            }
+        });
+        runner.run("framing/pipe_roundtrip_buffer" + suffix, [&](uint64_t n) {
+            std::string in;
+            for (uint64_t i = 0; i < n; ++i) {
+                writer.sendPipeMessage(buffer.data(), buffer.size());
+                reader.receivePipeMessage(in, 1);
+                doNotOptimize(in);
+            }
+        });
+    }
+}
+#endif
+
+// 每个 op = 提交一个任务并等它执行完（批量提交后等待全部完成，按任务数摊销）
+void benchThreadPool(Runner& runner) {
+    NullBuffer quiet;
+    std::streambuf* original = std::cout.rdbuf(&quiet);
+    ThreadPool pool(4);
+    std::cout.rdbuf(original);
+
+    std::atomic<uint64_t> done{0};
+    runner.run("threadpool/submit_execute", [&](uint64_t n) {
+        done.store(0, std::memory_order_relaxed);
+        for (uint64_t i = 0; i < n; ++i) {
+            std::shared_ptr<TaskBase> task = std::make_shared<FunctionTask>([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+            pool.submit(task);
+        }
+        while (done.load(std::memory_order_acquire) < n) std::this_thread::yield();
+    });
+    runner.run("threadpool/submit_batch", [&](uint64_t n) {
+        done.store(0, std::memory_order_relaxed);
+        std::vector<std::shared_ptr<TaskBase>> batch;
+        batch.reserve(static_cast<size_t>(n));
+        for (uint64_t i = 0; i < n; ++i) {
+            batch.push_back(std::make_shared<FunctionTask>([&done] { done.fetch_add(1, std::memory_order_relaxed); }));
+        }
+        pool.submitBatch(batch);
+        while (done.load(std::memory_order_acquire) < n) std::this_thread::yield();
+    });
+
+    std::cout.rdbuf(&quiet);
+    pool.stop();
+    std::cout.rdbuf(original);
+}
+
+// 追踪埋点开销：关闭时应只剩一次分支；开启但未命中采样、命中采样写入环形缓冲两种情况对照
+void benchTracing(Runner& runner) {
+    const std::string messageId = "1715000000000_42";
+    uint32_t savedRate = Tracer::sampleRate();
+
+    Tracer::setSampleRate(0);
+    runner.run("trace/span_disabled", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            TraceSpan span("bench", messageId);
+            doNotOptimize(span);
+        }
+    });
+    // 采样率取一个不命中该ID的值，只付出计时 + 哈希的代价
+    uint32_t missRate = 2;
+    while (Tracer::setSampleRate(missRate), Tracer::sampled(messageId)) ++missRate;
+    runner.run("trace/span_unsampled", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            TraceSpan span("bench", messageId);
+            doNotOptimize(span);
+        }
+    });
+    Tracer::setSampleRate(1);
+    runner.run("trace/span_sampled", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            TraceSpan span("bench", messageId);
+            doNotOptimize(span);
+        }
+    });
+
+    Tracer::setSampleRate(savedRate);
+    Tracer::clear();
+}
+
+// ===== 结果输出与基线对比 =====
+void writeJson(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    out << "{\"benchmarks\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << std::fixed << std::setprecision(3)
+            << "  {\"name\": \"" << r.name << "\", \"ns_per_op\": " << r.nsPerOp
+            << ", \"spread_pct\": " << r.spreadPct << ", \"allocs_per_op\": " << r.allocsPerOp
+            << ", \"bytes_per_op\": " << r.bytesPerOp << ", \"iterations\": " << r.iterations << "}"
+            << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]}" << std::endl;
+}
+
+// 读取 writeJson 写出的文件：只取 name 与 ns_per_op
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t n = line.find("\"name\": \"");
+        size_t t = line.find("\"ns_per_op\": ");
+        if (n == std::string::npos || t == std::string::npos) continue;
+        n += 9;
+        std::string name = line.substr(n, line.find('"', n) - n);
+        baseline[name] = std::strtod(line.c_str() + t + 13, nullptr);
+    }
+    return baseline;
+}
+
+int compareWithBaseline(const std::vector<Result>& results, const std::string& path, double threshold) {
+    std::map<std::string, double> baseline = readBaseline(path);
+    if (baseline.empty()) {
+        std::cerr << "基线文件为空或无法读取: " << path << std::endl;
+        return 1;
+    }
+
+    std::cout << std::endl << "=== 与基线对比 (" << path << ", 阈值 " << threshold << "%) ===" << std::endl;
+    int regressions = 0;
+    for (const Result& r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end() || it->second <= 0) continue;
+        double delta = (r.nsPerOp - it->second) / it->second * 100.0;
+        bool regressed = delta > threshold;
+        regressions += regressed ? 1 : 0;
+        std::cout << std::left << std::setw(40) << r.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << it->second << " -> " << std::setw(10) << r.nsPerOp << " ns/op  "
+                  << std::showpos << delta << std::noshowpos << "%" << (regressed ? "  << 回退" : "") << std::endl;
+    }
+    std::cout << (regressions ? "发现 " + std::to_string(regressions) + " 个回退" : std::string("无回退")) << std::endl;
+    return regressions ? 1 : 0;
+}
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+        if (key == "--filter") opt.filter = value;
+        else if (key == "--samples") opt.samples = std::max<size_t>(1, std::strtoul(value.c_str(), nullptr, 10));
+        else if (key == "--min-ms") opt.minMs = std::strtod(value.c_str(), nullptr);
+        else if (key == "--json") opt.jsonPath = value;
+        else if (key == "--baseline") opt.baselinePath = value;
+        else if (key == "--threshold") opt.threshold = std::strtod(value.c_str(), nullptr);
+        else {
+            std::cerr << "未知参数: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) return 1;
+
+    std::cout << "=== 热路径微基准 (samples=" << opt.samples << ", min-ms=" << opt.minMs << ") ===" << std::endl;
+    Runner runner(opt);
+    benchProtocol(runner);
+#ifndef _WIN32
+    benchFraming(runner);
+#endif
+    benchThreadPool(runner);
+    benchTracing(runner);
+
+    if (!opt.jsonPath.empty()) writeJson(opt.jsonPath, runner.results());
+    if (!opt.baselinePath.empty()) return compareWithBaseline(runner.results(), opt.baselinePath, opt.threshold);
+    return 0;
+}
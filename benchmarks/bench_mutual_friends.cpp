@@ -0,0 +1,153 @@
+// ==============================
+// 共同好友 / 好友推荐 基准测试
+// ==============================
+// 对比：
+//   1. legacy   : 原实现（unordered_set<string> 逐个探测）
+//   2. platform : Platform::mutualFriends（有序字符串集合归并）
+//   3. kernels  : SetIntersect 各内核（整数句柄数组）
+// 用法: bench_mutual_friends [users=20000] [avgFriends=200] [pairs=200000]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "../src/core/Platform.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double nsPerOp(Clock::time_point start, Clock::time_point end, size_t ops) {
+    return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(ops);
+}
+
+void report(const std::string& name, double ns, double baselineNs, size_t checksum) {
+    std::cout << std::left << std::setw(28) << name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(1) << ns << " ns/op"
+              << std::setw(10) << std::setprecision(2) << (baselineNs / ns) << "x"
+              << "   (checksum " << checksum << ")" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t userCount  = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    const size_t avgFriends = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+    const size_t pairCount  = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 200000;
+
+    std::cout << "=== 共同好友基准 ===" << std::endl;
+    std::cout << "users=" << userCount << " avgFriends=" << avgFriends << " pairs=" << pairCount
+              << " bestKernel=" << SetIntersect::kernelName(SetIntersect::bestKernel()) << std::endl;
+
+    // ===== 构造随机社交图（对称好友关系，带少量"大V"）=====
+    Platform platform;
+    std::vector<std::string> ids;
+    ids.reserve(userCount);
+    for (size_t i = 0; i < userCount; ++i) {
+        ids.push_back("u" + std::to_string(100000 + i));
+        platform.users.emplace(ids.back(), User(ids.back(), ids.back()));
+    }
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, userCount - 1);
+    const size_t edges = userCount * avgFriends / 2;
+    for (size_t e = 0; e < edges; ++e) {
+        size_t a = pick(rng);
+        // 10% 的边连向前 1% 的热门用户，制造规模悬殊的好友列表
+        size_t b = (rng() % 10 == 0) ? pick(rng) % std::max<size_t>(1, userCount / 100) : pick(rng);
+        if (a == b) continue;
+        platform.users[ids[a]].addFriend(ids[b]);
+        platform.users[ids[b]].addFriend(ids[a]);
+    }
+
+    auto buildStart = Clock::now();
+    platform.rebuildSocialIndex();
+    auto buildEnd = Clock::now();
+    std::cout << "索引构建: " << std::chrono::duration<double, std::milli>(buildEnd - buildStart).count() << " ms" << std::endl;
+
+    // 原实现使用的 unordered_set<string> 副本
+    std::vector<std::unordered_set<std::string>> legacy(userCount);
+    for (size_t i = 0; i < userCount; ++i) {
+        const auto& f = platform.users[ids[i]].friends();
+        legacy[i].insert(f.begin(), f.end());
+    }
+
+    std::vector<std::pair<size_t, size_t>> pairs(pairCount);
+    for (auto& p : pairs) p = {pick(rng), pick(rng)};
+
+    std::cout << std::endl << std::left << std::setw(28) << "implementation"
+              << std::right << std::setw(15) << "latency" << std::setw(11) << "speedup" << std::endl;
+
+    // 1. legacy
+    size_t checksum = 0;
+    auto t0 = Clock::now();
+    for (const auto& p : pairs) {
+        std::vector<std::string> res;
+        const auto& A = legacy[p.first];
+        const auto& B = legacy[p.second];
+        for (const auto& x : A) if (B.count(x)) res.push_back(x);
+        checksum += res.size();
+    }
+    auto t1 = Clock::now();
+    const double legacyNs = nsPerOp(t0, t1, pairs.size());
+    report("legacy unordered_set", legacyNs, legacyNs, checksum);
+
+    // 2. Platform::mutualFriends
+    checksum = 0;
+    t0 = Clock::now();
+    for (const auto& p : pairs) checksum += platform.mutualFriends(ids[p.first], ids[p.second]).size();
+    t1 = Clock::now();
+    report("platform string merge", nsPerOp(t0, t1, pairs.size()), legacyNs, checksum);
+
+    // 3. 各内核（按句柄）
+    const SocialIndex& index = platform.socialIndex;
+    std::vector<std::pair<SocialIndex::Handle, SocialIndex::Handle>> handlePairs;
+    handlePairs.reserve(pairs.size());
+    for (const auto& p : pairs) handlePairs.emplace_back(index.handleOf(ids[p.first]), index.handleOf(ids[p.second]));
+
+    const SetIntersect::Kernel kernels[] = {
+        SetIntersect::Kernel::Scalar, SetIntersect::Kernel::Galloping,
+        SetIntersect::Kernel::SSE, SetIntersect::Kernel::AVX2, SetIntersect::Kernel::Auto
+    };
+    for (auto kernel : kernels) {
+        if (!SetIntersect::isAvailable(kernel)) {
+            std::cout << std::left << std::setw(28) << SetIntersect::kernelName(kernel) << "   (不支持，跳过)" << std::endl;
+            continue;
+        }
+        checksum = 0;
+        t0 = Clock::now();
+        for (const auto& p : handlePairs) {
+            checksum += SetIntersect::count(index.friendsOf(p.first), index.friendsOf(p.second), kernel);
+        }
+        t1 = Clock::now();
+        report(std::string("count/") + SetIntersect::kernelName(kernel), nsPerOp(t0, t1, pairs.size()), legacyNs, checksum);
+    }
+
+    // 4. 批量 API
+    t0 = Clock::now();
+    auto counts = index.mutualFriendCounts(handlePairs);
+    t1 = Clock::now();
+    checksum = 0;
+    for (size_t c : counts) checksum += c;
+    report("batched mutualFriendCounts", nsPerOp(t0, t1, pairs.size()), legacyNs, checksum);
+
+    // 5. 好友的好友 Top-K
+    const size_t fofQueries = std::min<size_t>(2000, userCount);
+    checksum = 0;
+    t0 = Clock::now();
+    for (size_t i = 0; i < fofQueries; ++i) {
+        auto top = index.friendOfFriendTopK(index.handleOf(ids[i * (userCount / fofQueries)]), 10);
+        checksum += top.empty() ? 0 : top.front().second;
+    }
+    t1 = Clock::now();
+    std::cout << std::endl << "friendOfFriendTopK(k=10): "
+              << std::fixed << std::setprecision(1) << nsPerOp(t0, t1, fofQueries) / 1000.0
+              << " us/query (checksum " << checksum << ")" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+// ==============================
+// bench_transport - 收发后端对比：阻塞读写 / epoll / io_uring 的每帧系统调用数与吞吐
+// ==============================
+// 进程内起一个回显服务器（与 ClientHandler 相同的模型：每连接一个线程 receivePipeMessage 后
+// sendPipeMessage 回去），N 个客户端连接各自流水线发送 depth 帧、收齐回显后再发下一批。
+// 服务器侧的系统调用数取自 transport 指标 chat_io_syscalls_total（reactor 等待、读写、提交、唤醒）；
+// 阻塞模式没有 reactor，按代码路径估算上限：每收一帧至多 1 次 recv（接收缓冲一次可读多帧），每发一帧 1 次 sendmsg。
+//
+// 用法: bench_transport [--backend=io_uring|epoll|blocking] [--port=18090] [--conns=64]
+//                       [--frames=200000] [--depth=32] [--size=64]
+//   frames 为全部连接合计发出的帧数（回显同样多），depth 为每个连接同时在途的帧数
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/common/Metrics.hpp"
+#include "../src/network/socket_transport.hpp"
+#include "../src/network/tcp_socket.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string backend = "io_uring";
+    uint16_t port = 18090;
+    size_t conns = 64;
+    size_t frames = 200000;
+    size_t depth = 32;
+    size_t size = 64;
+};
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string key = arg;
+        std::string value;
+        size_t eq = arg.find('=');
+        if (eq != std::string::npos) {
+            key = arg.substr(0, eq);
+            value = arg.substr(eq + 1);
+        }
+
+        if (key == "--backend") opt.backend = value;
+        else if (key == "--port") opt.port = static_cast<uint16_t>(std::strtoul(value.c_str(), nullptr, 10));
+        else if (key == "--conns") opt.conns = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--frames") opt.frames = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--depth") opt.depth = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--size") opt.size = std::strtoul(value.c_str(), nullptr, 10);
+        else {
+            std::cerr << "未知参数: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (opt.conns == 0 || opt.depth == 0 || opt.frames < opt.conns * opt.depth ||
+        opt.size == 0 || opt.size > TcpSocket::MAX_PIPE_MESSAGE_SIZE) {
+        std::cerr << "参数无效：conns>=1, depth>=1, frames>=conns*depth, 1<=size<=65536" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 回显一个连接直到对端关闭
+void echoLoop(std::shared_ptr<TcpSocket> socket) {
+    std::string message;
+    while (true) {
+        if (socket->receivePipeMessage(message, 1)) {
+            if (!socket->sendPipeMessage(message)) break;
+            continue;
+        }
+        if (socket->getLastError() != "no data") break;
+    }
+    socket->close();
+}
+
+uint64_t counterValue(const std::string& name, const std::string& backend) {
+    return MetricsRegistry::instance().counter(name, "", "backend=\"" + backend + "\"").value();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) return 1;
+
+    TcpSocket listener;
+    listener.init();
+    if (!listener.create() || !listener.bind(opt.port, "127.0.0.1") ||
+        !listener.listen(static_cast<int>(opt.conns) + 16)) {
+        std::cerr << "监听失败: " << listener.getLastError() << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<SocketTransport> transport;
+    std::atomic<bool> accepting{true};
+    std::thread acceptThread;
+    if (opt.backend != "blocking") {
+        transport = SocketTransport::create(opt.backend);
+        if (!transport) {
+            std::cerr << "后端不可用: " << opt.backend << std::endl;
+            return 1;
+        }
+        SocketTransport* raw = transport.get();
+        transport->listen(listener.nativeHandle(), [raw](SocketHandle fd, const std::string&, uint16_t) {
+            auto socket = std::make_shared<TcpSocket>();
+            socket->setHandle(fd);
+            socket->attachTransport(*raw);
+            std::thread(echoLoop, socket).detach();
+        });
+        if (!transport->start()) {
+            std::cerr << "后端启动失败: " << transport->getLastError() << std::endl;
+            return 1;
+        }
+    } else {
+        acceptThread = std::thread([&] {
+            for (size_t i = 0; i < opt.conns && accepting; ++i) {
+                std::string ip;
+                uint16_t port = 0;
+                SocketHandle fd = listener.accept(ip, port);
+                if (fd < 0) break;
+                auto socket = std::make_shared<TcpSocket>();
+                socket->setHandle(fd);
+                std::thread(echoLoop, socket).detach();
+            }
+        });
+    }
+    const std::string backendName = transport ? transport->name() : "blocking";
+
+    // 客户端：阻塞 socket，每批 depth 帧一次写出，再收齐回显
+    std::vector<std::unique_ptr<TcpSocket>> clients;
+    for (size_t i = 0; i < opt.conns; ++i) {
+        std::unique_ptr<TcpSocket> client(new TcpSocket());
+        if (!client->create() || !client->connect("127.0.0.1", opt.port)) {
+            std::cerr << "连接失败: " << client->getLastError() << std::endl;
+            return 1;
+        }
+        clients.push_back(std::move(client));
+    }
+    if (acceptThread.joinable()) acceptThread.join();
+
+    const size_t batchesPerConn = opt.frames / (opt.conns * opt.depth);
+    const size_t totalFrames = batchesPerConn * opt.conns * opt.depth;
+    const std::string payload(opt.size, 'x');
+    std::vector<TcpSocket::PipeSegment> batch(opt.depth, TcpSocket::PipeSegment{ payload.data(), payload.size() });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));   // 连接全部挂上 reactor
+    uint64_t syscallsBefore = transport ? counterValue("chat_io_syscalls_total", backendName) : 0;
+    uint64_t wakeupsBefore = transport ? counterValue("chat_io_wakeups_total", backendName) : 0;
+    uint64_t sqesBefore = transport ? counterValue("chat_io_sqes_submitted_total", backendName) : 0;
+    std::atomic<size_t> failures{0};
+    auto start = Clock::now();
+
+    std::vector<std::thread> workers;
+    for (size_t c = 0; c < opt.conns; ++c) {
+        workers.emplace_back([&, c] {
+            TcpSocket& client = *clients[c];
+            std::string reply;
+            for (size_t b = 0; b < batchesPerConn; ++b) {
+                if (!client.sendPipeMessages(batch.data(), batch.size())) { ++failures; return; }
+                for (size_t i = 0; i < opt.depth; ++i) {
+                    if (!client.receivePipeMessage(reply, 5) || reply.size() != opt.size) { ++failures; return; }
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // 服务器侧帧数：收 totalFrames，发 totalFrames
+    double serverFrames = 2.0 * static_cast<double>(totalFrames);
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "backend=" << backendName << " conns=" << opt.conns << " depth=" << opt.depth
+              << " size=" << opt.size << " frames=" << totalFrames << std::endl;
+    std::cout << "elapsed " << seconds << " s, " << std::setprecision(0)
+              << static_cast<double>(totalFrames) / seconds << " round trips/s" << std::setprecision(3) << std::endl;
+    if (transport) {
+        uint64_t syscalls = counterValue("chat_io_syscalls_total", backendName) - syscallsBefore;
+        uint64_t wakeups = counterValue("chat_io_wakeups_total", backendName) - wakeupsBefore;
+        uint64_t sqes = counterValue("chat_io_sqes_submitted_total", backendName) - sqesBefore;
+        std::cout << "server syscalls/frame " << static_cast<double>(syscalls) / serverFrames
+                  << " (total " << syscalls << ", wakeups " << wakeups;
+        if (sqes > 0) std::cout << ", sqes " << sqes;
+        std::cout << ")" << std::endl;
+    } else {
+        std::cout << "server syscalls/frame <=1.000 (estimated: at most 1 recv per received frame + 1 sendmsg per sent frame)" << std::endl;
+    }
+    if (failures > 0) std::cout << "failed connections: " << failures.load() << std::endl;
+
+    for (auto& client : clients) client->close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    if (transport) transport->stop();
+    return failures > 0 ? 1 : 0;
+}
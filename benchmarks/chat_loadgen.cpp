@@ -0,0 +1,446 @@
+// ==============================
+// chat_loadgen - 无交互多连接压测 / 端到端延迟基准
+// ==============================
+// N 个模拟用户通过 AsyncChatClient 登录服务器，按开环调度（固定速率，不因服务器变慢而推迟）
+// 流水线发送私聊/群聊消息，收到投递后由客户端库自动回 ACK，最后输出吞吐和延迟分位数。
+// 延迟从"计划发送时刻"起算而不是实际发送时刻，修正协调遗漏（coordinated omission）：
+// 服务器卡顿导致的发送积压会完整计入延迟。
+//
+// 用法: chat_loadgen [--host=127.0.0.1] [--port=8080] [--users=50] [--duration=10]
+//                    [--warmup=2] [--drain=3] [--rate=200] [--group-rate=0] [--group=1001]
+//                    [--size=64] [--senders=2] [--coalesce-us=0] [--compress] [--json=result.json]
+//   rate/group-rate 为全体用户合计的每秒消息数；size 为消息内容字节数（≤1000）
+//   群消息只有在群成员在线时才产生投递延迟样本
+//   --coalesce-us 客户端发送合并窗口（微秒），0 为有数据就写
+//   --compress 登录时请求连接压缩（内置字典），结束时输出收发的压缩帧数
+//   --json 把结果写入文件（机器可读，便于与基线对比）
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "../src/client/AsyncChatClient.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// ===== 参数 =====
+struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t port = 8080;
+    size_t users = 50;
+    double duration = 10.0;
+    double warmup = 2.0;
+    double drain = 3.0;
+    double rate = 200.0;
+    double groupRate = 0.0;
+    std::string groupId = "1001";
+    size_t size = 64;
+    size_t senders = 2;
+    uint32_t coalesceUs = 0;
+    bool compress = false;
+    std::string jsonPath;
+};
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string key = arg;
+        std::string value;
+        size_t eq = arg.find('=');
+        if (eq != std::string::npos) {
+            key = arg.substr(0, eq);
+            value = arg.substr(eq + 1);
+        }
+
+        if (key == "--host") opt.host = value;
+        else if (key == "--port") opt.port = static_cast<uint16_t>(std::strtoul(value.c_str(), nullptr, 10));
+        else if (key == "--users") opt.users = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--duration") opt.duration = std::strtod(value.c_str(), nullptr);
+        else if (key == "--warmup") opt.warmup = std::strtod(value.c_str(), nullptr);
+        else if (key == "--drain") opt.drain = std::strtod(value.c_str(), nullptr);
+        else if (key == "--rate") opt.rate = std::strtod(value.c_str(), nullptr);
+        else if (key == "--group-rate") opt.groupRate = std::strtod(value.c_str(), nullptr);
+        else if (key == "--group") opt.groupId = value;
+        else if (key == "--size") opt.size = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--senders") opt.senders = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "--coalesce-us") opt.coalesceUs = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        else if (key == "--compress") opt.compress = true;
+        else if (key == "--json") opt.jsonPath = value;
+        else {
+            std::cerr << "未知参数: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (opt.users < 2 || opt.senders == 0 || opt.size == 0 || opt.size > 1000 ||
+        opt.duration <= 0 || opt.rate + opt.groupRate <= 0) {
+        std::cerr << "参数无效：users>=2, senders>=1, 1<=size<=1000, duration>0, rate+group-rate>0" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ===== 延迟直方图 =====
+// 对数-线性分桶（每个 2 的幂区间 64 个子桶），相对误差 < 1.6%，记录 O(1)、无锁（每线程一份，结束后合并）
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 7;
+    static const int64_t SUB_COUNT = int64_t(1) << SUB_BITS;   // 128
+    static const int64_t HALF = SUB_COUNT / 2;                 // 64
+
+    LatencyHistogram() : m_counts(bucketIndex(INT64_MAX) + 1, 0) {}
+
+    void record(int64_t valueNs) {
+        if (valueNs < 0) valueNs = 0;
+        ++m_counts[bucketIndex(valueNs)];
+        ++m_total;
+        m_sum += static_cast<double>(valueNs);
+        m_max = std::max(m_max, valueNs);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < m_counts.size(); ++i) m_counts[i] += other.m_counts[i];
+        m_total += other.m_total;
+        m_sum += other.m_sum;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    uint64_t count() const { return m_total; }
+    int64_t max() const { return m_max; }
+    double mean() const { return m_total ? m_sum / static_cast<double>(m_total) : 0.0; }
+
+    // q ∈ [0,1]，返回所在桶的上界
+    int64_t percentile(double q) const {
+        if (m_total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(m_total)));
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            seen += m_counts[i];
+            if (seen >= rank) return std::min(bucketUpper(i), m_max);
+        }
+        return m_max;
+    }
+
+private:
+    static size_t bucketIndex(int64_t v) {
+        if (v < SUB_COUNT) return static_cast<size_t>(v);
+        int msb = 63 - __builtin_clzll(static_cast<unsigned long long>(v));
+        int shift = msb - (SUB_BITS - 1);
+        return static_cast<size_t>(SUB_COUNT + (shift - 1) * HALF + ((v >> shift) - HALF));
+    }
+
+    static int64_t bucketUpper(size_t index) {
+        int64_t i = static_cast<int64_t>(index);
+        if (i < SUB_COUNT) return i;
+        int64_t shift = (i - SUB_COUNT) / HALF + 1;
+        int64_t sub = (i - SUB_COUNT) % HALF + HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total = 0;
+    double m_sum = 0;
+    int64_t m_max = 0;
+};
+
+// ===== 模拟用户连接 =====
+struct Connection {
+    explicit Connection(const AsyncChatClient::Options& options) : client(options) {}
+
+    AsyncChatClient client;
+    std::string userId;
+    std::atomic<size_t> inflight{0};      // 已发出、等待服务器响应的消息
+
+    // 只在本连接的事件循环线程（回调）里写，结束后汇总
+    LatencyHistogram deliveryLatency;     // 计划发送 -> 接收方收到
+    LatencyHistogram responseLatency;     // 计划发送 -> 发送方收到服务器响应
+    std::map<std::string, uint64_t> responseCodes;
+    uint64_t delivered = 0;
+    uint64_t unmatched = 0;
+};
+
+struct SharedState {
+    std::vector<std::atomic<int64_t>> intendedNs;   // 按消息序号记录计划发送时刻
+    std::atomic<int64_t> measureFromNs{0};          // 热身结束时刻，此前计划发送的消息不计入统计
+    std::atomic<bool> closing{false};               // 关闭连接时未完成的请求会以 DISCONNECTED 回调，不计入统计
+    std::atomic<uint64_t> attempted{0};
+    std::atomic<uint64_t> sendFailed{0};            // 被客户端库拒绝（背压/断线），没有发出
+    std::atomic<uint64_t> groupAttempted{0};
+    std::atomic<uint64_t> groupFailed{0};
+
+    explicit SharedState(size_t capacity) : intendedNs(capacity) {
+        for (auto& v : intendedNs) v.store(0, std::memory_order_relaxed);
+    }
+};
+
+const std::string ID_PREFIX = "lg";
+
+// lg<seq> -> seq；不是本工具发出的消息返回 -1
+int64_t sequenceOf(const std::string& messageId) {
+    if (messageId.compare(0, ID_PREFIX.size(), ID_PREFIX) != 0) return -1;
+    return std::strtoll(messageId.c_str() + ID_PREFIX.size(), nullptr, 10);
+}
+
+// 投递回调：ACK 已由客户端库发出，这里只统计延迟
+void onDelivered(Connection& conn, SharedState& shared, const MessageData& msg) {
+    int64_t arrived = nowNs();
+    int64_t seq = sequenceOf(msg.messageId);
+    if (seq < 0 || static_cast<size_t>(seq) >= shared.intendedNs.size()) {
+        ++conn.unmatched;
+        return;
+    }
+    int64_t intended = shared.intendedNs[static_cast<size_t>(seq)].load(std::memory_order_acquire);
+    ++conn.delivered;
+    if (intended >= shared.measureFromNs.load(std::memory_order_relaxed)) {
+        conn.deliveryLatency.record(arrived - intended);
+    }
+}
+
+// 开环发送：第 k 条消息的计划时刻 = start + k / totalRate，落后时立即补发而不跳过
+void senderLoop(size_t senderIndex, const Options& opt, std::vector<std::unique_ptr<Connection>>& conns,
+                SharedState& shared, int64_t startNs) {
+    const double totalRate = opt.rate + opt.groupRate;
+    const double groupShare = opt.groupRate / totalRate;
+    const std::string content(opt.size, 'x');
+    const size_t total = shared.intendedNs.size();
+
+    std::mt19937_64 rng(0x9E3779B97F4A7C15ull + senderIndex);
+    std::uniform_int_distribution<size_t> pickUser(0, conns.size() - 1);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+    for (size_t seq = senderIndex; seq < total; seq += opt.senders) {
+        int64_t intended = startNs + static_cast<int64_t>(static_cast<double>(seq) * 1e9 / totalRate);
+        int64_t wait = intended - nowNs();
+        if (wait > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+
+        Connection& from = *conns[pickUser(rng)];
+        std::string to;
+        bool toGroup = coin(rng) < groupShare;
+        if (toGroup) {
+            to = opt.groupId;
+        } else {
+            Connection* target = conns[pickUser(rng)].get();
+            while (target == &from) target = conns[pickUser(rng)].get();
+            to = target->userId;
+        }
+
+        MessageData msg(ID_PREFIX + std::to_string(seq), from.userId, to, content);
+        msg.timestamp = "0";
+        shared.intendedNs[seq].store(intended, std::memory_order_release);
+        shared.attempted.fetch_add(1, std::memory_order_relaxed);
+        if (toGroup) shared.groupAttempted.fetch_add(1, std::memory_order_relaxed);
+        from.inflight.fetch_add(1, std::memory_order_relaxed);
+
+        // 不等响应：响应在发送方连接的事件循环线程上回调
+        Connection* fromPtr = &from;
+        SharedState* sharedPtr = &shared;
+        from.client.sendMessage(msg, [fromPtr, sharedPtr, intended, toGroup](const ChatResponse& resp) {
+            if (sharedPtr->closing.load(std::memory_order_relaxed)) return;
+            fromPtr->inflight.fetch_sub(1, std::memory_order_relaxed);
+            if (resp.raw.empty()) {
+                sharedPtr->sendFailed.fetch_add(1, std::memory_order_relaxed);
+                if (toGroup) sharedPtr->groupFailed.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            int64_t arrived = nowNs();
+            ++fromPtr->responseCodes[(resp.ok ? "SUCCESS|" : "ERROR|") + resp.code];
+            if (intended >= sharedPtr->measureFromNs.load(std::memory_order_relaxed)) {
+                fromPtr->responseLatency.record(arrived - intended);
+            }
+        });
+    }
+}
+
+double toUs(int64_t ns) { return static_cast<double>(ns) / 1000.0; }
+
+void printHistogram(const char* name, const LatencyHistogram& h) {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << name << " (us, n=" << h.count() << ")" << std::endl;
+    std::cout << "  mean=" << toUs(static_cast<int64_t>(h.mean()))
+              << " p50=" << toUs(h.percentile(0.50))
+              << " p90=" << toUs(h.percentile(0.90))
+              << " p99=" << toUs(h.percentile(0.99))
+              << " p99.9=" << toUs(h.percentile(0.999))
+              << " max=" << toUs(h.max()) << std::endl;
+}
+
+void printHistogramJson(std::ostream& out, const char* name, const LatencyHistogram& h) {
+    out << "  \"" << name << "\": {\"count\": " << h.count()
+              << ", \"mean_us\": " << toUs(static_cast<int64_t>(h.mean()))
+              << ", \"p50_us\": " << toUs(h.percentile(0.50))
+              << ", \"p90_us\": " << toUs(h.percentile(0.90))
+              << ", \"p99_us\": " << toUs(h.percentile(0.99))
+              << ", \"p999_us\": " << toUs(h.percentile(0.999))
+              << ", \"max_us\": " << toUs(h.max()) << "}";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) return 1;
+
+#ifdef _WIN32
+    const long runTag = static_cast<long>(GetCurrentProcessId());
+#else
+    const long runTag = static_cast<long>(getpid());
+#endif
+
+    const double totalRate = opt.rate + opt.groupRate;
+    const size_t totalMessages = static_cast<size_t>(totalRate * opt.duration);
+    SharedState shared(totalMessages);
+
+    // 1. 建立连接并登录
+    std::vector<std::unique_ptr<Connection>> conns;
+    conns.reserve(opt.users);
+    AsyncChatClient::Options clientOptions;
+    clientOptions.coalesceWindowUs = opt.coalesceUs;
+    clientOptions.compression = opt.compress;
+    for (size_t i = 0; i < opt.users; ++i) {
+        std::unique_ptr<Connection> conn(new Connection(clientOptions));
+        conn->userId = ID_PREFIX + std::to_string(runTag) + "_" + std::to_string(i);
+        Connection* c = conn.get();
+        c->client.onMessage([c, &shared](const MessageData& msg, bool) { onDelivered(*c, shared, msg); });
+        if (!c->client.connect(opt.host, opt.port)) {
+            std::cerr << "连接失败 (" << i << "): " << c->client.getLastError() << std::endl;
+            return 1;
+        }
+        std::future<ChatResponse> login = c->client.login(c->userId);
+        if (login.wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+            std::cerr << "登录超时 (" << c->userId << ")" << std::endl;
+            return 1;
+        }
+        ChatResponse response = login.get();
+        if (response.code != "LOGIN_OK") {
+            std::cerr << "登录失败 (" << c->userId << "): " << response.raw << std::endl;
+            return 1;
+        }
+        conns.push_back(std::move(conn));
+    }
+
+    std::cout << "=== chat_loadgen ===" << std::endl;
+    std::cout << "server=" << opt.host << ":" << opt.port << " users=" << opt.users
+              << " rate=" << opt.rate << "/s group-rate=" << opt.groupRate << "/s size=" << opt.size
+              << "B duration=" << opt.duration << "s warmup=" << opt.warmup << "s senders=" << opt.senders
+              << " coalesce=" << opt.coalesceUs << "us" << (opt.compress ? " compress=lz4" : "") << std::endl;
+
+    // 2. 启动开环发送线程（收包、ACK 都在各连接的事件循环里）
+    int64_t startNs = nowNs() + 100 * 1000 * 1000;  // 预留 100ms 让线程就绪
+    shared.measureFromNs.store(startNs + static_cast<int64_t>(opt.warmup * 1e9));
+    std::vector<std::thread> senders;
+    for (size_t s = 0; s < opt.senders; ++s) {
+        senders.emplace_back([&, s] { senderLoop(s, opt, conns, shared, startNs); });
+    }
+    for (auto& t : senders) t.join();
+    int64_t sendEndNs = nowNs();
+
+    // 3. 等待在途消息的响应后关闭连接
+    int64_t drainDeadline = sendEndNs + static_cast<int64_t>(opt.drain * 1e9);
+    size_t unanswered = 0;
+    while (true) {
+        unanswered = 0;
+        for (auto& conn : conns) unanswered += conn->inflight.load(std::memory_order_relaxed);
+        if (unanswered == 0 || nowNs() >= drainDeadline) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    shared.closing = true;
+    uint64_t compressedOut = 0, compressedIn = 0, wireBytes = 0;
+    size_t compressing = 0;
+    for (auto& conn : conns) {
+        AsyncChatClient::Stats stats = conn->client.stats();
+        compressedOut += stats.framesCompressed;
+        compressedIn += stats.framesDecompressed;
+        wireBytes += stats.bytesSent + stats.bytesReceived;
+        if (stats.compressing) ++compressing;
+    }
+    for (auto& conn : conns) conn->client.close();
+
+    // 4. 汇总
+    LatencyHistogram delivery, response;
+    std::map<std::string, uint64_t> codes;
+    uint64_t delivered = 0, unmatched = 0;
+    for (auto& conn : conns) {
+        delivery.merge(conn->deliveryLatency);
+        response.merge(conn->responseLatency);
+        for (const auto& kv : conn->responseCodes) codes[kv.first] += kv.second;
+        delivered += conn->delivered;
+        unmatched += conn->unmatched;
+    }
+    const uint64_t sent = shared.attempted.load() - shared.sendFailed.load();
+    const uint64_t groupSent = shared.groupAttempted.load() - shared.groupFailed.load();
+
+    double measuredSec = std::max(1e-9, static_cast<double>(sendEndNs - shared.measureFromNs.load()) / 1e9);
+    double offeredRate = totalRate;
+    double deliveredRate = static_cast<double>(delivery.count()) / measuredSec;
+    double responseRate = static_cast<double>(response.count()) / measuredSec;
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "sent=" << sent << " (group " << groupSent << ")"
+              << " send_failed=" << shared.sendFailed.load()
+              << " delivered=" << delivered << " unmatched=" << unmatched
+              << " unanswered=" << unanswered << std::endl;
+    std::cout << "offered " << offeredRate << " msg/s, delivered " << deliveredRate
+              << " msg/s, responses " << responseRate << " msg/s (measured window " << measuredSec << "s)" << std::endl;
+    std::cout << "wire bytes=" << wireBytes;
+    if (opt.compress) {
+        std::cout << " compressed connections=" << compressing << "/" << conns.size()
+                  << " frames compressed out=" << compressedOut << " in=" << compressedIn;
+    }
+    std::cout << std::endl;
+    std::cout << "responses:";
+    for (const auto& kv : codes) std::cout << " " << kv.first << "=" << kv.second;
+    std::cout << std::endl;
+    printHistogram("delivery latency  (intended send -> recipient)", delivery);
+    printHistogram("response latency  (intended send -> server response)", response);
+
+    if (!opt.jsonPath.empty()) {
+        std::ofstream out(opt.jsonPath);
+        if (!out) {
+            std::cerr << "无法写入 " << opt.jsonPath << std::endl;
+            return 1;
+        }
+        out << "{" << std::endl;
+        out << std::fixed << std::setprecision(1);
+        out << "  \"users\": " << opt.users << ", \"offered_rate\": " << offeredRate
+            << ", \"size\": " << opt.size << ", \"duration_s\": " << opt.duration << "," << std::endl;
+        out << "  \"sent\": " << sent << ", \"send_failed\": " << shared.sendFailed.load()
+            << ", \"group_sent\": " << groupSent << ", \"delivered\": " << delivered
+            << ", \"unanswered\": " << unanswered << "," << std::endl;
+        out << "  \"delivered_per_sec\": " << deliveredRate << ", \"responses_per_sec\": " << responseRate << "," << std::endl;
+        out << "  \"responses\": {";
+        bool first = true;
+        for (const auto& kv : codes) {
+            out << (first ? "" : ", ") << "\"" << kv.first << "\": " << kv.second;
+            first = false;
+        }
+        out << "}," << std::endl;
+        printHistogramJson(out, "delivery_latency", delivery);
+        out << "," << std::endl;
+        printHistogramJson(out, "response_latency", response);
+        out << std::endl << "}" << std::endl;
+    }
+    return 0;
+}
@@ -9,16 +9,28 @@
 #endif
 
 #include <iostream>
+#include <chrono>
+#include <cstdlib>
 #include <string>
 #include <vector>
 #include <atomic>
 #include <thread>
+#include <mutex>
 #include <stddef.h>
 #include <memory>
 #include <cstddef>
 #include "../src/network/tcp_socket.hpp"
+#include "../src/network/socket_transport.hpp"
+#include "../src/network/listener_group.hpp"
+#include "../src/network/metrics_http.hpp"
+#include "../src/network/file_transfer.hpp"
+#include "../src/common/Tracer.hpp"
 #include "../src/core/Platform.hpp"
 #include "../src/chat/ChatServer.hpp"
+#include "../src/chat/ClusterNode.hpp"
+#include "../src/common/MessageId.hpp"
+#include "../src/common/HashRing.hpp"
+#include "../src/common/HistoryStore.hpp"
 #include "../src/common/Protocol.hpp"
 
 
@@ -27,12 +39,53 @@
 
 // 之前的ClientHandler类已移除 - 使用include/ClientHandler.h
 class SimpleChatServer {
+public:
+    struct Options {
+        uint16_t port = 8080;
+        uint16_t metricsPort = 9100;
+        uint16_t adminPort = 0;                      // 管理端口（只监听 127.0.0.1，POST /ring 改环、POST /trace 调采样率），0 表示不开启
+        std::string ioBackend;                       // "io_uring" / "epoll"；空表示每连接阻塞读写
+        size_t listeners = 0;                        // SO_REUSEPORT 监听 socket 数，0 表示按 CPU 核数
+        int backlog = TcpSocket::DEFAULT_BACKLOG;
+        ChatServer::CompressionConfig compression;   // 客户端在 LOGIN 里请求时才开启
+        uint16_t filePort = 8081;                    // 文件传输端口，0 表示不开启文件传输
+        std::string blobDirectory = "data/blobs";
+        uint64_t maxFileBytes = BlobStore::DEFAULT_MAX_BLOB_BYTES;
+        std::string handler = "thread";              // "thread" 每连接一个线程；"coroutine" 协程（需 C++20 与 transport）
+        size_t coroutineWorkers = 0;                 // 协程工作线程数，0 表示按 CPU 核数
+        uint16_t clusterPort = 0;                    // 节点间链路端口，0 表示单机运行
+        std::vector<ClusterNode::Peer> clusterPeers; // 其他节点
+        std::string clusterSecret;                   // 集群秘钥，空表示只接受 clusterPeers 里的节点
+        uint32_t clusterWeight = HashRing::DEFAULT_WEIGHT;   // 本节点在哈希环上的初始权重
+        int rebalanceDrainMs = 10000;                // 环变化后通知会话改连的时间窗口
+        std::string historyDirectory = "data/history";   // 消息历史目录，空表示不保存历史
+    };
+
 private:
-    TcpSocket m_serverSocket;
+    ListenerGroup m_listeners;
+#if CHAT_HAVE_COROUTINES
+    // 协程处理模式：连接处理协程在 m_handlerPool 上恢复。声明在 m_transport 之前（之后析构），
+    // transport 停止时被唤醒的协程仍能投递到线程池
+    std::unique_ptr<ThreadPool> m_handlerPool;
+    std::unique_ptr<CoroutineScheduler> m_scheduler;
+#endif
+    // 可选的 io_uring / epoll 收发后端；为空时沿用阻塞读写。声明在 m_chatServer 之前，
+    // 保证会话（及其 socket）先于 transport 析构
+    std::unique_ptr<SocketTransport> m_transport;
+    // 消息历史：m_chatServer 路由消息时写入，声明在它之前（之后析构）
+    std::unique_ptr<HistoryStore> m_history;
     Platform m_platform;
     ChatServer m_chatServer;
+    MetricsHttpServer m_metricsServer;   // Prometheus 抓取端点，独立端口
+    MetricsHttpServer m_adminServer;     // 管理端点（改环），只监听回环地址
+    // 集群链路：转发来的消息由 m_chatServer 投递，所以声明在它之后（先析构）
+    std::unique_ptr<ClusterNode> m_cluster;
+    // 文件传输端点：上传完成时回调 m_chatServer 投递引用消息，所以声明在它之后（先析构）
+    std::unique_ptr<BlobStore> m_blobStore;
+    std::unique_ptr<FileTransferServer> m_fileServer;
     std::atomic<bool> m_running;
     std::atomic<size_t> m_clientCount;
+    std::mutex m_clientThreadsMutex;     // 多个接收线程并发登记
     std::vector<std::thread> m_clientThreads; // 管理所有客户端线程
 
 public:
@@ -48,35 +101,124 @@ public:
         stop();
     }
 
-    bool start(uint16_t port) {
-        // 初始化服务器套接字
-        if (!m_serverSocket.init()) {
-            std::cerr << "[Server] Failed to initialize server socket" << std::endl;
-            return false;
+    bool start(const Options& options) {
+        m_chatServer.setCompression(options.compression);
+        if (!options.ioBackend.empty()) {
+            m_transport = SocketTransport::create(options.ioBackend);
+            if (!m_transport) {
+                std::cerr << "[Server] Warning: I/O backend '" << options.ioBackend
+                          << "' unavailable, using blocking sockets" << std::endl;
+            } else {
+                std::cout << "[Server] I/O backend: " << m_transport->name() << std::endl;
+            }
         }
 
-        if (!m_serverSocket.create()) {
-            std::cerr << "[Server] Failed to create server socket" << std::endl;
-            m_serverSocket.cleanup();
-            return false;
+        if (options.handler == "coroutine") {
+#if CHAT_HAVE_COROUTINES
+            if (!m_transport) {
+                std::cerr << "[Server] Warning: coroutine handlers need CHAT_IO_BACKEND, using threads" << std::endl;
+            } else {
+                m_handlerPool.reset(new ThreadPool(options.coroutineWorkers));
+                m_scheduler.reset(new CoroutineScheduler(*m_handlerPool));
+                std::cout << "[Server] Client handling: coroutines on " << m_handlerPool->getThreadCount()
+                          << " worker threads" << std::endl;
+            }
+#else
+            std::cerr << "[Server] Warning: built without C++20 coroutines, using threads" << std::endl;
+#endif
         }
 
-        if (!m_serverSocket.bind(port)) {
-            std::cerr << "[Server] Failed to bind to port " << port << std::endl;
-            m_serverSocket.close();
-            m_serverSocket.cleanup();
-            return false;
+        // 消息历史：打开失败时只关闭历史功能（HISTORY 被拒绝），不影响聊天服务
+        if (!options.historyDirectory.empty()) {
+            HistoryStore::Options historyOptions;
+            historyOptions.directory = options.historyDirectory;
+            m_history.reset(new HistoryStore(historyOptions));
+            std::string error;
+            if (m_history->open(error)) {
+                m_chatServer.setHistory(m_history.get());
+            } else {
+                std::cerr << "[Server] Warning: Failed to open message history: " << error << std::endl;
+                m_history.reset();
+            }
+        }
+
+        // 节点号写进消息ID和会话流序号，各实例必须不同；随机取号只适用于单实例，集群模式下拒绝启动
+        if (!std::getenv("CHAT_NODE_ID")) {
+            if (options.clusterPort != 0) {
+                std::cerr << "[Server] CHAT_NODE_ID must be set when CHAT_CLUSTER_PORT is configured" << std::endl;
+                return false;
+            }
+            std::cerr << "[Server] Warning: CHAT_NODE_ID not set, using random node id " << MessageId::nodeId()
+                      << "; run more than one instance only with distinct CHAT_NODE_ID values" << std::endl;
+        }
+
+        // 集群：先连上其他节点、同步用户目录，再开始接受客户端
+        if (options.clusterPort != 0) {
+            ClusterNode::Options clusterOptions;
+            clusterOptions.nodeId = MessageId::nodeId();
+            clusterOptions.port = options.clusterPort;
+            clusterOptions.peers = options.clusterPeers;
+            clusterOptions.clientPort = options.port;
+            clusterOptions.weight = options.clusterWeight;
+            clusterOptions.secret = options.clusterSecret;
+            m_cluster.reset(new ClusterNode(clusterOptions));
+            m_chatServer.setRebalanceDrain(options.rebalanceDrainMs);
+            m_chatServer.setCluster(m_cluster.get());
+            if (!m_cluster->start()) {
+                std::cerr << "[Server] Failed to start cluster link on port " << options.clusterPort << ": "
+                          << m_cluster->getLastError() << std::endl;
+                return false;
+            }
         }
 
-        if (!m_serverSocket.listen(10)) {
-            std::cerr << "[Server] Failed to listen on port " << port << std::endl;
-            m_serverSocket.close();
-            m_serverSocket.cleanup();
+        // 同一端口多个 SO_REUSEPORT 监听 socket，重连风暴时各核并行 accept
+        ListenerGroup::Options listenOptions;
+        listenOptions.port = options.port;
+        listenOptions.listeners = options.listeners;
+        listenOptions.backlog = options.backlog;
+        listenOptions.nonBlockingClients = (m_transport != nullptr);   // 阻塞模式的连接靠 SO_RCVTIMEO 等待
+        if (!m_listeners.open(listenOptions)) {
+            std::cerr << "[Server] Failed to listen on port " << options.port << ": "
+                      << m_listeners.getLastError() << std::endl;
             return false;
         }
 
+        // 文件传输：独立端口，启动失败时只关闭文件功能（FILE_OFFER 被拒绝），不影响聊天服务
+        if (options.filePort != 0) {
+            m_blobStore.reset(new BlobStore(options.blobDirectory, options.maxFileBytes));
+            m_fileServer.reset(new FileTransferServer(*m_blobStore));
+            m_fileServer->onComplete([this](const BlobInfo& blob) { m_chatServer.deliverFileReference(blob); });
+            if (m_fileServer->start(options.filePort)) {
+                m_chatServer.setFileTransfer(m_blobStore.get(), options.filePort);
+            } else {
+                std::cerr << "[Server] Warning: Failed to start file transfer on port " << options.filePort
+                          << ": " << m_fileServer->getLastError() << std::endl;
+            }
+        }
+
+        // 管理端口：POST /trace（sample=N）调整消息追踪采样率，0 关闭；导出仍是两个端口上的 GET /trace
+        m_adminServer.handlePost("/trace", [](const std::string& form) { return traceSample(form); });
+
+        // 集群模式下指标端口同时提供只读的 /ring；改环（POST /ring，set=4=100,3=0 调整权重 / 加入 / 移除节点）
+        // 只在管理端口上，管理端口只监听回环地址
+        if (m_cluster) {
+            m_metricsServer.handle("/ring", [this](const std::string&) { return ringStatus(); });
+            m_adminServer.handle("/ring", [this](const std::string&) { return ringStatus(); });
+            m_adminServer.handlePost("/ring", [this](const std::string& form) { return ringChange(form); });
+        }
+
+        // 指标端点启动失败不影响聊天服务
+        if (options.metricsPort != 0 && !m_metricsServer.start(options.metricsPort)) {
+            std::cerr << "[Server] Warning: Failed to start metrics endpoint on port " << options.metricsPort
+                      << ": " << m_metricsServer.getLastError() << std::endl;
+        }
+        if (options.adminPort != 0 && !m_adminServer.start(options.adminPort, "127.0.0.1")) {
+            std::cerr << "[Server] Warning: Failed to start admin endpoint on port " << options.adminPort
+                      << ": " << m_adminServer.getLastError() << std::endl;
+        }
+
         m_running = true;
-        std::cout << "[Server] Chat Server started on port " << port << std::endl;
+        std::cout << "[Server] Chat Server started on port " << options.port << std::endl;
         std::cout << "[Server] Waiting for client connections..." << std::endl;
         std::cout << "[Server] Using C++ std::thread for client handling" << std::endl;
 
@@ -88,92 +230,110 @@ public:
         std::cout << "• 使用 C++ std::thread 处理并发客户端" << std::endl;
         std::cout << "• 每个客户端拥有独立的线程" << std::endl;
         std::cout << "• 支持管道协议消息处理" << std::endl;
-        std::cout << "• Linux兼容性: 防止accept()阻塞卡死" << std::endl;
+        std::cout << "• " << m_listeners.size() << " 个监听 socket 并行接受连接" << std::endl;
         std::cout << "=====================================\n" << std::endl;
 
-        // 设置非阻塞模式（Linux下防止卡死）
-        if (!m_serverSocket.setListenNonBlocking(true)) {
-            std::cerr << "[Server] Warning: Failed to set non-blocking mode" << std::endl;
-        }
-
-        // 主循环：接受新客户端连接
-        static int connectionCheckCount = 0;  // 静态计数器，用于减少输出频率
-        while (m_running) {
-            std::string clientIp;
-            uint16_t clientPort;
-
-            // 每10个检查周期（约10秒）输出一次等待信息
-            if (++connectionCheckCount >= 10) {
-                std::cout << "[Server] Waiting for new client connection (non-blocking)..." << std::endl;
-                connectionCheckCount = 0;
-            }
-
-#ifdef __linux__
-            // Linux: 使用带超时的非阻塞accept
-            SocketHandle clientHandle = m_serverSocket.acceptNonBlocking(clientIp, clientPort, 1000); // 1秒超时
+        auto onAccept = [this](SocketHandle handle, const std::string& ip, uint16_t port) {
+            if (!m_running) {
+#ifdef _WIN32
+                closesocket(handle);
 #else
-            // Windows或其他系统：直接使用阻塞accept
-            SocketHandle clientHandle = m_serverSocket.accept(clientIp, clientPort);
+                ::close(handle);
 #endif
-
-            if (clientHandle == -1) {
-                if (!m_running) break;
-
-                // 检查是否是超时（这是正常的，无需打印错误）
-                std::string errorMsg = m_serverSocket.getLastError();
-                if (errorMsg == "timeout" || errorMsg == "no data") {
-                    // Linux下非阻塞accept失败，需要短暂延迟防止CPU占用
-                    #ifdef _WIN32
-                        Sleep(10);
-                    #else
-                        usleep(10 * 1000); // 10ms
-                    #endif
-                    continue; // 静静等待下一个循环
-                }
-
-                // 输出错误信息，需要重置计数器确保用户看到
-                std::cerr << "[Server] Failed to accept client connection: " << errorMsg << std::endl;
-                connectionCheckCount = 0;  // 重置计数器，在下次循环时会立即显示
-
-                // 短暂延时避免CPU占用过高
-                #ifdef _WIN32
-                    Sleep(10);
-                #else
-                    usleep(10 * 1000);
-                #endif
-                continue;
+                return;
             }
+            acceptClient(handle, ip, port);
+        };
+
+        if (m_transport) {
+            // transport 模式：由 reactor 接受连接（io_uring multishot accept / epoll accept4）
+            bool listening = true;
+            for (size_t i = 0; i < m_listeners.size() && listening; ++i) {
+                listening = m_transport->listen(m_listeners.handle(i), onAccept);
+            }
+            if (!listening || !m_transport->start()) {
+                std::cerr << "[Server] Failed to start I/O backend: " << m_transport->getLastError() << std::endl;
+                return;
+            }
+        } else if (!m_listeners.start(onAccept)) {
+            std::cerr << "[Server] Failed to start acceptors: " << m_listeners.getLastError() << std::endl;
+            return;
+        }
 
-            if (!m_running) break;
-
-            // 创建新的客户套接字
-            TcpSocket clientSocket;
-            clientSocket.setHandle(clientHandle);
-
-            size_t currentCount = ++m_clientCount;
-            std::cout << "[Server] Client #" << currentCount << " connected from "
-                      << clientIp << ":" << clientPort << std::endl;
+        // 接受连接都在接收线程 / reactor 上，主线程只等待退出
+        while (m_running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }
 
-            // 为每个客户端创建独立线程
-            try {
-                ClientHandler handler(std::move(clientSocket), clientIp, clientPort,
-                                    m_chatServer, m_running);
-                std::thread clientThread(std::move(handler));
+private:
+    std::string ringStatus() {
+        HashRing ring = m_cluster->ring();
+        return "version " + std::to_string(m_cluster->ringVersion()) + "\nring " + ring.toString() + "\n";
+    }
 
-                // 将线程添加到管理列表（用于清理）
-                m_clientThreads.push_back(std::move(clientThread));
+    static std::string traceSample(const std::string& form) {
+        size_t samplePos = form.find("sample=");
+        if (samplePos == std::string::npos) return "missing sample=\n";
+        Tracer::setSampleRate(static_cast<uint32_t>(std::strtoul(form.c_str() + samplePos + 7, nullptr, 10)));
+        return "sample " + std::to_string(Tracer::sampleRate()) + "\n";
+    }
 
-                // 分离线程，使其独立运行（不用等待结束）
-                m_clientThreads.back().detach();
+    // POST /ring：在当前环上应用 set= 里的变更，以新版本广播给所有节点。
+    // 各节点只搬迁归属变化的那部分用户，不需要重启集群
+    std::string ringChange(const std::string& form) {
+        size_t setPos = form.find("set=");
+        if (setPos == std::string::npos) return "missing set=\n";
+        std::string spec = form.substr(setPos + 4, form.find('&', setPos) - setPos - 4);
+        while (!spec.empty() && (spec.back() == '\n' || spec.back() == '\r')) spec.pop_back();
+        std::vector<std::pair<uint32_t, uint32_t>> changes;
+        if (!HashRing::parseWeights(spec, changes) || changes.empty()) return "invalid ring change: " + spec + "\n";
+        HashRing before = m_cluster->ring();
+        HashRing after = before;
+        for (const auto& change : changes) after.setNode(change.first, change.second);
+        if (!m_cluster->updateRing(after)) return "refused: ring would be empty\n";
+        std::cout << "[Server] 哈希环已调整为 " << after.toString() << std::endl;
+        return ringStatus();
+    }
 
-                std::cout << "[Server] Spawned dedicated thread for client #" << currentCount << std::endl;
-            } catch (const std::exception& e) {
-                std::cerr << "[Server] Failed to create thread for client #" << currentCount
-                          << ": " << e.what() << std::endl;
+    // 新连接：挂上 transport（若有），交给独立的 ClientHandler 线程或处理协程
+    void acceptClient(SocketHandle clientHandle, const std::string& clientIp, uint16_t clientPort) {
+        TcpSocket clientSocket;
+        clientSocket.setHandle(clientHandle);
+        if (m_transport) clientSocket.attachTransport(*m_transport);
+
+        size_t currentCount = ++m_clientCount;
+        std::cout << "[Server] Client #" << currentCount << " connected from "
+                  << clientIp << ":" << clientPort << std::endl;
+
+#if CHAT_HAVE_COROUTINES
+        if (m_scheduler) {
+            ChatServer::SessionHandle session = m_chatServer.createSession(clientIp, clientPort, std::move(clientSocket));
+            if (session.valid()) {
+                spawn(handleClientAsync(m_chatServer, session, clientIp, clientPort, m_running, *m_scheduler));
+                std::cout << "[Server] Spawned coroutine for client #" << currentCount << std::endl;
             }
+            return;
         }
-    }
+#endif
 
+        // 为每个客户端创建独立线程
+        try {
+            ClientHandler handler(std::move(clientSocket), clientIp, clientPort,
+                                m_chatServer, m_running);
+            std::thread clientThread(std::move(handler));
+
+            // 将线程添加到管理列表（用于清理），分离线程，使其独立运行（不用等待结束）
+            std::lock_guard<std::mutex> lock(m_clientThreadsMutex);
+            m_clientThreads.push_back(std::move(clientThread));
+            m_clientThreads.back().detach();
+
+            std::cout << "[Server] Spawned dedicated thread for client #" << currentCount << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "[Server] Failed to create thread for client #" << currentCount
+                      << ": " << e.what() << std::endl;
+        }
+    }
 
 public:
     void stop() {
@@ -190,12 +350,40 @@ public:
         usleep(1000 * 1000);
 #endif
 
+        // 先停止接受新连接，再断开节点间链路（转来的消息不再进入）
+        m_listeners.stop();
+        if (m_cluster) m_cluster->stop();
+        if (m_transport) m_transport->stop();
+#if CHAT_HAVE_COROUTINES
+        // transport 停止会唤醒挂起在读上的处理协程，scheduler 停止会按超时唤醒挂起在定时器上的协程；
+        // 恢复任务都排在 m_handlerPool 上，等它们跑完（最多 2 秒）再停线程池，
+        // 否则 stop() 丢弃的排队任务里的协程帧永远不会释放
+        if (m_scheduler) m_scheduler->stop();
+        if (m_handlerPool) {
+            auto drainDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while ((m_handlerPool->getQueuedTasks() > 0 || m_handlerPool->getActiveTasks() > 0) &&
+                   std::chrono::steady_clock::now() < drainDeadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            m_handlerPool->stop();
+        }
+#endif
+
         // 清理所有线程（已分离，不需要join，但要清理vector）
-        m_clientThreads.clear();
+        {
+            std::lock_guard<std::mutex> lock(m_clientThreadsMutex);
+            m_clientThreads.clear();
+        }
 
-        // 关闭服务器套接字
-        m_serverSocket.close();
-        m_serverSocket.cleanup();
+        m_metricsServer.stop();
+        m_adminServer.stop();
+        if (m_fileServer) m_fileServer->stop();
+        // 写出内存中的历史尾部；之后到达的消息不再记入历史
+        if (m_history) m_history->close();
+
+        // 关闭监听套接字
+        m_listeners.close();
+        TcpSocket().cleanup();
 
         // 保存平台数据
         if (!m_platform.save("data/users.txt", "data/groups.txt")) {
@@ -208,7 +396,10 @@ public:
     void showStats() {
         std::cout << "\n=== 服务器统计信息 ===" << std::endl;
         std::cout << "已处理客户端数量: " << m_clientCount.load() << std::endl;
-        std::cout << "活跃线程数量: " << m_clientThreads.size() << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(m_clientThreadsMutex);
+            std::cout << "活跃线程数量: " << m_clientThreads.size() << std::endl;
+        }
         std::cout << "服务器状态: " << (m_running.load() ? "运行中" : "已停止") << std::endl;
         std::cout << "==========================\n" << std::endl;
     }
@@ -222,9 +413,93 @@ int main() {
         std::cout << "=== 即时通信服务器 (C++ std::thread版本) ===" << std::endl;
         std::cout << "[Server] Starting with C++ std::thread support" << std::endl;
 
+        // 消息追踪采样率：CHAT_TRACE_SAMPLE=N 约每 N 条消息追踪一条，默认关闭；
+        // 运行中在管理端口上 POST /trace（sample=N）调整，GET /trace 导出
+        if (const char* sample = std::getenv("CHAT_TRACE_SAMPLE")) {
+            Tracer::setSampleRate(static_cast<uint32_t>(std::strtoul(sample, nullptr, 10)));
+        }
+
+        SimpleChatServer::Options options;
+        // 端口：CHAT_PORT 聊天端口（默认 8080），CHAT_METRICS_PORT 指标端口（默认 9100，0 关闭），
+        // CHAT_ADMIN_PORT 管理端口（只监听 127.0.0.1，默认 0 关闭）
+        if (const char* port = std::getenv("CHAT_PORT")) {
+            options.port = static_cast<uint16_t>(std::strtoul(port, nullptr, 10));
+        }
+        if (const char* metricsPort = std::getenv("CHAT_METRICS_PORT")) {
+            options.metricsPort = static_cast<uint16_t>(std::strtoul(metricsPort, nullptr, 10));
+        }
+        if (const char* adminPort = std::getenv("CHAT_ADMIN_PORT")) {
+            options.adminPort = static_cast<uint16_t>(std::strtoul(adminPort, nullptr, 10));
+        }
+        // 收发后端：CHAT_IO_BACKEND=io_uring|epoll，io_uring 不可用时回退到 epoll；未设置时每连接阻塞读写
+        if (const char* backend = std::getenv("CHAT_IO_BACKEND")) options.ioBackend = backend;
+        // 监听：CHAT_LISTENERS=N 个 SO_REUSEPORT 监听 socket（默认按 CPU 核数），CHAT_LISTEN_BACKLOG 监听队列长度
+        if (const char* listeners = std::getenv("CHAT_LISTENERS")) {
+            options.listeners = std::strtoul(listeners, nullptr, 10);
+        }
+        if (const char* backlog = std::getenv("CHAT_LISTEN_BACKLOG")) {
+            options.backlog = static_cast<int>(std::strtol(backlog, nullptr, 10));
+        }
+        // 压缩：CHAT_COMPRESSION=off 拒绝客户端的压缩请求；CHAT_COMPRESS_MIN_BYTES 压缩阈值；
+        // CHAT_COMPRESS_DICT 训练好的字典文件（bench_compression --save-dict 生成），客户端需用同一个字典
+        if (const char* compression = std::getenv("CHAT_COMPRESSION")) {
+            options.compression.enabled = std::string(compression) != "off";
+        }
+        if (const char* minBytes = std::getenv("CHAT_COMPRESS_MIN_BYTES")) {
+            options.compression.minBytes = std::strtoul(minBytes, nullptr, 10);
+        }
+        if (const char* dictPath = std::getenv("CHAT_COMPRESS_DICT")) {
+            if (!CompressionDictionary::loadFile(dictPath, options.compression.dictionary)) {
+                std::cerr << "[Server] Warning: Failed to load compression dictionary " << dictPath
+                          << ", using built-in dictionary" << std::endl;
+            }
+        }
+
+        // 文件传输：CHAT_FILE_PORT 端口（默认 8081，0 关闭），CHAT_BLOB_DIR 存储目录，CHAT_MAX_FILE_BYTES 单个文件上限
+        if (const char* filePort = std::getenv("CHAT_FILE_PORT")) {
+            options.filePort = static_cast<uint16_t>(std::strtoul(filePort, nullptr, 10));
+        }
+        if (const char* blobDir = std::getenv("CHAT_BLOB_DIR")) options.blobDirectory = blobDir;
+        if (const char* maxFile = std::getenv("CHAT_MAX_FILE_BYTES")) {
+            options.maxFileBytes = std::strtoull(maxFile, nullptr, 10);
+        }
+        // 连接处理：CHAT_HANDLER=coroutine 用协程（需以 C++20 编译并设置 CHAT_IO_BACKEND），
+        // CHAT_CORO_WORKERS 协程工作线程数（默认按 CPU 核数）
+        if (const char* handler = std::getenv("CHAT_HANDLER")) options.handler = handler;
+        if (const char* workers = std::getenv("CHAT_CORO_WORKERS")) {
+            options.coroutineWorkers = std::strtoul(workers, nullptr, 10);
+        }
+
+        // 集群：CHAT_CLUSTER_PORT 节点间链路端口（默认 0 单机运行），CHAT_CLUSTER_PEERS 其他节点
+        // "2=10.0.0.2:9200,3=10.0.0.3:9200"；本节点号取 CHAT_NODE_ID，各节点必须不同
+        if (const char* clusterPort = std::getenv("CHAT_CLUSTER_PORT")) {
+            options.clusterPort = static_cast<uint16_t>(std::strtoul(clusterPort, nullptr, 10));
+        }
+        if (const char* peers = std::getenv("CHAT_CLUSTER_PEERS")) {
+            if (!ClusterNode::parsePeers(peers, options.clusterPeers)) {
+                std::cerr << "[Server] Invalid CHAT_CLUSTER_PEERS: " << peers << std::endl;
+                return -1;
+            }
+        }
+        // CHAT_CLUSTER_SECRET 集群秘钥，各节点相同；不设置时只接受 CHAT_CLUSTER_PEERS 里的节点
+        if (const char* secret = std::getenv("CHAT_CLUSTER_SECRET")) options.clusterSecret = secret;
+        // CHAT_NODE_WEIGHT 本节点在初始哈希环上的权重（对端权重写在 CHAT_CLUSTER_PEERS 的 @ 之后），
+        // CHAT_REBALANCE_DRAIN_MS 环变化后通知会话改连的时间窗口
+        if (const char* weight = std::getenv("CHAT_NODE_WEIGHT")) {
+            options.clusterWeight = static_cast<uint32_t>(std::strtoul(weight, nullptr, 10));
+        }
+        if (const char* drain = std::getenv("CHAT_REBALANCE_DRAIN_MS")) {
+            options.rebalanceDrainMs = static_cast<int>(std::strtol(drain, nullptr, 10));
+        }
+        // 消息历史：CHAT_HISTORY_DIR 存储目录（默认 data/history），CHAT_HISTORY=off 不保存历史
+        if (const char* historyDir = std::getenv("CHAT_HISTORY_DIR")) options.historyDirectory = historyDir;
+        if (const char* history = std::getenv("CHAT_HISTORY")) {
+            if (std::string(history) == "off") options.historyDirectory.clear();
+        }
+
         SimpleChatServer server;
 
-        if (server.start(8080)) {
+        if (server.start(options)) {
             std::cout << "[Server] Server started successfully!" << std::endl;
             std::cout << "[Server] Press Ctrl+C to stop the server..." << std::endl;
 
@@ -1,6 +1,13 @@
 #include "ChatServer.hpp"
+#include "ClusterNode.hpp"
+#include "PresenceService.hpp"
+#include "../common/HistoryStore.hpp"
 #include "../common/Protocol.hpp"
 #include "../core/Message.hpp"
+#include "../common/Metrics.hpp"
+#include "../common/Tracer.hpp"
+#include "../common/MessageId.hpp"
+#include <algorithm>
 #include <map>
 #include <iostream>
 #include <sstream>
@@ -11,6 +18,91 @@
 #include <unordered_map>
 #include <condition_variable>
 
+namespace {
+
+// 登录时未声明设备的客户端（LOGIN|userId）都视为同一个默认设备
+const char* const DEFAULT_DEVICE_ID = "default";
+
+// 在线状态订阅者 id：会话句柄打包成 64 位，句柄过期（会话已关闭）时 acquire 失败，订阅随之取消
+uint64_t presenceSubscriberId(const SlabHandle& handle) {
+    return (static_cast<uint64_t>(handle.index) << 32) | handle.generation;
+}
+
+SlabHandle presenceSession(uint64_t subscriber) {
+    SlabHandle handle;
+    handle.index = static_cast<uint32_t>(subscriber >> 32);
+    handle.generation = static_cast<uint32_t>(subscriber);
+    return handle;
+}
+
+// 服务器指标：注册一次，之后热路径只做原子累加
+struct ServerMetrics {
+    Counter& loginReceived;
+    Counter& messageReceived;
+    Counter& ackReceived;
+    Counter& logoutReceived;
+    Counter& unknownReceived;
+    Counter& batchReceived;
+    Counter& fileOfferReceived;
+    Histogram& batchSize;
+    Counter& routedDirect;
+    Counter& routedGroup;
+    Counter& routedOffline;
+    Counter& routedRemote;
+    Counter& groupDeliveries;
+    Histogram& processSeconds;
+    Histogram& ackLatencySeconds;
+    Counter& ackTimeouts;
+    Gauge& sessions;
+    Gauge& onlineUsers;
+    Gauge& offlineDepth;
+    Counter& offlineStored;
+    Counter& offlineEvicted;
+    Counter& offlineDelivered;
+    Counter& compressionNegotiated;
+    Counter& rebalanceInboxes;
+    Counter& rebalanceMessages;
+    Counter& rebalanceReconnects;
+};
+
+ServerMetrics& serverMetrics() {
+    MetricsRegistry& r = MetricsRegistry::instance();
+    const char* receivedHelp = "Client commands received, by command type";
+    const char* routedHelp = "Chat messages routed, by route taken";
+    static ServerMetrics metrics{
+        r.counter("chat_commands_received_total", receivedHelp, "type=\"login\""),
+        r.counter("chat_commands_received_total", receivedHelp, "type=\"message\""),
+        r.counter("chat_commands_received_total", receivedHelp, "type=\"ack\""),
+        r.counter("chat_commands_received_total", receivedHelp, "type=\"logout\""),
+        r.counter("chat_commands_received_total", receivedHelp, "type=\"unknown\""),
+        r.counter("chat_commands_received_total", receivedHelp, "type=\"batch\""),
+        r.counter("chat_commands_received_total", receivedHelp, "type=\"file_offer\""),
+        r.histogram("chat_message_batch_size", "Messages per MESSAGE_BATCH frame",
+                    std::vector<double>{1, 2, 5, 10, 20, 50, 100, 200, 500}),
+        r.counter("chat_messages_routed_total", routedHelp, "route=\"direct\""),
+        r.counter("chat_messages_routed_total", routedHelp, "route=\"group\""),
+        r.counter("chat_messages_routed_total", routedHelp, "route=\"offline\""),
+        r.counter("chat_messages_routed_total", routedHelp, "route=\"remote\""),
+        r.counter("chat_group_deliveries_total", "Group message copies pushed to online members"),
+        r.histogram("chat_process_seconds", "Time to process one client command, including delivery"),
+        r.histogram("chat_ack_latency_seconds", "Time from forwarding a message to receiving its ACK"),
+        r.counter("chat_ack_timeouts_total", "Forwarded messages not ACKed within the wait window"),
+        r.gauge("chat_sessions", "Open client sessions"),
+        r.gauge("chat_users_online", "Users with at least one logged-in session"),
+        r.gauge("chat_offline_queue_depth", "Messages waiting in offline queues"),
+        r.counter("chat_offline_stored_total", "Messages written to offline queues"),
+        r.counter("chat_offline_evicted_total", "Oldest offline messages dropped at the per-user cap"),
+        r.counter("chat_offline_delivered_total", "Offline messages delivered after login"),
+        r.counter("chat_compression_negotiated_total", "Logins that switched the connection to compressed frames"),
+        r.counter("chat_rebalance_inboxes_moved_total", "Offline inboxes handed to their owner node after a ring change or link recovery"),
+        r.counter("chat_rebalance_messages_moved_total", "Offline messages streamed to their owner node during rebalancing"),
+        r.counter("chat_rebalance_reconnects_total", "RECONNECT notices sent to sessions whose user moved to another node"),
+    };
+    return metrics;
+}
+
+} // namespace
+
 
 ChatServer::ChatServer(Platform& pf) : m_platform(pf), m_running(false) {
     // 确保数据文件存在，如果不存在则初始化
@@ -20,10 +112,27 @@ ChatServer::ChatServer(Platform& pf) : m_platform(pf), m_running(false) {
     if (!m_platform.load("data/users.txt", "data/groups.txt")) {
         std::cout << "[ChatServer] 警告：数据文件加载失败，使用默认数据" << std::endl;
     }
+
+    // 群成员位图：在线成员 = 成员位图 AND 在线位图
+    m_platform.enableGroupBitmaps();
+
+    // 好友在线状态：变化先记账，刷新线程按周期给每个订阅会话推一帧合并后的 PRESENCE
+    m_presence.reset(new PresenceService(m_platform.userHandles, [this](uint64_t subscriber, const std::string& frame) {
+        SessionRef session = m_sessions.acquire(presenceSession(subscriber));
+        if (!session) return false;
+        {
+            std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+            if (!session->isLoggedIn || !session->presenceSubscribed) return false;
+        }
+        return session->socket.sendPipeMessage(frame);
+    }));
+    m_presence->start();
+
 }
 
 ChatServer::~ChatServer() {
     stop();
+    m_presence->stop();
 
     std::cout << "[ChatServer] 服务器正在关闭，保存数据..." << std::endl;
     if (!m_platform.save("data/users.txt", "data/groups.txt")) {
@@ -75,14 +184,19 @@ void ChatServer::stop() {
         m_serverSocket.close();
         m_serverSocket.cleanup();
 
-        // 清理所有客户端连接
-        for (auto client : m_activeClients) {
-            if (client) {
-                client->socket.close();
-                delete client;
+        // 清理所有客户端连接：句柄立即失效，仍被处理线程引用的会话在引用释放后析构；
+        // 句柄归各处理线程关闭，这里只停止收发
+        for (const auto& handle : m_sessions.handles()) {
+            if (SessionRef client = m_sessions.acquire(handle)) {
+                client->socket.shutdown();
             }
+            if (m_sessions.destroy(handle)) serverMetrics().sessions.dec();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_onlineMutex);
+            m_onlineUsers.clear();
         }
-        m_activeClients.clear();
+        serverMetrics().onlineUsers.set(0);
 
         std::cout << "服务器已停止" << std::endl;
     }
@@ -90,144 +204,56 @@ void ChatServer::stop() {
 
 
 
-void ChatServer::acceptNewClient() {
-    std::cout << "等待客户端连接..." << std::endl;
-
-    std::string clientIp;
-    uint16_t clientPort;
-    SocketHandle clientSocket = m_serverSocket.accept(clientIp, clientPort);
-
-    if (clientSocket == -1) {
-        std::cerr << "接受连接失败: " << m_serverSocket.getLastError() << std::endl;
-        return;
-    }
-
-    // 创建新的客户端会话，拥有真实的socket
-    TcpSocket realSocket;
-    realSocket.setHandle(clientSocket);
-    ClientSession* newClient = new ClientSession(clientIp, clientPort, std::move(realSocket));
-
-    m_activeClients.push_back(newClient);
-
-    std::cout << "新客户端连接成功: " << clientIp << ":" << clientPort << " (socket已初始化)" << std::endl;
+// 创建用户会话
+ChatServer::SessionHandle ChatServer::createSession(const std::string& ip, uint16_t port, TcpSocket&& socket) {
+    SessionHandle handle = m_sessions.create(ip, port, std::move(socket));
+    if (SessionRef session = m_sessions.acquire(handle)) session->handle = handle;
+    serverMetrics().sessions.inc();
+    return handle;
 }
 
-void ChatServer::handleClientMessages() {
-    std::cout << "处理客户端消息..." << std::endl;
-
-    if (m_activeClients.empty()) {
-        std::cout << "没有活动客户端" << std::endl;
-        return;
-    }
-
-    // 处理所有客户端的消息
-    for (auto client : m_activeClients) {
-        if (!client) {
-            continue;
-        }
-
-        if (!client->socket.isConnected()) {
-            std::cout << "客户端 " << client->ip << ":" << client->port << " 连接已断开，移除客户端" << std::endl;
-            // 断开连接的客户端从列表移除
-            for (auto it = m_activeClients.begin(); it != m_activeClients.end(); ++it) {
-                if (*it == client) {
-                    m_activeClients.erase(it);
-                    delete client;
-                    break;
-                }
-            }
-            continue;
-        }
-
-        std::string message;
-        ssize_t bytesRead = client->socket.recv(message, 1024);
-
-        if (bytesRead > 0) {
-            std::cout << "[" << client->ip << ":" << client->port << "] 收到消息: " << message << std::endl;
-
-            std::string response = processMessage(message, client, m_activeClients);
-
-            // 发送响应前验证连接
-            if (client && client->socket.isConnected()) {
-                if (client->socket.send(response)) {
-                    std::cout << "[" << client->ip << ":" << client->port << "] 响应发送成功" << std::endl;
-                } else {
-                    std::cout << "[" << client->ip << ":" << client->port << "] 响应发送失败: " << client->socket.getLastError() << std::endl;
-                }
-            }
-        }
-        else if (bytesRead == 0) {
-            std::cout << "客户端连接已关闭: " << client->ip << ":" << client->port << " (正常断开)" << std::endl;
-            // 标记客户端为断开状态
-            client->isLoggedIn = false;
-            client->socket.close();
-        }
-        else {
-            // 连接错误，检查错误码决定是否断开
-            int errorCode = client->socket.getLastErrorCode();
-            if (errorCode == 10054 || errorCode == 104 || errorCode == 10053) {  // 连接重置或已被破坏
-                std::cout << "客户端连接已断开 (Connection reset): " << client->ip << ":" << client->port << std::endl;
-                client->isLoggedIn = false;
-                client->socket.close();
-            } else if (errorCode == 10060) {  // 超时
-                // 超时忽略
-            } else {
-                std::cout << "客户端连接错误 (Error " << errorCode << "): " << client->ip << ":" << client->port << std::endl;
-                client->isLoggedIn = false;
-                client->socket.close();
-            }
-        }
+// 关闭用户会话：先下线再使句柄失效；其他线程仍持有的 SessionRef 释放后才真正析构
+void ChatServer::closeSession(SessionHandle session) {
+    if (SessionRef client = m_sessions.acquire(session)) {
+        markOffline(client.get());
+        client->socket.close();
     }
+    if (m_sessions.destroy(session)) serverMetrics().sessions.dec();
 }
 
-
-
-// 创建用户会话
-ChatServer::ClientSession* ChatServer::createSession(const std::string& ip, uint16_t port, TcpSocket&& socket) {
-    ClientSession* newSession = new ClientSession(ip, port, std::move(socket));
-    m_activeClients.push_back(newSession);
-    return newSession;
+std::string ChatServer::processMessage(const std::string& rawMessage, SessionHandle session) {
+    SessionRef client = m_sessions.acquire(session);
+    return processMessage(rawMessage, client.get());
 }
 
 std::string ChatServer::processMessage(const std::string& rawMessage, const std::string& clientId) {
-    ClientSession* currentClient = findClientByAddr(clientId);
+    SessionRef currentClient = findClientByAddr(clientId);
 
     if (rawMessage.substr(0, 5) == "LOGIN") {
-        if (currentClient == nullptr) {
-            // 这个分支应该不会执行，如果执行说明acceptNewClient有问题
-            std::cout << "[LOGIN WARNING] 未找到现有会话，acceptNewClient可能未执行" << std::endl;
+        if (!currentClient) {
+            // 这个分支应该不会执行，如果执行说明连接建立时没有创建会话
+            std::cout << "[LOGIN WARNING] 未找到现有会话，连接建立时可能未创建会话" << std::endl;
             size_t colon = clientId.find(':');
             if (colon != std::string::npos) {
                 std::string ip = clientId.substr(0, colon);
                 uint16_t port = (uint16_t)std::stoi(clientId.substr(colon + 1));
                 TcpSocket tempSocket; // 临时socket，将由ClientHandler设置
-                currentClient = new ClientSession(ip, port, std::move(tempSocket));
-                m_activeClients.push_back(currentClient);
-            }
-        }
-
-        // 为现有或新建的会话设置用户信息
-        if (currentClient) {
-            size_t pos = rawMessage.find('|');
-            if (pos != std::string::npos) {
-                std::string userId = rawMessage.substr(pos + 1);
-                currentClient->userId = userId;
-                currentClient->isLoggedIn = true;
-                std::cout << "[登录] 用户 " << userId << " 已成功登录，会话已激活 (IP: "
-                          << currentClient->ip << ":" << currentClient->port << ")" << std::endl;
+                currentClient = m_sessions.acquire(createSession(ip, port, std::move(tempSocket)));
             }
         }
-
-        return processMessage(rawMessage, currentClient, m_activeClients);
     }
 
-    // 对于非LOGIN消息，使用现有逻辑
-    return processMessage(rawMessage, currentClient, m_activeClients);
+    // 登录状态在下面的处理中设置
+    return processMessage(rawMessage, currentClient.get());
 }
 
-std::string ChatServer::processMessage(const std::string& rawMessage, ClientSession* currentClient, std::vector<ClientSession*>& activeClients) {
+std::string ChatServer::processMessage(const std::string& rawMessage, ClientSession* currentClient) {
+    ServerMetrics& metrics = serverMetrics();
+    ScopedTimer timer(metrics.processSeconds);
+
     // 先处理ACK消息
     if (rawMessage.substr(0, 3) == "ACK") {
+        metrics.ackReceived.inc();
         handleAck(rawMessage, currentClient);
         return "";  // ACK不需要响应
     }
@@ -238,78 +264,580 @@ std::string ChatServer::processMessage(const std::string& rawMessage, ClientSess
     }
 
     if (rawMessage.substr(0, 5) == "LOGIN") {
-        // 解析登录消息格式: LOGIN|userId
+        metrics.loginReceived.inc();
+        // 解析登录消息格式: LOGIN|userId[|deviceId][|COMPRESS:lz4[+dictId]]
         size_t pos = rawMessage.find('|');
-        std::string userId = (pos != std::string::npos) ? rawMessage.substr(pos + 1) : "";
+        std::string userId;
+        std::string deviceId;
+        std::string compressOffer;
+        if (pos != std::string::npos) {
+            size_t fieldPos = rawMessage.find('|', pos + 1);
+            userId = rawMessage.substr(pos + 1, fieldPos == std::string::npos ? std::string::npos : fieldPos - pos - 1);
+            while (fieldPos != std::string::npos) {
+                size_t next = rawMessage.find('|', fieldPos + 1);
+                std::string field = rawMessage.substr(fieldPos + 1, next == std::string::npos ? std::string::npos : next - fieldPos - 1);
+                if (field.compare(0, 9, "COMPRESS:") == 0) {
+                    compressOffer = field.substr(9);
+                } else if (deviceId.empty()) {
+                    deviceId = field;
+                }
+                fieldPos = next;
+            }
+        }
+        if (deviceId.empty()) deviceId = DEFAULT_DEVICE_ID;
 
         if (!userId.empty()) {
-            // 直接设置当前客户端的登录状态
-            currentClient->isLoggedIn = true;
-            currentClient->userId = userId;
-            std::cout << "[登录] 用户 " << userId << " 已成功登录 (IP: " << currentClient->ip << ":" << currentClient->port << ")" << std::endl;
-
-            // 登录成功后，捎带离线消息数据
-            return createBundledLoginResponse(userId);
+            // 先开启压缩再发应答：客户端看到应答里的 COMPRESS 后发来的帧可能已是压缩的
+            std::string loginFields = negotiateCompression(currentClient, compressOffer);
+            // 先登记设备游标再接入路由，避免登录过程中投递的消息被当成新设备的离线消息重发
+            registerDevice(userId, deviceId);
+            bindSession(currentClient, userId, deviceId);
+            std::cout << "[登录] 用户 " << userId << " 已成功登录 (设备: " << deviceId
+                      << ", IP: " << currentClient->ip << ":" << currentClient->port << ")" << std::endl;
+
+            // 登录成功后，捎带该设备未读的离线消息
+            return sendBundledLoginResponse(currentClient, userId, deviceId, loginFields);
         } else {
             std::cout << "[登录错误] 无效的用户ID" << std::endl;
             return "RESPONSE|ERROR|LOGIN_FAILED|登录失败：无效的用户ID";
         }
     }
+    else if (rawMessage.compare(0, 14, "MESSAGE_BATCH|") == 0) {
+        metrics.batchReceived.inc();
+        return processMessageBatch(rawMessage, loggedInUserId(currentClient));
+    }
     else if (rawMessage.substr(0, 7) == "MESSAGE") {
+        metrics.messageReceived.inc();
+        // 追踪：整条消息的处理过程，消息ID解析出来后再绑定
+        TraceSpan messageSpan("message");
         MessageData msgData;
-        if (!ProtocolProcessor::deserializeMessage(rawMessage, msgData)) {
-            std::cout << "[协议错误] 无法解析消息: " << rawMessage << std::endl;
-            return "RESPONSE|ERROR|PROTOCOL_ERROR|消息格式错误，请检查协议版本";
-        }
-
-        std::string senderId = msgData.senderId;
-        std::string recipientId = msgData.receiverId;
-        std::string content = msgData.content;
-
-        if (!senderId.empty() && !recipientId.empty()) {
-            // 检查接收方是否在线
-            if (isUserOnline(recipientId)) {
-                // 接收方在线，直接转发消息并等待ACK
-                ClientSession* recipientSession = findUserById(recipientId);
-                if (recipientSession && recipientSession->socket.isConnected()) {
-                    std::string forwardMessage = ProtocolProcessor::serializeMessage(msgData);
-                    bool success = sendMessageWithAck(recipientSession, forwardMessage);
-
-                    if (success) {
-                        std::cout << "[消息转发] ✅ 消息成功转发并确认至用户 " << recipientId << std::endl;
-                        return "RESPONSE|SUCCESS|MESSAGE_SENT|消息已发送并确认";
-                    } else {
-                        storeOfflineMessage(recipientId, forwardMessage);
-                        std::cout << "[离线消息] 转发失败，已保存为离线消息，发送者: " << senderId << std::endl;
-                        return "RESPONSE|ERROR|SEND_FAILED|转发失败，已保存为离线消息";
-                    }
-                } else {
-                    storeOfflineMessage(recipientId, ProtocolProcessor::serializeMessage(msgData));
-                    std::cout << "[离线消息] 接收者连接异常，已保存为离线消息，发送者: " << senderId << std::endl;
-                    return "RESPONSE|SUCCESS|MESSAGE_CACHED|接收者连接异常，已保存为离线消息";
-                }
-            } else {
-                // 接收方不在线，缓存消息
-                storeOfflineMessage(recipientId, ProtocolProcessor::serializeMessage(msgData));
-                std::cout << "[离线缓存] 接收方不在线，已缓存消息给用户 " << recipientId << std::endl;
-                return "RESPONSE|SUCCESS|MESSAGE_CACHED|消息已缓存";
-            }
-        }
-        std::cout << "[格式错误] 消息格式错误: " << rawMessage << std::endl;
-        return "RESPONSE|ERROR|INVALID_FORMAT|消息格式无效";
+        std::string error = prepareMessage(rawMessage, loggedInUserId(currentClient), msgData, messageSpan);
+        if (!error.empty()) return error;
+        return routeMessage(msgData);
+    }
+    else if (rawMessage.compare(0, 11, "FILE_OFFER|") == 0) {
+        metrics.fileOfferReceived.inc();
+        return offerFile(currentClient, rawMessage);
+    }
+    else if (rawMessage == "PRESENCE|SUBSCRIBE") {
+        return subscribePresence(currentClient);
+    }
+    else if (rawMessage.compare(0, 7, "STATUS|") == 0) {
+        return setPresenceStatus(currentClient, rawMessage);
+    }
+    else if (rawMessage.compare(0, 8, "HISTORY|") == 0) {
+        return queryHistory(currentClient, rawMessage);
     }
     else if (rawMessage.substr(0, 6) == "LOGOUT") {
+        metrics.logoutReceived.inc();
         if (currentClient) {
             std::string userId = currentClient->userId;
-            currentClient->isLoggedIn = false;
+            markOffline(currentClient);
             std::cout << "[登出] 用户 " << userId << " 已成功登出" << std::endl;
         }
         return "RESPONSE|SUCCESS|LOGOUT_OK|登出成功";
     }
 
+    metrics.unknownReceived.inc();
     return "RESPONSE|ERROR|UNKNOWN_COMMAND|未知命令";
 }
 
+std::string ChatServer::loggedInUserId(ClientSession* client) {
+    if (!client) return std::string();
+    std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+    return client->isLoggedIn ? client->userId : std::string();
+}
+
+std::string ChatServer::prepareMessage(const std::string& rawMessage, const std::string& sessionUserId,
+                                       MessageData& msgData, TraceSpan& messageSpan) {
+    TraceSpan decodeSpan("decode");
+    if (sessionUserId.empty()) return "RESPONSE|ERROR|NOT_LOGGED_IN|请先登录";
+    if (!ProtocolProcessor::deserializeMessage(rawMessage, msgData)) {
+        std::cout << "[协议错误] 无法解析消息: " << rawMessage << std::endl;
+        return "RESPONSE|ERROR|PROTOCOL_ERROR|消息格式错误，请检查协议版本";
+    }
+    if (msgData.senderId.empty() || msgData.receiverId.empty()) {
+        std::cout << "[格式错误] 消息格式错误: " << rawMessage << std::endl;
+        return "RESPONSE|ERROR|INVALID_FORMAT|消息格式无效";
+    }
+    // 只能以自己的身份发消息
+    if (msgData.senderId != sessionUserId) {
+        return "RESPONSE|ERROR|SENDER_MISMATCH|发送者与登录用户不一致";
+    }
+    // 私聊双方必须是本节点认识的用户，未知ID在这里拒绝，不分配句柄、不建会话流
+    if (m_platform.groups.find(msgData.receiverId) == m_platform.groups.end() &&
+        directStreamKey(msgData.senderId, msgData.receiverId) == 0) {
+        return "RESPONSE|ERROR|USER_NOT_FOUND|接收者不存在";
+    }
+
+    // 消息ID在路由时确定，整条消息只编码一次；之后转发、ACK跟踪、
+    // 离线缓存、群扇出共享同一块缓冲，不再按接收者复制
+    if (msgData.messageId.empty()) {
+        msgData.messageId = ProtocolProcessor::generateMessageId();
+    }
+    messageSpan.bind(msgData.messageId);
+    decodeSpan.bind(msgData.messageId);
+    decodeSpan.finish();
+    return std::string();
+}
+
+// 路由一条已解码、已分配消息ID的消息：群消息扇出，私聊投递到接收者的在线设备并等待ACK，
+// 没有在线设备时存入离线日志。返回给发送者的响应
+std::string ChatServer::routeMessage(MessageData& msgData) {
+    DirectRoute route;
+    std::string response;
+    if (startRoute(msgData, route, response)) return response;
+    if (route.remote) {
+        waitForward(*route.remote);
+        return completeForward(msgData, route);
+    }
+    finishDelivery(route.devices, route.deliveries, route.attempt, route.acked);
+    return completeRoute(msgData, route);
+}
+
+bool ChatServer::startRoute(MessageData& msgData, DirectRoute& route, std::string& response) {
+    ServerMetrics& metrics = serverMetrics();
+    const std::string& senderId = msgData.senderId;
+    const std::string& recipientId = msgData.receiverId;
+
+    // 接收方是群：分配群会话流序号、编码、扇出都在该流的顺序锁内，
+    // 同一个群的消息在每个成员连接上按序号顺序写出
+    TraceSpan routeSpan("route", msgData.messageId);
+    auto groupIt = m_platform.groups.find(recipientId);
+    if (groupIt != m_platform.groups.end()) {
+        routeSpan.finish();
+        // 与 HISTORY 一致：只有群成员能往群里发，不分配序号、不记历史、不扇出
+        if (!groupIt->second.members().contains(senderId)) {
+            response = "RESPONSE|ERROR|NOT_GROUP_MEMBER|不是该群成员";
+            return true;
+        }
+        metrics.routedGroup.inc();
+        std::unique_lock<std::mutex> order = nextSequence(groupStreamKey(recipientId), msgData.seq);
+        OfflineEntry entry{ ProtocolProcessor::encodeMessage(msgData), groupStreamKey(recipientId), msgData.seq };
+        recordHistory(msgData, true, entry.frame);
+        response = fanOutToGroup(groupIt->second, senderId, entry) + "|SEQ:" + std::to_string(msgData.seq);
+        return true;
+    }
+
+    bool online = isUserOnline(recipientId);
+    if (online) route.devices = findUserSessions(recipientId, &route.deviceIds);
+    // 集群：接收者在其他节点上的设备（转来的消息只投递本节点，不再转发）
+    std::vector<uint32_t> remoteNodes;
+    if (m_cluster && !route.forwarded) remoteNodes = m_cluster->locate(recipientId);
+    routeSpan.finish();
+
+    // 私聊：在 发送者->接收者 会话流的顺序锁内分配序号并写出（或转发、存入离线日志），
+    // 等待 ACK 在锁外进行，慢设备不会挡住同一会话的下一条消息。
+    // 转来的消息序号由发送者所在节点分配，帧原样投递；它们在链路读线程上按到达顺序逐条写出
+    route.deliveries.resize(1);
+    {
+        uint64_t stream = directStreamKey(senderId, recipientId);
+        std::unique_lock<std::mutex> order;
+        if (!route.forwarded) order = nextSequence(stream, msgData.seq);
+        route.deliveries[0] = BatchDelivery{ msgData.messageId, ProtocolProcessor::encodeMessage(msgData), stream, msgData.seq };
+        const MessageBuffer& frame = route.deliveries[0].frame;
+        if (!route.forwarded) recordHistory(msgData, false, frame);
+        // 本节点有设备时在这里等 ACK，其他节点上的设备只推送一份；否则转发给第一个节点，由它等 ACK
+        size_t pushFrom = 0;
+        if (route.devices.empty() && !remoteNodes.empty()) {
+            route.remote = forwardToNode(remoteNodes[0], frame);
+            pushFrom = 1;
+        }
+        for (size_t i = pushFrom; i < remoteNodes.size(); ++i) {
+            m_cluster->push(remoteNodes[i], std::vector<std::string>{ recipientId }, frame.data(), frame.size());
+        }
+        if (!route.devices.empty()) {
+            startDelivery(route.devices, route.deliveries, route.attempt);
+        } else if (!route.remote) {
+            cacheOffline(recipientId, OfflineEntry{ frame, stream, msgData.seq });
+        }
+    }
+    if (!route.devices.empty() || route.remote) return false;
+
+    std::string seqField = "|SEQ:" + std::to_string(msgData.seq);
+    metrics.routedOffline.inc();
+    if (online) {
+        std::cout << "[离线消息] 接收者连接异常，已保存为离线消息，发送者: " << senderId << std::endl;
+        response = "RESPONSE|SUCCESS|MESSAGE_CACHED|接收者连接异常，已保存为离线消息" + seqField;
+    } else {
+        std::cout << "[离线缓存] 接收方不在线，已缓存消息给用户 " << recipientId << std::endl;
+        response = "RESPONSE|SUCCESS|MESSAGE_CACHED|消息已缓存" + seqField;
+    }
+    return true;
+}
+
+std::string ChatServer::completeForward(const MessageData& msgData, DirectRoute& route) {
+    const BatchDelivery& delivery = route.deliveries[0];
+    return settleForward(msgData.receiverId, OfflineEntry{ delivery.frame, delivery.streamKey, delivery.seq }, *route.remote);
+}
+
+std::string ChatServer::completeRoute(const MessageData& msgData, DirectRoute& route) {
+    ServerMetrics& metrics = serverMetrics();
+    const std::string& senderId = msgData.senderId;
+    const std::string& recipientId = msgData.receiverId;
+    std::vector<std::string> delivered;
+    for (size_t d = 0; d < route.devices.size(); ++d) {
+        if (route.acked[d][0]) delivered.push_back(route.deviceIds[d]);
+    }
+    // 未确认的设备（以及当前不在线的已知设备）由离线游标补发
+    const BatchDelivery& delivery = route.deliveries[0];
+    storeOfflineMessage(recipientId, OfflineEntry{ delivery.frame, delivery.streamKey, delivery.seq }, delivered);
+    std::string seqField = "|SEQ:" + std::to_string(msgData.seq);
+
+    if (!delivered.empty()) {
+        metrics.routedDirect.inc();
+        std::cout << "[消息转发] ✅ 消息成功转发并确认至用户 " << recipientId
+                  << " (" << delivered.size() << "/" << route.devices.size() << " 台设备)" << std::endl;
+        return "RESPONSE|SUCCESS|MESSAGE_SENT|消息已发送并确认" + seqField;
+    }
+    metrics.routedOffline.inc();
+    std::cout << "[离线消息] 转发失败，已保存为离线消息，发送者: " << senderId << std::endl;
+    return "RESPONSE|ERROR|SEND_FAILED|转发失败，已保存为离线消息" + seqField;
+}
+
+// 文件登记：FILE_OFFER|receiverId|size|fileName。文件内容不走聊天连接，这里只在 blob 存储里登记，
+// 返回文件端口的上传凭据：RESPONSE|SUCCESS|FILE_READY|说明|FILE:id|TOKEN:uploadToken|PORT:port
+std::string ChatServer::offerFile(ClientSession* client, const std::string& rawMessage) {
+    if (!m_blobStore) return "RESPONSE|ERROR|FILE_DISABLED|服务器未开启文件传输";
+    std::string ownerId;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+        if (client->isLoggedIn) ownerId = client->userId;
+    }
+    if (ownerId.empty()) return "RESPONSE|ERROR|NOT_LOGGED_IN|请先登录";
+
+    // 文件名是最后一个字段，取剩余部分（其中的分隔符由存储替换掉）
+    size_t receiverEnd = rawMessage.find('|', 11);
+    size_t sizeEnd = receiverEnd == std::string::npos ? std::string::npos : rawMessage.find('|', receiverEnd + 1);
+    if (sizeEnd == std::string::npos) return "RESPONSE|ERROR|INVALID_FORMAT|格式: FILE_OFFER|接收者|字节数|文件名";
+    std::string receiverId = rawMessage.substr(11, receiverEnd - 11);
+    std::string sizeText = rawMessage.substr(receiverEnd + 1, sizeEnd - receiverEnd - 1);
+    std::string name = rawMessage.substr(sizeEnd + 1);
+    char* end = nullptr;
+    uint64_t size = std::strtoull(sizeText.c_str(), &end, 10);
+    if (sizeText.empty() || *end != '\0') return "RESPONSE|ERROR|INVALID_FORMAT|文件大小无效";
+    if (receiverId.empty()) return "RESPONSE|ERROR|INVALID_FORMAT|接收者为空";
+
+    BlobInfo blob;
+    std::string error;
+    if (!m_blobStore->create(ownerId, receiverId, name, size, blob, error)) {
+        return "RESPONSE|ERROR|FILE_REJECTED|" + error;
+    }
+    std::cout << "[文件] 用户 " << ownerId << " 登记文件 " << blob.id << " (" << blob.name << ", "
+              << size << " 字节) -> " << receiverId << std::endl;
+    return "RESPONSE|SUCCESS|FILE_READY|请通过文件端口上传|FILE:" + blob.id + "|TOKEN:" + blob.uploadToken +
+           "|PORT:" + std::to_string(m_filePort);
+}
+
+// 订阅好友在线状态：PRESENCE|SUBSCRIBE -> RESPONSE|SUCCESS|PRESENCE_SUBSCRIBED|好友数。
+// 之后在线 / 离开的好友随下一个刷新周期以 PRESENCE|好友:online|好友:away 推来，状态变化同样合并推送；
+// 重复订阅按当前好友列表重建订阅
+std::string ChatServer::subscribePresence(ClientSession* client) {
+    SessionRef self = m_sessions.acquire(client->handle);
+    if (!self) return "RESPONSE|ERROR|NOT_LOGGED_IN|请先登录";
+    std::string userId;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+        if (client->isLoggedIn) userId = client->userId;
+    }
+    if (userId.empty()) return "RESPONSE|ERROR|NOT_LOGGED_IN|请先登录";
+
+    std::vector<uint32_t> friends;
+    auto user = m_platform.users.find(userId);
+    if (user != m_platform.users.end()) {
+        friends.reserve(user->second.friends().size());
+        for (const auto& friendId : user->second.friends()) friends.push_back(m_platform.userHandles.intern(friendId));
+    }
+    // 先标记再订阅：首个刷新周期的发送检查看得到标记
+    {
+        std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+        if (!client->isLoggedIn || client->userId != userId) return "RESPONSE|ERROR|NOT_LOGGED_IN|请先登录";
+        client->presenceSubscribed = true;
+    }
+    size_t count = m_presence->subscribe(presenceSubscriberId(self.handle()), friends);
+    return "RESPONSE|SUCCESS|PRESENCE_SUBSCRIBED|" + std::to_string(count);
+}
+
+// 声明自己的状态：STATUS|away 或 STATUS|online，订阅了本用户的好友在下一个刷新周期收到变化
+std::string ChatServer::setPresenceStatus(ClientSession* client, const std::string& rawMessage) {
+    PresenceService::Status status;
+    if (!PresenceService::parseStatus(rawMessage.substr(7), status)) {
+        return "RESPONSE|ERROR|INVALID_FORMAT|格式: STATUS|online 或 STATUS|away";
+    }
+    std::string userId;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+        if (client->isLoggedIn) userId = client->userId;
+    }
+    if (userId.empty()) return "RESPONSE|ERROR|NOT_LOGGED_IN|请先登录";
+    m_presence->setAway(m_platform.userHandles.intern(userId), status == PresenceService::Status::AWAY);
+    return std::string("RESPONSE|SUCCESS|STATUS_OK|") + PresenceService::statusName(status);
+}
+
+// 会话历史：HISTORY|会话|beforeSeq|limit，会话为对方用户ID或群号（须是群成员），beforeSeq 为 0 取最新一页。
+// 应答按时间顺序捎带消息帧：RESPONSE|SUCCESS|HISTORY|历史消息|COUNT:n|NEXT:seq|MESSAGE|...|MESSAGE|...
+// NEXT 是下一页的 beforeSeq，0 表示没有更早的消息。历史消息只供展示，客户端不 ACK。
+// 整页须装进一帧（MAX_PIPE_MESSAGE_SIZE）：装不下时从最早的一条起舍去，NEXT 指向留下的第一条，
+// 舍去的由下一页取回；连最新一条都装不下时跳过它。读盘失败时回 HISTORY_UNAVAILABLE，不回缺了一段的页
+std::string ChatServer::queryHistory(ClientSession* client, const std::string& rawMessage) {
+    if (!m_history) return "RESPONSE|ERROR|HISTORY_DISABLED|服务器未开启消息历史";
+    std::string userId;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+        if (client->isLoggedIn) userId = client->userId;
+    }
+    if (userId.empty()) return "RESPONSE|ERROR|NOT_LOGGED_IN|请先登录";
+
+    std::vector<std::string> fields;
+    std::istringstream stream(rawMessage.substr(8));
+    std::string field;
+    while (std::getline(stream, field, '|')) fields.push_back(field);
+    if (fields.empty() || fields[0].empty()) {
+        return "RESPONSE|ERROR|INVALID_FORMAT|格式: HISTORY|会话|beforeSeq|limit";
+    }
+    uint64_t beforeSeq = fields.size() > 1 ? std::strtoull(fields[1].c_str(), nullptr, 10) : 0;
+    size_t limit = fields.size() > 2 ? std::strtoul(fields[2].c_str(), nullptr, 10) : 0;
+    if (limit == 0) limit = DEFAULT_HISTORY_PAGE;
+
+    const std::string& peer = fields[0];
+    auto group = m_platform.groups.find(peer);
+    bool isGroup = group != m_platform.groups.end();
+    if (isGroup && !group->second.members().contains(userId)) {
+        return "RESPONSE|ERROR|HISTORY_DENIED|不是该群成员";
+    }
+
+    std::vector<MessageBuffer> records;
+    uint64_t firstSeq = 0;
+    if (!m_history->page(historyConversation(userId, peer, isGroup), beforeSeq, limit, records, firstSeq)) {
+        return "RESPONSE|ERROR|HISTORY_UNAVAILABLE|历史记录暂时无法读取";
+    }
+
+    // 记录的序号从 firstSeq 起连续；舍去前 dropped 条，直到应答头和留下的记录装得进一帧
+    size_t bodyBytes = 0;
+    for (const MessageBuffer& record : records) bodyBytes += 1 + record.size();
+    size_t dropped = 0;
+    std::string header;
+    for (;;) {
+        uint64_t keptFirst = records.empty() ? 0 : firstSeq + std::min(dropped, records.size() - 1);
+        uint64_t next = keptFirst > 1 ? keptFirst : 0;
+        header = "RESPONSE|SUCCESS|HISTORY|历史消息|COUNT:" + std::to_string(records.size() - dropped) +
+                 "|NEXT:" + std::to_string(next);
+        if (dropped == records.size() || header.size() + bodyBytes <= TcpSocket::MAX_PIPE_MESSAGE_SIZE) break;
+        bodyBytes -= 1 + records[dropped].size();
+        ++dropped;
+    }
+
+    std::vector<TcpSocket::PipeSegment> segments;
+    segments.reserve((records.size() - dropped) * 2 + 1);
+    segments.push_back(TcpSocket::PipeSegment{ header.data(), header.size() });
+    for (size_t i = dropped; i < records.size(); ++i) {
+        segments.push_back(TcpSocket::PipeSegment{ "|", 1 });
+        segments.push_back(TcpSocket::PipeSegment{ records[i].data(), records[i].size() });
+    }
+    if (!client->socket.sendPipeMessage(segments.data(), segments.size())) {
+        return "RESPONSE|ERROR|HISTORY_FAILED|历史消息发送失败：" + client->socket.getLastError();
+    }
+    return "";
+}
+
+std::string ChatServer::historyConversation(const std::string& senderId, const std::string& receiverId, bool group) {
+    if (group) return "g:" + receiverId;
+    return senderId < receiverId ? "d:" + senderId + "," + receiverId : "d:" + receiverId + "," + senderId;
+}
+
+void ChatServer::recordHistory(const MessageData& msgData, bool group, const MessageBuffer& frame) {
+    if (m_history) m_history->append(historyConversation(msgData.senderId, msgData.receiverId, group), frame);
+}
+
+// 上传完成：以上传者的名义把引用消息（"[FILE]id:下载令牌:大小:文件名"）路由给接收方，
+// 接收方按普通消息收到、ACK，离线时进入离线日志
+std::string ChatServer::deliverFileReference(const BlobInfo& blob) {
+    MessageData msgData(ProtocolProcessor::generateMessageId(), blob.ownerId, blob.receiverId,
+                        FileReference::format(blob));
+    TraceSpan messageSpan("message", msgData.messageId);
+    std::string response = routeMessage(msgData);
+    std::cout << "[文件] 文件 " << blob.id << " 的引用消息已路由: " << response << std::endl;
+    return response;
+}
+
+// 批量消息：整批解码后一次路由。群消息、离线接收者逐条处理；在线私聊按会话流分组，
+// 每组消息一次写给接收者的各个在线设备、共用一个 ACK 等待窗口，而不是逐条发送再各等 3 秒。
+// 同一会话流的消息保持批内顺序；整批只回一条汇总响应。
+std::string ChatServer::processMessageBatch(const std::string& rawMessage, const std::string& sessionUserId) {
+    BatchRoute batch;
+    std::string response;
+    if (!startBatch(rawMessage, sessionUserId, batch, response)) return response;
+
+    for (auto& direct : batch.direct) {
+        finishDelivery(direct.devices, direct.deliveries, direct.attempt, direct.acked);
+        settleBatchRecipient(batch, direct);
+    }
+    for (const auto& forward : batch.forwarded) {
+        waitForward(*forward.reply);
+        settleBatchForward(batch, forward);
+    }
+    return finishBatch(batch);
+}
+
+bool ChatServer::startBatch(const std::string& rawMessage, const std::string& sessionUserId, BatchRoute& batch,
+                            std::string& response) {
+    ServerMetrics& metrics = serverMetrics();
+    if (sessionUserId.empty()) {
+        response = "RESPONSE|ERROR|NOT_LOGGED_IN|请先登录";
+        return false;
+    }
+    std::vector<std::string> frames;
+    if (!ProtocolProcessor::deserializeMessageBatch(rawMessage, frames)) {
+        response = "RESPONSE|ERROR|PROTOCOL_ERROR|批量消息格式错误";
+        return false;
+    }
+    if (frames.size() > MAX_BATCH_MESSAGES) {
+        response = "RESPONSE|ERROR|BATCH_TOO_LARGE|单批最多 " + std::to_string(MAX_BATCH_MESSAGES) + " 条消息";
+        return false;
+    }
+    metrics.batchSize.observe(static_cast<double>(frames.size()));
+    batch.total = frames.size();
+
+    for (const auto& raw : frames) {
+        MessageData msgData;
+        if (!ProtocolProcessor::deserializeMessage(raw, msgData) || msgData.senderId != sessionUserId) {
+            ++batch.invalid;
+            continue;
+        }
+        if (msgData.messageId.empty()) {
+            msgData.messageId = ProtocolProcessor::generateMessageId();
+        }
+        const std::string& recipientId = msgData.receiverId;
+
+        auto groupIt = m_platform.groups.find(recipientId);
+        if (groupIt != m_platform.groups.end()) {
+            if (!groupIt->second.members().contains(msgData.senderId)) {
+                ++batch.invalid;
+                continue;
+            }
+            metrics.routedGroup.inc();
+            uint64_t groupStream = groupStreamKey(recipientId);
+            std::unique_lock<std::mutex> order = nextSequence(groupStream, msgData.seq);
+            OfflineEntry entry{ ProtocolProcessor::encodeMessage(msgData), groupStream, msgData.seq };
+            recordHistory(msgData, true, entry.frame);
+            fanOutToGroup(groupIt->second, msgData.senderId, entry);
+            ++batch.grouped;
+            continue;
+        }
+        // 接收者在本节点在线：先按会话流归组，解码完后整组在顺序锁内分配序号并写出。
+        // 一个流在批内第一次出现时决定走哪条路，之后的消息跟随，流内序号与批内顺序一致
+        uint64_t stream = directStreamKey(msgData.senderId, recipientId);
+        if (stream == 0) {
+            ++batch.invalid;
+            continue;
+        }
+        auto slot = batch.directSlots.find(stream);
+        if (slot == batch.directSlots.end() && isUserOnline(recipientId)) {
+            slot = batch.directSlots.emplace(stream, batch.direct.size()).first;
+            batch.direct.emplace_back();
+            batch.direct.back().recipientId = recipientId;
+            batch.direct.back().streamKey = stream;
+        }
+        if (slot != batch.directSlots.end()) {
+            batch.direct[slot->second].messages.push_back(std::move(msgData));
+            continue;
+        }
+        std::unique_lock<std::mutex> order = nextSequence(stream, msgData.seq);
+        MessageBuffer frame = ProtocolProcessor::encodeMessage(msgData);
+        recordHistory(msgData, false, frame);
+        // 接收者在其他节点上：在顺序锁内转发，应答留到最后一起等
+        std::vector<uint32_t> remoteNodes;
+        if (m_cluster) remoteNodes = m_cluster->locate(recipientId);
+        std::shared_ptr<RemoteReply> reply = remoteNodes.empty() ? nullptr : forwardToNode(remoteNodes[0], frame);
+        for (size_t i = 1; i < remoteNodes.size(); ++i) {
+            m_cluster->push(remoteNodes[i], std::vector<std::string>{ recipientId }, frame.data(), frame.size());
+        }
+        if (reply) {
+            batch.forwarded.push_back(BatchRoute::Forwarded{ recipientId, OfflineEntry{ frame, stream, msgData.seq }, reply });
+            continue;
+        }
+        metrics.routedOffline.inc();
+        cacheOffline(recipientId, OfflineEntry{ frame, stream, msgData.seq });
+        ++batch.cached;
+    }
+
+    // 在线私聊：与单条消息一样，分配序号、编码、写出都在会话流的顺序锁内，
+    // 同一流的下一条消息（例如发送者另一台设备发来的）不会先于这一组写出；等待 ACK 在锁外
+    for (auto& direct : batch.direct) {
+        direct.devices = findUserSessions(direct.recipientId, &direct.deviceIds);
+        uint64_t seq = 0;
+        std::unique_lock<std::mutex> order = nextSequence(direct.streamKey, seq, direct.messages.size());
+        direct.deliveries.reserve(direct.messages.size());
+        for (MessageData& msgData : direct.messages) {
+            msgData.seq = seq++;
+            MessageBuffer frame = ProtocolProcessor::encodeMessage(msgData);
+            recordHistory(msgData, false, frame);
+            direct.deliveries.push_back(BatchDelivery{ msgData.messageId, std::move(frame), direct.streamKey, msgData.seq });
+        }
+        // 与单条消息一致：接收者在其他节点上的设备各推送一份，ACK 只在本节点等
+        if (m_cluster) {
+            for (uint32_t node : m_cluster->locate(direct.recipientId)) {
+                for (const BatchDelivery& delivery : direct.deliveries) {
+                    m_cluster->push(node, std::vector<std::string>{ direct.recipientId },
+                                    delivery.frame.data(), delivery.frame.size());
+                }
+            }
+        }
+        startDelivery(direct.devices, direct.deliveries, direct.attempt);
+    }
+    return true;
+}
+
+void ChatServer::settleBatchRecipient(BatchRoute& batch, const BatchRoute::Direct& direct) {
+    ServerMetrics& metrics = serverMetrics();
+    const std::string& recipientId = direct.recipientId;
+    const std::vector<std::string>& deviceIds = direct.deviceIds;
+    const std::vector<std::vector<bool>>& acked = direct.acked;
+    const std::vector<BatchDelivery>& deliveries = direct.deliveries;
+    for (size_t i = 0; i < deliveries.size(); ++i) {
+        std::vector<std::string> delivered;
+        for (size_t d = 0; d < deviceIds.size(); ++d) {
+            if (acked[d][i]) delivered.push_back(deviceIds[d]);
+        }
+        // 未确认的设备由离线游标补发
+        storeOfflineMessage(recipientId, OfflineEntry{ deliveries[i].frame, deliveries[i].streamKey, deliveries[i].seq },
+                            delivered);
+        if (!delivered.empty()) {
+            metrics.routedDirect.inc();
+            ++batch.sent;
+            continue;
+        }
+        // 与单条消息一致：没有在线设备算缓存成功，发出后无设备确认算失败
+        metrics.routedOffline.inc();
+        ++(deviceIds.empty() ? batch.cached : batch.failed);
+    }
+}
+
+// 转发的消息按接收节点的应答记账：送达并确认、缓存（接收节点或本节点）、发出后无设备确认
+void ChatServer::settleBatchForward(BatchRoute& batch, const BatchRoute::Forwarded& forward) {
+    std::string response = settleForward(forward.recipientId, forward.entry, *forward.reply);
+    if (response.find("|MESSAGE_SENT|") != std::string::npos) {
+        ++batch.sent;
+    } else if (response.find("|MESSAGE_CACHED|") != std::string::npos) {
+        ++batch.cached;
+    } else {
+        ++batch.failed;
+    }
+}
+
+std::string ChatServer::finishBatch(const BatchRoute& batch) {
+    std::cout << "[批量消息] " << batch.total << " 条：送达 " << batch.sent << "，缓存 " << batch.cached
+              << "，群消息 " << batch.grouped << "，未确认 " << batch.failed << "，无效 " << batch.invalid << std::endl;
+
+    bool ok = (batch.failed == 0 && batch.invalid == 0);
+    std::ostringstream response;
+    response << "RESPONSE|" << (ok ? "SUCCESS|BATCH_SENT" : "ERROR|BATCH_PARTIAL")
+             << "|批量消息已处理 " << batch.total << " 条"
+             << "|SENT:" << batch.sent << "|CACHED:" << batch.cached << "|GROUP:" << batch.grouped
+             << "|FAILED:" << batch.failed << "|INVALID:" << batch.invalid;
+    return response.str();
+}
+
 void ChatServer::broadcastToUser(const std::string& userId, const struct Message& msg) {
     // 简单的广播逻辑
     std::cout << "[广播] 消息转发至用户 " << userId << ": " << msg.content << std::endl;
@@ -324,168 +852,623 @@ std::string ChatServer::serializeMessage(const struct Message& msg) {
     return "MESSAGE|" + msg.fromId + "|" + msg.toId + "|" + msg.content + "|" + msg.getFormattedTime();
 }
 
-// 创建捎带离线消息的登录响应
-std::string ChatServer::createBundledLoginResponse(const std::string& userId) {
-    auto it = m_offlineMessages.find(userId);
-    if (it == m_offlineMessages.end() || it->second.empty()) {
-        std::cout << "[登录捎带] 用户 " << userId << " 没有离线消息" << std::endl;
-        return "RESPONSE|SUCCESS|LOGIN_OK|登录成功";
-    }
-
+// 登录响应捎带离线消息：从该设备的游标起取消息，以分段方式直接写入同一帧，不拼接成大字符串
+std::string ChatServer::sendBundledLoginResponse(ClientSession* client, const std::string& userId,
+                                                 const std::string& deviceId, const std::string& loginFields) {
     // 限制离线消息数量以避免响应太长
     const size_t MAX_OFFLINE_MESSAGES = 50;
-    size_t actualCount = std::min(it->second.size(), MAX_OFFLINE_MESSAGES);
 
-    std::cout << "[登录捎带] 用户 " << userId << " 有 " << it->second.size() << " 条离线消息，捎带前 " << actualCount << " 条" << std::endl;
+    // 在锁内复制要捎带的消息（只增加引用计数），发送在锁外进行
+    uint64_t endSeq = 0;
+    size_t available = 0;
+    std::vector<OfflineEntry> bundled = peekOffline(userId, deviceId, MAX_OFFLINE_MESSAGES, endSeq, available);
+    if (bundled.empty()) {
+        std::cout << "[登录捎带] 用户 " << userId << " (设备 " << deviceId << ") 没有离线消息" << std::endl;
+        return "RESPONSE|SUCCESS|LOGIN_OK|登录成功" + loginFields;
+    }
+    std::cout << "[登录捎带] 用户 " << userId << " (设备 " << deviceId << ") 有 " << available
+              << " 条离线消息，捎带前 " << bundled.size() << " 条" << std::endl;
+
+    // 构建捎带响应：头部 + 消息1 + "|" + 消息2 ...
+    std::string header = "RESPONSE|SUCCESS|LOGIN_OK|登录成功" + loginFields + "|OFFLINE_COUNT:" +
+                         std::to_string(bundled.size()) + "|";
+    std::vector<TcpSocket::PipeSegment> segments;
+    segments.reserve(bundled.size() * 2 + 1);
+    segments.push_back(TcpSocket::PipeSegment{ header.data(), header.size() });
+    size_t totalLength = header.size();
+    for (size_t i = 0; i < bundled.size(); ++i) {
+        if (i > 0) {
+            segments.push_back(TcpSocket::PipeSegment{ "|", 1 });
+            ++totalLength;
+        }
+        segments.push_back(TcpSocket::PipeSegment{ bundled[i].frame.data(), bundled[i].frame.size() });
+        totalLength += bundled[i].frame.size();
+    }
 
-    // 构建捎带响应
-    std::string bundledResponse = "RESPONSE|SUCCESS|LOGIN_OK|登录成功|OFFLINE_COUNT:" +
-                                  std::to_string(actualCount) + "|";
+    std::cout << "[登录捎带] 构造的捎带响应长度: " << totalLength << std::endl;
+    std::cout << "[登录捎带] 第一个消息预览: " << bundled.front().frame.view().substr(0, 200) << std::endl;
 
-    // 捎带离线消息
-    size_t messageIndex = 0;
-    for (const auto& offlineMsg : it->second) {
-        if (messageIndex >= actualCount) {
-            break; // 只发送指定数量的消息
+    if (!client->socket.sendPipeMessage(segments.data(), segments.size())) {
+        // 发送失败：游标不动，下次登录重新捎带
+        std::cout << "[登录捎带] 捎带响应发送失败，离线消息保留在队列中" << std::endl;
+        return "";
+    }
+
+    advanceCursor(userId, deviceId, endSeq);
+    serverMetrics().offlineDelivered.inc(bundled.size());
+    size_t remaining = available - bundled.size();
+    if (remaining == 0) {
+        std::cout << "[登录捎带] 设备 " << deviceId << " 已读完用户 " << userId << " 的离线消息" << std::endl;
+    } else {
+        std::cout << "[登录捎带] 用户 " << userId << " (设备 " << deviceId << ") 还剩余 " << remaining << " 条离线消息在队列中" << std::endl;
+    }
+    return "";
+}
+
+// 压缩请求格式：lz4 或 lz4+字典id；算法不认识、字典对不上或服务器关闭压缩时不开启，客户端照常收发明文
+std::string ChatServer::negotiateCompression(ClientSession* client, const std::string& offer) {
+    // 压缩上下文跟连接走：同一连接再次登录沿用第一次协商的结果
+    if (!client->compression.empty()) return client->compression;
+    if (!m_compression.enabled || offer.empty()) return "";
+    size_t plus = offer.find('+');
+    if (offer.substr(0, plus) != "lz4") return "";
+
+    const CompressionDictionary* dictionary = nullptr;
+    if (plus != std::string::npos) {
+        std::string dictId = offer.substr(plus + 1);
+        if (!m_compression.dictionary.empty() && dictId == m_compression.dictionary.id()) {
+            dictionary = &m_compression.dictionary;
+        } else if (dictId == CompressionDictionary::builtin().id()) {
+            dictionary = &CompressionDictionary::builtin();
+        } else {
+            // 客户端的解压上下文已按它的字典建好，不能改用别的字典，只能不压缩
+            return "";
+        }
+    }
+    if (!client->socket.enableCompression(dictionary, m_compression.minBytes)) return "";
+    serverMetrics().compressionNegotiated.inc();
+    std::cout << "[压缩] 连接 " << client->ip << ":" << client->port << " 开启 lz4"
+              << (dictionary ? " + 字典 " + dictionary->id() : std::string()) << std::endl;
+    client->compression = dictionary ? "|COMPRESS:lz4+" + dictionary->id() : "|COMPRESS:lz4";
+    return client->compression;
+}
+
+// 离线消息处理的辅助方法实现
+// 返回的 SessionRef 钉住会话，调用方使用期间会话不会因断线被析构
+std::vector<ChatServer::SessionRef> ChatServer::findUserSessions(const std::string& userId,
+                                                                 std::vector<std::string>* deviceIds) {
+    std::vector<SessionRef> result;
+    std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+    auto it = m_userSessions.find(userId);
+    if (it == m_userSessions.end()) return result;
+    for (SessionHandle handle : it->second) {
+        SessionRef session = m_sessions.acquire(handle);
+        if (!session || !session->isLoggedIn || !session->socket.isConnected()) continue;
+        if (deviceIds) deviceIds->push_back(session->deviceId);
+        result.push_back(std::move(session));
+    }
+    return result;
+}
+
+// 会话登录：同一连接换身份时先退出原身份；同一用户同一设备的旧会话被新会话顶替（不再路由，
+// 连接本身由它的处理线程照常结束）。会话集合与在线位在同一把锁内更新，不会与并发下线交错
+void ChatServer::bindSession(ClientSession* client, const std::string& userId, const std::string& deviceId) {
+    markOffline(client);
+    SessionRef self = m_sessions.acquire(client->handle);
+    if (!self) return;
+
+    std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+    auto& sessions = m_userSessions[userId];
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        SessionRef other = m_sessions.acquire(*it);
+        if (other && other->deviceId != deviceId) {
+            ++it;
+            continue;
         }
-        if (messageIndex > 0) {
-            bundledResponse += "|"; // 分隔符
+        if (other) {
+            other->isLoggedIn = false;
+            std::cout << "[多端登录] 用户 " << userId << " 的设备 " << deviceId << " 在新连接登录，旧连接 "
+                      << other->ip << ":" << other->port << " 不再接收消息" << std::endl;
         }
-        bundledResponse += offlineMsg;
-        messageIndex++;
+        it = sessions.erase(it);
     }
+    client->isLoggedIn = true;
+    client->userId = userId;
+    client->deviceId = deviceId;
+    client->deviceHandle = m_deviceHandles.intern(userId + "|" + deviceId);
+    sessions.push_back(self.handle());
+    markOnline(userId);
+}
 
-    std::cout << "[登录捎带] 构造的捎带响应长度: " << bundledResponse.length() << std::endl;
-    std::cout << "[登录捎带] 第一个消息预览: " << bundledResponse.substr(0, 200) << (bundledResponse.length() > 200 ? "..." : "") << std::endl;
+bool ChatServer::isUserOnline(const std::string& userId) {
+    uint32_t handle = m_platform.userHandles.lookup(userId);
+    if (handle == IdInterner::INVALID_HANDLE) return false;
+    std::lock_guard<std::mutex> lock(m_onlineMutex);
+    return m_onlineUsers.contains(handle);
+}
 
-    // 清空该用户的离线消息队列(已处理的消息)
-    if (actualCount >= it->second.size()) {
-        // 所有消息都已发送，清空队列
-        it->second.clear();
-        m_offlineMessages.erase(it);
-        std::cout << "[登录捎带] 已清空用户 " << userId << " 的离线消息队列" << std::endl;
-    } else {
-        // 移除已发送的消息，保留剩余消息
-        auto& messageQueue = it->second;
-        for (size_t i = 0; i < actualCount; ++i) {
-            if (!messageQueue.empty()) {
-                messageQueue.pop_front();
+// 调用方持有 m_sessionStateMutex：同一用户的上线 / 下线按顺序广播给其他节点
+void ChatServer::markOnline(const std::string& userId) {
+    uint32_t handle = m_platform.userHandles.intern(userId);
+    bool added;
+    {
+        std::lock_guard<std::mutex> lock(m_onlineMutex);
+        added = m_onlineUsers.add(handle);
+        serverMetrics().onlineUsers.set(static_cast<int64_t>(m_onlineUsers.cardinality()));
+    }
+    if (!added) return;
+    m_presence->setLocalOnline(handle, true);
+    if (m_cluster) m_cluster->publishPresence(userId, true);
+}
+
+// 会话下线；同一用户的其他设备仍在线时保留在线位
+void ChatServer::markOffline(ClientSession* session) {
+    if (!session) return;
+    std::string userId;
+    std::string deviceId;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+        if (!session->isLoggedIn) return;
+        session->isLoggedIn = false;
+        userId = session->userId;
+        deviceId = session->deviceId;
+        if (session->presenceSubscribed) {
+            session->presenceSubscribed = false;
+            m_presence->unsubscribe(presenceSubscriberId(session->handle));
+        }
+
+        bool lastSession = true;
+        auto it = m_userSessions.find(userId);
+        if (it != m_userSessions.end()) {
+            auto& sessions = it->second;
+            sessions.erase(std::remove_if(sessions.begin(), sessions.end(), [&](SessionHandle handle) {
+                SessionRef other = m_sessions.acquire(handle);
+                return !other || other.get() == session;
+            }), sessions.end());
+            lastSession = sessions.empty();
+            if (lastSession) m_userSessions.erase(it);
+        }
+
+        uint32_t handle = lastSession ? m_platform.userHandles.lookup(userId) : IdInterner::INVALID_HANDLE;
+        if (handle != IdInterner::INVALID_HANDLE) {
+            {
+                std::lock_guard<std::mutex> onlineLock(m_onlineMutex);
+                m_onlineUsers.remove(handle);
+                serverMetrics().onlineUsers.set(static_cast<int64_t>(m_onlineUsers.cardinality()));
             }
+            m_presence->setLocalOnline(handle, false);
+            if (m_cluster) m_cluster->publishPresence(userId, false);
         }
-        std::cout << "[登录捎带] 用户 " << userId << " 还剩余 " << messageQueue.size() << " 条离线消息在队列中" << std::endl;
     }
 
-    return bundledResponse;
+    // 记录设备最近在线时间，设备数超限时按它淘汰
+    std::lock_guard<std::mutex> lock(m_offlineMutex);
+    auto inbox = m_inboxes.find(userId);
+    if (inbox == m_inboxes.end()) return;
+    auto device = inbox->second.devices.find(deviceId);
+    if (device != inbox->second.devices.end()) device->second.lastSeen = std::chrono::steady_clock::now();
 }
 
-// 离线消息处理的辅助方法实现
-ChatServer::ClientSession* ChatServer::findUserById(const std::string& userId) {
-    for (auto client : m_activeClients) {
-        if (client && client->userId == userId && client->isLoggedIn) {
-            return client;
+RoaringBitmap ChatServer::onlineMembersBitmap(const Group& group) {
+    if (group.hasMemberBitmap()) {
+        std::lock_guard<std::mutex> lock(m_onlineMutex);
+        return RoaringBitmap::andOf(group.memberBitmap(), m_onlineUsers);
+    }
+    // 未开启位图的小群：逐个成员查在线位图
+    RoaringBitmap online;
+    std::lock_guard<std::mutex> lock(m_onlineMutex);
+    for (const auto& uid : group.members()) {
+        uint32_t handle = m_platform.userHandles.lookup(uid);
+        if (handle != IdInterner::INVALID_HANDLE && m_onlineUsers.contains(handle)) online.add(handle);
+    }
+    return online;
+}
+
+std::vector<std::string> ChatServer::onlineMembersOfGroup(const std::string& groupId) {
+    std::vector<std::string> result;
+    auto it = m_platform.groups.find(groupId);
+    if (it == m_platform.groups.end()) return result;
+
+    RoaringBitmap online = onlineMembersBitmap(it->second);
+    result.reserve(static_cast<size_t>(online.cardinality()));
+    online.forEach([&](uint32_t handle) { result.push_back(m_platform.userHandles.name(handle)); });
+    return result;
+}
+
+// 全部成员共享同一块 frame，在线推送和离线缓存都不复制消息字节
+std::string ChatServer::fanOutToGroup(const Group& group, const std::string& senderId, const OfflineEntry& entry) {
+    const MessageBuffer& frame = entry.frame;
+    RoaringBitmap online = onlineMembersBitmap(group);
+
+    // 在线成员直接推送（群消息不逐条等待ACK，避免一个慢成员拖住整个群）
+    TraceSpan fanOutSpan("group_fanout");
+    if (fanOutSpan.active()) fanOutSpan.bind(ProtocolProcessor::peekMessageId(frame));
+
+    // 每个在线成员推送到它的全部在线设备；写失败或不在线的已知设备由离线游标补发。
+    // 集群模式下成员在其他节点上的设备按节点归组，每个节点推送一帧
+    size_t delivered = 0;
+    std::map<uint32_t, std::vector<std::string>> remoteMembers;
+    online.forEach([&](uint32_t handle) {
+        const std::string& memberId = m_platform.userHandles.name(handle);
+        if (memberId == senderId) return;
+        if (m_cluster) {
+            for (uint32_t node : m_cluster->locate(memberId)) remoteMembers[node].push_back(memberId);
+        }
+        std::vector<std::string> deviceIds;
+        std::vector<SessionRef> devices = findUserSessions(memberId, &deviceIds);
+        std::vector<std::string> reached;
+        for (size_t d = 0; d < devices.size(); ++d) {
+            if (devices[d]->socket.sendPipeMessage(frame.data(), frame.size())) {
+                reached.push_back(deviceIds[d]);
+                serverMetrics().groupDeliveries.inc();
+            }
+        }
+        if (!reached.empty()) ++delivered;
+        storeOfflineMessage(memberId, entry, reached);
+    });
+
+    // 离线成员 = 全体成员 − 在线成员；其中在其他节点上在线的不缓存，推送给所在节点；
+    // 真正离线的按归属节点归组，每个归属节点推送一帧，由那边存入离线日志
+    size_t cached = 0;
+    std::map<uint32_t, std::vector<std::string>> homedMembers;
+    auto cacheFor = [&](const std::string& memberId) {
+        if (memberId == senderId) return;
+        if (m_cluster) {
+            std::vector<uint32_t> nodes = m_cluster->locate(memberId);
+            if (!nodes.empty()) {
+                for (uint32_t node : nodes) remoteMembers[node].push_back(memberId);
+                ++delivered;
+                return;
+            }
+            ++cached;
+            uint32_t owner = m_cluster->owner(memberId);
+            if (owner != 0 && owner != m_cluster->nodeId()) {
+                homedMembers[owner].push_back(memberId);
+                return;
+            }
+        } else {
+            ++cached;
+        }
+        storeOfflineMessage(memberId, entry);
+    };
+    if (group.hasMemberBitmap()) {
+        RoaringBitmap::andNotOf(group.memberBitmap(), online).forEach([&](uint32_t handle) {
+            cacheFor(m_platform.userHandles.name(handle));
+        });
+    } else {
+        for (const auto& memberId : group.members()) {
+            uint32_t handle = m_platform.userHandles.lookup(memberId);
+            if (handle == IdInterner::INVALID_HANDLE || !online.contains(handle)) cacheFor(memberId);
         }
     }
-    return nullptr;
+    for (const auto& members : remoteMembers) {
+        // 链路刚断开时推送失败：这些成员按离线处理
+        if (m_cluster->push(members.first, members.second, frame.data(), frame.size())) continue;
+        for (const auto& memberId : members.second) storeOfflineMessage(memberId, entry);
+    }
+    for (const auto& members : homedMembers) {
+        // 归属节点不可达：先存在本节点，链路恢复后由搬迁交给它
+        if (m_cluster->push(members.first, members.second, frame.data(), frame.size())) continue;
+        for (const auto& memberId : members.second) storeOfflineMessage(memberId, entry);
+    }
+
+    std::cout << "[群消息] 群 " << group.number() << " 在线投递 " << delivered
+              << " 人，离线缓存 " << cached << " 人" << std::endl;
+    return "RESPONSE|SUCCESS|GROUP_SENT|群消息已投递 " + std::to_string(delivered) +
+           " 人，离线缓存 " + std::to_string(cached) + " 人";
 }
 
-bool ChatServer::isUserOnline(const std::string& userId) {
-    return findUserById(userId) != nullptr;
+// ==================== 会话流序号 ====================
+
+// 私聊流 = (发送者句柄 << 32) | 接收者句柄，按方向区分；比较只涉及整数。
+// 只查找不分配：句柄一经分配不回收，不能让客户端填的任意ID撑大句柄表和流表
+uint64_t ChatServer::directStreamKey(const std::string& senderId, const std::string& receiverId) {
+    uint64_t sender = m_platform.userHandles.lookup(senderId);
+    uint64_t receiver = m_platform.userHandles.lookup(receiverId);
+    if (sender == IdInterner::INVALID_HANDLE || receiver == IdInterner::INVALID_HANDLE) return 0;
+    return (sender << 32) | receiver;
+}
+
+// 群流的高 32 位取 INVALID_HANDLE，不会与任何私聊流冲突
+uint64_t ChatServer::groupStreamKey(const std::string& groupId) {
+    return (uint64_t(IdInterner::INVALID_HANDLE) << 32) | m_groupStreams.intern(groupId);
+}
+
+uint64_t ChatServer::streamKeyOf(const MessageData& msg) {
+    if (m_platform.groups.find(msg.receiverId) != m_platform.groups.end()) return groupStreamKey(msg.receiverId);
+    return directStreamKey(msg.senderId, msg.receiverId);
+}
+
+std::unique_lock<std::mutex> ChatServer::nextSequence(uint64_t streamKey, uint64_t& seq, size_t count) {
+    ConversationStream* stream;
+    {
+        // unordered_map 的节点地址在插入后保持不变；waiters 不为 0 的流不会被淘汰
+        uint64_t nowMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        if (nowMs >= m_lastStreamSweepMs + STREAM_SWEEP_INTERVAL_MS) evictIdleStreams(nowMs);
+        auto result = m_streams.try_emplace(streamKey);
+        stream = &result.first->second;
+        // 新建的流（包括重启、淘汰后重建）由本节点开一个新纪元
+        if (result.second) stream->lastSeq = StreamSequence::base(nowMs - MessageId::EPOCH_MS, MessageId::nodeId());
+        stream->lastUsedMs = nowMs;
+        stream->waiters.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::unique_lock<std::mutex> order(stream->order);
+    stream->waiters.fetch_sub(1, std::memory_order_relaxed);
+    // 纪元内计数不够分：换一个更晚的纪元，一批序号不跨纪元
+    if (StreamSequence::counterOf(stream->lastSeq) + count > StreamSequence::COUNTER_MASK) {
+        uint64_t nowMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()) - MessageId::EPOCH_MS;
+        uint64_t epochMs = std::max(nowMs, StreamSequence::epochMsOf(stream->lastSeq) + 1);
+        stream->lastSeq = StreamSequence::base(epochMs, MessageId::nodeId());
+    }
+    seq = stream->lastSeq + 1;
+    stream->lastSeq += count;
+    return order;
 }
 
-void ChatServer::storeOfflineMessage(const std::string& recipientId, const std::string& message) {
+void ChatServer::evictIdleStreams(uint64_t nowMs) {
+    m_lastStreamSweepMs = nowMs;
+    for (auto it = m_streams.begin(); it != m_streams.end();) {
+        ConversationStream& stream = it->second;
+        // 空闲、没有线程等着拿锁、当前也没人持有锁，才能安全删除
+        if (stream.lastUsedMs + STREAM_IDLE_MS > nowMs || stream.waiters.load(std::memory_order_relaxed) != 0 ||
+            !stream.order.try_lock()) {
+            ++it;
+            continue;
+        }
+        stream.order.unlock();
+        it = m_streams.erase(it);
+    }
+}
+
+bool ChatServer::sessionAcked(ClientSession& session, uint64_t streamKey, uint64_t seq) {
+    if (seq == 0) return false;
+    std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+    auto it = session.ackedWindows.find(StreamSequence::windowKey(streamKey, seq));
+    return it != session.ackedWindows.end() && it->second.seen(seq);
+}
+
+bool ChatServer::storeOfflineMessage(const std::string& recipientId, const OfflineEntry& entry,
+                                     const std::vector<std::string>& deliveredDevices) {
+    const MessageBuffer& frame = entry.frame;
     // 检查消息是否为有效的MESSAGE格式
-    if (message.substr(0, 7) != "MESSAGE") {
+    if (!frame.startsWith("MESSAGE")) {
         std::cout << "[离线消息] 警告：尝试存储非MESSAGE格式的离线消息，已忽略" << std::endl;
-        return;
+        return false;
     }
 
-    // 检查当前用户离线消息数量上限
-    const size_t MAX_OFFLINE_PER_USER = 100;
-    auto& userMessages = m_offlineMessages[recipientId];
+    std::lock_guard<std::mutex> lock(m_offlineMutex);
+    UserInbox& inbox = m_inboxes[recipientId];
 
-    if (userMessages.size() >= MAX_OFFLINE_PER_USER) {
-        // 移除最老的消息，为新消息腾出空间
-        std::cout << "[离线消息] 用户 " << recipientId << " 的离线消息数量达到上限 (" << MAX_OFFLINE_PER_USER << ")，移除最老的消息" << std::endl;
-        userMessages.pop_front();
+    // 记下这次确认收到的设备；所有已知设备都收到过（包括之前在其他节点收到的）就不必进日志
+    bool allDelivered = !inbox.devices.empty();
+    for (auto& device : inbox.devices) {
+        if (std::find(deliveredDevices.begin(), deliveredDevices.end(), device.first) != deliveredDevices.end()) {
+            markReceived(device.second, entry);
+        } else if (!deviceReceived(device.second, entry)) {
+            allDelivered = false;
+        }
     }
+    if (allDelivered) return false;
 
-    // 将消息存储到全局离线消息队列中
-    userMessages.push_back(message);
-    std::cout << "[离线消息] 消息已缓存给用户 " << recipientId
-              << "，当前队列长度: " << userMessages.size()
-              << "，消息预览: " << message.substr(0, 80) << (message.length() > 80 ? "..." : "") << std::endl;
+    TraceSpan enqueueSpan("offline_enqueue");
+    if (enqueueSpan.active()) enqueueSpan.bind(ProtocolProcessor::peekMessageId(frame));
 
-    // 检查总的离线消息缓存是否过多
-    size_t totalMessages = 0;
-    for (const auto& userQueue : m_offlineMessages) {
-        totalMessages += userQueue.second.size();
+    // 检查当前用户离线消息数量上限；游标落在被丢弃部分的设备读取时从新的头部开始
+    if (inbox.log.size() >= MAX_OFFLINE_PER_USER) {
+        std::cout << "[离线消息] 用户 " << recipientId << " 的离线消息数量达到上限 (" << MAX_OFFLINE_PER_USER << ")，移除最老的消息" << std::endl;
+        inbox.log.pop_front();
+        ++inbox.baseSeq;
+        --m_offlineTotal;
+        serverMetrics().offlineEvicted.inc();
     }
 
+    // 日志中只存一份（只增加引用计数）
+    inbox.log.push_back(entry);
+
+    // 已收到这条的设备：读到日志末尾的直接越过它，仍有积压的补读时跳过它
+    for (auto& device : inbox.devices) skipReceived(inbox, device.second);
+
+    size_t totalMessages = ++m_offlineTotal;
+    serverMetrics().offlineStored.inc();
+    serverMetrics().offlineDepth.set(static_cast<int64_t>(totalMessages));
+    std::cout << "[离线消息] 消息已缓存给用户 " << recipientId
+              << "，当前队列长度: " << inbox.log.size()
+              << "，消息预览: " << frame.view().substr(0, 80) << (frame.size() > 80 ? "..." : "") << std::endl;
+
     if (totalMessages % 50 == 0) {  // 每50条消息输出一次统计信息
         std::cout << "[离线消息统计] 当前系统离线消息总数: " << totalMessages
-                  << "，分布在 " << m_offlineMessages.size() << " 个用户中" << std::endl;
+                  << "，分布在 " << m_inboxes.size() << " 个用户中" << std::endl;
+    }
+    return true;
+}
+
+void ChatServer::registerDevice(const std::string& userId, const std::string& deviceId) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_offlineMutex);
+    UserInbox& inbox = m_inboxes[userId];
+    auto it = inbox.devices.find(deviceId);
+    if (it == inbox.devices.end()) {
+        // 设备数超限：淘汰最久未上线的设备，它的游标不再拖住日志回收
+        if (inbox.devices.size() >= MAX_DEVICES_PER_USER) {
+            auto oldest = std::min_element(inbox.devices.begin(), inbox.devices.end(), [](const auto& a, const auto& b) {
+                return a.second.lastSeen < b.second.lastSeen;
+            });
+            std::cout << "[多端登录] 用户 " << userId << " 设备数达到上限 (" << MAX_DEVICES_PER_USER
+                      << ")，移除最久未上线的设备 " << oldest->first << std::endl;
+            inbox.devices.erase(oldest);
+        }
+        DeviceCursor cursor;
+        cursor.nextSeq = inbox.baseSeq;
+        it = inbox.devices.emplace(deviceId, cursor).first;
     }
+    it->second.lastSeen = now;
+    trimInbox(inbox);
 }
 
+std::vector<ChatServer::OfflineEntry> ChatServer::peekOffline(const std::string& userId, const std::string& deviceId,
+                                                              size_t limit, uint64_t& endSeq, size_t& available) {
+    std::vector<OfflineEntry> result;
+    available = 0;
+    std::lock_guard<std::mutex> lock(m_offlineMutex);
+    auto it = m_inboxes.find(userId);
+    if (it == m_inboxes.end()) return result;
+    const UserInbox& inbox = it->second;
+
+    auto device = inbox.devices.find(deviceId);
+    const DeviceCursor* cursor = device == inbox.devices.end() ? nullptr : &device->second;
+    uint64_t seq = cursor ? std::max(cursor->nextSeq, inbox.baseSeq) : inbox.baseSeq;
+    endSeq = seq;
+    // 在线时已收到的消息跳过；取满 limit 条后游标停在下一条未读消息上
+    for (; seq < inbox.endSeq(); ++seq) {
+        const OfflineEntry& entry = inbox.log[static_cast<size_t>(seq - inbox.baseSeq)];
+        if (cursor && deviceReceived(*cursor, entry)) {
+            if (result.size() == available) endSeq = seq + 1;
+            continue;
+        }
+        if (result.size() < limit) {
+            result.push_back(entry);
+            endSeq = seq + 1;
+        }
+        ++available;
+    }
+    return result;
+}
+
+void ChatServer::advanceCursor(const std::string& userId, const std::string& deviceId, uint64_t endSeq) {
+    std::lock_guard<std::mutex> lock(m_offlineMutex);
+    auto it = m_inboxes.find(userId);
+    if (it == m_inboxes.end()) return;
+    auto device = it->second.devices.find(deviceId);
+    if (device == it->second.devices.end()) return;  // 设备已被淘汰
+    device->second.nextSeq = std::max(device->second.nextSeq, endSeq);
+    device->second.lastSeen = std::chrono::steady_clock::now();
+    skipReceived(it->second, device->second);
+    trimInbox(it->second);
+}
+
+bool ChatServer::deviceReceived(const DeviceCursor& device, const OfflineEntry& entry) {
+    if (entry.seq == 0) return false;
+    auto window = device.received.find(StreamSequence::windowKey(entry.streamKey, entry.seq));
+    return window != device.received.end() && window->second.seen(entry.seq);
+}
+
+void ChatServer::markReceived(DeviceCursor& device, const OfflineEntry& entry) {
+    if (entry.seq == 0) return;
+    uint64_t key = StreamSequence::windowKey(entry.streamKey, entry.seq);
+    if (device.received.size() >= MAX_DEVICE_WINDOWS && device.received.find(key) == device.received.end()) {
+        device.received.erase(device.received.begin());
+    }
+    device.received[key].insert(entry.seq);
+}
+
+void ChatServer::skipReceived(const UserInbox& inbox, DeviceCursor& device) {
+    uint64_t seq = std::max(device.nextSeq, inbox.baseSeq);
+    while (seq < inbox.endSeq() && deviceReceived(device, inbox.log[static_cast<size_t>(seq - inbox.baseSeq)])) ++seq;
+    device.nextSeq = seq;
+}
+
+std::vector<std::string> ChatServer::receivedDevices(const std::string& userId, const OfflineEntry& entry) {
+    std::vector<std::string> result;
+    std::lock_guard<std::mutex> lock(m_offlineMutex);
+    auto it = m_inboxes.find(userId);
+    if (it == m_inboxes.end()) return result;
+    for (const auto& device : it->second.devices) {
+        if (deviceReceived(device.second, entry)) result.push_back(device.first);
+    }
+    return result;
+}
+
+// 回收所有已知设备都读过的日志头部；还没有设备登录过的用户保留到上限
+void ChatServer::trimInbox(UserInbox& inbox) {
+    if (inbox.devices.empty()) return;
+    uint64_t minSeq = inbox.endSeq();
+    for (const auto& device : inbox.devices) {
+        minSeq = std::min(minSeq, device.second.nextSeq);
+    }
+    size_t trimmed = 0;
+    while (!inbox.log.empty() && inbox.baseSeq < minSeq) {
+        inbox.log.pop_front();
+        ++inbox.baseSeq;
+        ++trimmed;
+    }
+    if (trimmed > 0) {
+        m_offlineTotal -= trimmed;
+        serverMetrics().offlineDepth.set(static_cast<int64_t>(m_offlineTotal));
+    }
+}
+
+// 按设备补发离线消息：每个在线设备从自己的游标读，每条等待该设备ACK后推进游标
 void ChatServer::deliverOfflineMessages(const std::string& userId) {
-    auto it = m_offlineMessages.find(userId);
-    if (it != m_offlineMessages.end() && !it->second.empty()) {
-        ClientSession* client = findUserById(userId);
-        if (client && client->socket.isConnected()) {
-            std::cout << "[离线消息] 向用户 " << userId << " 投递 " << it->second.size() << " 条离线消息" << std::endl;
-
-            // 创建离线消息通知
-            std::string offlineNotify = "RESPONSE|OFFLINE_MESSAGES|COUNT|" + std::to_string(it->second.size()) + "|离线消息准备投递";
-
-            // 发送离线消息通知(不需要ACK，直接发送)
-            if (!client->socket.sendPipeMessage(offlineNotify)) {
-                std::cout << "[离线消息] 离线消息通知发送失败，跳过离线消息投递" << std::endl;
-                return;
-            }
-            std::cout << "[离线消息] 已发送离线消息通知给用户" << std::endl;
-
-            // 依次投递离线消息，每条都等待ACK确认(为MESSAGE类型启用ACK)
-            size_t delivered = 0;
-            size_t failed = 0;
-
-            while (!it->second.empty() && failed < 3) {  // 最多连续失败3次就停止
-                std::string offlineMsg = it->second.front();
-                std::cout << "[离线消息] 投递 (" << (delivered + 1) << "/" << it->second.size() << "): " << offlineMsg << " 到用户 " << userId << std::endl;
-
-                if (sendMessageWithAck(client, offlineMsg)) {
-                    std::cout << "[离线消息] ✅ 消息确认收到" << std::endl;
-                    it->second.pop_front();
-                    delivered++;
-                    failed = 0;  // 重置失败计数
-                } else {
-                    std::cout << "[离线消息] ❌ 消息投递失败，ACK超时" << std::endl;
-                    failed++;
-
-                    if (failed >= 3) {
-                        std::cout << "[离线消息] 连续失败3次，停止投递剩余离线消息" << std::endl;
-                        break;
-                    }
-
-                    // 短暂延迟后重试
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                }
+    std::vector<std::string> deviceIds;
+    std::vector<SessionRef> devices = findUserSessions(userId, &deviceIds);
+
+    for (size_t d = 0; d < devices.size(); ++d) {
+        const SessionRef& client = devices[d];
+        const std::string& deviceId = deviceIds[d];
+        uint64_t seq = 0;
+        size_t pendingCount = 0;
+        peekOffline(userId, deviceId, 0, seq, pendingCount);
+        if (pendingCount == 0) {
+            continue;
+        }
+        std::cout << "[离线消息] 向用户 " << userId << " (设备 " << deviceId << ") 投递 " << pendingCount << " 条离线消息" << std::endl;
+
+        // 创建离线消息通知
+        std::string offlineNotify = "RESPONSE|OFFLINE_MESSAGES|COUNT|" + std::to_string(pendingCount) + "|离线消息准备投递";
+
+        // 发送离线消息通知(不需要ACK，直接发送)
+        if (!client->socket.sendPipeMessage(offlineNotify)) {
+            std::cout << "[离线消息] 离线消息通知发送失败，跳过该设备的离线消息投递" << std::endl;
+            continue;
+        }
+
+        // 依次投递，每条都等待ACK确认；等待ACK期间不持有离线队列锁
+        size_t delivered = 0;
+        size_t failed = 0;
+        size_t remaining = 0;
+
+        while (failed < 3) {  // 最多连续失败3次就停止
+            std::vector<OfflineEntry> next = peekOffline(userId, deviceId, 1, seq, remaining);
+            if (next.empty()) {
+                break;
             }
+            const OfflineEntry& offlineMsg = next.front();
+            std::cout << "[离线消息] 投递 (" << (delivered + 1) << "): " << offlineMsg.frame.view() << " 到用户 " << userId << std::endl;
+
+            if (sendMessageWithAck(client, offlineMsg, ProtocolProcessor::peekMessageId(offlineMsg.frame))) {
+                std::cout << "[离线消息] ✅ 消息确认收到" << std::endl;
+                advanceCursor(userId, deviceId, seq);
+                serverMetrics().offlineDelivered.inc();
+                delivered++;
+                failed = 0;  // 重置失败计数
+            } else {
+                std::cout << "[离线消息] ❌ 消息投递失败，ACK超时" << std::endl;
+                failed++;
 
-            std::cout << "[离线消息] 成功投递 " << delivered << " 条离线消息给用户 " << userId << ", 总共有 " << it->second.size() << " 条剩余未投递" << std::endl;
+                if (failed >= 3) {
+                    std::cout << "[离线消息] 连续失败3次，停止投递剩余离线消息" << std::endl;
+                    break;
+                }
 
-            // 如果队列为空，则移除该用户条目
-            if (it->second.empty()) {
-                m_offlineMessages.erase(it);
+                // 短暂延迟后重试
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
             }
         }
+
+        peekOffline(userId, deviceId, 0, seq, remaining);
+        std::cout << "[离线消息] 成功投递 " << delivered << " 条离线消息给用户 " << userId << " (设备 " << deviceId
+                  << "), 总共有 " << remaining << " 条剩余未投递" << std::endl;
     }
 }
 
 // 查找客户端通过IP:port
-ChatServer::ClientSession* ChatServer::findClientByAddr(const std::string& addr) {
+ChatServer::SessionRef ChatServer::findClientByAddr(const std::string& addr) {
     size_t colon = addr.find(':');
     if (colon == std::string::npos) {
-        return nullptr;
+        return SessionRef();
     }
 
     std::string ip = addr.substr(0, colon);
@@ -495,112 +1478,240 @@ ChatServer::ClientSession* ChatServer::findClientByAddr(const std::string& addr)
     try {
         port = (uint16_t)std::stoi(portStr);
     } catch (const std::exception&) {
-        return nullptr;
+        return SessionRef();
     }
 
-    for (auto client : m_activeClients) {
-        if (client && client->ip == ip && client->port == port) {
-            return client;
-        }
-    }
-    return nullptr;
+    // ip/port 在会话创建后不再修改，池锁内比较即可
+    return m_sessions.findIf([&](const ClientSession& client) {
+        return client.ip == ip && client.port == port;
+    });
 }
 
 // 简化消息处理接口
-bool ChatServer::receiveFromClient(void* sessionPtr, std::string& message, bool& active) {
-    ClientSession* session = reinterpret_cast<ClientSession*>(sessionPtr);
+bool ChatServer::receiveFromClient(SessionHandle handle, std::string& message, bool& active) {
+    SessionRef session = m_sessions.acquire(handle);
     if (!session || !session->socket.isConnected()) {
         active = false;
         return false;
     }
 
     message.clear();
-    return session->socket.receivePipeMessage(message, 1);
+    if (session->socket.receivePipeMessage(message, 1)) return true;
+
+    // 对端正常关闭：会话下线，结束处理循环
+    if (session->socket.getLastError() == "peer closed") {
+        markOffline(session.get());
+        session->socket.close();
+        active = false;
+    }
+    return false;
 }
 
-bool ChatServer::sendToClient(void* sessionPtr, const std::string& response) {
-    ClientSession* session = reinterpret_cast<ClientSession*>(sessionPtr);
+bool ChatServer::sendToClient(SessionHandle handle, const std::string& response) {
+    // 空响应表示无需回复（如 ACK、已直接发出的捎带登录响应）
+    if (response.empty()) {
+        return true;
+    }
+    SessionRef session = m_sessions.acquire(handle);
     if (!session || !session->socket.isConnected()) {
         return false;
     }
     return session->socket.sendPipeMessage(response);
 }
 
-// 发送消息并等待ACK确认
-bool ChatServer::sendMessageWithAck(ClientSession* targetClient, const std::string& message) {
+// 发送单条消息给一个设备并等待ACK确认；entry.frame 是已编码的 MESSAGE 帧，传输记录只持有其引用
+bool ChatServer::sendMessageWithAck(const SessionRef& targetClient, const OfflineEntry& entry, const std::string& messageId) {
+    const MessageBuffer& frame = entry.frame;
     if (!targetClient || !targetClient->socket.isConnected()) {
         return false;
     }
 
-    std::string messageToSend = message;
-    std::string messageId;
-
-    // 解析消息类型
-    Type msgType = ProtocolProcessor::parseProtocolType(message);
-
-    if (msgType == Message) {
-        // 处理MESSAGE类型 - 检查并设置messageId
-        MessageData msgData;
-        if (!ProtocolProcessor::deserializeMessage(message, msgData)) {
-            std::cout << "[协议错误] 无法解析MESSAGE类型消息: " << message << std::endl;
-            return false;
-        }
+    // 没有消息ID就无法匹配ACK，直接发送
+    if (messageId.empty()) {
+        std::cout << "[直接发送] 消息缺少ID，不等待ACK" << std::endl;
+        return targetClient->socket.sendPipeMessage(frame.data(), frame.size());
+    }
 
-        if (msgData.messageId.empty()) {
-            msgData.messageId = ProtocolProcessor::generateMessageId();
-            messageToSend = ProtocolProcessor::serializeMessage(msgData);
-            std::cout << "[消息ID] 生成MESSAGE新ID: " << msgData.messageId << std::endl;
-        } else {
-            std::cout << "[消息ID] 使用MESSAGE现有ID: " << msgData.messageId << std::endl;
-        }
-        messageId = msgData.messageId;
+    // 补发的帧带着原有序号，按日志里记下的会话流查本连接的确认窗口，已确认过的不再发送
+    std::vector<SessionRef> devices;
+    devices.push_back(m_sessions.acquire(targetClient.handle()));
+    std::vector<std::vector<bool>> acked;
+    return sendMessagesWithAck(devices,
+                               std::vector<BatchDelivery>{ BatchDelivery{ messageId, frame, entry.streamKey, entry.seq } },
+                               acked) == 1;
+}
 
-    } else if (msgType == Response) {
-        // 处理RESPONSE类型 - 发送但不等待ACK确认
-        std::cout << "[响应消息] 发送RESPONSE类型消息但不等待ACK: " << message << std::endl;
+// 投递并等待ACK：先登记全部传输记录（按 消息ID|设备ID 索引，同一条消息在各设备上分别确认），
+// 再把所有帧合并写给每个设备，最后在同一个截止时间前等待各条 ACK
+size_t ChatServer::sendMessagesWithAck(const std::vector<SessionRef>& devices, const std::vector<BatchDelivery>& deliveries,
+                                       std::vector<std::vector<bool>>& acked) {
+    DeliveryAttempt attempt;
+    startDelivery(devices, deliveries, attempt);
+    return finishDelivery(devices, deliveries, attempt, acked);
+}
 
-    } else {
-        // 其他不需要ACK的消息类型，直接发送
-        std::cout << "[直接发送] 无需ACK的消息类型，直接发送" << std::endl;
-        return targetClient->socket.sendPipeMessage(message);
+void ChatServer::startDelivery(const std::vector<SessionRef>& devices, const std::vector<BatchDelivery>& deliveries,
+                               DeliveryAttempt& attempt) {
+    attempt.sends.clear();
+    attempt.sends.resize(devices.size());
+    if (devices.empty() || deliveries.empty()) {
+        return;
     }
 
-    // 发送消息
-    if (!targetClient->socket.sendPipeMessage(messageToSend)) {
-        std::cout << "[发送失败] 消息发送失败，接收者: " << targetClient->userId << std::endl;
-        return false;
+    for (size_t d = 0; d < devices.size(); ++d) {
+        const SessionRef& target = devices[d];
+        if (!target || !target->socket.isConnected()) continue;
+        DeliveryAttempt::DeviceSend& send = attempt.sends[d];
+        send.alreadyAcked.assign(deliveries.size(), false);
+        {
+            std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+            send.recipientId = target->userId;
+            send.deviceId = target->deviceId;
+            send.deviceHandle = target->deviceHandle;
+        }
+        send.handles.resize(deliveries.size());
+        send.transmissions.resize(deliveries.size());
+        for (size_t i = 0; i < deliveries.size(); ++i) {
+            const BatchDelivery& delivery = deliveries[i];
+            if (sessionAcked(*target, delivery.streamKey, delivery.seq)) {
+                send.alreadyAcked[i] = true;
+                continue;
+            }
+            send.handles[i] = m_transmissions.create(delivery.messageId, delivery.frame, send.recipientId, send.deviceId,
+                                                     delivery.streamKey, delivery.seq, target.handle());
+            send.transmissions[i] = m_transmissions.acquire(send.handles[i]);
+        }
+    }
+    // 先登记再发送，避免ACK先于登记到达而被丢弃
+    attempt.messageKeys.clear();
+    for (const auto& delivery : deliveries) attempt.messageKeys.push_back(MessageId::key(delivery.messageId));
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        for (const auto& send : attempt.sends) {
+            for (size_t i = 0; i < send.handles.size(); ++i) {
+                if (!send.handles[i].valid()) continue;
+                m_pendingTransmissions[PendingKey{ attempt.messageKeys[i], send.deviceHandle }] = send.handles[i];
+            }
+        }
     }
 
-    // 对于非MESSAGE类型，直接返回成功（不需要ACK）
-    if (msgType != Message) {
-        std::cout << "[直接成功] 响应消息发送完成" << std::endl;
-        return true;
+    uint64_t writeStartNs = Tracer::enabled() ? Tracer::nowNs() : 0;
+    std::vector<TcpSocket::PipeSegment> segments;
+    segments.reserve(deliveries.size());
+    for (size_t d = 0; d < devices.size(); ++d) {
+        DeliveryAttempt::DeviceSend& send = attempt.sends[d];
+        if (send.handles.empty()) continue;
+        segments.clear();
+        for (size_t i = 0; i < deliveries.size(); ++i) {
+            if (send.handles[i].valid()) {
+                segments.push_back(TcpSocket::PipeSegment{ deliveries[i].frame.data(), deliveries[i].frame.size() });
+            }
+        }
+        send.sent = segments.empty() || devices[d]->socket.sendPipeMessages(segments.data(), segments.size());
+        if (!send.sent) {
+            std::cout << "[发送失败] 消息发送失败，接收者: " << send.recipientId << " (设备 " << send.deviceId << ")" << std::endl;
+        }
     }
+    attempt.sentAt = std::chrono::steady_clock::now();
+    attempt.sentNs = writeStartNs != 0 ? Tracer::nowNs() : 0;
+    if (TRACE_UNLIKELY(writeStartNs != 0)) {
+        for (const auto& delivery : deliveries) {
+            if (Tracer::sampled(delivery.messageId)) Tracer::record("write", delivery.messageId, writeStartNs, attempt.sentNs);
+        }
+    }
+}
 
-    // 创建传输记录并等待ACK（仅对MESSAGE类型）
-    auto transmission = std::make_unique<MessageTransmission>(
-        messageId, messageToSend, targetClient
-    );
+size_t ChatServer::finishDelivery(const std::vector<SessionRef>& devices, const std::vector<BatchDelivery>& deliveries,
+                                  DeliveryAttempt& attempt, std::vector<std::vector<bool>>& acked) {
+    acked.assign(devices.size(), std::vector<bool>(deliveries.size(), false));
+    if (devices.empty() || deliveries.empty()) {
+        return 0;
+    }
 
-    std::unique_lock<std::mutex> lock(transmission->mutex);
+    // 等待ACK确认，所有设备、所有消息共用 3 秒截止时间；本连接此前已确认过的直接算作确认
+    auto deadline = attempt.sentAt + std::chrono::seconds(ACK_TIMEOUT_SEC);
+    for (size_t d = 0; d < devices.size(); ++d) {
+        DeliveryAttempt::DeviceSend& send = attempt.sends[d];
+        if (!send.sent) continue;
+        for (size_t i = 0; i < deliveries.size(); ++i) {
+            if (send.alreadyAcked[i]) {
+                acked[d][i] = true;
+                continue;
+            }
+            MessageTransmission& trans = *send.transmissions[i];
+            std::unique_lock<std::mutex> lock(trans.mutex);
+            acked[d][i] = trans.cv.wait_until(lock, deadline, [&]() { return trans.acknowledged; });
+            noteAckWait(attempt, deliveries[i], acked[d][i], trans.acknowledgedAt);
+        }
+    }
+    return settleDelivery(deliveries, attempt, acked);
+}
 
-    // 将传输记录添加到待处理的映射中
-    m_pendingTransmissions[messageId] = std::move(transmission);
+void ChatServer::noteAckWait(const DeliveryAttempt& attempt, const BatchDelivery& delivery, bool acked,
+                             std::chrono::steady_clock::time_point acknowledgedAt) {
+    if (acked) {
+        serverMetrics().ackLatencySeconds.observe(std::chrono::duration<double>(acknowledgedAt - attempt.sentAt).count());
+    } else {
+        serverMetrics().ackTimeouts.inc();
+    }
+    if (TRACE_UNLIKELY(attempt.sentNs != 0) && Tracer::sampled(delivery.messageId)) {
+        Tracer::record("ack_wait", delivery.messageId, attempt.sentNs, Tracer::nowNs());
+    }
+}
 
-    // 等待ACK确认，最多等待3秒
-    auto& trans = *m_pendingTransmissions[messageId];
-    bool ackReceived = trans.cv.wait_for(lock, std::chrono::seconds(3),
-                                           [&]() { return trans.acknowledged; });
+size_t ChatServer::settleDelivery(const std::vector<BatchDelivery>& deliveries, DeliveryAttempt& attempt,
+                                  const std::vector<std::vector<bool>>& acked) {
+    size_t ackCount = 0;
+    for (size_t d = 0; d < attempt.sends.size(); ++d) {
+        const DeliveryAttempt::DeviceSend& send = attempt.sends[d];
+        if (!send.sent) continue;
+        size_t deviceAcks = 0;
+        for (size_t i = 0; i < deliveries.size(); ++i) {
+            if (acked[d][i]) ++deviceAcks;
+        }
+        ackCount += deviceAcks;
+        if (deliveries.size() == 1) {
+            if (deviceAcks == 1) {
+                std::cout << "[ACK成功] 消息 " << deliveries[0].messageId << " 已由设备 " << send.deviceId << " 确认收到" << std::endl;
+            } else {
+                std::cout << "[ACK超时] 消息 " << deliveries[0].messageId << " 未收到设备 " << send.deviceId << " 的确认，将由离线游标补发" << std::endl;
+            }
+        } else {
+            std::cout << "[批量投递] 接收者 " << send.recipientId << " (设备 " << send.deviceId << ")："
+                      << deviceAcks << "/" << deliveries.size() << " 条已确认" << std::endl;
+        }
+    }
 
-    // 无论是否有ACK，都从待处理映射中移除
-    m_pendingTransmissions.erase(messageId);
+    // 无论是否有ACK，都从待处理映射中移除（同键的新记录不受影响）
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        for (const auto& send : attempt.sends) {
+            for (size_t i = 0; i < send.handles.size(); ++i) {
+                if (!send.handles[i].valid()) continue;
+                auto it = m_pendingTransmissions.find(PendingKey{ attempt.messageKeys[i], send.deviceHandle });
+                if (it != m_pendingTransmissions.end() && it->second == send.handles[i]) {
+                    m_pendingTransmissions.erase(it);
+                }
+            }
+        }
+    }
+    for (auto& send : attempt.sends) {
+        send.transmissions.clear();
+        for (TransmissionHandle handle : send.handles) {
+            if (handle.valid()) m_transmissions.destroy(handle);
+        }
+    }
+    return ackCount;
+}
 
-    if (ackReceived) {
-        std::cout << "[ACK成功] 消息 " << messageId << " 已确认收到" << std::endl;
-        return true;
-    } else {
-        std::cout << "[ACK超时] 消息 " << messageId << " 未收到确认，重试后续消息失败时将保存为离线" << std::endl;
-        return false;
+void ChatServer::acknowledge(MessageTransmission& trans, std::chrono::steady_clock::time_point at) {
+    trans.acknowledged = true;
+    trans.acknowledgedAt = at;
+    trans.cv.notify_one();
+    if (trans.ackWaiter) {
+        std::function<void()> waiter;
+        waiter.swap(trans.ackWaiter);
+        waiter();
     }
 }
 
@@ -612,108 +1723,407 @@ void ChatServer::handleAck(const std::string& ackMessage, ClientSession* senderC
         return;
     }
 
-    if (ackData.receiverId != senderClient->userId) {
-        std::cout << "[ACK异常] 用户 " << senderClient->userId << " 确认其他用户的消息，消息ID: " << ackData.messageId << std::endl;
+    if (!senderClient) {
+        return;  // 未建立会话的连接发来的ACK
+    }
+
+    std::string userId;
+    std::string deviceId;
+    uint32_t deviceHandle;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+        userId = senderClient->userId;
+        deviceId = senderClient->deviceId;
+        deviceHandle = senderClient->deviceHandle;
+    }
+    if (ackData.receiverId != userId) {
+        std::cout << "[ACK异常] 用户 " << userId << " 确认其他用户的消息，消息ID: " << ackData.messageId << std::endl;
         return;
     }
 
-    // 查找并确认对应的传输记录
-    auto it = m_pendingTransmissions.find(ackData.messageId);
-    if (it != m_pendingTransmissions.end()) {
-        std::unique_lock<std::mutex> lock(it->second->mutex);
-        it->second->acknowledged = true;
-        it->second->cv.notify_one();
+    Tracer::mark("ack", ackData.messageId);
 
-        std::cout << "[ACK接收] 消息 " << ackData.messageId << " 已确认，由用户 " << ackData.receiverId << " 发送" << std::endl;
+    // 查找并确认该设备对应的传输记录
+    uint64_t messageKey = MessageId::key(ackData.messageId);
+    TransmissionRef trans;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        auto it = m_pendingTransmissions.find(PendingKey{ messageKey, deviceHandle });
+        if (it != m_pendingTransmissions.end()) trans = m_transmissions.acquire(it->second);
+    }
+    // 旧客户端的非数字ID按哈希取键，可能碰撞，核对一次原文
+    if (trans && MessageId::isHashedKey(messageKey) && trans->messageId != ackData.messageId) {
+        trans = TransmissionRef();
+    }
+    if (trans) {
+        uint64_t streamKey = 0;
+        uint64_t seq = 0;
+        {
+            std::unique_lock<std::mutex> lock(trans->mutex);
+            acknowledge(*trans, std::chrono::steady_clock::now());
+            streamKey = trans->streamKey;
+            seq = trans->seq;
+        }
+        // 记入本连接的确认窗口，之后的补发 / 重传跳过这条
+        if (seq != 0) {
+            std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+            auto& windows = senderClient->ackedWindows;
+            uint64_t key = StreamSequence::windowKey(streamKey, seq);
+            if (windows.size() >= MAX_SESSION_WINDOWS && windows.find(key) == windows.end()) {
+                windows.erase(windows.begin());
+            }
+            windows[key].insert(seq);
+        }
+
+        std::cout << "[ACK接收] 消息 " << ackData.messageId << " 已确认，由用户 " << ackData.receiverId
+                  << " 的设备 " << deviceId << " 发送" << std::endl;
     } else {
         std::cout << "[ACK无记录] 找到未知消息ID的ACK: " << ackData.messageId << std::endl;
     }
 }
 
-// 处理重试传输
-void ChatServer::processRetryTransmissions() {
-    if (m_pendingTransmissions.empty()) {
-        return;
+// ==================== 集群 ====================
+// 接收者不在本节点时：私聊转发到它所在的节点，由那边投递并等待 ACK，应答原样带回给发送者；
+// 群消息按节点归组推送。接收者不在任何节点上时，消息存到它在哈希环上的归属节点。
+// 节点之间的链路、用户目录、哈希环与请求配对见 ClusterNode。
+
+void ChatServer::setCluster(ClusterNode* cluster) {
+    m_cluster = cluster;
+    if (!cluster) return;
+    cluster->onForward([this](const std::string& frame) { return routeForwarded(frame); });
+    cluster->onPush([this](const std::vector<std::string>& users, const std::string& frame) {
+        deliverPushed(users, frame);
+    });
+    cluster->onPresence([this](const std::string& userId, uint32_t node, bool online) {
+        m_presence->setRemoteOnline(m_platform.userHandles.intern(userId), online);
+        if (!online) return;
+        size_t moved = handOffInbox(userId, node);
+        if (moved > 0) {
+            std::cout << "[集群] 用户 " << userId << " 在节点 " << node << " 上线，交接 " << moved << " 条离线消息" << std::endl;
+        }
+    });
+    cluster->onRebalance([this](const HashRing& before, const HashRing& after) { rebalance(before, after); });
+}
+
+std::shared_ptr<ChatServer::RemoteReply> ChatServer::forwardToNode(uint32_t node, const MessageBuffer& frame) {
+    auto reply = std::make_shared<RemoteReply>();
+    bool sent = m_cluster->forward(node, frame.data(), frame.size(), [reply](bool ok, const std::string& response) {
+        std::function<void()> waiter;
+        {
+            std::lock_guard<std::mutex> lock(reply->mutex);
+            reply->done = true;
+            reply->ok = ok;
+            reply->response = response;
+            waiter.swap(reply->waiter);
+        }
+        reply->cv.notify_one();
+        if (waiter) waiter();
+    });
+    return sent ? reply : nullptr;
+}
+
+void ChatServer::waitForward(RemoteReply& reply) {
+    std::unique_lock<std::mutex> lock(reply.mutex);
+    reply.cv.wait(lock, [&reply] { return reply.done; });
+}
+
+std::string ChatServer::settleForward(const std::string& recipientId, const OfflineEntry& entry, RemoteReply& reply) {
+    ServerMetrics& metrics = serverMetrics();
+    if (reply.ok) {
+        metrics.routedRemote.inc();
+        return reply.response;
     }
+    // 链路断开或超时：接收节点可能已经投递。缓存的这条推到接收者所在节点（归属节点或上线时交接）后，
+    // 已收到它的设备会被跳过
+    metrics.routedOffline.inc();
+    cacheOffline(recipientId, entry);
+    std::cout << "[集群] 转发给用户 " << recipientId << " 的消息没有应答，已保存为离线消息" << std::endl;
+    return "RESPONSE|SUCCESS|MESSAGE_CACHED|接收者所在节点无应答，已保存为离线消息|SEQ:" + std::to_string(entry.seq);
+}
 
-    auto now = std::chrono::steady_clock::now();
-    std::vector<std::string> completedTransmissions;
+std::function<std::string()> ChatServer::routeForwarded(const std::string& frame) {
+    auto msgData = std::make_shared<MessageData>();
+    if (!ProtocolProcessor::deserializeMessage(frame, *msgData) || msgData->messageId.empty() || msgData->seq == 0 ||
+        m_platform.groups.find(msgData->receiverId) != m_platform.groups.end()) {
+        std::cout << "[集群] 无法处理转来的消息: " << frame.substr(0, 80) << std::endl;
+        return [] { return std::string("RESPONSE|ERROR|PROTOCOL_ERROR|转发的消息格式错误"); };
+    }
+    Tracer::mark("forwarded", msgData->messageId);
+    // 发送者由转来消息的节点担保，可能还没在本节点出现过
+    m_platform.userHandles.intern(msgData->senderId);
+
+    auto route = std::make_shared<DirectRoute>();
+    route->forwarded = true;
+    std::string response;
+    if (startRoute(*msgData, *route, response)) return [response] { return response; };
+    return [this, msgData, route] {
+        finishDelivery(route->devices, route->deliveries, route->attempt, route->acked);
+        return completeRoute(*msgData, *route);
+    };
+}
+
+void ChatServer::deliverPushed(const std::vector<std::string>& users, const std::string& frame) {
+    // 其他节点推来的帧在这里解析一次，记下会话流与序号，之后补发不再解析
+    OfflineEntry entry{ MessageBuffer::copyOf(frame) };
+    MessageData msg;
+    if (ProtocolProcessor::deserializeMessage(frame, msg)) {
+        m_platform.userHandles.intern(msg.senderId);
+        entry.streamKey = streamKeyOf(msg);
+        entry.seq = msg.seq;
+    }
+    const MessageBuffer& buffer = entry.frame;
+    for (const auto& userId : users) {
+        std::vector<std::string> deviceIds;
+        std::vector<SessionRef> devices = findUserSessions(userId, &deviceIds);
+        // 已收到过的设备不再发送（例如转发超时后发送节点又缓存、交接过来的同一条）
+        std::vector<std::string> reached = receivedDevices(userId, entry);
+        for (size_t d = 0; d < devices.size(); ++d) {
+            if (std::find(reached.begin(), reached.end(), deviceIds[d]) != reached.end()) continue;
+            if (devices[d]->socket.sendPipeMessage(buffer.data(), buffer.size())) reached.push_back(deviceIds[d]);
+        }
+        storeOfflineMessage(userId, entry, reached);
+    }
+}
+
+size_t ChatServer::handOffInbox(const std::string& userId, uint32_t node) {
+    // 本节点也有设备在线时日志留给本地游标
+    if (isUserOnline(userId)) return 0;
+    std::deque<OfflineEntry> log;
+    {
+        std::lock_guard<std::mutex> lock(m_offlineMutex);
+        auto it = m_inboxes.find(userId);
+        if (it == m_inboxes.end() || it->second.log.empty()) return 0;
+        UserInbox& inbox = it->second;
+        log.swap(inbox.log);
+        inbox.baseSeq += log.size();
+        for (auto& device : inbox.devices) device.second.nextSeq = inbox.baseSeq;
+        m_offlineTotal -= log.size();
+        serverMetrics().offlineDepth.set(static_cast<int64_t>(m_offlineTotal));
+    }
+
+    const std::vector<std::string> users{ userId };
+    for (size_t i = 0; i < log.size(); ++i) {
+        if (m_cluster->push(node, users, log[i].frame.data(), log[i].frame.size())) continue;
+        // 链路断开：没推送出去的放回本节点的日志
+        for (size_t j = i; j < log.size(); ++j) storeOfflineMessage(userId, log[j]);
+        return i;
+    }
+    return log.size();
+}
 
-    for (auto& pair : m_pendingTransmissions) {
-        std::unique_lock<std::mutex> lock(pair.second->mutex);
+void ChatServer::cacheOffline(const std::string& recipientId, const OfflineEntry& entry) {
+    if (m_cluster) {
+        uint32_t owner = m_cluster->owner(recipientId);
+        if (owner != 0 && owner != m_cluster->nodeId() &&
+            m_cluster->push(owner, std::vector<std::string>{ recipientId }, entry.frame.data(), entry.frame.size())) {
+            return;
+        }
+    }
+    storeOfflineMessage(recipientId, entry);
+}
 
-        // 检查是否已经确认
-        if (pair.second->acknowledged) {
-            completedTransmissions.push_back(pair.first);
+void ChatServer::rebalance(const HashRing& before, const HashRing& after) {
+    ServerMetrics& metrics = serverMetrics();
+    const uint32_t self = m_cluster->nodeId();
+
+    // 一、离线日志：归属不在本节点的（环变化后搬走的区间，或归属节点不可达时暂存的）交给归属节点。
+    // 只扫描本节点已有的日志；每推送一批停一下，不让搬迁挤占链路上的实时消息
+    std::vector<std::pair<std::string, uint32_t>> inboxes;
+    {
+        std::lock_guard<std::mutex> lock(m_offlineMutex);
+        for (const auto& entry : m_inboxes) {
+            if (entry.second.log.empty()) continue;
+            uint32_t owner = after.owner(entry.first);
+            if (owner != 0 && owner != self) inboxes.emplace_back(entry.first, owner);
+        }
+    }
+    size_t movedInboxes = 0;
+    size_t movedMessages = 0;
+    for (size_t i = 0; i < inboxes.size() && m_cluster->isRunning(); ++i) {
+        size_t moved = handOffInbox(inboxes[i].first, inboxes[i].second);
+        if (moved > 0) {
+            ++movedInboxes;
+            movedMessages += moved;
+        }
+        if ((i + 1) % REBALANCE_BATCH_USERS == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(REBALANCE_PAUSE_MS));
+        }
+    }
+    metrics.rebalanceInboxes.inc(movedInboxes);
+    metrics.rebalanceMessages.inc(movedMessages);
+    if (movedInboxes > 0) {
+        std::cout << "[集群] 搬迁离线日志：" << movedInboxes << " 个用户，" << movedMessages << " 条消息" << std::endl;
+    }
+    if (before == after) return;
+
+    // 二、在线会话：只通知归属发生变化、新归属不是本节点的用户。通知均匀分散在 drain 窗口内，
+    // 客户端陆续改连，不会同时涌向新节点；旧连接在客户端断开前照常收发
+    std::vector<std::pair<std::string, uint32_t>> movedUsers;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionStateMutex);
+        for (const auto& entry : m_userSessions) {
+            if (entry.second.empty()) continue;
+            uint32_t owner = after.owner(entry.first);
+            if (owner != 0 && owner != self && owner != before.owner(entry.first)) movedUsers.emplace_back(entry.first, owner);
+        }
+    }
+    if (movedUsers.empty()) return;
+    std::cout << "[集群] 哈希环变化，" << movedUsers.size() << " 个在线用户将在 " << m_rebalanceDrainMs
+              << "ms 内陆续改连到新的归属节点" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    auto interval = std::chrono::milliseconds(m_rebalanceDrainMs) / movedUsers.size();
+    for (size_t i = 0; i < movedUsers.size(); ++i) {
+        auto due = start + interval * i;
+        while (m_cluster->isRunning() && std::chrono::steady_clock::now() < due) {
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                due - std::chrono::steady_clock::now(), std::chrono::milliseconds(100)));
+        }
+        if (!m_cluster->isRunning()) return;
+        std::string host;
+        uint16_t port = 0;
+        if (!m_cluster->clientEndpoint(movedUsers[i].second, host, port)) continue;   // 新归属不可达：留在本节点
+        std::string notice = "RECONNECT|" + host + "|" + std::to_string(port);
+        for (const SessionRef& session : findUserSessions(movedUsers[i].first)) {
+            if (session->socket.sendPipeMessage(notice)) metrics.rebalanceReconnects.inc();
+        }
+    }
+}
+
+// ==================== 协程处理 ====================
+// 与上面的同步路径共用 startRoute / startDelivery / settleDelivery 等步骤，只有等待的方式不同：
+// 等待下一帧挂在 transport 的可读回调上，等待 ACK 挂在传输记录的 ackWaiter 上，超时由调度器的定时器触发。
+// 顺序锁、会话锁都只在两次挂起之间持有。
+
+#if CHAT_HAVE_COROUTINES
+
+Task<bool> ChatServer::receiveFromClientAsync(SessionHandle handle, std::string& message, CoroutineScheduler& scheduler) {
+    while (true) {
+        SessionRef session = m_sessions.acquire(handle);
+        if (!session || !session->socket.isConnected()) co_return false;
+        TcpSocket& socket = session->socket;
+        if (!socket.hasTransport()) {
+            // 阻塞模式的连接没有可读通知，只能占着线程等
+            bool active = true;
+            session.reset();
+            if (receiveFromClient(handle, message, active)) co_return true;
+            if (!active) co_return false;
             continue;
         }
 
-        // 检查重试时间
-        if (now >= pair.second->nextRetryTime) {
-            if (pair.second->retryCount >= MAX_RETRIES) {
-                std::cout << "[重试失败] 消息 " << pair.first << " 已达到最大重试次数，保存为离线消息" << std::endl;
-                // 将消息保存为离线消息
-                MessageData msgData;
-                if (ProtocolProcessor::deserializeMessage(pair.second->content, msgData)) {
-                    storeOfflineMessage(msgData.receiverId, pair.second->content);
-                }
-                completedTransmissions.push_back(pair.first);
-                continue;
-            }
+        message.clear();
+        if (socket.receivePipeMessage(message, 0)) co_return true;
+        // 对端关闭或出错：连接结束，由调用方 closeSession
+        if (!socket.isConnected()) co_return false;
+        // 会话由 session 钉住，挂起期间 socket 不会被析构
+        co_await CallbackAwaiter(scheduler, [&socket](std::function<void()> wake) {
+            return socket.notifyWhenReadable(std::move(wake));
+        });
+    }
+}
 
-            // 尝试重新发送
-            auto& transmission = pair.second;
-            if (transmission->targetClient->socket.isConnected()) {
-                if (transmission->targetClient->socket.sendPipeMessage(transmission->content)) {
-                    transmission->retryCount++;
-                    transmission->nextRetryTime = now + std::chrono::milliseconds(RETRY_INTERVAL_MS * transmission->retryCount);
-
-                    std::cout << "[重试发送] 消息 " << pair.first << " 重试第 " << transmission->retryCount << " 次" << std::endl;
-                } else {
-                    std::cout << "[重试失败] 消息 " << pair.first << " 重试发送失败" << std::endl;
-                    transmission->retryCount++;
-                    transmission->nextRetryTime = now + std::chrono::milliseconds(RETRY_INTERVAL_MS * transmission->retryCount);
-                }
-            } else {
-                std::cout << "[重试取消] 目标客户端已断开，消息 " << pair.first << " 保存为离线" << std::endl;
-                MessageData msgData;
-                if (ProtocolProcessor::deserializeMessage(pair.second->content, msgData)) {
-                    storeOfflineMessage(msgData.receiverId, pair.second->content);
-                }
-                completedTransmissions.push_back(pair.first);
-            }
+Task<std::string> ChatServer::processMessageAsync(const std::string& rawMessage, SessionHandle session,
+                                                  CoroutineScheduler& scheduler) {
+    std::string sessionUserId;
+    {
+        SessionRef client = m_sessions.acquire(session);
+        if (!client || rawMessage.compare(0, 7, "MESSAGE") != 0) {
+            co_return processMessage(rawMessage, client.get());
         }
+        sessionUserId = loggedInUserId(client.get());
     }
 
-    // 清理已完成/失败的传输
-    for (const auto& msgId : completedTransmissions) {
-        m_pendingTransmissions.erase(msgId);
+    ServerMetrics& metrics = serverMetrics();
+    ScopedTimer timer(metrics.processSeconds);
+    if (rawMessage.compare(0, 14, "MESSAGE_BATCH|") == 0) {
+        metrics.batchReceived.inc();
+        co_return co_await processMessageBatchAsync(rawMessage, sessionUserId, scheduler);
     }
+
+    metrics.messageReceived.inc();
+    TraceSpan messageSpan("message");
+    MessageData msgData;
+    std::string error = prepareMessage(rawMessage, sessionUserId, msgData, messageSpan);
+    if (!error.empty()) co_return error;
+    co_return co_await routeMessageAsync(msgData, scheduler);
 }
 
-// 清理超时传输
-void ChatServer::cleanupTimeoutTransmissions() {
-    if (m_pendingTransmissions.empty()) {
-        return;
+Task<std::string> ChatServer::routeMessageAsync(MessageData& msgData, CoroutineScheduler& scheduler) {
+    DirectRoute route;
+    std::string response;
+    if (startRoute(msgData, route, response)) co_return response;
+    if (route.remote) {
+        co_await waitForwardAsync(*route.remote, scheduler);
+        co_return completeForward(msgData, route);
     }
+    co_await finishDeliveryAsync(route.devices, route.deliveries, route.attempt, route.acked, scheduler);
+    co_return completeRoute(msgData, route);
+}
 
-    auto now = std::chrono::steady_clock::now();
-    auto maxWaitTime = std::chrono::minutes(5);  // 最大等待时间5分钟
+Task<std::string> ChatServer::processMessageBatchAsync(const std::string& rawMessage, const std::string& sessionUserId,
+                                                       CoroutineScheduler& scheduler) {
+    BatchRoute batch;
+    std::string response;
+    if (!startBatch(rawMessage, sessionUserId, batch, response)) co_return response;
 
-    std::vector<std::string> timeoutTransmissions;
+    for (auto& direct : batch.direct) {
+        co_await finishDeliveryAsync(direct.devices, direct.deliveries, direct.attempt, direct.acked, scheduler);
+        settleBatchRecipient(batch, direct);
+    }
+    for (const auto& forward : batch.forwarded) {
+        co_await waitForwardAsync(*forward.reply, scheduler);
+        settleBatchForward(batch, forward);
+    }
+    co_return finishBatch(batch);
+}
 
-    for (const auto& pair : m_pendingTransmissions) {
-        const auto& transmission = pair.second;
-        auto elapsedTime = now - transmission->nextRetryTime;
+// 转发的应答由链路读线程（或超时清理）写入；ClusterNode 保证一定会应答，这里不另设截止时间
+Task<void> ChatServer::waitForwardAsync(RemoteReply& reply, CoroutineScheduler& scheduler) {
+    co_await CallbackAwaiter(scheduler, [&reply](std::function<void()> wake) {
+        std::lock_guard<std::mutex> lock(reply.mutex);
+        if (reply.done) return false;
+        reply.waiter = std::move(wake);
+        return true;
+    });
+}
 
-        if (elapsedTime > maxWaitTime) {
-            timeoutTransmissions.push_back(pair.first);
-        }
+Task<size_t> ChatServer::finishDeliveryAsync(const std::vector<SessionRef>& devices,
+                                             const std::vector<BatchDelivery>& deliveries,
+                                             DeliveryAttempt& attempt, std::vector<std::vector<bool>>& acked,
+                                             CoroutineScheduler& scheduler) {
+    acked.assign(devices.size(), std::vector<bool>(deliveries.size(), false));
+    if (devices.empty() || deliveries.empty()) {
+        co_return 0;
     }
 
-    // 清理超时传输
-    for (const auto& msgId : timeoutTransmissions) {
-        std::cout << "[清理超时] 超时消息已清理: " << msgId << std::endl;
-        m_pendingTransmissions.erase(msgId);
+    auto deadline = attempt.sentAt + std::chrono::seconds(ACK_TIMEOUT_SEC);
+    for (size_t d = 0; d < devices.size(); ++d) {
+        DeliveryAttempt::DeviceSend& send = attempt.sends[d];
+        if (!send.sent) continue;
+        for (size_t i = 0; i < deliveries.size(); ++i) {
+            if (send.alreadyAcked[i]) {
+                acked[d][i] = true;
+                continue;
+            }
+            // 已确认的不挂起；否则登记 ackWaiter，由 handleAck 或截止时间的定时器先到者恢复
+            MessageTransmission& trans = *send.transmissions[i];
+            auto armAck = [&trans](std::function<void()> wake) {
+                std::lock_guard<std::mutex> lock(trans.mutex);
+                if (trans.acknowledged) return false;
+                trans.ackWaiter = std::move(wake);
+                return true;
+            };
+            co_await CallbackAwaiter(scheduler, armAck, deadline);
+            std::chrono::steady_clock::time_point acknowledgedAt;
+            {
+                std::lock_guard<std::mutex> lock(trans.mutex);
+                acked[d][i] = trans.acknowledged;
+                acknowledgedAt = trans.acknowledgedAt;
+                trans.ackWaiter = nullptr;
+            }
+            noteAckWait(attempt, deliveries[i], acked[d][i], acknowledgedAt);
+        }
     }
+    co_return settleDelivery(deliveries, attempt, acked);
 }
+
+#endif // CHAT_HAVE_COROUTINES
@@ -6,8 +6,28 @@
 #include <deque>
 #include "../network/tcp_socket.hpp"
 #include "../core/Message.hpp"
+#include <chrono>
 #include <condition_variable>
 #include "../core/Platform.hpp"
+#include "../common/Protocol.hpp"
+#include "../common/RoaringBitmap.hpp"
+#include "../common/SlabPool.hpp"
+#include "../common/MessageBuffer.hpp"
+#include "../common/SequenceWindow.hpp"
+#include "../common/IdInterner.hpp"
+#include "../common/Compression.hpp"
+#include "../common/BlobStore.hpp"
+#include "../common/Task.hpp"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+class TraceSpan;
+class ClusterNode;
+class HashRing;
+class PresenceService;
+class HistoryStore;
 
 class ChatServer {
 public:
@@ -17,8 +37,15 @@ public:
         std::string ip;
         uint16_t port;
         std::string userId;
+        std::string deviceId;                     // 登录时声明的设备标识，同一用户的多个连接按它区分
+        uint32_t deviceHandle = IdInterner::INVALID_HANDLE;   // "用户ID|设备ID" 的整数句柄，ACK 索引用
         bool isLoggedIn = false;
+        std::string compression;                  // 已协商的压缩应答字段，同一连接再次登录时原样返回
         std::deque<std::string> offlineMessages;  // 离线消息队列
+        // 本连接已确认的消息序号（按会话流和纪元分窗口），补发/重传前先查，已确认的不再发送；m_sessionStateMutex 保护
+        std::unordered_map<uint64_t, SequenceWindow> ackedWindows;
+        bool presenceSubscribed = false;          // 已订阅好友在线状态（订阅者 id 即会话句柄）；m_sessionStateMutex 保护
+        SlabHandle handle;                        // 本会话在 m_sessions 中的句柄，createSession 时写入、之后不变
 
         ClientSession() : port(0) {}
         ClientSession(const std::string& ipAddr, uint16_t port)
@@ -27,10 +54,38 @@ public:
             : ip(ipAddr), port(port), socket(std::move(socket)), isLoggedIn(false) {}
     };
 
+    // 会话存放在对象池中，对外只暴露带代数校验的句柄；
+    // 使用会话时先 acquire() 得到 SessionRef，持有期间会话不会被析构
+    using SessionPool = SlabPool<ClientSession>;
+    using SessionHandle = SessionPool::Handle;
+    using SessionRef = SessionPool::Ref;
+
+    // 连接级压缩：客户端在 LOGIN 里带 COMPRESS:lz4[+字典id] 请求，服务器开启后在登录应答里回
+    // 同样的 COMPRESS 字段；请求带字典 id 时必须与服务器配置的字典或内置字典一致，否则不开启压缩
+    struct CompressionConfig {
+        bool enabled = true;
+        size_t minBytes = 48;                                     // 小于该长度的帧不压缩
+        CompressionDictionary dictionary = CompressionDictionary::builtin();
+    };
+
 public:
     ChatServer(Platform& pf);
     ~ChatServer();
 
+    // start 之前调用
+    void setCompression(const CompressionConfig& config) { m_compression = config; }
+    // 文件传输：FILE_OFFER 在 store 里登记上传，应答里告诉客户端文件端口；store 为空时拒绝 FILE_OFFER
+    void setFileTransfer(BlobStore* store, uint16_t port) { m_blobStore = store; m_filePort = port; }
+    // 会话历史：路由的每条消息在分配序号时追加到所属会话，HISTORY 请求分页读取；start 之前设置
+    void setHistory(HistoryStore* history) { m_history = history; }
+    // 文件上传完成后调用（文件传输线程上）：把引用消息路由给接收方，返回路由结果
+    std::string deliverFileReference(const BlobInfo& blob);
+    // 集群模式：在 cluster->start() 之前调用，登记转发 / 推送 / 目录变化的处理。
+    // 之后接收者不在本节点时，私聊转发到它所在的节点，群消息推送给各节点上的在线成员
+    void setCluster(ClusterNode* cluster);
+    // 哈希环变化后通知在线会话改连的时间窗口：drainMs 内均匀分散发出 RECONNECT
+    void setRebalanceDrain(int drainMs) { m_rebalanceDrainMs = drainMs; }
+
     bool start(uint16_t port);
     void stop();
     bool isRunning() const { return m_running; }
@@ -40,58 +95,222 @@ public:
 
     // 消息处理接口
     std::string processMessage(const std::string& rawMessage, const std::string& clientId = "");
-    std::string processMessage(const std::string& rawMessage, ClientSession* client, std::vector<ClientSession*>& activeClients);
+    std::string processMessage(const std::string& rawMessage, SessionHandle session);
+    std::string processMessage(const std::string& rawMessage, ClientSession* client);
 
     // 核心会话管理
-    ClientSession* createSession(const std::string& ip, uint16_t port, TcpSocket&& socket);
+    SessionHandle createSession(const std::string& ip, uint16_t port, TcpSocket&& socket);
+    // 连接结束时调用：会话下线、句柄失效，对象在最后一个引用释放后回收
+    void closeSession(SessionHandle session);
 
     // 消息处理接口
-    bool receiveFromClient(void* sessionPtr, std::string& message, bool& active);
-    bool sendToClient(void* sessionPtr, const std::string& response);
+    bool receiveFromClient(SessionHandle session, std::string& message, bool& active);
+    bool sendToClient(SessionHandle session, const std::string& response);
+
+#if CHAT_HAVE_COROUTINES
+    // 协程版处理（C++20）：行为与同步接口一致，但等待下一帧、等待 ACK 时挂起协程，不占线程。
+    // 收到一帧返回 true；连接已结束返回 false。会话需挂在 transport 上，否则退回阻塞读取
+    Task<bool> receiveFromClientAsync(SessionHandle session, std::string& message, CoroutineScheduler& scheduler);
+    // 私聊与批量消息在等待 ACK 时挂起；其余命令不等待，直接走同步的 processMessage
+    Task<std::string> processMessageAsync(const std::string& rawMessage, SessionHandle session,
+                                          CoroutineScheduler& scheduler);
+#endif
+
+    // 在线状态（位图维护，O(1) 查询）
+    bool isUserOnline(const std::string& userId);
+    // 群的在线成员：群成员位图 AND 在线用户位图
+    std::vector<std::string> onlineMembersOfGroup(const std::string& groupId);
 
 private:
-    // 新增的私有方法
-    void acceptNewClient();
-    void handleClientMessages();
+    // 离线日志里的一条：帧连同它所属的会话流与流内序号，补发时据此查确认窗口，不必再解析帧
+    struct OfflineEntry {
+        MessageBuffer frame;
+        uint64_t streamKey = 0;
+        uint64_t seq = 0;
+    };
 
     void broadcastToUser(const std::string& userId, const struct Message& msg);
     void broadcastToGroup(const std::string& groupId, const struct Message& msg);
     std::string serializeMessage(const struct Message& msg);
 
-    // 捎带离线消息处理
-    std::string createBundledLoginResponse(const std::string& userId);
-
+    // 捎带离线消息处理：有离线消息时直接分段发送捎带响应并返回空串，否则返回普通登录响应；
+    // loginFields 追加在"登录成功"之后（如压缩协商结果）
+    std::string sendBundledLoginResponse(ClientSession* client, const std::string& userId, const std::string& deviceId,
+                                         const std::string& loginFields = std::string());
+    // 处理 LOGIN 里的压缩请求：开启连接压缩并返回应答字段（"|COMPRESS:..."），不开启返回空串
+    std::string negotiateCompression(ClientSession* client, const std::string& offer);
+    // FILE_OFFER：登记待上传文件，返回上传凭据
+    std::string offerFile(ClientSession* client, const std::string& rawMessage);
+    // PRESENCE|SUBSCRIBE：订阅好友在线状态；STATUS|away / STATUS|online：声明自己的状态
+    std::string subscribePresence(ClientSession* client);
+    std::string setPresenceStatus(ClientSession* client, const std::string& rawMessage);
+    // HISTORY|会话|beforeSeq|limit：会话为对方用户ID或群号；直接发出分段响应，返回空串或错误响应
+    std::string queryHistory(ClientSession* client, const std::string& rawMessage);
+    // 私聊两个方向共用一个会话 "d:较小ID,较大ID"，群为 "g:群号"
+    static std::string historyConversation(const std::string& senderId, const std::string& receiverId, bool group);
+    // 调用方持有该消息会话流的顺序锁：历史中的顺序与序号分配顺序一致
+    void recordHistory(const MessageData& msgData, bool group, const MessageBuffer& frame);
+    // 解码 MESSAGE 并补上消息ID，messageSpan 绑定到该ID；发送者须是本连接登录的用户 sessionUserId。
+    // 失败返回给发送者的错误响应，成功返回空串
+    std::string prepareMessage(const std::string& rawMessage, const std::string& sessionUserId,
+                               MessageData& msgData, TraceSpan& messageSpan);
+    // 已登录会话的用户ID，未登录为空
+    std::string loggedInUserId(ClientSession* client);
+    // 路由一条已解码、已有消息ID的消息（私聊投递并等待ACK / 群扇出 / 离线缓存），返回给发送者的响应
+    std::string routeMessage(MessageData& msgData);
 
+    // 用户的全部在线设备（已登录且连接未断开）；deviceIds 非空时同时返回各会话的设备标识
+    std::vector<SessionRef> findUserSessions(const std::string& userId, std::vector<std::string>* deviceIds = nullptr);
+    // 会话登录为 userId/deviceId；同一设备的旧会话被顶下线
+    void bindSession(ClientSession* client, const std::string& userId, const std::string& deviceId);
 
     // 离线消息处理的辅助方法
-    ClientSession* findUserById(const std::string& userId);
-    bool isUserOnline(const std::string& userId);
-    void storeOfflineMessage(const std::string& recipientId, const std::string& message);
+    // 追加到用户的离线日志；deliveredDevices 为已确认收到的设备，所有已知设备都收到时不追加。
+    // 返回是否追加
+    bool storeOfflineMessage(const std::string& recipientId, const OfflineEntry& entry,
+                             const std::vector<std::string>& deliveredDevices = std::vector<std::string>());
     void deliverOfflineMessages(const std::string& userId);
+    // 设备登录时登记游标；新设备从日志中最早的保留消息开始读
+    void registerDevice(const std::string& userId, const std::string& deviceId);
+    // 从设备游标起最多取 limit 条（跳过该设备已收到的）；endSeq 为读完这些消息后游标应推进到的位置，
+    // available 为该设备未读总数
+    std::vector<OfflineEntry> peekOffline(const std::string& userId, const std::string& deviceId,
+                                          size_t limit, uint64_t& endSeq, size_t& available);
+    // 设备已收到序号 < endSeq 的消息：推进游标并回收所有设备都已读过的日志
+    void advanceCursor(const std::string& userId, const std::string& deviceId, uint64_t endSeq);
+
+    SessionRef findClientByAddr(const std::string& addr);
 
-    ClientSession* findClientByAddr(const std::string& addr);
+    // 在线位图维护
+    void markOnline(const std::string& userId);
+    void markOffline(ClientSession* session);
+    RoaringBitmap onlineMembersBitmap(const Group& group);
+    // 群消息扇出：在线成员直接投递，其余成员写入离线队列
+    std::string fanOutToGroup(const Group& group, const std::string& senderId, const OfflineEntry& entry);
 
-    // 消息重传管理
+    // 会话流：私聊按 发送者->接收者 方向、群聊按群各一条，序号在流内单调递增。
+    // order 锁覆盖"分配序号 + 编码 + 写出"，同一流的消息在每个连接上按序号顺序写出；
+    // 新建流（包括重启、流空闲被淘汰后重建）由本节点开一个新纪元（见 StreamSequence），
+    // 其他节点给同一个流编的号在各自的纪元里，接收方按纪元分开去重
+    struct ConversationStream {
+        uint64_t lastSeq = 0;
+        uint64_t lastUsedMs = 0;           // 由 m_streamsMutex 保护
+        std::atomic<uint32_t> waiters{0};  // 已取到流、还没拿到顺序锁的线程数；不为 0 时不淘汰
+        std::mutex order;
+    };
+    // 收发双方都必须是本节点认识的用户（已加载、登录过或集群通告过），否则返回 0，
+    // 客户端随意填写的ID不会被分配句柄
+    uint64_t directStreamKey(const std::string& senderId, const std::string& receiverId);
+    uint64_t groupStreamKey(const std::string& groupId);
+    uint64_t streamKeyOf(const MessageData& msg);
+    // 分配 count 个连续序号（seq 为第一个），返回持有该流顺序锁的 unique_lock
+    std::unique_lock<std::mutex> nextSequence(uint64_t streamKey, uint64_t& seq, size_t count = 1);
+    // 淘汰空闲超过 STREAM_IDLE_MS 且无人使用的流；调用方持有 m_streamsMutex
+    void evictIdleStreams(uint64_t nowMs);
+    // 会话是否已确认过该序号
+    bool sessionAcked(ClientSession& session, uint64_t streamKey, uint64_t seq);
+
+    // 离线日志：每个用户一份，消息只存一次；各设备只记自己的读取游标（下一条要读的序号）。
+    // 日志头部的消息在所有已知设备都读过后回收，单用户超过上限时丢弃最老的消息
+    // 每台设备还按会话流和纪元记录已确认收到的序号：补读日志、接收其他节点推来或交接来的消息时跳过，
+    // 同一条消息不会再投递给已收到它的设备
+    struct DeviceCursor {
+        uint64_t nextSeq = 0;
+        std::chrono::steady_clock::time_point lastSeen;
+        std::unordered_map<uint64_t, SequenceWindow> received;
+    };
+    struct UserInbox {
+        std::deque<OfflineEntry> log;     // 序号 baseSeq, baseSeq+1, ...
+        uint64_t baseSeq = 0;
+        std::unordered_map<std::string, DeviceCursor> devices;
+        uint64_t endSeq() const { return baseSeq + log.size(); }
+    };
+    void trimInbox(UserInbox& inbox);     // 调用方持有 m_offlineMutex
+    // 以下调用方持有 m_offlineMutex
+    static bool deviceReceived(const DeviceCursor& device, const OfflineEntry& entry);
+    static void markReceived(DeviceCursor& device, const OfflineEntry& entry);
+    static void skipReceived(const UserInbox& inbox, DeviceCursor& device);  // 游标越过紧随其后的已收到消息
+    // 已确认收到过这条消息的设备
+    std::vector<std::string> receivedDevices(const std::string& userId, const OfflineEntry& entry);
+
+    // 等待 ACK 的传输记录
+    // 传输记录同样放在对象池中：mutex/cv 在池槽位内原地构造，不再每条消息一次堆分配；
+    // 目标会话以句柄保存，会话断开后句柄失效。超时未确认的消息不重传，由离线游标补发
     struct MessageTransmission {
         std::string messageId;
-        std::string content;
-        ClientSession* targetClient;
-        int retryCount;
-        std::chrono::steady_clock::time_point nextRetryTime;
+        MessageBuffer frame;              // 与离线队列/群扇出共享同一块缓冲
+        std::string recipientId;
+        std::string deviceId;
+        uint64_t streamKey;
+        uint64_t seq;
+        SessionHandle targetSession;
         std::mutex mutex;
         bool acknowledged;
+        std::chrono::steady_clock::time_point acknowledgedAt;
         std::condition_variable cv;
+        std::function<void()> ackWaiter;  // 挂起等待的协程：确认时调用一次（mutex 保护）
 
-        MessageTransmission(const std::string& msgId, const std::string& msg, ClientSession* client)
-            : messageId(msgId), content(msg), targetClient(client),
-              retryCount(0), acknowledged(false) {
-            nextRetryTime = std::chrono::steady_clock::now();
-        }
+        MessageTransmission(const std::string& msgId, const MessageBuffer& msg, const std::string& recipient,
+                            const std::string& device, uint64_t stream, uint64_t sequence, SessionHandle target)
+            : messageId(msgId), frame(msg), recipientId(recipient), deviceId(device),
+              streamKey(stream), seq(sequence), targetSession(target), acknowledged(false) {}
     };
+    using TransmissionPool = SlabPool<MessageTransmission>;
+    using TransmissionHandle = TransmissionPool::Handle;
+    using TransmissionRef = TransmissionPool::Ref;
 
-    std::vector<ClientSession*> m_activeClients;
-    std::unordered_map<std::string, std::deque<std::string>> m_offlineMessages;  // 全局离线消息队列，按用户ID索引
-    std::unordered_map<std::string, std::unique_ptr<MessageTransmission>> m_pendingTransmissions;  // 等待ACK的消息
+    // 一次投递：startDelivery 登记传输记录并写出，finishDelivery 等待ACK并回收记录；
+    // 两步分开，写出可以放在会话流的顺序锁内，等待ACK放在锁外
+    struct DeliveryAttempt {
+        struct DeviceSend {
+            std::string recipientId;
+            std::string deviceId;
+            uint32_t deviceHandle = IdInterner::INVALID_HANDLE;
+            std::vector<TransmissionHandle> handles;    // 与 deliveries 对齐，已确认过的条目为空句柄
+            std::vector<TransmissionRef> transmissions;
+            std::vector<bool> alreadyAcked;             // 本连接此前已确认，不再写出
+            bool sent = false;
+        };
+        std::vector<DeviceSend> sends;
+        std::chrono::steady_clock::time_point sentAt;
+        uint64_t sentNs = 0;
+        std::vector<uint64_t> messageKeys;              // 与 deliveries 对齐的消息ID键
+    };
+
+    SessionPool m_sessions;
+    std::mutex m_sessionStateMutex;    // 保护会话的 userId / deviceId / isLoggedIn 及 m_userSessions
+    std::unordered_map<std::string, std::vector<SessionHandle>> m_userSessions;  // 用户 -> 已登录的各设备会话
+    RoaringBitmap m_onlineUsers;       // 在线用户句柄位图（句柄来自 m_platform.userHandles）
+    std::mutex m_onlineMutex;
+    std::unordered_map<std::string, UserInbox> m_inboxes;  // 离线日志与设备游标，按用户ID索引
+    size_t m_offlineTotal = 0;         // 离线日志中的消息总数（m_offlineMutex 保护）
+    std::mutex m_offlineMutex;
+    TransmissionPool m_transmissions;
+    // 等待ACK的传输记录：同一条消息在各设备上分别确认，键为 (消息ID的 64 位键, 设备句柄)，只做整数比较
+    struct PendingKey {
+        uint64_t messageKey;
+        uint32_t deviceHandle;
+        bool operator==(const PendingKey& o) const { return messageKey == o.messageKey && deviceHandle == o.deviceHandle; }
+    };
+    struct PendingKeyHash {
+        size_t operator()(const PendingKey& k) const noexcept {
+            return static_cast<size_t>((k.messageKey ^ (uint64_t(k.deviceHandle) << 40)) * 0x9E3779B97F4A7C15ULL);
+        }
+    };
+    std::unordered_map<PendingKey, TransmissionHandle, PendingKeyHash> m_pendingTransmissions;
+    std::mutex m_pendingMutex;
+    IdInterner m_deviceHandles;        // "用户ID|设备ID" -> 设备句柄
+    std::unordered_map<uint64_t, ConversationStream> m_streams;
+    std::mutex m_streamsMutex;
+    IdInterner m_groupStreams;         // 群号 -> 群会话流句柄
+    uint64_t m_lastStreamSweepMs = 0;
+    CompressionConfig m_compression;
+    BlobStore* m_blobStore = nullptr;
+    HistoryStore* m_history = nullptr;
+    uint16_t m_filePort = 0;
+    ClusterNode* m_cluster = nullptr;
+    int m_rebalanceDrainMs = DEFAULT_REBALANCE_DRAIN_MS;
+    std::unique_ptr<PresenceService> m_presence;   // 好友在线状态订阅，按周期合并推送
     bool m_running;
     Platform& m_platform;
     TcpSocket m_serverSocket;
@@ -99,12 +318,135 @@ private:
     std::unordered_map<std::string, TcpSocket*> clientSockets; // for threaded version
 
     static const size_t MAX_MESSAGE_SIZE = 1024;
-    static const int MAX_RETRIES = 3;
-    static const int RETRY_INTERVAL_MS = 1000;
+    static const int ACK_TIMEOUT_SEC = 3;            // 一次投递等待 ACK 的时间
+    static const size_t MAX_BATCH_MESSAGES = 500;
+    static const size_t MAX_OFFLINE_PER_USER = 100;
+    static const size_t MAX_DEVICES_PER_USER = 8;
+    static const size_t MAX_SESSION_WINDOWS = 256;   // 每个连接跟踪的会话流上限
+    static const size_t MAX_DEVICE_WINDOWS = 64;     // 每台设备记录已收序号的会话流上限
+    static const uint64_t STREAM_IDLE_MS = 10 * 60 * 1000;     // 会话流空闲多久后淘汰
+    static const uint64_t STREAM_SWEEP_INTERVAL_MS = 60 * 1000;
+    static const int DEFAULT_REBALANCE_DRAIN_MS = 10000;
+    static const size_t REBALANCE_BATCH_USERS = 64;  // 搬迁离线日志时每批的用户数
+    static const int REBALANCE_PAUSE_MS = 20;        // 批之间的停顿
+    static const size_t DEFAULT_HISTORY_PAGE = 50;   // HISTORY 未指定 limit 时的页大小
+
+    // 批量消息中发往同一在线接收者的一条
+    struct BatchDelivery {
+        std::string messageId;
+        MessageBuffer frame;
+        uint64_t streamKey;
+        uint64_t seq;
+    };
+    std::string processMessageBatch(const std::string& rawMessage, const std::string& sessionUserId);
+
+    // 转发到其他节点的一条消息的应答：链路读线程（或超时清理）写入，等待方是线程（cv）或协程（waiter）
+    struct RemoteReply {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+        bool ok = false;
+        std::string response;
+        std::function<void()> waiter;     // 挂起等待的协程：应答到达时调用一次（mutex 保护）
+    };
+
+    // 一条私聊的投递：startRoute 分配序号并写出，等待 ACK 之后 completeRoute 补存离线并生成应答；
+    // 接收者只在其他节点上时 startRoute 转发过去，等到应答后 completeForward 生成应答
+    struct DirectRoute {
+        bool forwarded = false;           // 由其他节点转来：序号已分配，只投递本节点的设备
+        std::vector<std::string> deviceIds;
+        std::vector<SessionRef> devices;
+        std::vector<BatchDelivery> deliveries;
+        DeliveryAttempt attempt;
+        std::vector<std::vector<bool>> acked;
+        std::shared_ptr<RemoteReply> remote;
+    };
+    // 返回 true 表示已经处理完（群消息、离线缓存），response 为应答；false 表示已写出（或已转发）、等待结果
+    bool startRoute(MessageData& msgData, DirectRoute& route, std::string& response);
+    std::string completeRoute(const MessageData& msgData, DirectRoute& route);
+    std::string completeForward(const MessageData& msgData, DirectRoute& route);
+
+    // 一批消息的路由：startBatch 解码并处理群消息和离线接收者，在线私聊按会话流分组，
+    // 每组在流的顺序锁内分配序号并写出；每组等待 ACK 后 settleBatchRecipient 记账，finishBatch 生成汇总应答
+    struct BatchRoute {
+        size_t total = 0;
+        size_t sent = 0, cached = 0, grouped = 0, failed = 0, invalid = 0;
+        // 发往本节点在线接收者的一组私聊（同一会话流，保持批内顺序）
+        struct Direct {
+            std::string recipientId;
+            uint64_t streamKey = 0;
+            std::vector<MessageData> messages;
+            std::vector<BatchDelivery> deliveries;
+            std::vector<std::string> deviceIds;
+            std::vector<SessionRef> devices;
+            DeliveryAttempt attempt;
+            std::vector<std::vector<bool>> acked;
+        };
+        std::vector<Direct> direct;                        // 按首次出现排序
+        std::unordered_map<uint64_t, size_t> directSlots;  // 会话流 -> direct 下标
+        // 接收者在其他节点上的消息：逐条转发，全部写出后再一起等应答
+        struct Forwarded {
+            std::string recipientId;
+            OfflineEntry entry;
+            std::shared_ptr<RemoteReply> reply;
+        };
+        std::vector<Forwarded> forwarded;
+    };
+    // 解码失败或超过条数上限时返回 false，response 为错误应答。发送者不是 sessionUserId、
+    // 发往自己不在的群的消息不路由，计入 invalid
+    bool startBatch(const std::string& rawMessage, const std::string& sessionUserId, BatchRoute& batch,
+                    std::string& response);
+    void settleBatchRecipient(BatchRoute& batch, const BatchRoute::Direct& direct);
+    void settleBatchForward(BatchRoute& batch, const BatchRoute::Forwarded& forward);
+    std::string finishBatch(const BatchRoute& batch);
+
+    // ==================== 集群 ====================
+    // 在顺序锁内转发给 node（保持会话流顺序）；链路不可用时返回空指针，由调用方存入离线日志
+    std::shared_ptr<RemoteReply> forwardToNode(uint32_t node, const MessageBuffer& frame);
+    static void waitForward(RemoteReply& reply);
+    // 转发结束：失败时存入本节点的离线日志（接收者上线时交接到它所在的节点），返回给发送者的响应
+    std::string settleForward(const std::string& recipientId, const OfflineEntry& entry, RemoteReply& reply);
+    // 收到其他节点转来的私聊：写给本节点的设备，返回等待 ACK 并生成应答的函数
+    std::function<std::string()> routeForwarded(const std::string& frame);
+    // 收到其他节点推送的消息（群消息、交接的离线日志）：写给本节点的设备，未送达的设备进离线日志
+    void deliverPushed(const std::vector<std::string>& users, const std::string& frame);
+    // 用户在 node 上线（或 node 成为它的归属节点）：本节点为他保存的离线日志整体推送过去，
+    // 之后由那边的游标补发。返回推送出去的条数
+    size_t handOffInbox(const std::string& userId, uint32_t node);
+    // 离线缓存到接收者的归属节点（一致性哈希环）；归属是本节点、单机运行或推送失败时存在本节点
+    void cacheOffline(const std::string& recipientId, const OfflineEntry& entry);
+    // 哈希环变化 / 链路建立后（ClusterNode 的搬迁线程上）：离线日志按批交给归属节点，
+    // 归属变化的在线用户按节奏收到 RECONNECT|host|port，陆续改连到新的归属节点
+    void rebalance(const HashRing& before, const HashRing& after);
+
+    // 同一组消息一次写给接收者的每个在线设备，所有设备共用一个 ACK 截止时间；
+    // acked[d][i] 表示设备 d 已确认第 i 条，返回确认总数
+    size_t sendMessagesWithAck(const std::vector<SessionRef>& devices, const std::vector<BatchDelivery>& deliveries,
+                               std::vector<std::vector<bool>>& acked);
+    void startDelivery(const std::vector<SessionRef>& devices, const std::vector<BatchDelivery>& deliveries,
+                       DeliveryAttempt& attempt);
+    size_t finishDelivery(const std::vector<SessionRef>& devices, const std::vector<BatchDelivery>& deliveries,
+                          DeliveryAttempt& attempt, std::vector<std::vector<bool>>& acked);
+    // 一条 ACK 等待结束：记录 ACK 延迟 / 超时指标和追踪
+    void noteAckWait(const DeliveryAttempt& attempt, const BatchDelivery& delivery, bool acked,
+                     std::chrono::steady_clock::time_point acknowledgedAt);
+    // 等待全部结束：按设备记日志，移除待确认索引并回收传输记录，返回确认总数
+    size_t settleDelivery(const std::vector<BatchDelivery>& deliveries, DeliveryAttempt& attempt,
+                          const std::vector<std::vector<bool>>& acked);
+    // 标记已确认并唤醒等待者（线程或协程）；调用方持有 trans.mutex
+    static void acknowledge(MessageTransmission& trans, std::chrono::steady_clock::time_point at);
+
+#if CHAT_HAVE_COROUTINES
+    Task<std::string> routeMessageAsync(MessageData& msgData, CoroutineScheduler& scheduler);
+    Task<std::string> processMessageBatchAsync(const std::string& rawMessage, const std::string& sessionUserId,
+                                               CoroutineScheduler& scheduler);
+    Task<void> waitForwardAsync(RemoteReply& reply, CoroutineScheduler& scheduler);
+    Task<size_t> finishDeliveryAsync(const std::vector<SessionRef>& devices, const std::vector<BatchDelivery>& deliveries,
+                                     DeliveryAttempt& attempt, std::vector<std::vector<bool>>& acked,
+                                     CoroutineScheduler& scheduler);
+#endif
 
     // 新增：消息传输方法
-    bool sendMessageWithAck(ClientSession* targetClient, const std::string& message);
+    bool sendMessageWithAck(const SessionRef& target, const OfflineEntry& entry, const std::string& messageId);
     void handleAck(const std::string& ackMessage, ClientSession* senderClient);
-    void processRetryTransmissions();
-    void cleanupTimeoutTransmissions();
 };
@@ -10,12 +10,72 @@
 #include <vector>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <functional>
 #include <stddef.h>
 #include <memory>
 #include <cstddef>
 
 #include "ChatServer.hpp"
 
+// ACK 不产生响应、不会等待，读到后直接在读循环里处理：不能排在一个正在等 ACK 的请求后面，
+// 否则双方互相发消息时都要等满 ACK 超时
+inline bool isAckFrame(const std::string &message)
+{
+    return message.compare(0, 3, "ACK") == 0;
+}
+
+// 一个连接上待处理的请求帧：读线程按到达顺序放入，处理线程依次取出，响应顺序与请求顺序一致。
+// 队列满时读线程等待，慢请求不会让单个连接无限堆积
+class PendingFrames
+{
+public:
+    static constexpr size_t CAPACITY = 256;
+
+    // 队列已关闭时返回 false
+    bool push(std::string frame)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_frames.size() < CAPACITY; });
+        if (m_closed)
+            return false;
+        m_frames.push_back(std::move(frame));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // 队列已关闭且取空时返回 false；关闭前放入的帧仍会被取出处理
+    bool pop(std::string &frame)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_frames.empty(); });
+        if (m_frames.empty())
+            return false;
+        frame = std::move(m_frames.front());
+        m_frames.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::deque<std::string> m_frames;
+    bool m_closed = false;
+};
+
 // 客户端连接处理器类
 class ClientHandler
 {
@@ -24,7 +84,7 @@ private:
     uint16_t clientPort;
     ChatServer &chatServer;
     std::atomic<bool> &serverRunning;
-    void* session = nullptr; // 管理的会话指针，ChatServer负责所有socket操作
+    ChatServer::SessionHandle session; // 会话句柄，ChatServer负责所有socket操作
 
 public:
     ClientHandler(TcpSocket &&socketRef, const std::string &ip, uint16_t port,
@@ -34,8 +94,8 @@ public:
         std::cout << "[ClientHandler] Created for client " << clientIp << ":" << clientPort << std::endl;
 
         // 直接创建会话，ChatServer 管理 socket
-        session = reinterpret_cast<void*>(chatServer.createSession(ip, port, std::move(socketRef)));
-        if (session)
+        session = chatServer.createSession(ip, port, std::move(socketRef));
+        if (session.valid())
         {
             std::cout << "[ClientHandler] ✅ ClientSession created successfully, ChatServer now manages socket" << std::endl;
         }
@@ -49,6 +109,17 @@ public:
 
     void operator()()
     {
+        // 读线程只收帧：ACK 当场处理，其余请求交给本连接的处理线程按顺序处理并回复。
+        // 处理线程等 ACK 期间读线程照常读，对方回来的 ACK 不会被卡住
+        PendingFrames pending;
+        std::thread worker([this, &pending] {
+            std::string frame;
+            while (pending.pop(frame))
+            {
+                chatServer.sendToClient(session, respond(frame));
+            }
+        });
+
         try
         {
             std::cout << "[Server] Started handling client: " << clientIp << ":" << clientPort << std::endl;
@@ -78,32 +149,13 @@ public:
                     std::cout << "[Server] RECEIVED from " << clientIp << ":" << clientPort
                               << " [" << message.length() << " bytes]: '" << message << "'" << std::endl;
 
-                    try
+                    if (isAckFrame(message))
                     {
-                        // 快速路径优化：先检查是否是管道消息
-                        if (message.find("|") != std::string::npos)
-                        {
-                            // ChatServer 处理消息
-                            std::string response = chatServer.processMessage(message, clientIp + ":" + std::to_string(clientPort));
-                            chatServer.sendToClient(session, response);
-                        }
-                        else if (message.length() > 0)
-                        {
-                            // 对于非管道消息，发送通用成功响应
-                            chatServer.sendToClient(session, "RESPONSE|SUCCESS|MESSAGE_RECEIVED");
-                        }
-                        // 忽略空消息，不输出日志
+                        respond(message);
                     }
-                    catch (const std::exception &e)
+                    else if (!pending.push(message))
                     {
-                        std::cerr << "[Server] Exception from " << clientIp << ":" << clientPort
-                                  << ": " << e.what() << std::endl;
-                        chatServer.sendToClient(session, "RESPONSE|ERROR|Processing failed: " + std::string(e.what()));
-                    }
-                    catch (...)
-                    {
-                        std::cerr << "[Server] Unknown exception from " << clientIp << ":" << clientPort << std::endl;
-                        chatServer.sendToClient(session, "RESPONSE|ERROR|Unknown processing error");
+                        break;
                     }
                 }
             }
@@ -119,10 +171,217 @@ public:
         {
             std::cerr << "[Server] Unknown exception in client handler for " << clientIp << ":" << clientPort << std::endl;
         }
+
+        // 已收到的请求处理完再下线，处理线程不会再用到会话
+        pending.close();
+        worker.join();
+
+        // 连接结束（包括异常退出）：会话下线并回收
+        chatServer.closeSession(session);
     }
 
     ~ClientHandler()
     {
-        // 清理资源 - ChatServer 自动管理会话生命周期
+        // 会话已在处理循环结束时由 closeSession() 回收
+    }
+
+private:
+    // 处理一帧，返回要发回的响应（ACK 返回空串，sendToClient 会忽略）
+    std::string respond(const std::string &message)
+    {
+        try
+        {
+            // 快速路径优化：先检查是否是管道消息
+            if (message.find("|") != std::string::npos)
+            {
+                // ChatServer 处理消息
+                return chatServer.processMessage(message, session);
+            }
+            // 对于非管道消息，发送通用成功响应
+            return "RESPONSE|SUCCESS|MESSAGE_RECEIVED";
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[Server] Exception from " << clientIp << ":" << clientPort
+                      << ": " << e.what() << std::endl;
+            return "RESPONSE|ERROR|Processing failed: " + std::string(e.what());
+        }
+        catch (...)
+        {
+            std::cerr << "[Server] Unknown exception from " << clientIp << ":" << clientPort << std::endl;
+            return "RESPONSE|ERROR|Unknown processing error";
+        }
+    }
+};
+
+#if CHAT_HAVE_COROUTINES
+// 一个连接上正在处理的请求（协程版）：每帧按到达顺序编号，各自在独立的协程里处理，
+// 完成的响应按编号依次发出，顺序与请求顺序一致。在途请求达到上限时读协程挂起，
+// 等最早的一个完成后再读。读协程结束后由最后一个完成的请求下线会话
+class PendingResponses
+{
+public:
+    static constexpr size_t MAX_IN_FLIGHT = 64;
+
+    // 登记一个新请求，返回它的编号
+    uint64_t begin()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_inFlight;
+        return m_nextIndex++;
+    }
+
+    // 请求 index 完成：把能按顺序发出的响应都发出。返回 true 表示读协程已结束且这是最后一个请求，
+    // 调用方负责下线会话
+    bool complete(ChatServer &chatServer, ChatServer::SessionHandle session, uint64_t index, std::string response)
+    {
+        std::function<void()> resumeReader;
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ready.emplace(index, std::move(response));
+            // 在锁内发送，两个同时完成的请求不会把响应交错发出
+            for (auto it = m_ready.begin(); it != m_ready.end() && it->first == m_nextToSend; it = m_ready.erase(it))
+            {
+                chatServer.sendToClient(session, it->second);
+                ++m_nextToSend;
+            }
+            --m_inFlight;
+            resumeReader = std::move(m_slotFreed);
+            m_slotFreed = nullptr;
+            last = m_readerDone && m_inFlight == 0;
+        }
+        if (resumeReader)
+            resumeReader();
+        return last;
+    }
+
+    // 等待在途请求低于上限；arm 返回 false 表示不必等待
+    auto waitForSlot(CoroutineScheduler &scheduler)
+    {
+        return CallbackAwaiter(scheduler, [this](std::function<void()> callback) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_inFlight < MAX_IN_FLIGHT)
+                return false;
+            m_slotFreed = std::move(callback);
+            return true;
+        });
+    }
+
+    // 读协程结束。返回 true 表示没有在途请求，调用方负责下线会话
+    bool finishReading()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_readerDone = true;
+        return m_inFlight == 0;
     }
+
+private:
+    std::mutex m_mutex;
+    uint64_t m_nextIndex = 0;
+    uint64_t m_nextToSend = 0;
+    std::map<uint64_t, std::string> m_ready;
+    size_t m_inFlight = 0;
+    std::function<void()> m_slotFreed;
+    bool m_readerDone = false;
 };
+
+// 处理一个请求帧并按顺序回复。由读协程 spawn，在读协程的线程上运行到第一个挂起点
+// （消息的序号分配和写出都在挂起之前），所以路由顺序与到达顺序一致
+inline Task<void> handleFrameAsync(ChatServer &chatServer, ChatServer::SessionHandle session,
+                                   std::string message, uint64_t index, std::shared_ptr<PendingResponses> pending,
+                                   std::string clientIp, uint16_t clientPort, CoroutineScheduler &scheduler)
+{
+    std::string response;
+    try
+    {
+        if (message.find("|") != std::string::npos)
+        {
+            response = co_await chatServer.processMessageAsync(message, session, scheduler);
+        }
+        else
+        {
+            response = "RESPONSE|SUCCESS|MESSAGE_RECEIVED";
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[Server] Exception from " << clientIp << ":" << clientPort
+                  << ": " << e.what() << std::endl;
+        response = "RESPONSE|ERROR|Processing failed: " + std::string(e.what());
+    }
+    catch (...)
+    {
+        std::cerr << "[Server] Unknown exception from " << clientIp << ":" << clientPort << std::endl;
+        response = "RESPONSE|ERROR|Unknown processing error";
+    }
+    if (pending->complete(chatServer, session, index, std::move(response)))
+    {
+        chatServer.closeSession(session);
+    }
+}
+
+// 协程版连接处理（C++20）：等待下一帧、等待 ACK 时挂起协程，不占线程，
+// 少量工作线程即可同时推进大量连接。连接需已挂在 transport 上。
+// 读协程只收帧：ACK 当场处理，其余请求各自 spawn 一个协程处理，等 ACK 期间照常读下一帧
+inline Task<void> handleClientAsync(ChatServer &chatServer, ChatServer::SessionHandle session,
+                                    std::string clientIp, uint16_t clientPort,
+                                    std::atomic<bool> &serverRunning, CoroutineScheduler &scheduler)
+{
+    // 从 reactor / 接收线程切到工作线程上运行
+    co_await scheduler.schedule();
+    std::cout << "[Server] Started coroutine for client: " << clientIp << ":" << clientPort << std::endl;
+
+    auto pending = std::make_shared<PendingResponses>();
+    std::string message;
+    message.reserve(1024);
+    while (serverRunning)
+    {
+        bool hasMessage = false;
+        try
+        {
+            hasMessage = co_await chatServer.receiveFromClientAsync(session, message, scheduler);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[Server] Exception in client coroutine for " << clientIp << ":" << clientPort
+                      << ": " << e.what() << std::endl;
+        }
+        if (!hasMessage)
+        {
+            break;
+        }
+        if (message.empty())
+        {
+            continue;
+        }
+
+        std::cout << "[Server] RECEIVED from " << clientIp << ":" << clientPort
+                  << " [" << message.length() << " bytes]: '" << message << "'" << std::endl;
+
+        if (isAckFrame(message))
+        {
+            try
+            {
+                chatServer.processMessage(message, session);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "[Server] Exception from " << clientIp << ":" << clientPort
+                          << ": " << e.what() << std::endl;
+            }
+            continue;
+        }
+
+        co_await pending->waitForSlot(scheduler);
+        spawn(handleFrameAsync(chatServer, session, message, pending->begin(), pending,
+                               clientIp, clientPort, scheduler));
+    }
+
+    std::cout << "[Server] Finished coroutine for client: " << clientIp << ":" << clientPort << std::endl;
+    if (pending->finishReading())
+    {
+        chatServer.closeSession(session);
+    }
+}
+#endif
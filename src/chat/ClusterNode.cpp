@@ -0,0 +1,719 @@
+#include "ClusterNode.hpp"
+#include "../common/Metrics.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+// 集群指标
+struct ClusterMetrics {
+    Counter& framesSent;
+    Counter& framesReceived;
+    Counter& forwards;
+    Counter& forwardFailures;
+    Counter& pushes;
+    Histogram& forwardSeconds;
+    Counter& ringChanges;
+    Gauge& links;
+    Gauge& directoryUsers;
+    Gauge& ringVersion;
+    Gauge& ringNodes;
+};
+
+ClusterMetrics& clusterMetrics() {
+    MetricsRegistry& r = MetricsRegistry::instance();
+    static ClusterMetrics metrics{
+        r.counter("chat_cluster_frames_sent_total", "Frames written to inter-node links"),
+        r.counter("chat_cluster_frames_received_total", "Frames read from inter-node links"),
+        r.counter("chat_cluster_forwards_total", "Messages forwarded to the node holding the recipient"),
+        r.counter("chat_cluster_forward_failures_total", "Forwards that found no link, timed out or lost their link"),
+        r.counter("chat_cluster_pushes_total", "Fire-and-forget PUSH frames sent to other nodes"),
+        r.histogram("chat_cluster_forward_seconds", "Time from forwarding a message to the remote node's reply, including the recipient's ACK"),
+        r.counter("chat_cluster_ring_changes_total", "Hash ring versions adopted by this node"),
+        r.gauge("chat_cluster_links", "Inter-node links currently up"),
+        r.gauge("chat_cluster_directory_users", "Users known to be online on other nodes"),
+        r.gauge("chat_cluster_ring_version", "Version of the hash ring this node routes by"),
+        r.gauge("chat_cluster_ring_nodes", "Nodes on the hash ring"),
+    };
+    return metrics;
+}
+
+// 去掉 "TYPE|" 之后按第一个 '|' 切成 head 和 rest
+bool splitField(const std::string& frame, size_t start, std::string& head, std::string& rest) {
+    size_t bar = frame.find('|', start);
+    if (bar == std::string::npos) return false;
+    head = frame.substr(start, bar - start);
+    rest = frame.substr(bar + 1);
+    return true;
+}
+
+std::vector<std::string> splitUsers(const std::string& list) {
+    std::vector<std::string> users;
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > start) users.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return users;
+}
+
+// DIRSYNC 分帧：单帧用户列表不超过这个长度
+const size_t DIRSYNC_CHUNK_BYTES = 32 * 1024;
+
+} // namespace
+
+// ==============================
+// 配置
+// ==============================
+
+bool ClusterNode::parsePeers(const std::string& spec, std::vector<Peer>& peers) {
+    peers.clear();
+    for (std::string entry : splitUsers(spec)) {
+        Peer peer;
+        size_t at = entry.rfind('@');
+        if (at != std::string::npos) {
+            char* weightEnd = nullptr;
+            peer.weight = static_cast<uint32_t>(std::strtoul(entry.c_str() + at + 1, &weightEnd, 10));
+            if (weightEnd == entry.c_str() + at + 1 || *weightEnd != '\0') return false;
+            entry.resize(at);
+        }
+        size_t eq = entry.find('=');
+        size_t colon = entry.rfind(':');
+        if (eq == std::string::npos || colon == std::string::npos || colon < eq) return false;
+        char* end = nullptr;
+        peer.id = static_cast<uint32_t>(std::strtoul(entry.c_str(), &end, 10));
+        if (end != entry.c_str() + eq) return false;
+        peer.host = entry.substr(eq + 1, colon - eq - 1);
+        peer.port = static_cast<uint16_t>(std::strtoul(entry.c_str() + colon + 1, nullptr, 10));
+        if (peer.host.empty() || peer.port == 0) return false;
+        peers.push_back(peer);
+    }
+    return true;
+}
+
+ClusterNode::ClusterNode(const Options& options)
+    : m_options(options), m_running(false), m_acceptedLinks(0), m_nextRequestId(1),
+      m_ringVersion(0), m_ringOrigin(options.nodeId), m_rebalancePending(false) {
+    // 初始环：自己和配置里的节点（版本 0）。链路建立后与对端交换，最终都采用同一个
+    m_ring.setNode(m_options.nodeId, m_options.weight);
+    for (const Peer& peer : m_options.peers) m_ring.setNode(peer.id, peer.weight);
+}
+
+ClusterNode::~ClusterNode() {
+    stop();
+}
+
+// ==============================
+// 启停
+// ==============================
+
+bool ClusterNode::start() {
+    if (m_running) return true;
+    if (!m_listenSocket.init() || !m_listenSocket.create()) {
+        m_lastError = m_listenSocket.getLastError();
+        return false;
+    }
+    if (!m_listenSocket.bind(m_options.port) || !m_listenSocket.listen(128)) {
+        m_lastError = m_listenSocket.getLastError();
+        m_listenSocket.close();
+        return false;
+    }
+    m_listenSocket.setListenNonBlocking(true);
+
+    m_workers.reset(new ThreadPool(m_options.workers));
+    m_running = true;
+    std::lock_guard<std::mutex> lock(m_threadsMutex);
+    m_threads.emplace_back(&ClusterNode::acceptLoop, this);
+    m_threads.emplace_back(&ClusterNode::sweepLoop, this);
+    m_threads.emplace_back(&ClusterNode::rebalanceLoop, this);
+    for (const Peer& peer : m_options.peers) {
+        if (peer.id != m_options.nodeId) m_threads.emplace_back(&ClusterNode::dialLoop, this, peer);
+    }
+    {
+        std::lock_guard<std::mutex> ringLock(m_ringMutex);
+        clusterMetrics().ringNodes.set(static_cast<int64_t>(m_ring.nodeCount()));
+        std::cout << "[Cluster] 节点 " << m_options.nodeId << " 已启动，链路端口 " << m_options.port
+                  << "，对端 " << m_options.peers.size() << " 个，哈希环 " << m_ring.toString() << std::endl;
+    }
+    return true;
+}
+
+void ClusterNode::stop() {
+    if (!m_running.exchange(false)) return;
+    m_sweepCv.notify_all();
+    {
+        // 搬迁线程可能正要进入等待：持锁后再通知，不会丢失唤醒
+        std::lock_guard<std::mutex> lock(m_rebalanceMutex);
+    }
+    m_rebalanceCv.notify_all();
+
+    // 关闭各链路：读线程随之退出并清理目录
+    std::vector<std::shared_ptr<Link>> links;
+    {
+        std::lock_guard<std::mutex> lock(m_linksMutex);
+        for (const auto& entry : m_links) links.push_back(entry.second);
+    }
+    for (const auto& link : links) link->socket.shutdown();
+
+    {
+        std::lock_guard<std::mutex> lock(m_threadsMutex);
+        for (auto& thread : m_threads) {
+            if (thread.joinable()) thread.join();
+        }
+        m_threads.clear();
+    }
+    while (m_acceptedLinks.load() != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    m_listenSocket.close();
+
+    // 还在等应答的转发全部按失败结束，同步等待者不会一直阻塞
+    std::vector<ReplyCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        for (auto& entry : m_pending) callbacks.push_back(std::move(entry.second.callback));
+        m_pending.clear();
+    }
+    for (auto& callback : callbacks) callback(false, std::string());
+    if (m_workers) m_workers->stop();
+    std::cout << "[Cluster] 节点 " << m_options.nodeId << " 已停止" << std::endl;
+}
+
+// ==============================
+// 链路
+// ==============================
+
+void ClusterNode::acceptLoop() {
+    while (m_running) {
+        std::string ip;
+        uint16_t port = 0;
+        SocketHandle handle = m_listenSocket.acceptNonBlocking(ip, port, 200);
+        if (handle == -1) {
+            if (!m_running) break;
+            std::string error = m_listenSocket.getLastError();
+            if (error != "timeout" && error != "no data") {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            continue;
+        }
+        ++m_acceptedLinks;
+        try {
+            std::thread(&ClusterNode::serveAccepted, this, handle, ip, port).detach();
+        } catch (const std::exception& e) {
+            --m_acceptedLinks;
+            TcpSocket failed;
+            failed.setHandle(handle);
+            std::cerr << "[Cluster] 无法创建链路线程: " << e.what() << std::endl;
+        }
+    }
+}
+
+void ClusterNode::serveAccepted(SocketHandle handle, std::string ip, uint16_t port) {
+    auto link = std::make_shared<Link>();
+    link->host = ip;
+    link->socket.setHandle(handle);
+    // 第一帧必须是 HELLO。有集群秘钥时配置里没有的节点也接受（新加入集群的节点拨过来），
+    // 但本该由本节点拨号的对端拨进来时拒绝，每对节点只保留一条链路
+    std::string hello;
+    bool valid = link->socket.receivePipeMessage(hello, HELLO_TIMEOUT_SEC) && parseHello(hello, *link) &&
+                 link->peerId != m_options.nodeId && admits(*link);
+    if (valid && !dialsTo(link->peerId)) {
+        link->socket.setNoDelay(true);
+        if (link->socket.sendPipeMessage(helloFrame())) runLink(link);
+    } else if (!valid) {
+        std::cerr << "[Cluster] 拒绝来自 " << ip << ":" << port << " 的链路：握手无效" << std::endl;
+    }
+    link->socket.close();
+    --m_acceptedLinks;
+}
+
+void ClusterNode::dialLoop(Peer peer) {
+    // 节点号更小的对端通常会拨过来；只有它没把本节点配置进去（本节点是新加入的）时才由本节点拨号，
+    // 先等一轮让它的拨号先到，之后有链路时不再拨
+    bool primary = dialsTo(peer.id);
+    bool reported = false;
+    for (int waited = 0; !primary && m_running && waited < 2 * RECONNECT_INTERVAL_MS; waited += 100) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    while (m_running) {
+        auto link = std::make_shared<Link>();
+        link->peerId = peer.id;
+        link->host = peer.host;
+        if (!primary && findLink(peer.id)) {
+            // 已有对端拨过来的链路
+        } else if (link->socket.init() && link->socket.connect(peer.host, peer.port)) {
+            link->socket.setNoDelay(true);
+            reported = false;
+            // 对端回 HELLO 才算握手成功；对端认为应由它拨号时直接关闭连接
+            std::string hello;
+            Link answered;
+            if (link->socket.sendPipeMessage(helloFrame()) &&
+                link->socket.receivePipeMessage(hello, HELLO_TIMEOUT_SEC) && parseHello(hello, answered) &&
+                answered.peerId == peer.id) {
+                link->clientPort = answered.clientPort;
+                runLink(link);
+            }
+        } else if (!reported) {
+            // 对端还没启动时每秒重试一次，只报告第一次失败
+            std::cerr << "[Cluster] 无法连接节点 " << peer.id << " (" << peer.host << ":" << peer.port
+                      << "): " << link->socket.getLastError() << "，稍后重试" << std::endl;
+            reported = true;
+        }
+        link->socket.close();
+        for (int waited = 0; m_running && waited < RECONNECT_INTERVAL_MS; waited += 100) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
+void ClusterNode::runLink(const std::shared_ptr<Link>& link) {
+    std::shared_ptr<Link> previous;
+    {
+        std::lock_guard<std::mutex> lock(m_linksMutex);
+        if (!m_running) return;
+        std::shared_ptr<Link>& slot = m_links[link->peerId];
+        previous = slot;
+        slot = link;
+        clusterMetrics().links.set(static_cast<int64_t>(m_links.size()));
+    }
+    // 对端重连而旧链路还没发现断开：关掉旧链路，它的读线程退出时看到已被替换，不再清理目录
+    if (previous) previous->socket.shutdown();
+    std::cout << "[Cluster] 与节点 " << link->peerId << " 的链路已建立" << std::endl;
+
+    // 先交换哈希环，再同步用户目录；对端现在可达，暂存在本节点、归属于它的离线日志可以交出去了
+    sendFrame(link, ringFrame());
+    {
+        HashRing current = ring();
+        scheduleRebalance(current, current);
+    }
+
+    // 把本地在线用户整体同步给对端，之后的变化由 DIR 增量广播
+    {
+        std::lock_guard<std::mutex> lock(m_localMutex);
+        std::string frame = "DIRSYNC|";
+        size_t listed = 0;
+        for (const auto& userId : m_localUsers) {
+            if (listed > 0) frame += ',';
+            frame += userId;
+            if (frame.size() >= DIRSYNC_CHUNK_BYTES) {
+                sendFrame(link, frame);
+                frame = "DIRSYNC|";
+                listed = 0;
+                continue;
+            }
+            ++listed;
+        }
+        if (listed > 0) sendFrame(link, frame);
+    }
+
+    std::string frame;
+    while (m_running) {
+        if (!link->socket.receivePipeMessage(frame, 1)) {
+            if (link->socket.isConnected()) continue;   // 超时，链路仍然正常
+            break;
+        }
+        clusterMetrics().framesReceived.inc();
+        handleFrame(link, frame);
+    }
+    linkDown(link);
+}
+
+void ClusterNode::handleFrame(const std::shared_ptr<Link>& link, const std::string& frame) {
+    std::string head;
+    std::string rest;
+    if (frame.compare(0, 5, "FWDR|") == 0) {
+        if (!splitField(frame, 5, head, rest)) return;
+        uint64_t requestId = std::strtoull(head.c_str(), nullptr, 10);
+        PendingForward pending;
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            auto it = m_pending.find(requestId);
+            if (it == m_pending.end()) return;   // 已超时
+            pending = std::move(it->second);
+            m_pending.erase(it);
+        }
+        clusterMetrics().forwardSeconds.observeSince(pending.sentAt);
+        pending.callback(true, rest);
+    } else if (frame.compare(0, 4, "FWD|") == 0) {
+        if (!splitField(frame, 4, head, rest)) return;
+        // 写出在读线程上按序完成；等待接收者 ACK 放到工作线程上，读线程继续读后面的帧
+        ForwardCompletion complete = m_onForward ? m_onForward(rest) : ForwardCompletion();
+        if (!complete) {
+            sendFrame(link, "FWDR|" + head + "|RESPONSE|ERROR|SEND_FAILED|目标节点未启用消息转发");
+            return;
+        }
+        std::shared_ptr<TaskBase> task = std::make_shared<FunctionTask>([this, link, head, complete] {
+            sendFrame(link, "FWDR|" + head + "|" + complete());
+        });
+        m_workers->submit(std::move(task));
+    } else if (frame.compare(0, 5, "PUSH|") == 0) {
+        if (!splitField(frame, 5, head, rest)) return;
+        if (m_onPush) m_onPush(splitUsers(head), rest);
+    } else if (frame.compare(0, 4, "DIR|") == 0) {
+        if (!splitField(frame, 4, head, rest)) return;
+        setRemotePresence(link->peerId, head, rest == "1");
+    } else if (frame.compare(0, 8, "DIRSYNC|") == 0) {
+        for (const auto& userId : splitUsers(frame.substr(8))) setRemotePresence(link->peerId, userId, true);
+    } else if (frame.compare(0, 5, "RING|") == 0) {
+        // RING|版本|发起节点|环
+        std::string origin;
+        std::string spec;
+        HashRing received;
+        if (!splitField(frame, 5, head, rest) || !splitField(rest, 0, origin, spec) || !HashRing::parse(spec, received)) {
+            std::cerr << "[Cluster] 节点 " << link->peerId << " 发来无效的哈希环: " << frame.substr(0, 80) << std::endl;
+            return;
+        }
+        adoptRing(received, std::strtoull(head.c_str(), nullptr, 10),
+                  static_cast<uint32_t>(std::strtoul(origin.c_str(), nullptr, 10)), link->peerId);
+    } else {
+        std::cerr << "[Cluster] 节点 " << link->peerId << " 发来未知帧: " << frame.substr(0, 40) << std::endl;
+    }
+}
+
+void ClusterNode::linkDown(const std::shared_ptr<Link>& link) {
+    {
+        std::lock_guard<std::mutex> lock(m_linksMutex);
+        auto it = m_links.find(link->peerId);
+        if (it == m_links.end() || it->second != link) return;   // 已被新链路替换
+        m_links.erase(it);
+        clusterMetrics().links.set(static_cast<int64_t>(m_links.size()));
+    }
+    std::cout << "[Cluster] 与节点 " << link->peerId << " 的链路已断开" << std::endl;
+    failPending(link->peerId);
+
+    // 该节点上的用户全部视为离线：之后发给他们的消息进本地离线日志，等他们重新登录或链路恢复
+    std::unordered_set<std::string> users;
+    {
+        std::lock_guard<std::mutex> lock(m_directoryMutex);
+        auto node = m_nodeUsers.find(link->peerId);
+        if (node != m_nodeUsers.end()) {
+            users.swap(node->second);
+            m_nodeUsers.erase(node);
+        }
+        for (const auto& userId : users) {
+            auto entry = m_directory.find(userId);
+            if (entry == m_directory.end()) continue;
+            auto& nodes = entry->second;
+            nodes.erase(std::remove(nodes.begin(), nodes.end(), link->peerId), nodes.end());
+            if (nodes.empty()) m_directory.erase(entry);
+        }
+        clusterMetrics().directoryUsers.set(static_cast<int64_t>(m_directory.size()));
+    }
+    if (m_onPresence) {
+        for (const auto& userId : users) m_onPresence(userId, link->peerId, false);
+    }
+}
+
+std::string ClusterNode::helloFrame() const {
+    return "HELLO|" + std::to_string(m_options.nodeId) + "|" + std::to_string(m_options.clientPort) + "|" +
+           m_options.secret;
+}
+
+bool ClusterNode::parseHello(const std::string& frame, Link& link) const {
+    if (frame.compare(0, 6, "HELLO|") != 0) return false;
+    char* end = nullptr;
+    link.peerId = static_cast<uint32_t>(std::strtoul(frame.c_str() + 6, &end, 10));
+    if (end == frame.c_str() + 6 || link.peerId == 0) return false;
+    std::string secret;
+    if (*end == '|') {
+        link.clientPort = static_cast<uint16_t>(std::strtoul(end + 1, &end, 10));
+        if (*end == '|') secret.assign(end + 1);
+    }
+    // 逐字节比较全部内容，耗时与在哪一位不同无关
+    const std::string& expected = m_options.secret;
+    unsigned char diff = secret.size() == expected.size() ? 0 : 1;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        diff |= static_cast<unsigned char>(expected[i] ^ (i < secret.size() ? secret[i] : 0));
+    }
+    if (diff != 0) {
+        std::cerr << "[Cluster] 节点 " << link.peerId << " 的握手秘钥不符" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ClusterNode::admits(const Link& link) const {
+    if (!m_options.secret.empty()) return true;
+    return std::any_of(m_options.peers.begin(), m_options.peers.end(), [&](const Peer& peer) {
+        // 配置里的地址与 connect 一样是点分十进制 IPv4，直接比较文本
+        return peer.id == link.peerId && peer.host == link.host;
+    });
+}
+
+bool ClusterNode::dialsTo(uint32_t peerId) const {
+    return peerId > m_options.nodeId &&
+           std::any_of(m_options.peers.begin(), m_options.peers.end(), [&](const Peer& peer) { return peer.id == peerId; });
+}
+
+std::shared_ptr<ClusterNode::Link> ClusterNode::findLink(uint32_t node) {
+    std::lock_guard<std::mutex> lock(m_linksMutex);
+    auto it = m_links.find(node);
+    return it == m_links.end() ? nullptr : it->second;
+}
+
+bool ClusterNode::sendFrame(const std::shared_ptr<Link>& link, const std::string& frame) {
+    TcpSocket::PipeSegment segment{ frame.data(), frame.size() };
+    return sendFrame(link, &segment, 1);
+}
+
+bool ClusterNode::sendFrame(const std::shared_ptr<Link>& link, const TcpSocket::PipeSegment* segments, size_t count) {
+    if (!link->socket.sendPipeMessage(segments, count)) return false;
+    clusterMetrics().framesSent.inc();
+    return true;
+}
+
+// ==============================
+// 用户目录
+// ==============================
+
+void ClusterNode::publishPresence(const std::string& userId, bool online) {
+    std::lock_guard<std::mutex> lock(m_localMutex);
+    bool changed = online ? m_localUsers.insert(userId).second : m_localUsers.erase(userId) > 0;
+    if (!changed) return;
+    std::vector<std::shared_ptr<Link>> links;
+    {
+        std::lock_guard<std::mutex> linksLock(m_linksMutex);
+        for (const auto& entry : m_links) links.push_back(entry.second);
+    }
+    std::string frame = "DIR|" + userId + (online ? "|1" : "|0");
+    for (const auto& link : links) sendFrame(link, frame);
+}
+
+std::vector<uint32_t> ClusterNode::locate(const std::string& userId) {
+    std::lock_guard<std::mutex> lock(m_directoryMutex);
+    auto it = m_directory.find(userId);
+    return it == m_directory.end() ? std::vector<uint32_t>() : it->second;
+}
+
+size_t ClusterNode::remoteUserCount() {
+    std::lock_guard<std::mutex> lock(m_directoryMutex);
+    return m_directory.size();
+}
+
+bool ClusterNode::clientEndpoint(uint32_t node, std::string& host, uint16_t& port) {
+    std::shared_ptr<Link> link = findLink(node);
+    if (!link || link->clientPort == 0) return false;
+    host = link->host;
+    port = link->clientPort;
+    return true;
+}
+
+void ClusterNode::setRemotePresence(uint32_t node, const std::string& userId, bool online) {
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock(m_directoryMutex);
+        auto entry = m_directory.find(userId);
+        if (online) {
+            std::vector<uint32_t>& nodes = m_directory[userId];
+            auto pos = std::lower_bound(nodes.begin(), nodes.end(), node);
+            if (pos == nodes.end() || *pos != node) {
+                nodes.insert(pos, node);
+                m_nodeUsers[node].insert(userId);
+                changed = true;
+            }
+        } else if (entry != m_directory.end()) {
+            auto& nodes = entry->second;
+            auto pos = std::find(nodes.begin(), nodes.end(), node);
+            if (pos != nodes.end()) {
+                nodes.erase(pos);
+                if (nodes.empty()) m_directory.erase(entry);
+                m_nodeUsers[node].erase(userId);
+                changed = true;
+            }
+        }
+        clusterMetrics().directoryUsers.set(static_cast<int64_t>(m_directory.size()));
+    }
+    if (changed && m_onPresence) m_onPresence(userId, node, online);
+}
+
+// ==============================
+// 转发
+// ==============================
+
+bool ClusterNode::forward(uint32_t node, const char* frame, size_t length, ReplyCallback callback) {
+    ClusterMetrics& metrics = clusterMetrics();
+    std::shared_ptr<Link> link = findLink(node);
+    if (!link) {
+        metrics.forwardFailures.inc();
+        return false;
+    }
+    auto now = std::chrono::steady_clock::now();
+    uint64_t requestId;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        requestId = m_nextRequestId++;
+        m_pending.emplace(requestId, PendingForward{ node, now, now + std::chrono::milliseconds(m_options.forwardTimeoutMs),
+                                                     std::move(callback) });
+    }
+    metrics.forwards.inc();
+
+    // 请求头和消息帧作为两段写进同一帧，消息本身不再拷贝
+    std::string header = "FWD|" + std::to_string(requestId) + "|";
+    TcpSocket::PipeSegment segments[2] = { { header.data(), header.size() }, { frame, length } };
+    if (sendFrame(link, segments, 2)) return true;
+
+    // 写失败：收回登记；已被链路断开的清理取走时回调已经（或即将）被调用，按已受理处理
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    if (m_pending.erase(requestId) == 0) return true;
+    metrics.forwardFailures.inc();
+    return false;
+}
+
+bool ClusterNode::push(uint32_t node, const std::vector<std::string>& users, const char* frame, size_t length) {
+    if (users.empty()) return true;
+    std::shared_ptr<Link> link = findLink(node);
+    if (!link) return false;
+    std::string header = "PUSH|";
+    for (size_t i = 0; i < users.size(); ++i) {
+        if (i > 0) header += ',';
+        header += users[i];
+    }
+    header += '|';
+    TcpSocket::PipeSegment segments[2] = { { header.data(), header.size() }, { frame, length } };
+    if (!sendFrame(link, segments, 2)) return false;
+    clusterMetrics().pushes.inc();
+    return true;
+}
+
+void ClusterNode::failPending(uint32_t node) {
+    std::vector<ReplyCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        for (auto it = m_pending.begin(); it != m_pending.end();) {
+            if (it->second.node != node) {
+                ++it;
+                continue;
+            }
+            callbacks.push_back(std::move(it->second.callback));
+            it = m_pending.erase(it);
+        }
+    }
+    clusterMetrics().forwardFailures.inc(callbacks.size());
+    for (auto& callback : callbacks) callback(false, std::string());
+}
+
+// 每 100ms 清理一次超时的转发
+void ClusterNode::sweepLoop() {
+    std::vector<ReplyCallback> expired;
+    std::unique_lock<std::mutex> lock(m_pendingMutex);
+    while (m_running) {
+        m_sweepCv.wait_for(lock, std::chrono::milliseconds(100));
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = m_pending.begin(); it != m_pending.end();) {
+            if (it->second.deadline > now) {
+                ++it;
+                continue;
+            }
+            expired.push_back(std::move(it->second.callback));
+            it = m_pending.erase(it);
+        }
+        if (expired.empty()) continue;
+        lock.unlock();
+        clusterMetrics().forwardFailures.inc(expired.size());
+        for (auto& callback : expired) callback(false, std::string());
+        expired.clear();
+        lock.lock();
+    }
+}
+
+// ==============================
+// 哈希环与搬迁
+// ==============================
+
+uint32_t ClusterNode::owner(const std::string& userId) {
+    std::lock_guard<std::mutex> lock(m_ringMutex);
+    return m_ring.owner(userId);
+}
+
+HashRing ClusterNode::ring() {
+    std::lock_guard<std::mutex> lock(m_ringMutex);
+    return m_ring;
+}
+
+uint64_t ClusterNode::ringVersion() {
+    std::lock_guard<std::mutex> lock(m_ringMutex);
+    return m_ringVersion;
+}
+
+std::string ClusterNode::ringFrame() {
+    std::lock_guard<std::mutex> lock(m_ringMutex);
+    return "RING|" + std::to_string(m_ringVersion) + "|" + std::to_string(m_ringOrigin) + "|" + m_ring.toString();
+}
+
+bool ClusterNode::updateRing(const HashRing& ring) {
+    if (ring.empty()) return false;
+    uint64_t version;
+    {
+        std::lock_guard<std::mutex> lock(m_ringMutex);
+        version = m_ringVersion + 1;
+    }
+    adoptRing(ring, version, m_options.nodeId, 0);
+    return true;
+}
+
+void ClusterNode::adoptRing(const HashRing& ring, uint64_t version, uint32_t origin, uint32_t fromNode) {
+    HashRing before;
+    std::string frame;
+    {
+        std::lock_guard<std::mutex> lock(m_ringMutex);
+        bool newer = version > m_ringVersion || (version == m_ringVersion && origin < m_ringOrigin);
+        if (!newer) return;
+        before = m_ring;
+        m_ring = ring;
+        m_ringVersion = version;
+        m_ringOrigin = origin;
+        frame = "RING|" + std::to_string(version) + "|" + std::to_string(origin) + "|" + ring.toString();
+        ClusterMetrics& metrics = clusterMetrics();
+        metrics.ringChanges.inc();
+        metrics.ringVersion.set(static_cast<int64_t>(version));
+        metrics.ringNodes.set(static_cast<int64_t>(ring.nodeCount()));
+    }
+    if (before != ring) {
+        std::cout << "[Cluster] 采用节点 " << origin << " 发布的哈希环 v" << version << ": " << ring.toString()
+                  << "（" << before.toString() << " -> 归属变化 " << static_cast<int>(before.movedFraction(ring) * 1000) / 10.0
+                  << "%）" << std::endl;
+    }
+    // 转告其他节点：和发起节点之间链路暂时断开的节点也能收到，重复的帧因版本不新被忽略
+    broadcast(frame, fromNode);
+    if (before != ring) scheduleRebalance(before, ring);
+}
+
+void ClusterNode::broadcast(const std::string& frame, uint32_t exceptNode) {
+    std::vector<std::shared_ptr<Link>> links;
+    {
+        std::lock_guard<std::mutex> lock(m_linksMutex);
+        for (const auto& entry : m_links) {
+            if (entry.first != exceptNode) links.push_back(entry.second);
+        }
+    }
+    for (const auto& link : links) sendFrame(link, frame);
+}
+
+void ClusterNode::scheduleRebalance(const HashRing& before, const HashRing& after) {
+    {
+        std::lock_guard<std::mutex> lock(m_rebalanceMutex);
+        if (!m_rebalancePending) m_rebalanceBefore = before;
+        m_rebalanceAfter = after;
+        m_rebalancePending = true;
+    }
+    m_rebalanceCv.notify_one();
+}
+
+void ClusterNode::rebalanceLoop() {
+    std::unique_lock<std::mutex> lock(m_rebalanceMutex);
+    while (m_running) {
+        if (!m_rebalancePending) {
+            m_rebalanceCv.wait(lock);
+            continue;
+        }
+        HashRing before = std::move(m_rebalanceBefore);
+        HashRing after = std::move(m_rebalanceAfter);
+        m_rebalancePending = false;
+        lock.unlock();
+        if (m_onRebalance) m_onRebalance(before, after);
+        lock.lock();
+    }
+}
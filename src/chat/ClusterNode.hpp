@@ -0,0 +1,209 @@
+#pragma once
+
+// ========================================================================================
+// ClusterNode - 多进程集群：节点间长连接、共享的用户目录、跨节点的消息转发
+// ========================================================================================
+// - 每对节点之间一条持久 TCP 链路：节点号小的一方主动连接、断开后每秒重连，另一方接受；
+//   链路关闭 Nagle，各线程的帧经 TcpSocket 的写端交接合并写出（一次系统调用带走多帧）
+// - 用户目录：每个节点把本地登录/下线的用户广播给其他节点（DIR），链路建立时整体同步一次（DIRSYNC）；
+//   链路断开时该节点的目录项全部作废
+// - 转发在同一条链路上多路复用，按请求号配对应答：
+//     FWD|reqId|<MESSAGE 帧>       -> FWDR|reqId|<接收节点给发送者的响应>
+//   接收节点投递并等待接收者的 ACK，应答里带回结果（MESSAGE_SENT / MESSAGE_CACHED / SEND_FAILED）
+// - 不需要应答的推送（群消息扇出、补发离线日志）：PUSH|u1,u2,...|<MESSAGE 帧>
+// - 一致性哈希环（HashRing）决定每个用户的归属节点：离线日志存在归属节点上，客户端应连到归属节点。
+//   环带版本号，RING|版本|发起节点|1=100,2=100 在链路建立时互相交换、变更时广播；
+//   版本大的胜出，版本相同时发起节点号小的胜出，所有节点最终采用同一个环。
+//   环变化（以及链路建立）后在独立的线程上调用一次 RebalanceHandler 做搬迁，连续的变化合并成一次
+// - 握手：拨号方先发 HELLO|节点号|客户端端口|集群秘钥，接受方校验后回同样的 HELLO；客户端端口用于让会话改连到归属节点。
+//   配置了集群秘钥时只接受秘钥一致的节点（新节点带上秘钥即可加入）；没有秘钥时只接受配置里列出的节点，
+//   且来源地址须与配置一致。RING 只在握手过的链路上收，未授权的连接改不了环
+// 节点之间的帧和客户端帧一样是 4 字节长度前缀，单帧不超过 TcpSocket::MAX_PIPE_MESSAGE_SIZE。
+// ========================================================================================
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../network/tcp_socket.hpp"
+#include "../common/HashRing.hpp"
+#include "../common/ThreadPool.hpp"
+
+class ClusterNode {
+public:
+    struct Peer {
+        uint32_t id = 0;
+        std::string host;
+        uint16_t port = 0;
+        uint32_t weight = HashRing::DEFAULT_WEIGHT;   // 在初始哈希环上的权重
+    };
+
+    struct Options {
+        uint32_t nodeId = 0;              // 本节点号，与 MessageId 的节点号一致
+        uint16_t port = 0;                // 节点间链路监听端口
+        uint16_t clientPort = 0;          // 本节点的客户端端口，握手时告诉对端
+        uint32_t weight = HashRing::DEFAULT_WEIGHT;
+        // 其他节点（不含自己）。节点号小的一方拨号；新加入的节点只需列出已有节点，由它拨号过去
+        std::vector<Peer> peers;
+        // 集群秘钥：各节点相同，握手时校验。链路不加密，节点间网络仍应是内网
+        std::string secret;
+        size_t workers = 8;               // 处理转发请求的线程数（每个请求会等待接收者 ACK）
+        int forwardTimeoutMs = 5000;      // 转发等待应答的上限，应大于接收节点的 ACK 等待时间
+    };
+
+    // ok 为 false 表示链路断开或超时，response 为空
+    using ReplyCallback = std::function<void(bool ok, const std::string& response)>;
+    // 收到转发的消息帧：在链路读线程上按到达顺序调用（写出给接收者，保持会话流的顺序），
+    // 返回的函数放到工作线程上执行（等待接收者 ACK），其结果作为给发送者的响应带回
+    using ForwardCompletion = std::function<std::string()>;
+    using ForwardHandler = std::function<ForwardCompletion(const std::string& frame)>;
+    // 收到推送：在链路的读线程上调用，应当只做非阻塞的投递 / 缓存
+    using PushHandler = std::function<void(const std::vector<std::string>& users, const std::string& frame)>;
+    // 远端节点上的用户上线 / 下线（含链路断开时的批量下线）
+    using PresenceHandler = std::function<void(const std::string& userId, uint32_t nodeId, bool online)>;
+    // 搬迁：在搬迁线程上调用，可以慢慢做（按节奏推送、等待），应当定期检查 isRunning()。
+    // 链路建立时 before == after，只需把归属于对端、暂存在本节点的离线日志交出去
+    using RebalanceHandler = std::function<void(const HashRing& before, const HashRing& after)>;
+
+    static constexpr int RECONNECT_INTERVAL_MS = 1000;
+    static constexpr int HELLO_TIMEOUT_SEC = 5;
+
+    // 解析 "2=10.0.0.2:9200,3=10.0.0.3:9200@50"，@ 之后为权重（默认 HashRing::DEFAULT_WEIGHT）
+    static bool parsePeers(const std::string& spec, std::vector<Peer>& peers);
+
+    explicit ClusterNode(const Options& options);
+    ~ClusterNode();
+
+    // start 之前设置
+    void onForward(ForwardHandler handler) { m_onForward = std::move(handler); }
+    void onPush(PushHandler handler) { m_onPush = std::move(handler); }
+    void onPresence(PresenceHandler handler) { m_onPresence = std::move(handler); }
+    void onRebalance(RebalanceHandler handler) { m_onRebalance = std::move(handler); }
+
+    bool start();
+    void stop();
+    bool isRunning() const { return m_running; }
+    uint32_t nodeId() const { return m_options.nodeId; }
+    std::string getLastError() const { return m_lastError; }
+
+    // 本地用户上线（第一台设备）/ 下线（最后一台设备），广播给其他节点
+    void publishPresence(const std::string& userId, bool online);
+    // 用户所在的远端节点，按节点号升序；不在任何远端节点上时为空
+    std::vector<uint32_t> locate(const std::string& userId);
+    // 远端节点上在线的用户数
+    size_t remoteUserCount();
+    // 节点的客户端地址（链路对端地址 + 握手时告知的客户端端口）；没有链路时返回 false
+    bool clientEndpoint(uint32_t node, std::string& host, uint16_t& port);
+
+    // 用户的归属节点；环为空时返回 0
+    uint32_t owner(const std::string& userId);
+    HashRing ring();
+    uint64_t ringVersion();
+    // 管理操作：以新版本发布 ring 并广播给所有节点；ring 为空时拒绝
+    bool updateRing(const HashRing& ring);
+
+    // 把消息帧转发给 node：收到应答、超时或链路断开时调用一次 callback（链路读线程或清理线程上）。
+    // 链路不可用时返回 false，callback 不会被调用
+    bool forward(uint32_t node, const char* frame, size_t length, ReplyCallback callback);
+    // 推送给 node 上的 users，不等应答
+    bool push(uint32_t node, const std::vector<std::string>& users, const char* frame, size_t length);
+
+private:
+    ClusterNode(const ClusterNode&) = delete;
+    ClusterNode& operator=(const ClusterNode&) = delete;
+
+    // 一条已握手的链路：socket 的读端和关闭归运行 runLink 的线程，写端任何线程都可用
+    struct Link {
+        uint32_t peerId = 0;
+        std::string host;                 // 对端地址：拨号时为配置的地址，接受时为来源 IP
+        uint16_t clientPort = 0;          // 握手时确定，之后不变
+        TcpSocket socket;
+    };
+
+    struct PendingForward {
+        uint32_t node;
+        std::chrono::steady_clock::time_point sentAt;
+        std::chrono::steady_clock::time_point deadline;
+        ReplyCallback callback;
+    };
+
+    void acceptLoop();
+    void dialLoop(Peer peer);
+    void serveAccepted(SocketHandle handle, std::string ip, uint16_t port);
+    std::string helloFrame() const;
+    // 解析 HELLO|节点号|客户端端口|秘钥，秘钥一致时填入 link
+    bool parseHello(const std::string& frame, Link& link) const;
+    // 对端是否允许建立链路：有秘钥时握手已校验，没有时须是配置里的节点、从配置的地址连来
+    bool admits(const Link& link) const;
+    // 对端是配置里节点号更大的节点：应由本节点拨号，它拨进来的链路拒绝
+    bool dialsTo(uint32_t peerId) const;
+    // 登记链路、同步目录并读到链路断开，之后清理该节点的目录项和待应答的转发
+    void runLink(const std::shared_ptr<Link>& link);
+    void handleFrame(const std::shared_ptr<Link>& link, const std::string& frame);
+    void linkDown(const std::shared_ptr<Link>& link);
+    void sweepLoop();
+
+    std::shared_ptr<Link> findLink(uint32_t node);
+    bool sendFrame(const std::shared_ptr<Link>& link, const std::string& frame);
+    bool sendFrame(const std::shared_ptr<Link>& link, const TcpSocket::PipeSegment* segments, size_t count);
+    // 远端目录更新；调用方不持有任何锁
+    void setRemotePresence(uint32_t node, const std::string& userId, bool online);
+    void failPending(uint32_t node);
+
+    std::string ringFrame();
+    // 收到 RING：比本地的更优时采用，转告其他链路并安排一次搬迁
+    void adoptRing(const HashRing& ring, uint64_t version, uint32_t origin, uint32_t fromNode);
+    void broadcast(const std::string& frame, uint32_t exceptNode);
+    void scheduleRebalance(const HashRing& before, const HashRing& after);
+    void rebalanceLoop();
+
+    Options m_options;
+    ForwardHandler m_onForward;
+    PushHandler m_onPush;
+    PresenceHandler m_onPresence;
+    RebalanceHandler m_onRebalance;
+
+    std::atomic<bool> m_running;
+    std::string m_lastError;
+    TcpSocket m_listenSocket;
+    std::vector<std::thread> m_threads;          // 接受线程、各拨号线程、清理线程
+    std::mutex m_threadsMutex;
+    std::atomic<size_t> m_acceptedLinks;         // 接受侧链路线程数，stop 等它归零
+    std::unique_ptr<ThreadPool> m_workers;
+
+    std::mutex m_linksMutex;
+    std::unordered_map<uint32_t, std::shared_ptr<Link>> m_links;
+
+    // 本地在线用户：链路建立时整体同步；更新和广播在同一把锁内，同一用户的 DIR 不会与 DIRSYNC 乱序
+    std::mutex m_localMutex;
+    std::unordered_set<std::string> m_localUsers;
+
+    std::mutex m_directoryMutex;
+    std::unordered_map<std::string, std::vector<uint32_t>> m_directory;           // 用户 -> 远端节点
+    std::unordered_map<uint32_t, std::unordered_set<std::string>> m_nodeUsers;    // 远端节点 -> 用户
+
+    std::mutex m_pendingMutex;
+    std::condition_variable m_sweepCv;
+    uint64_t m_nextRequestId;
+    std::unordered_map<uint64_t, PendingForward> m_pending;
+
+    std::mutex m_ringMutex;
+    HashRing m_ring;
+    uint64_t m_ringVersion;
+    uint32_t m_ringOrigin;
+
+    // 待做的搬迁：尚未开始的多次变化合并为 (最早的 before, 最新的 after)
+    std::mutex m_rebalanceMutex;
+    std::condition_variable m_rebalanceCv;
+    bool m_rebalancePending;
+    HashRing m_rebalanceBefore;
+    HashRing m_rebalanceAfter;
+};
@@ -0,0 +1,249 @@
+#include "PresenceService.hpp"
+#include "../common/Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// 在线状态指标：changes 与 entries 之比即合并掉的通知比例
+struct PresenceMetrics {
+    Counter& changes;
+    Counter& notifications;
+    Counter& frames;
+    Counter& entries;
+    Gauge& subscribers;
+};
+
+PresenceMetrics& presenceMetrics() {
+    MetricsRegistry& r = MetricsRegistry::instance();
+    static PresenceMetrics metrics{
+        r.counter("chat_presence_changes_total", "User status changes (online / away / offline)"),
+        r.counter("chat_presence_notifications_total", "Status changes queued for subscribers before coalescing"),
+        r.counter("chat_presence_frames_total", "Batched PRESENCE frames sent to subscribers"),
+        r.counter("chat_presence_entries_total", "Status entries carried by PRESENCE frames after coalescing"),
+        r.gauge("chat_presence_subscribers", "Sessions subscribed to friends' presence"),
+    };
+    return metrics;
+}
+
+} // namespace
+
+const char* PresenceService::statusName(Status status) {
+    switch (status) {
+        case Status::ONLINE: return "online";
+        case Status::AWAY: return "away";
+        default: return "offline";
+    }
+}
+
+bool PresenceService::parseStatus(const std::string& name, Status& status) {
+    if (name == "online") {
+        status = Status::ONLINE;
+    } else if (name == "away") {
+        status = Status::AWAY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+PresenceService::PresenceService(IdInterner& users, Sender sender)
+    : PresenceService(users, std::move(sender), Options()) {}
+
+PresenceService::PresenceService(IdInterner& users, Sender sender, const Options& options)
+    : m_users(users), m_sender(std::move(sender)), m_options(options), m_running(false) {}
+
+PresenceService::~PresenceService() {
+    stop();
+}
+
+void PresenceService::start() {
+    if (m_running.exchange(true)) return;
+    m_flushThread = std::thread(&PresenceService::flushLoop, this);
+}
+
+void PresenceService::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running.exchange(false)) return;
+    }
+    m_flushCv.notify_all();
+    if (m_flushThread.joinable()) m_flushThread.join();
+}
+
+// ==============================
+// 状态
+// ==============================
+
+void PresenceService::setLocalOnline(uint32_t user, bool online) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    UserState& state = m_states[user];
+    UserState before = state;
+    state.localOnline = online;
+    updateState(user, before, state);
+}
+
+void PresenceService::setRemoteOnline(uint32_t user, bool online) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    UserState& state = m_states[user];
+    UserState before = state;
+    if (online) {
+        ++state.remoteNodes;
+    } else if (state.remoteNodes > 0) {
+        --state.remoteNodes;
+    }
+    updateState(user, before, state);
+}
+
+void PresenceService::setAway(uint32_t user, bool away) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_states.find(user);
+    if (it == m_states.end()) return;
+    UserState before = it->second;
+    it->second.away = away;
+    updateState(user, before, it->second);
+}
+
+PresenceService::Status PresenceService::statusOf(uint32_t user) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_states.find(user);
+    return it == m_states.end() ? Status::OFFLINE : it->second.effective();
+}
+
+void PresenceService::updateState(uint32_t user, const UserState& before, const UserState& after) {
+    Status status = after.effective();
+    if (status == Status::OFFLINE) m_states.erase(user);   // 离线不占表项，away 一并清除
+    if (status == before.effective()) return;
+
+    PresenceMetrics& metrics = presenceMetrics();
+    metrics.changes.inc();
+    auto watchers = m_watchers.find(user);
+    if (watchers == m_watchers.end()) return;
+    metrics.notifications.inc(watchers->second.size());
+    for (SubscriberId id : watchers->second) {
+        auto subscriber = m_subscribers.find(id);
+        if (subscriber == m_subscribers.end()) continue;
+        subscriber->second.dirty.insert(user);
+        if (!subscriber->second.queued) {
+            subscriber->second.queued = true;
+            m_dirtySubscribers.push_back(id);
+        }
+    }
+}
+
+// ==============================
+// 订阅
+// ==============================
+
+size_t PresenceService::subscribe(SubscriberId id, const std::vector<uint32_t>& users) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    removeSubscriberLocked(id);
+    Subscriber& subscriber = m_subscribers[id];
+    size_t count = std::min(users.size(), m_options.maxWatchedPerSubscriber);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t user = users[i];
+        if (!subscriber.lastSent.emplace(user, Status::OFFLINE).second) continue;
+        m_watchers[user].push_back(id);
+        // 已在线的好友进首帧
+        auto state = m_states.find(user);
+        if (state != m_states.end() && state->second.effective() != Status::OFFLINE) subscriber.dirty.insert(user);
+    }
+    if (!subscriber.dirty.empty()) {
+        subscriber.queued = true;
+        m_dirtySubscribers.push_back(id);
+    }
+    presenceMetrics().subscribers.set(static_cast<int64_t>(m_subscribers.size()));
+    return subscriber.lastSent.size();
+}
+
+void PresenceService::unsubscribe(SubscriberId id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    removeSubscriberLocked(id);
+    presenceMetrics().subscribers.set(static_cast<int64_t>(m_subscribers.size()));
+}
+
+size_t PresenceService::subscriberCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_subscribers.size();
+}
+
+void PresenceService::removeSubscriberLocked(SubscriberId id) {
+    auto it = m_subscribers.find(id);
+    if (it == m_subscribers.end()) return;
+    for (const auto& entry : it->second.lastSent) {
+        auto watchers = m_watchers.find(entry.first);
+        if (watchers == m_watchers.end()) continue;
+        auto& list = watchers->second;
+        list.erase(std::remove(list.begin(), list.end(), id), list.end());
+        if (list.empty()) m_watchers.erase(watchers);
+    }
+    // m_dirtySubscribers 里残留的 id 在刷新时找不到订阅者，直接跳过
+    m_subscribers.erase(it);
+}
+
+// ==============================
+// 刷新
+// ==============================
+
+void PresenceService::flushLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+        m_flushCv.wait_for(lock, std::chrono::milliseconds(m_options.flushIntervalMs));
+        if (!m_running) break;
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+void PresenceService::flush() {
+    // 锁内按当前状态生成各订阅者的帧并更新"上次发送"，锁外写出
+    std::vector<std::pair<SubscriberId, std::string>> frames;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_dirtySubscribers.empty()) return;
+        std::vector<SubscriberId> dirty;
+        dirty.swap(m_dirtySubscribers);
+        PresenceMetrics& metrics = presenceMetrics();
+        for (SubscriberId id : dirty) {
+            auto it = m_subscribers.find(id);
+            if (it == m_subscribers.end() || !it->second.queued) continue;
+            Subscriber& subscriber = it->second;
+            subscriber.queued = false;
+            std::string frame;
+            size_t entries = 0;
+            for (uint32_t user : subscriber.dirty) {
+                auto state = m_states.find(user);
+                Status status = state == m_states.end() ? Status::OFFLINE : state->second.effective();
+                Status& last = subscriber.lastSent[user];
+                if (status == last) continue;     // 周期内变回原状态：不必通知
+                last = status;
+                if (entries == m_options.maxEntriesPerFrame) {
+                    frames.emplace_back(id, std::move(frame));
+                    frame.clear();
+                    entries = 0;
+                }
+                if (frame.empty()) frame = "PRESENCE";
+                frame += '|';
+                frame += m_users.name(user);
+                frame += ':';
+                frame += statusName(status);
+                ++entries;
+                metrics.entries.inc();
+            }
+            subscriber.dirty.clear();
+            if (!frame.empty()) frames.emplace_back(id, std::move(frame));
+        }
+        metrics.frames.inc(frames.size());
+    }
+
+    SubscriberId failed = 0;
+    bool anyFailed = false;
+    for (const auto& entry : frames) {
+        if (anyFailed && entry.first == failed) continue;
+        if (m_sender(entry.first, entry.second)) continue;
+        failed = entry.first;
+        anyFailed = true;
+        unsubscribe(entry.first);
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+// ========================================================================================
+// PresenceService - 在线状态与订阅：状态变化只记账，按周期给每个订阅者合并成一帧
+// ========================================================================================
+// - 每个用户一个状态：ONLINE / AWAY / OFFLINE。在线 = 本节点有已登录的会话或其他节点上有（集群目录）；
+//   AWAY 由客户端声明，用户完全下线时清除
+// - 订阅者（一个会话）订阅一组用户（好友）。被订阅者状态变化时只把它记进各订阅者的待发集合，不发帧；
+//   刷新线程每 flushIntervalMs 给有变化的订阅者发一帧，内容是各用户的当前状态：
+//     PRESENCE|alice:online|bob:away|carol:offline
+//   一个周期内的反复变化只发最终状态，与上次发给该订阅者的相同时不发。登录风暴时每个订阅者每周期至多一帧
+// - 订阅时把被订阅者的"上次发送"记为 offline：不在线的好友不出现在首帧里，首帧即在线好友的快照
+// 用户以 IdInterner 的整数句柄标识，订阅者以调用方给的 64 位 id 标识（ChatServer 用会话句柄）。
+// ========================================================================================
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../common/IdInterner.hpp"
+
+class PresenceService {
+public:
+    enum class Status : uint8_t { OFFLINE = 0, ONLINE = 1, AWAY = 2 };
+
+    using SubscriberId = uint64_t;
+    // 把一帧写给订阅者；返回 false 表示订阅者已不可用（连接断开），它的订阅随之取消
+    using Sender = std::function<bool(SubscriberId subscriber, const std::string& frame)>;
+
+    struct Options {
+        int flushIntervalMs = 500;        // 合并窗口：状态变化最多延迟这么久送达
+        size_t maxEntriesPerFrame = 256;  // 单帧条目上限，超出的拆成多帧
+        size_t maxWatchedPerSubscriber = 5000;
+    };
+
+    static const char* statusName(Status status);
+    // "online" / "away"；客户端只能声明这两种
+    static bool parseStatus(const std::string& name, Status& status);
+
+    PresenceService(IdInterner& users, Sender sender);
+    PresenceService(IdInterner& users, Sender sender, const Options& options);
+    ~PresenceService();
+
+    void start();
+    void stop();
+
+    // ==================== 状态来源 ====================
+    // 本节点上的第一台设备登录 / 最后一台设备下线
+    void setLocalOnline(uint32_t user, bool online);
+    // 用户在其他节点上线 / 下线（每个节点各报一次）
+    void setRemoteOnline(uint32_t user, bool online);
+    // 客户端声明离开 / 回来；用户不在线时忽略
+    void setAway(uint32_t user, bool away);
+    Status statusOf(uint32_t user);
+
+    // ==================== 订阅 ====================
+    // 替换 subscriber 的订阅；返回实际订阅的用户数（超过上限的部分被截掉）
+    size_t subscribe(SubscriberId subscriber, const std::vector<uint32_t>& users);
+    void unsubscribe(SubscriberId subscriber);
+    size_t subscriberCount();
+
+private:
+    PresenceService(const PresenceService&) = delete;
+    PresenceService& operator=(const PresenceService&) = delete;
+
+    struct UserState {
+        bool localOnline = false;
+        uint16_t remoteNodes = 0;
+        bool away = false;
+        Status effective() const {
+            if (!localOnline && remoteNodes == 0) return Status::OFFLINE;
+            return away ? Status::AWAY : Status::ONLINE;
+        }
+    };
+
+    struct Subscriber {
+        std::unordered_map<uint32_t, Status> lastSent;   // 被订阅者 -> 上次发给本订阅者的状态
+        std::unordered_set<uint32_t> dirty;              // 本周期有变化的被订阅者
+        bool queued = false;                             // 已在 m_dirtySubscribers 里
+    };
+
+    // 调用方持有 m_mutex：状态变了就给所有订阅者记脏
+    void updateState(uint32_t user, const UserState& before, const UserState& after);
+    void removeSubscriberLocked(SubscriberId subscriber);
+    void flushLoop();
+    void flush();
+
+    IdInterner& m_users;
+    Sender m_sender;
+    Options m_options;
+
+    std::mutex m_mutex;
+    std::unordered_map<uint32_t, UserState> m_states;                        // 只存非离线的用户
+    std::unordered_map<SubscriberId, Subscriber> m_subscribers;
+    std::unordered_map<uint32_t, std::vector<SubscriberId>> m_watchers;     // 被订阅者 -> 订阅者
+    std::vector<SubscriberId> m_dirtySubscribers;
+
+    std::atomic<bool> m_running;
+    std::condition_variable m_flushCv;
+    std::thread m_flushThread;
+};
@@ -0,0 +1,867 @@
+#include "AsyncChatClient.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#include <poll.h>
+#endif
+
+namespace {
+
+// 帧长度上限：与 TcpSocket 不同，登录捎带离线消息的响应可能较大，这里只防御明显损坏的长度
+const uint32_t MAX_FRAME_SIZE = 16 * 1024 * 1024;
+const size_t READ_CHUNK = 64 * 1024;
+
+#ifdef _WIN32
+// Windows 下没有可放进 WSAPoll 的管道，用短超时轮询发送缓冲
+const int POLL_TIMEOUT_MS = 10;
+#endif
+
+bool wouldBlock() {
+#ifdef _WIN32
+    int err = WSAGetLastError();
+    return err == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+bool interrupted() {
+#ifdef _WIN32
+    return false;
+#else
+    return errno == EINTR;
+#endif
+}
+
+std::string socketErrorText() {
+#ifdef _WIN32
+    return "socket error " + std::to_string(WSAGetLastError());
+#else
+    return std::strerror(errno);
+#endif
+}
+
+void appendFrame(std::string& out, const std::string& payload) {
+    uint32_t len = static_cast<uint32_t>(payload.size());
+    char header[4] = {
+        static_cast<char>((len >> 24) & 0xFF), static_cast<char>((len >> 16) & 0xFF),
+        static_cast<char>((len >> 8) & 0xFF), static_cast<char>(len & 0xFF)
+    };
+    out.append(header, 4);
+    out.append(payload);
+}
+
+int64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 汇总响应中的计数字段：...|SENT:n|CACHED:n|...
+size_t responseCount(const std::string& raw, const char* key) {
+    std::string needle = std::string("|") + key + ":";
+    size_t pos = raw.find(needle);
+    if (pos == std::string::npos) return 0;
+    return static_cast<size_t>(std::strtoul(raw.c_str() + pos + needle.size(), nullptr, 10));
+}
+
+bool startsWith(const std::string& s, const char* prefix) {
+    return s.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+// 当前线程运行的是哪个客户端的事件循环
+thread_local const AsyncChatClient* t_loopOwner = nullptr;
+
+// 用户回调异常不能打断事件循环
+template <typename F, typename... Args>
+void invokeSafely(const F& callback, Args&&... args) {
+    if (!callback) return;
+    try {
+        callback(std::forward<Args>(args)...);
+    } catch (...) {
+    }
+}
+
+} // namespace
+
+// ========================================================================================
+// 构造 / 析构
+// ========================================================================================
+
+AsyncChatClient::AsyncChatClient() : AsyncChatClient(Options()) {}
+
+AsyncChatClient::AsyncChatClient(const Options& options) : m_options(options) {}
+
+AsyncChatClient::~AsyncChatClient() {
+    close();
+}
+
+// ========================================================================================
+// 连接管理
+// ========================================================================================
+
+bool AsyncChatClient::connect(const std::string& host, uint16_t port) {
+    close();
+
+    if (!m_socket.init() || !m_socket.connect(host, port)) {
+        std::lock_guard<std::mutex> lock(m_outMutex);
+        m_lastError = m_socket.getLastError();
+        return false;
+    }
+    if (!m_socket.setNonBlockingMode(true)) {
+        std::lock_guard<std::mutex> lock(m_outMutex);
+        m_lastError = m_socket.getLastError();
+        m_socket.close();
+        return false;
+    }
+
+    // 流水线下连续的小帧不能被 Nagle 攒着等对端 ACK
+    int noDelay = 1;
+    setsockopt(m_socket.nativeHandle(), IPPROTO_TCP, TCP_NODELAY,
+               reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+#ifndef _WIN32
+    if (::pipe(m_wakePipe) != 0) {
+        std::lock_guard<std::mutex> lock(m_outMutex);
+        m_lastError = socketErrorText();
+        m_socket.close();
+        return false;
+    }
+    for (int fd : m_wakePipe) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+#endif
+
+    m_writing.clear();
+    m_writeOffset = 0;
+    m_inbound.clear();
+    m_inboundOffset = 0;
+    m_compressor.reset();
+    m_compressing = false;
+    m_decompressor.reset();
+    if (m_options.compression) {
+        const CompressionDictionary* dictionary = m_options.dictionary.empty() ? nullptr : &m_options.dictionary;
+        m_decompressor.reset(new FrameDecompressor(dictionary));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_outMutex);
+        m_outbound.clear();
+        m_lastError.clear();
+    }
+    m_stopRequested = false;
+    m_connected = true;
+    m_loopThread = std::thread(&AsyncChatClient::eventLoop, this);
+    return true;
+}
+
+void AsyncChatClient::close() {
+    m_stopRequested = true;
+    wake();
+
+    // 在回调里调用 close 时不能 join 自己，线程由之后的 close/析构回收
+    if (!m_loopThread.joinable() || m_loopThread.get_id() == std::this_thread::get_id()) {
+        return;
+    }
+    m_loopThread.join();
+
+#ifndef _WIN32
+    for (int& fd : m_wakePipe) {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+std::string AsyncChatClient::getLastError() const {
+    std::lock_guard<std::mutex> lock(m_outMutex);
+    return m_lastError;
+}
+
+std::string AsyncChatClient::userId() const {
+    std::lock_guard<std::mutex> lock(m_outMutex);
+    return m_userId;
+}
+
+// ========================================================================================
+// 请求接口
+// ========================================================================================
+
+void AsyncChatClient::login(const std::string& userId, ResponseCallback callback) {
+    {
+        std::lock_guard<std::mutex> lock(m_outMutex);
+        m_userId = userId;
+    }
+    std::string frame = "LOGIN|" + userId;
+    if (!m_options.deviceId.empty()) frame += "|" + m_options.deviceId;
+    if (m_options.compression) {
+        frame += "|COMPRESS:lz4";
+        if (!m_options.dictionary.empty()) frame += "+" + m_options.dictionary.id();
+    }
+    enqueue(frame, std::move(callback));
+}
+
+std::future<ChatResponse> AsyncChatClient::login(const std::string& userId) {
+    auto promise = std::make_shared<std::promise<ChatResponse>>();
+    std::future<ChatResponse> future = promise->get_future();
+    login(userId, [promise](const ChatResponse& resp) { promise->set_value(resp); });
+    return future;
+}
+
+void AsyncChatClient::sendMessage(MessageData& msg, ResponseCallback callback) {
+    if (msg.messageId.empty()) {
+        msg.messageId = ProtocolProcessor::generateMessageId();
+    }
+    if (msg.senderId.empty()) {
+        msg.senderId = userId();
+    }
+    std::string frame = ProtocolProcessor::serializeMessage(msg);
+    if (frame.empty()) {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        invokeSafely(callback, localFailure("INVALID_FORMAT", "消息字段无效"));
+        return;
+    }
+    // 自己发出的群消息不会推送回来：用响应里的序号填上本端群会话流的这个位置，
+    // 否则其他成员的下一条消息会被当成出现空缺而等待
+    std::string groupKey = "g:" + msg.receiverId;
+    enqueue(frame, [this, groupKey, callback = std::move(callback)](const ChatResponse& resp) {
+        if (resp.code == "GROUP_SENT" && resp.seq != 0) markOwnSequence(groupKey, resp.seq);
+        invokeSafely(callback, resp);
+    });
+}
+
+std::future<ChatResponse> AsyncChatClient::sendMessage(MessageData& msg) {
+    auto promise = std::make_shared<std::promise<ChatResponse>>();
+    std::future<ChatResponse> future = promise->get_future();
+    sendMessage(msg, [promise](const ChatResponse& resp) { promise->set_value(resp); });
+    return future;
+}
+
+std::future<ChatResponse> AsyncChatClient::sendMessage(const std::string& receiverId, const std::string& content) {
+    MessageData msg("", receiverId, content);
+    return sendMessage(msg);
+}
+
+void AsyncChatClient::sendMessageBatch(std::vector<MessageData>& msgs, BatchCallback callback) {
+    // 所有帧共享的汇总状态，最后一个响应到达时回调
+    struct BatchState {
+        std::mutex mutex;
+        BatchResult result;
+        size_t remaining = 0;
+        BatchCallback callback;
+    };
+    auto state = std::make_shared<BatchState>();
+    state->callback = std::move(callback);
+    state->result.total = msgs.size();
+
+    std::string sender = userId();
+    std::vector<std::vector<std::string>> chunks;
+    std::vector<std::string> current;
+    size_t currentBytes = 0;
+    for (auto& msg : msgs) {
+        if (msg.messageId.empty()) msg.messageId = ProtocolProcessor::generateMessageId();
+        if (msg.senderId.empty()) msg.senderId = sender;
+        std::string frame = ProtocolProcessor::serializeMessage(msg);
+        if (frame.empty()) {
+            ++state->result.invalid;
+            continue;
+        }
+        size_t entryBytes = frame.size() + 8;   // 十进制长度 + ':'
+        if (!current.empty() && (currentBytes + entryBytes > m_options.maxBatchBytes ||
+                                 current.size() >= m_options.maxBatchMessages)) {
+            chunks.push_back(std::move(current));
+            current.clear();
+            currentBytes = 0;
+        }
+        current.push_back(std::move(frame));
+        currentBytes += entryBytes;
+    }
+    if (!current.empty()) chunks.push_back(std::move(current));
+
+    state->result.frames = chunks.size();
+    state->remaining = chunks.size();
+    if (chunks.empty()) {
+        state->result.ok = state->result.invalid == 0;
+        invokeSafely(state->callback, state->result);
+        return;
+    }
+
+    for (const auto& chunk : chunks) {
+        size_t chunkSize = chunk.size();
+        enqueue(ProtocolProcessor::serializeMessageBatch(chunk), [state, chunkSize](const ChatResponse& resp) {
+            BatchCallback done;
+            BatchResult result;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                BatchResult& r = state->result;
+                if (resp.code == "BATCH_SENT" || resp.code == "BATCH_PARTIAL") {
+                    r.sent += responseCount(resp.raw, "SENT");
+                    r.cached += responseCount(resp.raw, "CACHED");
+                    r.group += responseCount(resp.raw, "GROUP");
+                    r.failed += responseCount(resp.raw, "FAILED");
+                    r.invalid += responseCount(resp.raw, "INVALID");
+                } else {
+                    r.failed += chunkSize;   // 整帧被拒绝或断线
+                }
+                r.responses.push_back(resp);
+                if (--state->remaining > 0) return;
+                r.ok = (r.failed == 0 && r.invalid == 0);
+                done = std::move(state->callback);
+                result = std::move(r);
+            }
+            invokeSafely(done, result);
+        });
+    }
+}
+
+std::future<AsyncChatClient::BatchResult> AsyncChatClient::sendMessageBatch(std::vector<MessageData>& msgs) {
+    auto promise = std::make_shared<std::promise<BatchResult>>();
+    std::future<BatchResult> future = promise->get_future();
+    sendMessageBatch(msgs, [promise](const BatchResult& result) { promise->set_value(result); });
+    return future;
+}
+
+void AsyncChatClient::logout(ResponseCallback callback) {
+    enqueue("LOGOUT|" + userId(), std::move(callback));
+}
+
+std::future<ChatResponse> AsyncChatClient::logout() {
+    auto promise = std::make_shared<std::promise<ChatResponse>>();
+    std::future<ChatResponse> future = promise->get_future();
+    logout([promise](const ChatResponse& resp) { promise->set_value(resp); });
+    return future;
+}
+
+bool AsyncChatClient::sendAck(const std::string& messageId) {
+    if (messageId.empty() || !isConnected()) return false;
+    enqueue(ProtocolProcessor::serializeAck(AckData(messageId, userId())), nullptr);
+    m_acksSent.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void AsyncChatClient::sendRequest(const std::string& frame, ResponseCallback callback) {
+    enqueue(frame, std::move(callback));
+}
+
+AsyncChatClient::Stats AsyncChatClient::stats() const {
+    Stats s;
+    s.framesSent = m_framesSent.load(std::memory_order_relaxed);
+    s.framesReceived = m_framesReceived.load(std::memory_order_relaxed);
+    s.bytesSent = m_bytesSent.load(std::memory_order_relaxed);
+    s.bytesReceived = m_bytesReceived.load(std::memory_order_relaxed);
+    s.acksSent = m_acksSent.load(std::memory_order_relaxed);
+    s.messagesReceived = m_messagesReceived.load(std::memory_order_relaxed);
+    s.responsesReceived = m_responsesReceived.load(std::memory_order_relaxed);
+    s.rejected = m_rejected.load(std::memory_order_relaxed);
+    s.duplicatesDropped = m_duplicatesDropped.load(std::memory_order_relaxed);
+    s.reordered = m_reordered.load(std::memory_order_relaxed);
+    s.gapsSkipped = m_gapsSkipped.load(std::memory_order_relaxed);
+    s.compressing = m_compressing.load(std::memory_order_relaxed);
+    s.framesCompressed = m_framesCompressed.load(std::memory_order_relaxed);
+    s.framesDecompressed = m_framesDecompressed.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_outMutex);
+    s.pendingRequests = m_pending.size();
+    s.outboundBytes = m_outbound.size();
+    return s;
+}
+
+// ========================================================================================
+// 发送缓冲：生产者追加，事件循环交换后写出
+// ========================================================================================
+
+void AsyncChatClient::enqueue(const std::string& frame, ResponseCallback callback) {
+    const char* failCode = nullptr;
+    const char* failText = nullptr;
+    bool wasEmpty = false;
+    bool reachedThreshold = false;
+    {
+        std::lock_guard<std::mutex> lock(m_outMutex);
+        if (!m_connected.load(std::memory_order_acquire)) {
+            failCode = "DISCONNECTED";
+            failText = "未连接到服务器";
+        } else if (m_outbound.size() + frame.size() > m_options.maxOutboundBytes) {
+            failCode = "BACKPRESSURE";
+            failText = "发送缓冲已满";
+        } else {
+            wasEmpty = m_outbound.empty();
+            size_t before = m_outbound.size();
+            appendFrame(m_outbound, frame);
+            if (wasEmpty) m_outboundSinceNs = steadyNowNs();
+            reachedThreshold = m_options.coalesceWindowUs > 0 && before < m_options.coalesceBytes &&
+                               m_outbound.size() >= m_options.coalesceBytes;
+            if (callback) m_pending.push_back(std::move(callback));
+        }
+    }
+
+    if (failCode) {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        invokeSafely(callback, localFailure(failCode, failText));
+        return;
+    }
+    m_framesSent.fetch_add(1, std::memory_order_relaxed);
+    // 缓冲原本非空时事件循环必然还会再来取（合并窗口已在计时），不必重复唤醒，除非刚攒够
+    // 阈值需要提前写出；事件循环线程自己追加的帧（自动 ACK、回调里发的请求）在回到循环顶部
+    // 时处理，也不需要唤醒
+    if ((wasEmpty || reachedThreshold) && t_loopOwner != this) wake();
+}
+
+void AsyncChatClient::wake() {
+#ifndef _WIN32
+    if (m_wakePipe[1] >= 0) {
+        char b = 1;
+        ssize_t ignored = ::write(m_wakePipe[1], &b, 1);   // 管道满说明已有未处理的唤醒
+        (void)ignored;
+    }
+#endif
+}
+
+// ========================================================================================
+// 事件循环
+// ========================================================================================
+
+void AsyncChatClient::eventLoop() {
+    const SocketHandle fd = m_socket.nativeHandle();
+    std::string reason = "closed";
+    t_loopOwner = this;
+
+    while (!m_stopRequested.load(std::memory_order_acquire)) {
+        if (!flushOutbound()) {
+            reason = getLastError();
+            break;
+        }
+        bool wantWrite = m_writeOffset < m_writing.size();
+        // 合并窗口内的数据：poll 最多睡到窗口结束；等待重排的消息：最多睡到最早的超时
+        int64_t delayNs = wantWrite ? -1 : flushDelayNs();
+        int64_t holdNs = releaseExpired();
+        if (holdNs >= 0 && (delayNs < 0 || holdNs < delayNs)) delayNs = holdNs;
+
+#ifdef _WIN32
+        WSAPOLLFD fds[1];
+        fds[0].fd = fd;
+        fds[0].events = POLLRDNORM | (wantWrite ? POLLWRNORM : 0);
+        fds[0].revents = 0;
+        int timeoutMs = POLL_TIMEOUT_MS;
+        if (delayNs >= 0) timeoutMs = static_cast<int>(std::min<int64_t>(POLL_TIMEOUT_MS, (delayNs + 999999) / 1000000));
+        int ready = WSAPoll(fds, 1, timeoutMs);
+#else
+        pollfd fds[2];
+        fds[0].fd = fd;
+        fds[0].events = static_cast<short>(POLLIN | (wantWrite ? POLLOUT : 0));
+        fds[0].revents = 0;
+        fds[1].fd = m_wakePipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+#  ifdef __linux__
+        timespec timeout{ static_cast<time_t>(delayNs / 1000000000), static_cast<long>(delayNs % 1000000000) };
+        int ready = ::ppoll(fds, 2, delayNs >= 0 ? &timeout : nullptr, nullptr);
+#  else
+        int ready = ::poll(fds, 2, delayNs >= 0 ? static_cast<int>((delayNs + 999999) / 1000000) : -1);
+#  endif
+#endif
+        if (ready < 0) {
+            if (interrupted()) continue;
+            reason = socketErrorText();
+            break;
+        }
+
+#ifndef _WIN32
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (::read(m_wakePipe[0], drain, sizeof(drain)) > 0) {}
+        }
+#endif
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (!readInbound()) {
+                reason = getLastError();
+                break;
+            }
+        }
+    }
+
+    // 主动关闭时尽量把已排队的帧（如 LOGOUT）写出去
+    if (m_stopRequested.load(std::memory_order_acquire)) {
+        flushOutbound();
+    }
+    shutdownLoop(reason);
+}
+
+bool AsyncChatClient::flushOutbound() {
+    const SocketHandle fd = m_socket.nativeHandle();
+    while (true) {
+        bool swapped = false;
+        if (m_writeOffset >= m_writing.size()) {
+            m_writing.clear();
+            m_writeOffset = 0;
+            std::lock_guard<std::mutex> lock(m_outMutex);
+            if (m_outbound.empty()) return true;
+            if (m_options.coalesceWindowUs > 0 && !m_stopRequested.load(std::memory_order_relaxed) &&
+                m_outbound.size() < m_options.coalesceBytes &&
+                steadyNowNs() - m_outboundSinceNs < static_cast<int64_t>(m_options.coalesceWindowUs) * 1000) {
+                return true;   // 窗口未到，等更多帧一起写
+            }
+            m_writing.swap(m_outbound);
+            swapped = true;
+        }
+        if (swapped && m_compressor) {
+            // 刚换入的整批帧：在锁外逐帧压缩（压缩上下文只在事件循环线程使用）
+            size_t compressed = m_compressor->compressFrames(m_writing.data(), m_writing.size(), m_compressed,
+                                                             TcpSocket::COMPRESSED_FRAME_FLAG);
+            if (compressed > 0) {
+                m_writing.swap(m_compressed);
+                m_framesCompressed.fetch_add(compressed, std::memory_order_relaxed);
+            }
+        }
+
+        while (m_writeOffset < m_writing.size()) {
+#ifdef _WIN32
+            int n = ::send(fd, m_writing.data() + m_writeOffset,
+                           static_cast<int>(m_writing.size() - m_writeOffset), 0);
+#else
+            ssize_t n = ::send(fd, m_writing.data() + m_writeOffset, m_writing.size() - m_writeOffset, MSG_NOSIGNAL);
+#endif
+            if (n > 0) {
+                m_writeOffset += static_cast<size_t>(n);
+                m_bytesSent.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+                continue;
+            }
+            if (n < 0 && interrupted()) continue;
+            if (n < 0 && wouldBlock()) return true;   // 等 POLLOUT
+            std::lock_guard<std::mutex> lock(m_outMutex);
+            m_lastError = socketErrorText();
+            return false;
+        }
+    }
+}
+
+int64_t AsyncChatClient::flushDelayNs() {
+    if (m_options.coalesceWindowUs == 0) return -1;
+    std::lock_guard<std::mutex> lock(m_outMutex);
+    if (m_outbound.empty()) return -1;
+    int64_t remaining = m_outboundSinceNs + static_cast<int64_t>(m_options.coalesceWindowUs) * 1000 - steadyNowNs();
+    return remaining > 0 ? remaining : 0;
+}
+
+bool AsyncChatClient::readInbound() {
+    const SocketHandle fd = m_socket.nativeHandle();
+    char buf[READ_CHUNK];
+    bool open = true;
+
+    while (true) {
+#ifdef _WIN32
+        int n = ::recv(fd, buf, static_cast<int>(sizeof(buf)), 0);
+#else
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+#endif
+        if (n > 0) {
+            m_inbound.append(buf, static_cast<size_t>(n));
+            m_bytesReceived.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+            if (static_cast<size_t>(n) < sizeof(buf)) break;
+            continue;
+        }
+        if (n == 0) {
+            std::lock_guard<std::mutex> lock(m_outMutex);
+            m_lastError = "peer closed";
+            open = false;
+            break;
+        }
+        if (interrupted()) continue;
+        if (wouldBlock()) break;
+        std::lock_guard<std::mutex> lock(m_outMutex);
+        m_lastError = socketErrorText();
+        open = false;
+        break;
+    }
+
+    // 拆出所有完整的帧；对端关闭前已到达的帧照常分发
+    while (m_inbound.size() - m_inboundOffset >= 4) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(m_inbound.data() + m_inboundOffset);
+        uint32_t header = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+                          (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+        uint32_t len = header & ~TcpSocket::COMPRESSED_FRAME_FLAG;
+        if (len > MAX_FRAME_SIZE) {
+            std::lock_guard<std::mutex> lock(m_outMutex);
+            m_lastError = "frame too large";
+            return false;
+        }
+        if (m_inbound.size() - m_inboundOffset - 4 < len) break;
+        std::string frame;
+        if (header & TcpSocket::COMPRESSED_FRAME_FLAG) {
+            if (!m_decompressor || !m_decompressor->decompress(m_inbound.data() + m_inboundOffset + 4, len, frame,
+                                                              TcpSocket::MAX_PIPE_MESSAGE_SIZE)) {
+                std::lock_guard<std::mutex> lock(m_outMutex);
+                m_lastError = m_decompressor ? "corrupt compressed frame" : "unexpected compressed frame";
+                return false;
+            }
+            m_framesDecompressed.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            frame.assign(m_inbound, m_inboundOffset + 4, len);
+        }
+        m_inboundOffset += 4 + len;
+        m_framesReceived.fetch_add(1, std::memory_order_relaxed);
+        dispatchFrame(frame);
+    }
+
+    if (m_inboundOffset == m_inbound.size()) {
+        m_inbound.clear();
+        m_inboundOffset = 0;
+    } else if (m_inboundOffset >= READ_CHUNK) {
+        m_inbound.erase(0, m_inboundOffset);
+        m_inboundOffset = 0;
+    }
+    return open;
+}
+
+// ========================================================================================
+// 帧分发
+// ========================================================================================
+
+void AsyncChatClient::dispatchFrame(const std::string& frame) {
+    if (startsWith(frame, "MESSAGE|")) {
+        MessageData msg;
+        if (ProtocolProcessor::deserializeMessage(frame, msg)) {
+            deliverMessage(msg, false);
+            return;
+        }
+    } else if (startsWith(frame, "RESPONSE|") && !startsWith(frame, "RESPONSE|OFFLINE_MESSAGES|")) {
+        dispatchResponse(frame);
+        return;
+    }
+    invokeSafely(m_onNotice, frame);
+}
+
+void AsyncChatClient::dispatchResponse(const std::string& frame) {
+    ResponseCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(m_outMutex);
+        if (!m_pending.empty()) {
+            callback = std::move(m_pending.front());
+            m_pending.pop_front();
+        }
+    }
+    m_responsesReceived.fetch_add(1, std::memory_order_relaxed);
+    ChatResponse resp = parseResponse(frame);
+
+    // 登录响应捎带离线消息：...|OFFLINE_COUNT:n|MESSAGE|...|MESSAGE|...
+    // 先逐条交付（并 ACK），再完成登录请求
+    if (resp.ok && resp.code == "LOGIN_OK") {
+        // 服务器同意压缩：之后换入发送缓冲的帧开始压缩
+        if (m_decompressor && !m_compressor) {
+            size_t offered = frame.find("|COMPRESS:lz4");
+            size_t countPos = frame.find("|OFFLINE_COUNT:");
+            if (offered != std::string::npos && (countPos == std::string::npos || offered < countPos)) {
+                const CompressionDictionary* dictionary = m_options.dictionary.empty() ? nullptr : &m_options.dictionary;
+                m_compressor.reset(new FrameCompressor(dictionary, m_options.compressMinBytes));
+                m_compressing = true;
+            }
+        }
+        size_t countPos = frame.find("|OFFLINE_COUNT:");
+        size_t cur = countPos == std::string::npos ? std::string::npos : frame.find("MESSAGE|", countPos);
+        while (cur != std::string::npos) {
+            size_t next = frame.find("|MESSAGE|", cur);
+            std::string part = frame.substr(cur, next == std::string::npos ? std::string::npos : next - cur);
+            MessageData msg;
+            if (ProtocolProcessor::deserializeMessage(part, msg)) {
+                deliverMessage(msg, true);
+            }
+            cur = next == std::string::npos ? next : next + 1;
+        }
+    }
+
+    if (callback) {
+        invokeSafely(callback, resp);
+    } else {
+        invokeSafely(m_onNotice, frame);
+    }
+}
+
+void AsyncChatClient::deliverMessage(const MessageData& msg, bool offline) {
+    m_messagesReceived.fetch_add(1, std::memory_order_relaxed);
+    // 重复的消息也要 ACK：服务器重发往往是因为上一次的 ACK 没有及时到达
+    if (m_options.autoAck && !msg.messageId.empty()) {
+        sendAck(msg.messageId);
+    }
+    if (msg.seq == 0) {
+        invokeSafely(m_onMessage, msg, offline);
+        return;
+    }
+
+    InboundStream& stream = inboundStream(streamKeyFor(msg, userId()), msg.seq);
+    // 只丢弃窗口内确实见过的序号；早于窗口的无法判断，照常交付，宁可重复也不丢消息
+    if (stream.seen.seen(msg.seq)) {
+        m_duplicatesDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    stream.seen.insert(msg.seq);
+    HeldMessage message;
+    message.msg = msg;
+    message.offline = offline;
+    acceptSequenced(stream, msg.seq, std::move(message));
+}
+
+// ========================================================================================
+// 按会话流重排：序号连续的直接交付，出现空缺的先持有，空缺补齐或等待超时后按序交付
+// ========================================================================================
+
+std::string AsyncChatClient::streamKeyFor(const MessageData& msg, const std::string& self) {
+    // 发给自己的是私聊（流按对方区分），否则接收方是群
+    return msg.receiverId == self ? "d:" + msg.senderId : "g:" + msg.receiverId;
+}
+
+AsyncChatClient::InboundStream& AsyncChatClient::inboundStream(const std::string& streamKey, uint64_t seq) {
+    std::string key = streamKey + "@" + std::to_string(StreamSequence::epochOf(seq));
+    auto it = m_inboundStreams.find(key);
+    if (it != m_inboundStreams.end()) return it->second;
+    // 纪元随节点、重建和计数用完不断更替：超过上限时丢掉没有持有消息的旧状态，
+    // 只损失它们的去重记录（之后的重发会再交付一次）
+    if (m_inboundStreams.size() >= MAX_INBOUND_STREAMS) {
+        for (auto old = m_inboundStreams.begin(); old != m_inboundStreams.end();) {
+            old = old->second.held.empty() ? m_inboundStreams.erase(old) : std::next(old);
+        }
+    }
+    return m_inboundStreams[key];
+}
+
+void AsyncChatClient::acceptSequenced(InboundStream& stream, uint64_t seq, HeldMessage&& message) {
+    if (m_options.reorderWindowMs == 0) {
+        stream.delivered = std::max(stream.delivered, seq);
+        emitMessage(message);
+        return;
+    }
+    if (stream.delivered == 0 || seq > stream.delivered + SequenceWindow::WIDTH) {
+        // 第一次见到该流的这个纪元，或序号跳出窗口（如中间的消息已被服务器丢弃）：放出持有的消息，以它为新基准
+        releaseHeld(stream, true);
+        stream.delivered = seq;
+        emitMessage(message);
+        return;
+    }
+    if (seq <= stream.delivered) {
+        // 空缺已因超时被跳过之后才到达：不再排序，直接交付
+        m_reordered.fetch_add(1, std::memory_order_relaxed);
+        emitMessage(message);
+        return;
+    }
+    if (seq == stream.delivered + 1) {
+        if (!stream.held.empty()) m_reordered.fetch_add(1, std::memory_order_relaxed);
+        stream.delivered = seq;
+        emitMessage(message);
+        releaseHeld(stream, false);
+        return;
+    }
+    message.deadlineNs = steadyNowNs() + static_cast<int64_t>(m_options.reorderWindowMs) * 1000000;
+    stream.held.emplace(seq, std::move(message));
+    ++m_heldCount;
+}
+
+void AsyncChatClient::releaseHeld(InboundStream& stream, bool all) {
+    while (!stream.held.empty()) {
+        auto it = stream.held.begin();
+        if (it->first != stream.delivered + 1) {
+            if (!all) break;
+            m_gapsSkipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        stream.delivered = it->first;
+        HeldMessage message = std::move(it->second);
+        stream.held.erase(it);
+        --m_heldCount;
+        emitMessage(message);
+    }
+}
+
+void AsyncChatClient::markOwnSequence(const std::string& streamKey, uint64_t seq) {
+    InboundStream& stream = inboundStream(streamKey, seq);
+    if (stream.seen.seen(seq)) return;
+    stream.seen.insert(seq);
+    HeldMessage marker;
+    marker.own = true;
+    acceptSequenced(stream, seq, std::move(marker));
+}
+
+int64_t AsyncChatClient::releaseExpired() {
+    if (m_heldCount == 0) return -1;
+    int64_t now = steadyNowNs();
+    int64_t next = -1;
+    for (auto& entry : m_inboundStreams) {
+        InboundStream& stream = entry.second;
+        // 序号最小的持有消息等待超时：跳过它前面的空缺
+        while (!stream.held.empty() && stream.held.begin()->second.deadlineNs <= now) {
+            m_gapsSkipped.fetch_add(1, std::memory_order_relaxed);
+            stream.delivered = stream.held.begin()->first - 1;
+            releaseHeld(stream, false);
+        }
+        if (!stream.held.empty()) {
+            int64_t remaining = stream.held.begin()->second.deadlineNs - now;
+            if (next < 0 || remaining < next) next = remaining;
+        }
+    }
+    return next;
+}
+
+void AsyncChatClient::emitMessage(const HeldMessage& message) {
+    if (!message.own) invokeSafely(m_onMessage, message.msg, message.offline);
+}
+
+void AsyncChatClient::failPending(const std::string& reason) {
+    std::deque<ResponseCallback> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_outMutex);
+        pending.swap(m_pending);
+        m_outbound.clear();
+    }
+    ChatResponse failure = localFailure("DISCONNECTED", reason);
+    for (auto& callback : pending) {
+        invokeSafely(callback, failure);
+    }
+}
+
+void AsyncChatClient::shutdownLoop(const std::string& reason) {
+    bool wasConnected = m_connected.exchange(false, std::memory_order_acq_rel);
+    m_socket.close();
+    // 断开前交付仍在等待空缺的消息；去重窗口保留，重连后服务器补发的消息仍能识别
+    for (auto& entry : m_inboundStreams) releaseHeld(entry.second, true);
+    failPending(reason);
+    // 主动 close 不算断线
+    if (wasConnected && !m_stopRequested.load(std::memory_order_acquire)) {
+        invokeSafely(m_onDisconnect, reason);
+    }
+}
+
+ChatResponse AsyncChatClient::parseResponse(const std::string& frame) {
+    // RESPONSE|status|code|text[|...]
+    ChatResponse resp;
+    resp.raw = frame;
+    size_t statusBegin = frame.find('|');
+    if (statusBegin == std::string::npos) return resp;
+    size_t codeBegin = frame.find('|', statusBegin + 1);
+    std::string status = frame.substr(statusBegin + 1,
+        codeBegin == std::string::npos ? std::string::npos : codeBegin - statusBegin - 1);
+    resp.ok = (status == "SUCCESS");
+    if (codeBegin == std::string::npos) return resp;
+    size_t textBegin = frame.find('|', codeBegin + 1);
+    resp.code = frame.substr(codeBegin + 1,
+        textBegin == std::string::npos ? std::string::npos : textBegin - codeBegin - 1);
+    if (textBegin == std::string::npos) return resp;
+    size_t textEnd = frame.find('|', textBegin + 1);
+    resp.text = frame.substr(textBegin + 1,
+        textEnd == std::string::npos ? std::string::npos : textEnd - textBegin - 1);
+    // 发送消息的响应以 |SEQ:n 结尾（登录响应捎带的消息帧里也有 SEQ，不在这里解析）
+    if (resp.code != "LOGIN_OK") {
+        size_t seqPos = frame.rfind("|SEQ:");
+        if (seqPos != std::string::npos && seqPos > textBegin) {
+            resp.seq = std::strtoull(frame.c_str() + seqPos + 5, nullptr, 10);
+        }
+    }
+    return resp;
+}
+
+ChatResponse AsyncChatClient::localFailure(const std::string& code, const std::string& text) {
+    ChatResponse resp;
+    resp.ok = false;
+    resp.code = code;
+    resp.text = text;
+    return resp;
+}
@@ -0,0 +1,236 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../network/tcp_socket.hpp"
+#include "../common/Protocol.hpp"
+#include "../common/SequenceWindow.hpp"
+#include "../common/Compression.hpp"
+
+// ========================================================================================
+// AsyncChatClient - 非阻塞聊天客户端库（无界面，可用于控制台客户端、机器人和压测）
+// ========================================================================================
+// - 一个连接一个事件循环线程：poll 等待可读/可写，收发都不阻塞调用方
+// - 流水线发送：请求写入发送缓冲后立即返回，不等上一条的响应；服务器对同一连接
+//   按顺序处理请求，响应按 FIFO 与待响应请求一一对应，通过回调或 future 交付
+// - 收到推送的 MESSAGE（包括登录响应捎带的离线消息）自动回 ACK，再交给 onMessage；
+//   带序号的消息按会话流（私聊按对方、群聊按群）去重，并在 reorderWindowMs 内按序号重排，
+//   空缺超时后跳过，不会无限等待
+// - 可选合并窗口（类似 Nagle）：发送缓冲的第一帧最多等 coalesceWindowUs 微秒或攒够
+//   coalesceBytes 字节再写，突发的多帧合并成一次系统调用；sendMessageBatch 把整批消息
+//   编成 MESSAGE_BATCH 帧，服务器一次路由并只回一条汇总响应
+// - 可选连接压缩：LOGIN 时请求 COMPRESS:lz4[+字典id]，服务器同意后两个方向的大帧按连接级
+//   流式上下文压缩（解压端在连接时就建好，服务器开启后推来的第一帧就可能是压缩的）
+// - 发送缓冲超过上限时请求立即以 BACKPRESSURE 失败；连接断开时所有未完成请求以
+//   DISCONNECTED 失败，不会有永远等不到的 future
+// 所有回调都在事件循环线程上调用，回调里不能阻塞等待本客户端的 future。
+// ========================================================================================
+
+// 服务器响应：RESPONSE|SUCCESS/ERROR|code|text
+struct ChatResponse {
+    bool ok = false;
+    std::string code;      // LOGIN_OK / MESSAGE_SENT / MESSAGE_CACHED / ...，本地失败为 DISCONNECTED / BACKPRESSURE
+    std::string text;
+    std::string raw;       // 完整响应帧（登录捎带的离线消息已拆出交给 onMessage）
+    uint64_t seq = 0;      // 发送消息的响应中服务器分配的会话流序号（SEQ:n），没有为 0
+};
+
+class AsyncChatClient {
+public:
+    using ResponseCallback = std::function<void(const ChatResponse&)>;
+    // offline 为 true 表示消息来自登录响应捎带的离线消息
+    using MessageCallback = std::function<void(const MessageData&, bool offline)>;
+    // 与请求无关的通知帧（如 RESPONSE|OFFLINE_MESSAGES|COUNT|n）
+    using NoticeCallback = std::function<void(const std::string& frame)>;
+    using DisconnectCallback = std::function<void(const std::string& reason)>;
+
+    struct Options {
+        size_t maxOutboundBytes = 8 * 1024 * 1024;   // 发送缓冲上限（字节），超过即拒绝新请求
+        bool autoAck = true;                         // 收到消息自动回 ACK
+        uint32_t coalesceWindowUs = 0;               // 合并窗口（微秒），0 表示有数据就写
+        size_t coalesceBytes = 16 * 1024;            // 缓冲达到该字节数立即写出，不等窗口结束
+        size_t maxBatchBytes = 60 * 1024;            // 单个 MESSAGE_BATCH 帧上限（服务器单帧上限 64KB）
+        size_t maxBatchMessages = 500;               // 单个 MESSAGE_BATCH 帧最多消息数（与服务器一致）
+        std::string deviceId;                        // 登录时声明的设备标识（同一用户多端在线时区分连接），空为默认设备
+        uint32_t reorderWindowMs = 100;              // 序号出现空缺时最多等待的毫秒数，0 表示只去重不重排
+        bool compression = false;                    // 登录时请求连接压缩
+        CompressionDictionary dictionary = CompressionDictionary::builtin();   // 须与服务器一致；空表示不用字典
+        size_t compressMinBytes = 48;                // 小于该长度的帧不压缩
+    };
+
+    // sendMessageBatch 的汇总结果；一批消息可能被拆成多个 MESSAGE_BATCH 帧
+    struct BatchResult {
+        bool ok = false;          // 没有未确认 / 无效 / 未发出的消息
+        size_t total = 0;
+        size_t sent = 0;          // 接收方已 ACK
+        size_t cached = 0;        // 接收方离线，已缓存
+        size_t group = 0;         // 群消息（已扇出）
+        size_t failed = 0;        // 发出后未确认（服务器已转存离线），或整帧因断线/背压未发出
+        size_t invalid = 0;       // 字段无效，未发送
+        size_t frames = 0;        // 拆成的 MESSAGE_BATCH 帧数
+        std::vector<ChatResponse> responses;   // 各帧的响应，按到达顺序
+    };
+    using BatchCallback = std::function<void(const BatchResult&)>;
+
+    struct Stats {
+        uint64_t framesSent = 0;       // 已进入发送缓冲的帧
+        uint64_t framesReceived = 0;
+        uint64_t bytesSent = 0;
+        uint64_t bytesReceived = 0;
+        uint64_t acksSent = 0;
+        uint64_t messagesReceived = 0;
+        uint64_t responsesReceived = 0;
+        uint64_t rejected = 0;         // 因背压或未连接被拒绝的请求
+        uint64_t duplicatesDropped = 0;   // 按序号判定为重复、未交给 onMessage 的消息（仍会 ACK）
+        uint64_t reordered = 0;        // 晚于后续序号到达的消息
+        uint64_t gapsSkipped = 0;      // 等待超时后跳过的序号空缺
+        bool compressing = false;      // 服务器已同意压缩
+        uint64_t framesCompressed = 0;     // 压缩后发出的帧
+        uint64_t framesDecompressed = 0;   // 收到并解压的帧
+        size_t pendingRequests = 0;    // 已发出、等待响应的请求
+        size_t outboundBytes = 0;      // 尚未写入 socket 的字节
+    };
+
+    AsyncChatClient();
+    explicit AsyncChatClient(const Options& options);
+    ~AsyncChatClient();
+
+    // 回调应在 connect 之前设置
+    void onMessage(MessageCallback callback) { m_onMessage = std::move(callback); }
+    void onNotice(NoticeCallback callback) { m_onNotice = std::move(callback); }
+    void onDisconnect(DisconnectCallback callback) { m_onDisconnect = std::move(callback); }
+
+    // 建立连接（阻塞到 TCP 连接完成）并启动事件循环
+    bool connect(const std::string& host, uint16_t port);
+    // 停止事件循环并关闭连接；未完成的请求以 DISCONNECTED 失败
+    void close();
+    bool isConnected() const { return m_connected.load(std::memory_order_acquire); }
+    std::string getLastError() const;
+    std::string userId() const;
+
+    // LOGIN|userId[|deviceId][|COMPRESS:...]；成功后 userId 用于自动 ACK
+    void login(const std::string& userId, ResponseCallback callback);
+    std::future<ChatResponse> login(const std::string& userId);
+
+    // 发送消息：msg 缺少 messageId / senderId 时就地补上，调用方可据此关联后续事件。
+    // 私聊响应 MESSAGE_SENT 表示接收方已 ACK；MESSAGE_CACHED 表示已存为离线消息
+    void sendMessage(MessageData& msg, ResponseCallback callback);
+    std::future<ChatResponse> sendMessage(MessageData& msg);
+    std::future<ChatResponse> sendMessage(const std::string& receiverId, const std::string& content);
+
+    // 批量发送：msgs 中缺少的 messageId / senderId 就地补上；全部帧的响应到齐后回调一次
+    void sendMessageBatch(std::vector<MessageData>& msgs, BatchCallback callback);
+    std::future<BatchResult> sendMessageBatch(std::vector<MessageData>& msgs);
+
+    void logout(ResponseCallback callback);
+    std::future<ChatResponse> logout();
+
+    // 手动确认消息（关闭 autoAck 时使用）；ACK 没有响应
+    bool sendAck(const std::string& messageId);
+
+    // 发送任意一条需要响应的命令帧，供机器人 / 压测发送自定义请求
+    void sendRequest(const std::string& frame, ResponseCallback callback);
+
+    Stats stats() const;
+
+private:
+    AsyncChatClient(const AsyncChatClient&) = delete;
+    AsyncChatClient& operator=(const AsyncChatClient&) = delete;
+
+    // 把一帧追加到发送缓冲；callback 非空时登记为待响应请求
+    void enqueue(const std::string& frame, ResponseCallback callback);
+    void wake();
+
+    void eventLoop();
+    bool flushOutbound();           // 尽量写出发送缓冲，出错返回 false；合并窗口未到时留待下次
+    int64_t flushDelayNs();         // 距合并窗口结束的纳秒数，-1 表示没有等待中的数据
+    bool readInbound();             // 读到 EAGAIN 为止并分发完整帧，出错/对端关闭返回 false
+    void dispatchFrame(const std::string& frame);
+    void dispatchResponse(const std::string& frame);
+    void deliverMessage(const MessageData& msg, bool offline);
+
+    // 按会话流的去重 / 重排状态，只由事件循环线程访问
+    struct HeldMessage {
+        MessageData msg;
+        bool offline = false;
+        bool own = false;          // 自己发出的群消息只占位，不交付
+        int64_t deadlineNs = 0;
+    };
+    struct InboundStream {
+        SequenceWindow seen;
+        uint64_t delivered = 0;                    // 已按序交付到的序号，0 表示还没有基准
+        std::map<uint64_t, HeldMessage> held;      // 等待前面空缺补齐的消息
+    };
+    static std::string streamKeyFor(const MessageData& msg, const std::string& self);
+    // 序号所在 (会话流, 纪元) 的状态：不同节点或不同时期编的号互不可比，各自去重、重排
+    InboundStream& inboundStream(const std::string& streamKey, uint64_t seq);
+    void acceptSequenced(InboundStream& stream, uint64_t seq, HeldMessage&& message);
+    void releaseHeld(InboundStream& stream, bool all);   // 交付连续的（all 时交付全部）持有消息
+    void markOwnSequence(const std::string& streamKey, uint64_t seq);
+    int64_t releaseExpired();      // 交付等待超时的消息，返回距下一个超时的纳秒数，-1 表示没有
+    void emitMessage(const HeldMessage& message);
+    void failPending(const std::string& reason);
+    void shutdownLoop(const std::string& reason);
+
+    static ChatResponse parseResponse(const std::string& frame);
+    static ChatResponse localFailure(const std::string& code, const std::string& text);
+
+    Options m_options;
+    TcpSocket m_socket;
+    std::thread m_loopThread;
+    std::atomic<bool> m_connected{false};
+    std::atomic<bool> m_stopRequested{false};
+
+    MessageCallback m_onMessage;
+    NoticeCallback m_onNotice;
+    DisconnectCallback m_onDisconnect;
+
+    // 生产者与事件循环共享：发送缓冲 + 待响应请求队列（同一把锁保证二者顺序一致）
+    mutable std::mutex m_outMutex;
+    std::string m_outbound;
+    int64_t m_outboundSinceNs = 0;  // 发送缓冲由空变非空的时刻（合并窗口起点）
+    std::deque<ResponseCallback> m_pending;
+    std::string m_userId;
+    std::string m_lastError;
+
+    // 只由事件循环线程访问
+    std::string m_writing;          // 正在写出的缓冲（与 m_outbound 交换）
+    size_t m_writeOffset = 0;
+    std::string m_inbound;          // 已读未解析的字节
+    size_t m_inboundOffset = 0;
+    std::unordered_map<std::string, InboundStream> m_inboundStreams;   // 键为 "流@纪元"
+    static constexpr size_t MAX_INBOUND_STREAMS = 4096;
+    size_t m_heldCount = 0;         // 所有流中持有的消息数
+    std::unique_ptr<FrameDecompressor> m_decompressor;   // 请求了压缩时在 connect 中创建
+    std::unique_ptr<FrameCompressor> m_compressor;       // 登录应答同意压缩后创建
+    std::string m_compressed;       // 压缩发送缓冲的输出，与 m_writing 交换
+
+#ifndef _WIN32
+    int m_wakePipe[2] = { -1, -1 };   // 生产者写一个字节唤醒 poll
+#endif
+
+    std::atomic<uint64_t> m_framesSent{0};
+    std::atomic<uint64_t> m_framesReceived{0};
+    std::atomic<uint64_t> m_bytesSent{0};
+    std::atomic<uint64_t> m_bytesReceived{0};
+    std::atomic<uint64_t> m_acksSent{0};
+    std::atomic<uint64_t> m_messagesReceived{0};
+    std::atomic<uint64_t> m_responsesReceived{0};
+    std::atomic<uint64_t> m_rejected{0};
+    std::atomic<uint64_t> m_duplicatesDropped{0};
+    std::atomic<uint64_t> m_reordered{0};
+    std::atomic<uint64_t> m_gapsSkipped{0};
+    std::atomic<bool> m_compressing{false};
+    std::atomic<uint64_t> m_framesCompressed{0};
+    std::atomic<uint64_t> m_framesDecompressed{0};
+};
@@ -1,6 +1,8 @@
 #include "ChatClient.hpp"
+#include <cstdlib>
 #include <random>
 #include <iomanip>
+#include <fstream>
 #include <sstream>
 
 #ifdef _WIN32
@@ -67,6 +69,7 @@ void ChatClientApp::setupPlatform() {
     m_platform.users.emplace("bob", User("bob", "Bob"));
     m_platform.groups.emplace("group1", Group("group1", GroupType::QQ));
     m_platform.groups.emplace("wxgroup1", Group("wxgroup1", GroupType::WeChat));
+    m_platform.rebuildSocialIndex();
     std::cout << "平台已初始化，包含示例用户和群组" << std::endl;
 }
 
@@ -82,272 +85,136 @@ void ChatClientApp::setUser(const std::string &userId) {
 bool ChatClientApp::connect(const std::string &serverIp, uint16_t serverPort) {
     if (m_connected) disconnect();
 
-    if (!m_socket.init()) {
-        std::cerr << "初始化客户端套接字失败" << std::endl;
-        return false;
-    }
+    m_client.onMessage([this](const MessageData &msg, bool offline) { handleIncomingMessage(msg, offline); });
+    m_client.onNotice([this](const std::string &frame) {
+        if (frame.compare(0, 10, "RECONNECT|") == 0) {
+            size_t bar = frame.find('|', 10);
+            if (bar == std::string::npos) return;
+            std::lock_guard<std::mutex> lock(m_redirectMutex);
+            m_redirectHost = frame.substr(10, bar - 10);
+            m_redirectPort = static_cast<uint16_t>(std::strtoul(frame.c_str() + bar + 1, nullptr, 10));
+            return;
+        }
+        if (frame.compare(0, 9, "PRESENCE|") == 0) {
+            // PRESENCE|好友:状态|好友:状态 —— 服务器按周期合并推送的好友状态变化
+            std::string text = "好友状态:";
+            for (size_t start = 9; start < frame.size();) {
+                size_t bar = frame.find('|', start);
+                if (bar == std::string::npos) bar = frame.size();
+                std::string entry = frame.substr(start, bar - start);
+                size_t colon = entry.rfind(':');
+                if (colon != std::string::npos) {
+                    std::string status = entry.substr(colon + 1);
+                    text += " " + entry.substr(0, colon) +
+                            (status == "online" ? "(在线)" : status == "away" ? "(离开)" : "(离线)");
+                }
+                start = bar + 1;
+            }
+            pushMessageToQueue(MessageData("SYSTEM", m_userId, text), false);
+            return;
+        }
+        if (frame.find("OFFLINE_MESSAGES") != std::string::npos) {
+            pushMessageToQueue(MessageData("SYSTEM", m_userId, frame), true);
+        }
+    });
+    m_client.onDisconnect([this](const std::string &reason) {
+        std::cout << "\n[Client] 与服务器的连接已断开: " << reason << std::endl;
+        m_connected = false;
+    });
 
-    if (!m_socket.connect(serverIp, serverPort)) {
-        std::cerr << "连接到服务器失败 " << serverIp << ":" << serverPort << std::endl;
+    if (!m_client.connect(serverIp, serverPort)) {
+        std::cerr << "连接到服务器失败 " << serverIp << ":" << serverPort
+                  << " (" << m_client.getLastError() << ")" << std::endl;
         return false;
     }
 
     m_connected = true;
+    m_serverIp = serverIp;
     std::cout << "成功连接到服务器 " << serverIp << ":" << serverPort << std::endl;
 
     m_threadPool.stop();
 
     if (!m_userId.empty()) {
-        std::string loginMsg = "LOGIN|" + m_userId;
-        std::cout << "[Client] Preparing to send LOGIN message: '" << loginMsg << "'" << std::endl;
-
-        if (m_socket.sendPipeMessage(loginMsg)) {
-            std::cout << "用户登录消息已发送：" << m_userId << std::endl;
-
-            // 优化后的等待登录确认 - 保持简洁，让异步队列处理后续消息
-            std::cout << "等待登录确认..." << std::endl;
-            std::string initialResponse;
-            bool loginConfirmed = false;
-
-            // 延长等待时间以确保接收到捎带消息(如果有的话)
-            for (int attempt = 0; attempt < Config::LOGIN_TIMEOUT_SECONDS * 2; ++attempt) {
-                if (m_socket.receivePipeMessage(initialResponse, 1)) {
-                    std::cout << "[Client] 收到登录响应: " << initialResponse << std::endl;
-
-                    if (initialResponse.find("LOGIN_OK") != std::string::npos) {
-                        std::cout << "✅ 登录确认完成！" << std::endl;
-
-                        // 检查是否包含捎带离线消息
-                        if (initialResponse.find("OFFLINE_COUNT:") != std::string::npos) {
-                            std::cout << "[Client] 检测到捎带离线消息，在异步队列中处理" << std::endl;
-                            displayOfflineMessages(initialResponse);
-                        } else {
-                            std::cout << "[Client] 无离线消息捎带" << std::endl;
-                        }
-
-                        loginConfirmed = true;
-                        break;
-                    }
-                } else {
-                    std::cout << "[Client] 等待登录确认... (尝试 " << (attempt + 1) << "/" << (Config::LOGIN_TIMEOUT_SECONDS * 2) << ")" << std::endl;
-                }
-            }
-
-            if (!loginConfirmed) {
-                std::cerr << "登录确认超时！" << std::endl;
-                disconnect();
-                return false;
-            }
+        {
+            std::lock_guard<std::mutex> lock(m_offlineMutex);
+            m_loginOffline.clear();
+        }
+        m_messagesReceived = 0;
+        m_messagesProcessed = 0;
 
-            // Start async message queue system
-            std::cout << "[Client] 登录成功，开始启动异步消息队列系统..." << std::endl;
-            m_messagesReceived = 0;
-            m_messagesProcessed = 0;
+        // 登录响应由事件循环交付；捎带的离线消息在登录完成前已经逐条 ACK 并收集到 m_loginOffline
+        std::future<ChatResponse> login = m_client.login(m_userId);
+        std::cout << "用户登录消息已发送：" << m_userId << "，等待登录确认..." << std::endl;
 
-            // Start producer thread
-            m_listenerThread = std::thread(&ChatClientApp::messageProducer, this);
+        if (login.wait_for(std::chrono::seconds(Config::LOGIN_TIMEOUT_SECONDS)) != std::future_status::ready) {
+            std::cerr << "登录确认超时！" << std::endl;
+            disconnect();
+            return false;
+        }
+        ChatResponse response = login.get();
+        if (!response.ok || response.code != "LOGIN_OK") {
+            std::cerr << "登录失败: " << (response.text.empty() ? response.code : response.text) << std::endl;
+            disconnect();
+            return false;
+        }
+        std::cout << "✅ 登录确认完成！" << std::endl;
 
-            #ifdef _WIN32
-            Sleep(200);  // 增加延迟确保消息处理完成
-            #else
-            usleep(200 * 1000);
-            #endif
+        std::vector<MessageData> offlineMessages;
+        {
+            std::lock_guard<std::mutex> lock(m_offlineMutex);
+            offlineMessages.swap(m_loginOffline);
+        }
+        displayOfflineMessages(offlineMessages);
 
-            // Start consumer thread
-            m_messageProcessorThread = std::thread(&ChatClientApp::messageConsumer, this);
+        // 网络收发已由 AsyncChatClient 的事件循环负责，这里只启动显示用的消费者线程
+        std::cout << "[Client] 登录成功，开始启动异步消息队列系统..." << std::endl;
+        m_messageQueue.reopen();
+        m_messageProcessorThread = std::thread(&ChatClientApp::messageConsumer, this);
 
-        } else {
-            std::cerr << "登录消息发送失败: " << m_socket.getLastError() << std::endl;
-            return false;
-        }
+        // 订阅好友在线状态；应答只带好友数，之后的状态变化由 onNotice 收到
+        m_client.sendRequest("PRESENCE|SUBSCRIBE", [](const ChatResponse &) {});
     }
     return true;
 }
 
 void ChatClientApp::disconnect() {
-    if (m_connected) {
-        m_connected = false;
-        m_messageQueue.finish();
-
-        if (m_listenerThread.joinable()) {
-            std::cout << "[Client] 等待生产者线程结束..." << std::endl;
-            m_listenerThread.join();
-        }
-
-        if (m_messageProcessorThread.joinable()) {
-            std::cout << "[Client] 等待消费者线程结束..." << std::endl;
-            m_messageProcessorThread.join();
-        }
-
-        m_socket.close();
-        m_socket.cleanup();
+    bool wasConnected = m_connected.exchange(false);
+    m_messageQueue.finish();
 
-        // Reset ThreadPool for next use
-        std::cout << "[Client] 正在重置ThreadPool..." << std::endl;
+    if (m_messageProcessorThread.joinable()) {
+        std::cout << "[Client] 等待消费者线程结束..." << std::endl;
+        m_messageProcessorThread.join();
+    }
+    m_client.close();
 
+    if (wasConnected) {
+        AsyncChatClient::Stats stats = m_client.stats();
         std::cout << "\n📊 通信统计:" << std::endl;
         std::cout << "   🔹 消息接收: " << m_messagesReceived << std::endl;
         std::cout << "   🔹 消息处理: " << m_messagesProcessed << std::endl;
+        std::cout << "   🔹 发送帧/接收帧: " << stats.framesSent << "/" << stats.framesReceived
+                  << "，自动ACK: " << stats.acksSent << std::endl;
         std::cout << "已断开与服务器的连接" << std::endl;
     }
 }
 
 // Message Processing Core Functions
-void ChatClientApp::processMessageToQueue(const std::string &message) {
-    std::cout << "[Client] 处理接收到的消息: " << message << std::endl;
-
-    // 检查是否是MESSAGE类型的消息
-    if (message.substr(0, 7) == "MESSAGE") {
-        MessageData msgData;
-        if (ProtocolProcessor::deserializeMessage(message, msgData)) {
-            // 如果是发送给当前用户的消息，发送ACK确认
-            if (msgData.receiverId == m_userId && !msgData.senderId.empty()) {
-                std::cout << "[Client] 检测到杀消息，准备发送ACK确认..." << std::endl;
-                if (sendAckMessage(msgData.messageId)) {
-                    std::cout << "[Client] ✅ ACK发送成功: " << msgData.messageId << std::endl;
-                } else {
-                    std::cout << "[Client] ❌ ACK发送失败: " << msgData.messageId << std::endl;
-                    // 继续处理消息，即使ACK失败
-                }
-            } else {
-                std::cout << "[Client] 消息不是发送给自己的，跳过ACK" << std::endl;
-            }
-
-            // 将消息添加到队列进行显示，不管ACK是否发送成功
-            MessageData msgForQueue(msgData.senderId, msgData.receiverId, msgData.content);
-            if (!msgData.timestamp.empty()) {
-                msgForQueue.timestamp = msgData.timestamp;
-            }
-            std::cout << "[Client] 消息内容添加到显示队列: 发送者=" << msgData.senderId << ", 内容=" << msgData.content << std::endl;
-            pushMessageToQueue(msgForQueue, true);
-            return;
-        } else {
-            std::cout << "[Client] 解析MESSAGE失败: " << message << std::endl;
-            return;
-        }
-    }
-
-    // 检查是否是ACK类型的消息(客户端自己发送的ACK回显，不需要处理)
-    if (message.substr(0, 3) == "ACK") {
-        std::cout << "[Client] 收到ACK消息(这是自己发送的回显): " << message << std::endl;
-        return; // 忽略ACK消息
-    }
-
-    // 处理其他类型的消息
-    if (message.find("OFFLINE_COUNT:") != std::string::npos) {
-        // 这是包含离线消息的登录响应，直接处理多个离线消息
-        std::cout << "[Client] 🔥 发现离线消息响应，开始处理多个离线消息..." << std::endl;
-
-        // 解析OFFLINE_COUNT以获取消息数量
-        size_t countPos = message.find("OFFLINE_COUNT:");
-        size_t countEndPos = message.find("|", countPos);
-        int offlineCount = 1; // 默认至少有一个消息
-
-        if (countEndPos != std::string::npos && countPos != std::string::npos) {
-            std::string countStr = message.substr(countPos + 14, countEndPos - (countPos + 14));
-            try {
-                offlineCount = std::stoi(countStr);
-                std::cout << "[Client] 解析得到离线消息数量: " << offlineCount << std::endl;
-            } catch (...) {
-                std::cout << "[Client] 无法解析离线消息数量，使用默认值1" << std::endl;
-            }
-        }
-
-        // 从OFFLINE_COUNT后面开始查找所有MESSAGE段
-        size_t currentPos = message.find("MESSAGE|", countEndPos);
-        int processedCount = 0;
-
-        std::cout << "[Client] 开始处理多个离线消息，预计处理 " << offlineCount << " 条消息" << std::endl;
-
-        while (currentPos != std::string::npos && processedCount < offlineCount) {
-            // 查找下一个MESSAGE开始作为当前消息结束的分隔符
-            size_t nextMessagePos = message.find("MESSAGE|", currentPos + 1);
-            std::string messagePart;
-
-            if (nextMessagePos != std::string::npos) {
-                messagePart = message.substr(currentPos, nextMessagePos - currentPos);
-            } else {
-                messagePart = message.substr(currentPos);
-            }
-
-            if (!messagePart.empty()) {
-                std::cout << "[Client] 处理离线消息 #" << (processedCount + 1) << ": " << messagePart << std::endl;
-
-                // 解析这个MESSAGE消息
-                MessageData msgData;
-                if (ProtocolProcessor::deserializeMessage(messagePart, msgData)) {
-                    processedCount++;
-
-                    std::cout << "[Client] 🔔 收到离线消息 #" << processedCount << " !" << std::endl;
-                    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-                    std::cout << "📨 离线消息 #" << processedCount << std::endl;
-                    std::cout << "👤 来自: " << msgData.senderId << std::endl;
-                    std::cout << "💬 内容: " << msgData.content << std::endl;
-                    if (!msgData.timestamp.empty()) {
-                        std::cout << "🕐 时间: " << msgData.timestamp << std::endl;
-                    }
-                    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-
-                    // 发送ACK确认
-                    if (!msgData.messageId.empty()) {
-                        sendAckMessage(msgData.messageId);
-                        std::cout << "[Client] ✅ 已发送离线消息 #" << processedCount << " ACK确认" << std::endl;
-                    }
-                } else {
-                    std::cout << "[Client] ❌ 离线消息 #" << (processedCount + 1) << " 解析失败" << std::endl;
-                }
-            }
-
-            // 移动到下一个MESSAGE开始位置
-            currentPos = nextMessagePos;
-        }
-
-        std::cout << "[Client] ✅ 离线消息处理完成，共处理了 " << processedCount << " 条离线消息" << std::endl;
-
-        if (processedCount > 0) {
-            std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-            std::cout << "🎉 所有离线消息已读取完成！您现在可以正常收发消息了。" << std::endl;
-            std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-        }
-
-        return;
-    }
-
-    ParsedMessage parsed = parseMessage(message);
-    if (!parsed.isValid()) {
-        std::cout << "[Client] 消息解析失败: " << message << std::endl;
+void ChatClientApp::handleIncomingMessage(const MessageData &msg, bool offline) {
+    // ACK 已由 AsyncChatClient 发出
+    if (offline) {
+        std::lock_guard<std::mutex> lock(m_offlineMutex);
+        m_loginOffline.push_back(msg);
         return;
     }
-
-    std::cout << "[Client] 处理其他类型消息: " << parsed.type << std::endl;
-
-    if (parsed.isResponse()) {
-        MessageData responseMsg("SERVER", m_userId, message);
-        pushMessageToQueue(responseMsg, true);
-    } else if (parsed.isSystemMessage() && message.find("OFFLINE_MESSAGES") != std::string::npos) {
-        MessageData offlineMsg("SYSTEM", m_userId, message);
-        pushMessageToQueue(offlineMsg, true);
-    }
+    MessageData msgForQueue(msg.senderId, msg.receiverId, msg.content);
+    msgForQueue.timestamp = msg.timestamp;
+    pushMessageToQueue(msgForQueue, true);
 }
 
-void ChatClientApp::messageProducer() {
-    std::cout << "[Client] 🎯 生产者线程启动 - 专注网络I/O" << std::endl;
-    while (m_connected && m_running) {
-        std::string message;
-        bool hasMessage = false;
-        std::lock_guard<std::mutex> lock(m_socketMutex);
-        if (m_connected) {
-            hasMessage = m_socket.receivePipeMessage(message, 0);
-        }
-
-        if (hasMessage && !message.empty()) {
-            processMessageToQueue(message);
-        } else if (!hasMessage) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        }
-    }
-    m_messageQueue.finish();
-    std::cout << "[Client] 🎯 生产者线程结束 - 总接收: " << m_messagesReceived << " 消息" << std::endl;
+void ChatClientApp::handleServerResponse(const ChatResponse &resp) {
+    // 本地失败（断线、背压）没有原始帧，按响应格式补一个交给消费者显示
+    std::string content = resp.raw.empty() ? "RESPONSE|ERROR|" + resp.code + "|" + resp.text : resp.raw;
+    pushMessageToQueue(MessageData("SERVER", m_userId, content), true);
 }
 
 void ChatClientApp::messageConsumer() {
@@ -360,20 +227,22 @@ void ChatClientApp::messageConsumer() {
                     std::cout << "\n✅ 消息已发送成功" << std::endl;
                 } else if (msg.content.find("MESSAGE_CACHED") != std::string::npos) {
                     std::cout << "\n📨 接收方不在线，已缓存消息" << std::endl;
-                } else if (msg.content.find("SEND_FAILED") != std::string::npos) {
+                } else if (msg.content.find("|ERROR|") != std::string::npos) {
                     std::cout << "\n⚠️ 消息发送失败" << std::endl;
                 }
             } else if (msg.senderId == "SYSTEM" && msg.content.find("OFFLINE_MESSAGES") != std::string::npos) {
+                // RESPONSE|OFFLINE_MESSAGES|COUNT|n|...
                 std::stringstream ss(msg.content);
-                std::string prefix, type, count;
+                std::string prefix, type, label, count;
                 std::getline(ss, prefix, '|');
                 std::getline(ss, type, '|');
+                std::getline(ss, label, '|');
                 std::getline(ss, count, '|');
                 std::cout << "\n📨 系统通知：收到 " << count << " 条离线消息" << std::endl;
             } else if (msg.receiverId == m_userId) {
                 std::cout << "\n━━━━━━━━━━━━━━━━━━ 🔔 新消息 🔔 ━━━━━━━━━━━━━━━━━━" << std::endl;
                 std::cout << "👤 来自: " << msg.senderId << std::endl;
-                std::cout << "💬 消息内容: " << msg.content << std::endl;
+                std::cout << "💬 消息内容: " << describeContent(msg.content) << std::endl;
                 if (!msg.timestamp.empty()) {
                     std::cout << "🕐 时间戳: " << msg.timestamp << std::endl;
                 }
@@ -393,6 +262,20 @@ void ChatClientApp::sleepAndCheckConnection() {
     usleep(Config::MENU_CHECK_INTERVAL_MS * 1000);
 #endif
 
+    // 集群调整分片后服务器要求改连：断开并登录到新的归属节点，离线消息随登录补发
+    std::string redirectHost;
+    uint16_t redirectPort = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_redirectMutex);
+        redirectHost.swap(m_redirectHost);
+        redirectPort = m_redirectPort;
+        m_redirectPort = 0;
+    }
+    if (m_connected && redirectPort != 0) {
+        std::cout << "\n[Client] 服务器要求改连到 " << redirectHost << ":" << redirectPort << std::endl;
+        if (!connect(redirectHost, redirectPort)) std::cout << "[Client] 改连失败" << std::endl;
+    }
+
     static int connectionCheckCounter = 0;
     if (++connectionCheckCounter >= Config::CONNECTION_CHECK_THRESHOLD && !m_connected) {
         std::cout << "\n连接已断开，正在退出..." << std::endl;
@@ -401,15 +284,8 @@ void ChatClientApp::sleepAndCheckConnection() {
 }
 
 // 显示离线消息的专用函数
-void ChatClientApp::displayOfflineMessages(const std::string &bundledResponse) {
-    auto offlineMessages = extractOfflineMessageDetails(bundledResponse);
-
+void ChatClientApp::displayOfflineMessages(const std::vector<MessageData> &offlineMessages) {
     if (!offlineMessages.empty()) {
-        // 批量发送ACK确认
-        for (const auto& msgData : offlineMessages) {
-            sendAckMessage(msgData.messageId); // 静默发送ACK
-        }
-
         std::cout << "\n📨 发现 " << offlineMessages.size() << " 条离线消息，正在为您展示...\n" << std::endl;
 
         // 逐条显示离线消息，使用和普通消息一样的格式
@@ -419,7 +295,7 @@ void ChatClientApp::displayOfflineMessages(const std::string &bundledResponse) {
             std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┐" << std::endl;
             std::cout << "📨 离线消息 #" << (i + 1) << "                ━━━━━━━━━━━━━━━━━━" << std::endl;
             std::cout << "👤 来自: " << msgData.senderId << std::endl;
-            std::cout << "💬 消息内容: " << msgData.content << std::endl;
+            std::cout << "💬 消息内容: " << describeContent(msgData.content) << std::endl;
             std::cout << "🕐 时间戳: " << (msgData.timestamp.empty() ? "未知时间" : msgData.timestamp) << std::endl;
             std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
 
@@ -442,69 +318,6 @@ void ChatClientApp::displayOfflineMessages(const std::string &bundledResponse) {
     }
 }
 
-// 从捎带的登录响应中提取离线消息详情
-std::vector<MessageData> ChatClientApp::extractOfflineMessageDetails(const std::string& bundledResponse) {
-    std::vector<MessageData> messages;
-
-    // 1) 找到 OFFLINE_COUNT，便于日志
-    size_t countPos = bundledResponse.find("OFFLINE_COUNT:");
-    if (countPos == std::string::npos) return messages;
-
-    // 2) 从 OFFLINE_COUNT 后面开始查找每个 MESSAGE| 段
-    size_t cur = bundledResponse.find("MESSAGE|", countPos);
-    while (cur != std::string::npos) {
-        size_t next = bundledResponse.find("MESSAGE|", cur + 1);
-        std::string part;
-        if (next == std::string::npos) part = bundledResponse.substr(cur);
-        else part = bundledResponse.substr(cur, next - cur);
-
-        // 3) 拆分 part（按照 '|'），注意 timestamp 可能包含空格但一般不会包含 '|'。
-        std::vector<std::string> tokens;
-        size_t p = 0;
-        while (p < part.size()) {
-            size_t q = part.find('|', p);
-            if (q == std::string::npos) {
-                tokens.push_back(part.substr(p));
-                break;
-            } else {
-                tokens.push_back(part.substr(p, q - p));
-                p = q + 1;
-            }
-        }
-
-        // tokens 期望格式： ["MESSAGE", messageId, senderId, receiverId, content, timestamp...]
-        if (tokens.size() >= 6 && tokens[0] == "MESSAGE") {
-            MessageData md;
-            md.messageId = tokens[1];
-            md.senderId  = tokens[2];
-            md.receiverId = tokens[3];
-            md.content = tokens[4];
-            // timestamp 可能被拆成多个 token（如果服务器意外插入了 |），把剩下拼起来
-            std::string ts;
-            for (size_t i = 5; i < tokens.size(); ++i) {
-                if (i > 5) ts += "|";
-                ts += tokens[i];
-            }
-            md.timestamp = ts;
-            messages.push_back(md);
-        } else {
-            // 4) 作为后备：交给 ProtocolProcessor 尝试解析（兼容旧格式）
-            MessageData md;
-            if (ProtocolProcessor::deserializeMessage(part, md)) {
-                messages.push_back(md);
-            } else {
-                std::cout << "[Client] ⚠️ 无法解析离线消息段（跳过）: " << part << std::endl;
-            }
-        }
-
-        cur = next;
-    }
-
-    return messages;
-}
-
-
-
 void ChatClientApp::pushMessageToQueue(const MessageData &msg, bool updateStats) {
     m_messageQueue.push(msg);
     if (updateStats) m_messagesReceived++;
@@ -524,13 +337,17 @@ void ChatClientApp::showMenu() {
     std::cout << "   [1] 📨 发送私人消息" << std::endl;
     std::cout << "   [2] 👥 发送群组消息" << std::endl;
     std::cout << "   [3] 📬 查看接收消息" << std::endl;
+    std::cout << "   [h] 🕘 查看聊天记录" << std::endl;
     std::cout << "\n🎪 功能演示" << std::endl;
     std::cout << "   [4] 🤖 微信服务演示" << std::endl;
     std::cout << "\n🛠️ 系统管理" << std::endl;
     std::cout << "   [5] 📊 显示平台信息" << std::endl;
     std::cout << "   [6] 🔌 断开连接" << std::endl;
     std::cout << "\n🧪 测试功能" << std::endl;
-    std::cout << "   [7] ⚡ ThreadPool批量测试" << std::endl;
+    std::cout << "   [7] ⚡ 批量发送测试" << std::endl;
+    std::cout << "\n📎 文件传输" << std::endl;
+    std::cout << "   [8] 📤 发送文件" << std::endl;
+    std::cout << "   [9] 📥 下载文件" << std::endl;
     std::cout << "\n🚪 系统操作" << std::endl;
     std::cout << "   [0] 🔚 退出程序" << std::endl;
     std::cout << "\n" << std::string(60, '-') << std::endl;
@@ -546,8 +363,11 @@ void ChatClientApp::processMenuCommand(int option) {
         case 4: wxServiceDemo(); break;
         case 5: showPlatformInfo(); break;
         case 6: if (m_connected) disconnect(); break;
-        case 7: threadPoolBatchTest(); break;
-        default: std::cout << "❌ 无效选项 '" << option << "'，请重新选择（0-7）。" << std::endl;
+        case 7: batchSendTest(); break;
+        case 8: sendFile(); break;
+        case 9: downloadFile(); break;
+        case MENU_HISTORY: showHistory(); break;
+        default: std::cout << "❌ 无效选项 '" << option << "'，请重新选择（0-9 或 h）。" << std::endl;
     }
 }
 
@@ -616,9 +436,9 @@ void ChatClientApp::sendPrivateMessage() {
     std::getline(std::cin >> std::ws, message);
 
     MessageData msgData = createMessageDataWithId(m_userId, targetUser, message);
-    std::string msgFormat = ProtocolProcessor::serializeMessage(msgData);
-    std::cout << (m_socket.sendPipeMessage(msgFormat) ?
-                  "私人消息已发送至" + targetUser : "发送消息失败") << std::endl;
+    m_client.sendMessage(msgData, [this](const ChatResponse &resp) { handleServerResponse(resp); });
+    m_messagesProcessed++;
+    std::cout << "私人消息已发送至" << targetUser << std::endl;
 }
 
 void ChatClientApp::sendGroupMessage() {
@@ -633,9 +453,9 @@ void ChatClientApp::sendGroupMessage() {
     std::getline(std::cin >> std::ws, message);
 
     MessageData msgData = createMessageDataWithId(m_userId, groupId, message);
-    std::string msgFormat = ProtocolProcessor::serializeMessage(msgData);
-    std::cout << (m_socket.sendPipeMessage(msgFormat) ?
-                  "群组消息已发送至" + groupId : "发送消息失败") << std::endl;
+    m_client.sendMessage(msgData, [this](const ChatResponse &resp) { handleServerResponse(resp); });
+    m_messagesProcessed++;
+    std::cout << "群组消息已发送至" << groupId << std::endl;
 }
 
 void ChatClientApp::receiveMessages() {
@@ -717,14 +537,13 @@ void ChatClientApp::showPlatformInfo() {
                   << ") - 群主: " << group.second.owner() << std::endl;
 }
 
-void ChatClientApp::threadPoolBatchTest() {
+void ChatClientApp::batchSendTest() {
     if (!m_connected) {
         std::cout << "未连接到服务器，无法进行批量发送测试" << std::endl;
         return;
     }
 
-    std::cout << "\n=== ThreadPool批量消息发送测试（并发模式）===" << std::endl;
-    std::cout << "ThreadPool已启动，准备批量发送消息..." << std::endl;
+    std::cout << "\n=== 批量消息发送测试（MESSAGE_BATCH）===" << std::endl;
 
     std::string targetUser;
     std::cout << "请输入目标用户ID (默认: alice)：";
@@ -732,43 +551,168 @@ void ChatClientApp::threadPoolBatchTest() {
     if (targetUser.empty()) targetUser = "alice";
 
     int messageCount = 5;
-    std::cout << "请输入发送消息数量 (默认: 5)：";
+    std::cout << "请输入发送消息数量 (默认: 5，最多 " << Config::MAX_BATCH_TEST_MESSAGES << ")：";
     std::string countStr;
     std::getline(std::cin >> std::ws, countStr);
     if (!countStr.empty()) {
         try { messageCount = std::stoi(countStr); } catch (...) {}
         if (messageCount < 1) messageCount = 1;
-        if (messageCount > 10) messageCount = 10;
+        if (messageCount > Config::MAX_BATCH_TEST_MESSAGES) messageCount = Config::MAX_BATCH_TEST_MESSAGES;
     }
 
-    std::cout << "[ThreadPool] 准备向用户 " << targetUser << " 发送 " << messageCount << " 条批量消息" << std::endl;
-    std::cout << "[ThreadPool] 消息将顺序发送（避免socket竞争），显示发送结果..." << std::endl;
-
-    std::vector<std::shared_ptr<BatchMessageTask>> tasks;
+    std::vector<MessageData> batch;
+    batch.reserve(messageCount);
     for (int i = 0; i < messageCount; ++i) {
-        tasks.push_back(std::make_shared<BatchMessageTask>(
-            m_socket, m_socketMutex, targetUser, m_userId, messageCount, i));
+        batch.push_back(createMessageDataWithId(m_userId, targetUser, "批量消息 #" + std::to_string(i + 1) + " - MESSAGE_BATCH测试"));
+    }
+
+    // 整批编码成 MESSAGE_BATCH 帧一次写出，服务器一次路由，只回一条汇总响应
+    std::cout << "[Batch] 向用户 " << targetUser << " 批量发送 " << messageCount << " 条消息..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    std::future<AsyncChatClient::BatchResult> pending = m_client.sendMessageBatch(batch);
+    if (pending.wait_for(std::chrono::seconds(Config::REQUEST_TIMEOUT_SECONDS)) != std::future_status::ready) {
+        std::cout << "[Batch] 等待服务器响应超时" << std::endl;
+        return;
+    }
+    AsyncChatClient::BatchResult result = pending.get();
+    auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "\n=== 批量发送完成 ===" << std::endl;
+    std::cout << "总消息数: " << result.total << "（" << result.frames << " 个批量帧）" << std::endl;
+    std::cout << "已送达: " << result.sent << std::endl;
+    std::cout << "已缓存(离线): " << result.cached << std::endl;
+    if (result.group > 0) std::cout << "群消息: " << result.group << std::endl;
+    std::cout << "未确认/失败: " << result.failed << std::endl;
+    if (result.invalid > 0) std::cout << "无效: " << result.invalid << std::endl;
+    std::cout << "耗时: " << elapsedMs << " ms" << std::endl;
+    std::cout << "连接状态: " << (m_connected ? "正常" : "已断开") << std::endl;
+}
+
+// 聊天记录：HISTORY|会话|beforeSeq|limit 从最新一页往前翻，每页按时间顺序显示
+void ChatClientApp::showHistory() {
+    if (!m_connected) {
+        std::cout << "未连接到服务器" << std::endl;
+        return;
+    }
+    std::string peerId;
+    std::cout << "请输入会话（对方用户ID或群组ID）：";
+    std::getline(std::cin >> std::ws, peerId);
+
+    uint64_t before = 0;
+    while (true) {
+        auto promise = std::make_shared<std::promise<ChatResponse>>();
+        std::future<ChatResponse> ready = promise->get_future();
+        m_client.sendRequest("HISTORY|" + peerId + "|" + std::to_string(before) + "|" + std::to_string(Config::HISTORY_PAGE_SIZE),
+                             [promise](const ChatResponse &resp) { promise->set_value(resp); });
+        if (ready.wait_for(std::chrono::seconds(Config::REQUEST_TIMEOUT_SECONDS)) != std::future_status::ready) {
+            std::cout << "❌ 等待服务器响应超时" << std::endl;
+            return;
+        }
+        ChatResponse response = ready.get();
+        if (!response.ok || response.code != "HISTORY") {
+            std::cout << "❌ 查询失败: " << (response.text.empty() ? response.code : response.text) << std::endl;
+            return;
+        }
+
+        // ...|NEXT:seq|MESSAGE|...|MESSAGE|...：与登录捎带的离线消息同样按 "|MESSAGE|" 拆分
+        const std::string &frame = response.raw;
+        size_t nextPos = frame.find("|NEXT:");
+        before = nextPos == std::string::npos ? 0 : std::strtoull(frame.c_str() + nextPos + 6, nullptr, 10);
+        size_t count = 0;
+        size_t cur = frame.find("MESSAGE|", nextPos == std::string::npos ? 0 : nextPos);
+        while (cur != std::string::npos) {
+            size_t next = frame.find("|MESSAGE|", cur);
+            MessageData msg;
+            if (ProtocolProcessor::deserializeMessage(frame.substr(cur, next == std::string::npos ? std::string::npos : next - cur), msg)) {
+                std::cout << "   [" << msg.timestamp << "] " << msg.senderId << ": " << describeContent(msg.content) << std::endl;
+                ++count;
+            }
+            cur = next == std::string::npos ? next : next + 1;
+        }
+        if (count == 0) std::cout << "（没有聊天记录）" << std::endl;
+        if (before == 0) {
+            std::cout << "—— 已到最早的消息 ——" << std::endl;
+            return;
+        }
+        std::string answer;
+        std::cout << "查看更早的消息？(y/n)：";
+        std::getline(std::cin >> std::ws, answer);
+        if (answer != "y" && answer != "Y") return;
     }
+}
 
-    std::cout << "[ThreadPool] 并发提交 " << messageCount << " 个任务..." << std::endl;
-    for (auto &task : tasks) {
-        m_threadPool.submit(std::static_pointer_cast<TaskBase>(task));
+void ChatClientApp::sendFile() {
+    if (!m_connected) {
+        std::cout << "未连接到服务器" << std::endl;
+        return;
+    }
+    std::string targetId, path;
+    std::cout << "请输入接收者（用户ID或群组ID）：";
+    std::getline(std::cin >> std::ws, targetId);
+    std::cout << "请输入本地文件路径：";
+    std::getline(std::cin >> std::ws, path);
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cout << "❌ 无法打开文件 " << path << std::endl;
+        return;
+    }
+    uint64_t size = static_cast<uint64_t>(file.tellg());
+    file.close();
+
+    // 1. 聊天连接上登记，拿到文件端口的上传凭据
+    auto promise = std::make_shared<std::promise<ChatResponse>>();
+    std::future<ChatResponse> ready = promise->get_future();
+    m_client.sendRequest("FILE_OFFER|" + targetId + "|" + std::to_string(size) + "|" + path,
+                         [promise](const ChatResponse &resp) { promise->set_value(resp); });
+    if (ready.wait_for(std::chrono::seconds(Config::REQUEST_TIMEOUT_SECONDS)) != std::future_status::ready) {
+        std::cout << "❌ 等待服务器响应超时" << std::endl;
+        return;
+    }
+    ChatResponse response = ready.get();
+    if (!response.ok || response.code != "FILE_READY") {
+        std::cout << "❌ 服务器拒绝了文件: " << (response.text.empty() ? response.code : response.text) << std::endl;
+        return;
+    }
+    std::string fileId, token;
+    std::stringstream fields(response.raw);
+    std::string field;
+    while (std::getline(fields, field, '|')) {
+        if (field.compare(0, 5, "FILE:") == 0) fileId = field.substr(5);
+        else if (field.compare(0, 6, "TOKEN:") == 0) token = field.substr(6);
+        else if (field.compare(0, 5, "PORT:") == 0) m_filePort = static_cast<uint16_t>(std::stoul(field.substr(5)));
     }
 
-    std::cout << "[ThreadPool] 等待所有任务完成..." << std::endl;
-    m_threadPool.waitForCompletion();
+    // 2. 单独的连接上传文件内容；聊天连接的收发不受影响，接收方在上传完成后收到引用消息
+    std::cout << "[File] 正在上传 " << path << " (" << size << " 字节)..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    FileTransferClient transfer;
+    if (!transfer.connect(m_serverIp, m_filePort) || !transfer.upload(fileId, token, path)) {
+        std::cout << "❌ 上传失败: " << transfer.getLastError() << std::endl;
+        return;
+    }
+    auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    m_messagesProcessed++;
+    std::cout << "✅ 文件已上传（" << elapsedMs << " ms），已通知 " << targetId << std::endl;
+}
 
-    int successCount = 0, failCount = 0;
-    for (auto &task : tasks) {
-        successCount += (task->getStatus() == TaskStatus::COMPLETED) ? 1 : 0;
-        failCount += (task->getStatus() != TaskStatus::COMPLETED) ? 1 : 0;
+void ChatClientApp::downloadFile() {
+    std::string reference, path;
+    std::cout << "请输入文件引用（收到的 [FILE]... 内容）：";
+    std::getline(std::cin >> std::ws, reference);
+    FileReference ref;
+    if (!FileReference::parse(reference, ref)) {
+        std::cout << "❌ 无效的文件引用" << std::endl;
+        return;
     }
+    std::cout << "请输入保存路径 (默认: " << ref.name << ")：";
+    std::getline(std::cin, path);
+    if (path.empty()) path = ref.name;
 
-    std::cout << "\n=== 批量发送完成 ===" << std::endl;
-    std::cout << "总消息数: " << messageCount << std::endl;
-    std::cout << "成功发送: " << successCount << std::endl;
-    std::cout << "失败发送: " << failCount << std::endl;
-    std::cout << "成功率: " << (messageCount > 0 ? (successCount * 100.0 / messageCount) : 0) << "%" << std::endl;
-    std::cout << "连接状态: " << (m_connected ? "正常" : "已断开") << std::endl;
-    std::cout << "ThreadPool测试完成" << std::endl;
+    FileTransferClient transfer;
+    if (!transfer.connect(m_serverIp, m_filePort) || !transfer.download(ref.id, ref.downloadToken, path)) {
+        std::cout << "❌ 下载失败: " << transfer.getLastError() << std::endl;
+        return;
+    }
+    std::cout << "✅ 已保存到 " << path << " (" << ref.size << " 字节)" << std::endl;
 }
@@ -10,6 +10,7 @@
 // 🎯 标准库头文件 (按字母顺序排列)
 // ========================================================================================
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
@@ -27,7 +28,9 @@
 // 🔧 系统头文件
 // ========================================================================================
 
+#ifdef _WIN32
 #include <conio.h>
+#endif
 
 // ========================================================================================
 // 📚 项目核心模块头文件 (按功能分组)
@@ -40,7 +43,8 @@
 #include "../core/Platform.hpp"
 
 // 网络通信层
-#include "../network/tcp_socket.hpp"
+#include "AsyncChatClient.hpp"
+#include "../network/file_transfer.hpp"
 
 // 基础服务层
 #include "../common/Protocol.hpp"
@@ -61,6 +65,10 @@ namespace Config
     // 消息处理配置
     const int OFFLINE_MESSAGE_DRAIN_ATTEMPTS = 10;
     const int LOGIN_TIMEOUT_SECONDS          = 10;
+    const int REQUEST_TIMEOUT_SECONDS        = 10;
+    const int MAX_BATCH_TEST_MESSAGES        = 500;
+    const int HISTORY_PAGE_SIZE              = 20;     // 查看聊天记录时每页条数
+    const uint16_t DEFAULT_FILE_PORT         = 8081;   // 还没收到过 FILE_READY 时下载用的文件端口
 
     // 系统限制配置
     const size_t MAX_MESSAGE_SIZE = 1024;
@@ -133,6 +141,13 @@ public:
         m_cv.notify_all();
     }
 
+    // 重新连接后继续使用
+    void reopen()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished = false;
+    }
+
     bool isFinished()
     {
         std::lock_guard<std::mutex> lock(m_mutex);
@@ -144,19 +159,25 @@ public:
 class ChatClientApp
 {
 private:
-    TcpSocket m_socket;
+    AsyncChatClient m_client;          // 网络收发、响应匹配、自动ACK都在它的事件循环线程里
     Platform m_platform;
     std::string m_userId;
-    bool m_connected = false;
+    std::string m_serverIp = "127.0.0.1";
+    uint16_t m_filePort = Config::DEFAULT_FILE_PORT;   // 最近一次 FILE_READY 里的文件端口
+    std::atomic<bool> m_connected{false};
     bool m_running = true;
     ThreadPool m_threadPool;
-    std::mutex m_socketMutex;
-    std::thread m_listenerThread;
     AsyncMessageQueue m_messageQueue;
+    std::mutex m_offlineMutex;
+    std::vector<MessageData> m_loginOffline;   // 登录响应捎带的离线消息，登录完成后统一展示
     std::thread m_messageProcessorThread;
     std::atomic<size_t> m_messagesReceived{0};
     std::atomic<size_t> m_messagesProcessed{0};
     WeChatService *m_wxService = nullptr;
+    // 服务器要求改连（RECONNECT|host|port，集群调整分片时发出）：事件循环线程记下，菜单循环里执行
+    std::mutex m_redirectMutex;
+    std::string m_redirectHost;
+    uint16_t m_redirectPort = 0;
 
     // Helper Methods
     ParsedMessage parseMessage(const std::string &message) const {
@@ -211,35 +232,21 @@ private:
         }
     }
 
+    static const int MENU_HISTORY = 10;   // 菜单 [h]：单键输入，不占数字
     int getMenuChoice() {
         char input = getchar();
         if (input >= '0' && input <= '9') {
             std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
             return input - '0';
         }
+        if (input == 'h' || input == 'H') {
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            return MENU_HISTORY;
+        }
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
         return -1;
     }
 
-    // 发送ACK确认消息
-    bool sendAckMessage(const std::string& messageId) {
-        if (!m_connected || messageId.empty()) {
-            return false;
-        }
-
-        AckData ackData(messageId, m_userId);
-        std::string ackMessage = ProtocolProcessor::serializeAck(ackData);
-
-        std::lock_guard<std::mutex> lock(m_socketMutex);
-        bool success = m_socket.sendPipeMessage(ackMessage);
-        if (success) {
-            std::cout << "[Client] ✅ 已发送ACK确认: " << messageId << std::endl;
-        } else {
-            std::cout << "[Client] ❌ ACK发送失败: " << messageId << std::endl;
-        }
-        return success;
-    }
-
     // 创建包含消息ID的消息数据
     MessageData createMessageDataWithId(const std::string& senderId, const std::string& receiverId,
                                        const std::string& content) {
@@ -251,73 +258,25 @@ private:
         return msgData;
     }
 
-    // 显示离线消息的专用函数
-    void displayOfflineMessages(const std::string &bundledResponse);
+    // 消息内容的显示文本：文件引用显示为文件名和大小，并附上下载用的引用
+    std::string describeContent(const std::string &content) const {
+        FileReference ref;
+        if (!FileReference::parse(content, ref)) return content;
+        return "📎 文件 " + ref.name + " (" + std::to_string(ref.size) + " 字节)，菜单 [9] 下载，引用: " + content;
+    }
 
-    // 从捎带的登录响应中提取离线消息详情
-    std::vector<MessageData> extractOfflineMessageDetails(const std::string& bundledResponse);
+    // 显示离线消息的专用函数
+    void displayOfflineMessages(const std::vector<MessageData> &offlineMessages);
 
     void pushMessageToQueue(const MessageData &msg, bool updateStats = true);
 
-    class BatchMessageTask : public TaskBase
-    {
-    private:
-        TcpSocket &m_clientSocket;
-        std::mutex &m_socketMutex;
-        std::string m_targetUser, m_currentUser;
-        int m_messageCount, m_messageId;
-
-    public:
-        BatchMessageTask(TcpSocket &socket, std::mutex &socketMutex,
-                         const std::string &targetUser, const std::string &currentUser,
-                         int count, int id)
-            : m_clientSocket(socket), m_socketMutex(socketMutex),
-              m_targetUser(targetUser), m_currentUser(currentUser),
-              m_messageCount(count), m_messageId(id) {}
-
-        void execute() override {
-            status_ = TaskStatus::RUNNING;
-            try {
-                std::string message = "批量消息 #" + std::to_string(m_messageId + 1) +
-                                      " - ThreadPool并发发送测试";
-                MessageData msgData;
-                msgData.messageId = ProtocolProcessor::generateMessageId();
-                msgData.senderId = m_currentUser;
-                msgData.receiverId = m_targetUser;
-                msgData.content = message;
-
-                std::string msgFormat = ProtocolProcessor::serializeMessage(msgData);
-
-                if (m_clientSocket.sendPipeMessage(msgFormat)) {
-                    std::cout << "[ThreadPool] 批量消息 #" << (m_messageId + 1) << " 发送成功" << std::endl;
-                    status_ = TaskStatus::COMPLETED;
-                    onComplete();
-                } else {
-                    std::cout << "[ThreadPool] 批量消息 #" << (m_messageId + 1) << " 发送失败" << std::endl;
-                    status_ = TaskStatus::FAILED;
-                    onError();
-                }
-            } catch (...) {
-                status_ = TaskStatus::FAILED;
-                onError();
-            }
-        }
-
-        void onComplete() override {
-            std::cout << "[ThreadPool] 批量消息 #" << (m_messageId + 1) << " 完成" << std::endl;
-        }
-
-        void onError() override {
-            std::cout << "[ThreadPool] 批量消息 #" << (m_messageId + 1) << " 失败" << std::endl;
-        }
-    };
-
     // =============================================================================
     // 🔄 核心消息处理函数
     // =============================================================================
 
-    void processMessageToQueue(const std::string& message);
-    void messageProducer();
+    // 以下两个在 AsyncChatClient 事件循环线程上调用，只做入队，不阻塞
+    void handleIncomingMessage(const MessageData& msg, bool offline);
+    void handleServerResponse(const ChatResponse& resp);
     void messageConsumer();
     void sleepAndCheckConnection();
 
@@ -344,10 +303,15 @@ public:
     void sendPrivateMessage();
     void sendGroupMessage();
     void receiveMessages();
+    void showHistory();
 
     // Service Demonstrations
     void wxServiceDemo();
     void showPlatformInfo();
-    void threadPoolBatchTest();
+    void batchSendTest();
+
+    // File Transfer：文件内容走服务器的文件端口，聊天连接上只有登记请求和引用消息
+    void sendFile();
+    void downloadFile();
 
 };
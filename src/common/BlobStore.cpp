@@ -0,0 +1,254 @@
+#include "BlobStore.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+// ==============================
+// 引用消息
+// ==============================
+
+std::string FileReference::format(const BlobInfo& blob) {
+    return std::string(PREFIX) + blob.id + ":" + blob.downloadToken + ":" + std::to_string(blob.size) + ":" + blob.name;
+}
+
+bool FileReference::parse(const std::string& content, FileReference& out) {
+    const size_t prefixLen = std::char_traits<char>::length(PREFIX);
+    if (content.compare(0, prefixLen, PREFIX) != 0) return false;
+    size_t idEnd = content.find(':', prefixLen);
+    if (idEnd == std::string::npos) return false;
+    size_t tokenEnd = content.find(':', idEnd + 1);
+    if (tokenEnd == std::string::npos) return false;
+    size_t sizeEnd = content.find(':', tokenEnd + 1);
+    if (sizeEnd == std::string::npos || sizeEnd == tokenEnd + 1) return false;
+
+    out.id = content.substr(prefixLen, idEnd - prefixLen);
+    out.downloadToken = content.substr(idEnd + 1, tokenEnd - idEnd - 1);
+    char* end = nullptr;
+    out.size = std::strtoull(content.c_str() + tokenEnd + 1, &end, 10);
+    if (end != content.c_str() + sizeEnd) return false;
+    out.name = content.substr(sizeEnd + 1);
+    return !out.id.empty() && !out.downloadToken.empty();
+}
+
+// ==============================
+// 存储
+// ==============================
+
+BlobStore::BlobStore(std::string directory, uint64_t maxBlobBytes)
+    : m_directory(std::move(directory)), m_maxBlobBytes(maxBlobBytes), m_random(std::random_device{}()) {}
+
+bool BlobStore::open(std::string& error) {
+#ifdef _WIN32
+    if (_mkdir(m_directory.c_str()) != 0 && errno != EEXIST) {
+        error = "无法创建目录 " + m_directory;
+        return false;
+    }
+#else
+    if (::mkdir(m_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        error = "无法创建目录 " + m_directory + ": " + std::strerror(errno);
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool BlobStore::validId(const std::string& id) {
+    if (id.size() != 16) return false;
+    for (char c : id) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return true;
+}
+
+std::string BlobStore::sanitizeName(const std::string& name) {
+    // 只保留最后一段路径；协议分隔符和控制字符替换成下划线
+    size_t slash = name.find_last_of("/\\");
+    std::string base = slash == std::string::npos ? name : name.substr(slash + 1);
+    for (char& c : base) {
+        if (c == '|' || static_cast<unsigned char>(c) < 0x20 || c == 0x7f) c = '_';
+    }
+    if (base.size() > MAX_NAME_BYTES) base.resize(MAX_NAME_BYTES);
+    if (base.empty() || base == "." || base == "..") base = "file";
+    return base;
+}
+
+std::string BlobStore::randomHex() {
+    static const char digits[] = "0123456789abcdef";
+    uint64_t value = m_random();
+    std::string out(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        out[i] = digits[value & 0xf];
+        value >>= 4;
+    }
+    return out;
+}
+
+void BlobStore::expireIdle() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (!it->second.writing && now - it->second.lastActivity > UPLOAD_IDLE_TIMEOUT) {
+            std::remove(partPath(it->first).c_str());
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool BlobStore::create(const std::string& ownerId, const std::string& receiverId, const std::string& name,
+                       uint64_t size, BlobInfo& out, std::string& error) {
+    if (size == 0) { error = "文件为空"; return false; }
+    if (size > m_maxBlobBytes) { error = "文件超过 " + std::to_string(m_maxBlobBytes) + " 字节上限"; return false; }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    expireIdle();
+    if (m_pending.size() >= MAX_PENDING_UPLOADS) { error = "未完成的上传过多，请稍后再试"; return false; }
+
+    BlobInfo info;
+    do {
+        info.id = randomHex();
+    } while (m_pending.count(info.id) != 0);
+    info.ownerId = ownerId;
+    info.receiverId = receiverId;
+    info.name = sanitizeName(name);
+    info.size = size;
+    info.uploadToken = randomHex();
+    info.downloadToken = randomHex();
+
+    PendingUpload& pending = m_pending[info.id];
+    pending.info = info;
+    pending.lastActivity = std::chrono::steady_clock::now();
+    out = info;
+    return true;
+}
+
+int BlobStore::beginUpload(const std::string& id, const std::string& token, uint64_t offset,
+                           uint64_t& remaining, std::string& error) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_pending.find(id);
+    if (it == m_pending.end() || it->second.info.uploadToken != token) { error = "文件不存在或令牌无效"; return -1; }
+    PendingUpload& pending = it->second;
+    if (pending.writing) { error = "该文件正在上传"; return -1; }
+    if (offset != pending.info.received) {
+        error = "偏移应为 " + std::to_string(pending.info.received);
+        return -1;
+    }
+#ifdef _WIN32
+    error = "当前平台不支持文件传输";
+    return -1;
+#else
+    int fd = ::open(partPath(id).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) { error = std::string("无法打开文件: ") + std::strerror(errno); return -1; }
+    pending.writing = true;
+    pending.lastActivity = std::chrono::steady_clock::now();
+    remaining = pending.info.size - pending.info.received;
+    return fd;
+#endif
+}
+
+bool BlobStore::endUpload(const std::string& id, int fd, uint64_t written, BlobInfo& info) {
+#ifndef _WIN32
+    if (fd >= 0) ::close(fd);
+#endif
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_pending.find(id);
+    if (it == m_pending.end()) return false;
+    PendingUpload& pending = it->second;
+    pending.writing = false;
+    pending.lastActivity = std::chrono::steady_clock::now();
+    pending.info.received += written;
+    if (pending.info.received > pending.info.size) pending.info.received = pending.info.size;
+    info = pending.info;
+    if (pending.info.received < pending.info.size) return false;
+
+    // 先写元数据再改名：下载只认 <id> 存在的文件，改名成功即可下载
+    info.complete = true;
+    if (!saveMeta(info) || std::rename(partPath(id).c_str(), blobPath(id).c_str()) != 0) {
+        std::remove(metaPath(id).c_str());
+        info.complete = false;
+        return false;
+    }
+    m_pending.erase(it);
+    return true;
+}
+
+bool BlobStore::stat(const std::string& id, const std::string& token, BlobInfo& info, std::string& error) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_pending.find(id);
+        if (it != m_pending.end()) {
+            if (it->second.info.uploadToken != token) { error = "文件不存在或令牌无效"; return false; }
+            info = it->second.info;
+            return true;
+        }
+    }
+    if (!validId(id) || !loadMeta(id, info) || info.downloadToken != token) {
+        error = "文件不存在或令牌无效";
+        return false;
+    }
+    return true;
+}
+
+int BlobStore::openForDownload(const std::string& id, const std::string& token, uint64_t& size, std::string& error) {
+    BlobInfo info;
+    if (!validId(id) || !loadMeta(id, info) || info.downloadToken != token) {
+        error = "文件不存在或令牌无效";
+        return -1;
+    }
+#ifdef _WIN32
+    error = "当前平台不支持文件传输";
+    return -1;
+#else
+    int fd = ::open(blobPath(id).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { error = std::string("无法打开文件: ") + std::strerror(errno); return -1; }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) != info.size) {
+        ::close(fd);
+        error = "文件已损坏";
+        return -1;
+    }
+    size = info.size;
+    return fd;
+#endif
+}
+
+// 元数据格式与用户/群数据文件一致：一行 owner|receiver|size|downloadToken|name
+bool BlobStore::loadMeta(const std::string& id, BlobInfo& info) const {
+    std::ifstream fin(metaPath(id));
+    if (!fin) return false;
+    std::string line;
+    if (!std::getline(fin, line)) return false;
+    std::istringstream ss(line);
+    std::string size;
+    if (!std::getline(ss, info.ownerId, '|') || !std::getline(ss, info.receiverId, '|') ||
+        !std::getline(ss, size, '|') || !std::getline(ss, info.downloadToken, '|') ||
+        !std::getline(ss, info.name)) {
+        return false;
+    }
+    info.id = id;
+    info.size = std::strtoull(size.c_str(), nullptr, 10);
+    info.received = info.size;
+    info.uploadToken.clear();
+    info.complete = true;
+    return true;
+}
+
+bool BlobStore::saveMeta(const BlobInfo& info) const {
+    std::ofstream fout(metaPath(info.id));
+    if (!fout) return false;
+    fout << info.ownerId << '|' << info.receiverId << '|' << info.size << '|'
+         << info.downloadToken << '|' << info.name << "\n";
+    return static_cast<bool>(fout.flush());
+}
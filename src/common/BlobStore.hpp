@@ -0,0 +1,99 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+// ========================================================================================
+// BlobStore - 文件/媒体的本地存储
+// ========================================================================================
+// - 聊天连接上只做登记（create）：分配文件ID、上传令牌和下载令牌，文件内容不经过聊天连接
+// - 上传按块顺序写入 <目录>/<id>.part：beginUpload 校验令牌和偏移（只能从已收到的位置续传），
+//   返回文件描述符，调用方用 splice / pwrite 直接写入；endUpload 记下实际写入的字节数，
+//   收满后改名为 <id> 并写 <id>.meta，之后的下载只看磁盘，服务器重启后仍可下载
+// - 下载 openForDownload 校验下载令牌，返回只读描述符和文件长度，由调用方 sendfile
+// - 同一文件同一时刻只允许一个上传；长时间没有进展的未完成上传在登记新文件时清理
+// 元数据由一把锁保护，文件读写不持锁。文件描述符只在 POSIX 平台上提供。
+// ========================================================================================
+
+struct BlobInfo {
+    std::string id;               // 16 位十六进制
+    std::string ownerId;          // 上传者
+    std::string receiverId;       // 接收的用户或群
+    std::string name;             // 文件名（已去掉路径和协议分隔符）
+    uint64_t size = 0;
+    uint64_t received = 0;        // 已写入的字节数，等于 size 时上传完成
+    std::string uploadToken;
+    std::string downloadToken;
+    bool complete = false;
+};
+
+// 接收方收到的引用消息内容："[FILE]id:downloadToken:size:name"，文件名放最后，可以含冒号
+struct FileReference {
+    std::string id;
+    std::string downloadToken;
+    uint64_t size = 0;
+    std::string name;
+
+    static constexpr const char* PREFIX = "[FILE]";
+    static std::string format(const BlobInfo& blob);
+    static bool parse(const std::string& content, FileReference& out);
+};
+
+class BlobStore {
+public:
+    static constexpr uint64_t DEFAULT_MAX_BLOB_BYTES = 1ULL << 30;   // 1GB
+    static constexpr size_t MAX_NAME_BYTES = 255;
+    static constexpr size_t MAX_PENDING_UPLOADS = 1024;
+    static constexpr std::chrono::minutes UPLOAD_IDLE_TIMEOUT{ 10 };
+
+    explicit BlobStore(std::string directory = "data/blobs", uint64_t maxBlobBytes = DEFAULT_MAX_BLOB_BYTES);
+
+    // 创建存储目录；失败返回 false
+    bool open(std::string& error);
+    const std::string& directory() const { return m_directory; }
+    uint64_t maxBlobBytes() const { return m_maxBlobBytes; }
+
+    // 登记一个待上传的文件；文件名会被清理（去掉路径、分隔符和控制字符）
+    bool create(const std::string& ownerId, const std::string& receiverId, const std::string& name,
+                uint64_t size, BlobInfo& out, std::string& error);
+
+    // 开始写一块：offset 必须等于已收到的字节数（断点续传从这里接着写）。
+    // 返回 .part 文件的可写描述符，remaining 为还差的字节数；出错返回 -1
+    int beginUpload(const std::string& id, const std::string& token, uint64_t offset,
+                    uint64_t& remaining, std::string& error);
+    // 结束一块：关闭 fd，已收到字节数加上 written。info 为更新后的状态；
+    // 返回本次是否使文件上传完成（完成的文件从内存中移除，只留磁盘上的文件和元数据）
+    bool endUpload(const std::string& id, int fd, uint64_t written, BlobInfo& info);
+
+    // 查询进度：上传令牌查未完成的上传，下载令牌查已完成的文件
+    bool stat(const std::string& id, const std::string& token, BlobInfo& info, std::string& error);
+
+    // 打开已完成的文件供下载；返回只读描述符，出错返回 -1
+    int openForDownload(const std::string& id, const std::string& token, uint64_t& size, std::string& error);
+
+private:
+    struct PendingUpload {
+        BlobInfo info;
+        bool writing = false;                                 // 有连接正在写
+        std::chrono::steady_clock::time_point lastActivity;
+    };
+
+    static bool validId(const std::string& id);
+    static std::string sanitizeName(const std::string& name);
+    std::string randomHex();                                  // 调用方持有 m_mutex
+    std::string blobPath(const std::string& id) const { return m_directory + "/" + id; }
+    std::string partPath(const std::string& id) const { return blobPath(id) + ".part"; }
+    std::string metaPath(const std::string& id) const { return blobPath(id) + ".meta"; }
+    bool loadMeta(const std::string& id, BlobInfo& info) const;
+    bool saveMeta(const BlobInfo& info) const;
+    void expireIdle();                                        // 调用方持有 m_mutex
+
+    std::string m_directory;
+    uint64_t m_maxBlobBytes;
+    std::mutex m_mutex;
+    std::unordered_map<std::string, PendingUpload> m_pending;
+    std::mt19937_64 m_random;
+};
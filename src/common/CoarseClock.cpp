@@ -0,0 +1,126 @@
+#include "CoarseClock.hpp"
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+namespace {
+
+constexpr size_t TEXT_WORDS = 3;   // 19 字节文本放进 3 个 8 字节字
+
+// seqlock 保护的缓存；数据字段也用原子变量（relaxed），并发读写不构成数据竞争
+struct ClockCache {
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint64_t> epochMs{0};
+    std::atomic<int64_t> second{-1};               // 文本对应的秒（自 1970 起）
+    std::atomic<uint64_t> text[TEXT_WORDS] = {};
+};
+
+ClockCache g_cache;
+
+uint64_t systemMs() noexcept {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+void formatLocal(std::time_t seconds, char* buf) noexcept {
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+    char tmp[TEXT_WORDS * 8] = {};
+    std::strftime(tmp, sizeof(tmp), "%Y-%m-%d %H:%M:%S", &local);
+    std::memcpy(buf, tmp, CoarseClock::TIMESTAMP_LENGTH);
+}
+
+// 只有后台线程（以及启动时的第一次）调用，写者之间不会并发
+void refresh() noexcept {
+    uint64_t ms = systemMs();
+    int64_t second = static_cast<int64_t>(ms / 1000);
+    bool newSecond = second != g_cache.second.load(std::memory_order_relaxed);
+    uint64_t words[TEXT_WORDS] = {};
+    if (newSecond) formatLocal(static_cast<std::time_t>(second), reinterpret_cast<char*>(words));
+
+    uint64_t seq = g_cache.sequence.load(std::memory_order_relaxed);
+    g_cache.sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    g_cache.epochMs.store(ms, std::memory_order_relaxed);
+    if (newSecond) {
+        g_cache.second.store(second, std::memory_order_relaxed);
+        for (size_t i = 0; i < TEXT_WORDS; ++i) g_cache.text[i].store(words[i], std::memory_order_relaxed);
+    }
+    g_cache.sequence.store(seq + 2, std::memory_order_release);
+}
+
+bool startTicker() {
+    refresh();
+    std::thread([] {
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::microseconds(CoarseClock::TICK_MICROS));
+            refresh();
+        }
+    }).detach();
+    return true;
+}
+
+inline void ensureStarted() {
+    static const bool started = startTicker();
+    (void)started;
+}
+
+// 读一份一致的快照
+void snapshot(uint64_t& ms, int64_t& second, uint64_t (&words)[TEXT_WORDS]) noexcept {
+    ensureStarted();
+    while (true) {
+        uint64_t before = g_cache.sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        ms = g_cache.epochMs.load(std::memory_order_relaxed);
+        second = g_cache.second.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < TEXT_WORDS; ++i) words[i] = g_cache.text[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (g_cache.sequence.load(std::memory_order_relaxed) == before) return;
+    }
+}
+
+} // namespace
+
+uint64_t CoarseClock::nowMs() noexcept {
+    ensureStarted();
+    // 单个字读取本身是原子的，不需要走 seqlock
+    return g_cache.epochMs.load(std::memory_order_relaxed);
+}
+
+size_t CoarseClock::formatNow(char* buf) noexcept {
+    uint64_t ms;
+    int64_t second;
+    uint64_t words[TEXT_WORDS];
+    snapshot(ms, second, words);
+    std::memcpy(buf, words, TIMESTAMP_LENGTH);
+    return TIMESTAMP_LENGTH;
+}
+
+std::string CoarseClock::timestamp() {
+    char buf[TIMESTAMP_LENGTH];
+    return std::string(buf, formatNow(buf));
+}
+
+size_t CoarseClock::format(std::chrono::system_clock::time_point when, char* buf) noexcept {
+    int64_t whenSecond = std::chrono::duration_cast<std::chrono::seconds>(when.time_since_epoch()).count();
+    uint64_t ms;
+    int64_t second;
+    uint64_t words[TEXT_WORDS];
+    snapshot(ms, second, words);
+    if (second == whenSecond) {
+        std::memcpy(buf, words, TIMESTAMP_LENGTH);
+    } else {
+        formatLocal(static_cast<std::time_t>(whenSecond), buf);
+    }
+    return TIMESTAMP_LENGTH;
+}
+
+std::string CoarseClock::toString(std::chrono::system_clock::time_point when) {
+    char buf[TIMESTAMP_LENGTH];
+    return std::string(buf, format(when, buf));
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ========================================================================================
+// CoarseClock - 粗粒度时钟：后台线程每毫秒刷新一次缓存，读取只是几次原子加载
+// ========================================================================================
+// - 缓存内容：自 1970 起的毫秒数 + 预先格式化好的本地时间 "YYYY-MM-DD HH:MM:SS"
+// - 本地时间只在秒数变化时由后台线程格式化一次（localtime_r），编码消息 / ACK 不再逐条调用
+//   localtime + strftime（glibc 的 localtime 内部加全局锁）
+// - 缓存由 seqlock 保护：写者先把序号改成奇数、写数据、再改成偶数；读者读到的前后序号
+//   不一致或为奇数时重读，读路径不加锁
+// - 精度约为一个刷新周期（1 毫秒），适合消息时间戳、消息ID这类场景，不适合测量耗时
+// 第一次读取时启动后台线程，进程结束前一直运行。
+// ========================================================================================
+
+class CoarseClock {
+public:
+    static constexpr size_t TIMESTAMP_LENGTH = 19;     // "YYYY-MM-DD HH:MM:SS"
+    static constexpr unsigned TICK_MICROS = 1000;
+
+    // 自 1970-01-01 起的毫秒数（最多滞后一个刷新周期）
+    static uint64_t nowMs() noexcept;
+
+    // 当前本地时间写入 buf（至少 TIMESTAMP_LENGTH 字节），返回长度
+    static size_t formatNow(char* buf) noexcept;
+    static std::string timestamp();
+
+    // 格式化任意时刻：与缓存同一秒时直接复制缓存，否则走 localtime_r
+    static size_t format(std::chrono::system_clock::time_point when, char* buf) noexcept;
+    static std::string toString(std::chrono::system_clock::time_point when);
+};
@@ -0,0 +1,453 @@
+#include "Compression.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace {
+
+// LZ4 块格式参数
+const size_t MIN_MATCH = 4;
+const size_t LAST_LITERALS = 5;        // 块末尾至少 5 字节字面量
+const size_t MF_LIMIT = 12;            // 最后一个匹配至少在块末尾 12 字节之前开始
+const unsigned HASH_LOG = 12;          // 4096 项，表 16KB，与 LZ4 默认一致
+const unsigned SKIP_TRIGGER = 6;       // 连续未命中 2^6 次后步长 +1
+
+// 窗口：保留 32KB 历史，另留 16KB 给新帧，放不下时把最近 32KB 前移；单帧更大时窗口按需扩大。
+// 每个开启压缩的连接约 112KB（两个窗口 + 16KB 哈希表）
+const size_t HISTORY_SIZE = 32 * 1024;
+const size_t WINDOW_SLACK = 16 * 1024;
+const size_t MAX_FRAME_INPUT = 64 * 1024;
+// 匹配距离不超过保留的历史（LZ4 格式本身允许 65535）：两端各自决定何时前移窗口，
+// 但都至少保留最近 32KB，距离在这之内的引用两端看到的内容一定相同
+const size_t MAX_OFFSET = HISTORY_SIZE;
+
+inline uint32_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+// 从 a、b 起比较，返回相同的字节数（a 不越过 limit）
+inline size_t matchLength(const char* a, const char* b, const char* limit) {
+    const char* start = a;
+    while (a + sizeof(uint64_t) <= limit) {
+        uint64_t x, y;
+        std::memcpy(&x, a, sizeof(x));
+        std::memcpy(&y, b, sizeof(y));
+        if (x != y) {
+            uint64_t diff = x ^ y;
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<size_t>(a - start) + static_cast<size_t>(__builtin_ctzll(diff) >> 3);
+#else
+            while ((diff & 0xFF) == 0) { diff >>= 8; ++a; }
+            return static_cast<size_t>(a - start);
+#endif
+        }
+        a += sizeof(uint64_t);
+        b += sizeof(uint64_t);
+    }
+    while (a < limit && *a == *b) { ++a; ++b; }
+    return static_cast<size_t>(a - start);
+}
+
+// 长度 >= 15 时的扩展字节：每个 255 表示继续
+inline void writeLength(std::string& out, size_t len) {
+    while (len >= 255) {
+        out.push_back(static_cast<char>(255));
+        len -= 255;
+    }
+    out.push_back(static_cast<char>(len));
+}
+
+inline void writeVarint(std::string& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline bool readVarint(const unsigned char*& p, const unsigned char* end, uint32_t& v) {
+    v = 0;
+    for (unsigned shift = 0; shift < 32 && p < end; shift += 7) {
+        unsigned char b = *p++;
+        v |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// 一段字面量 + 一个匹配（matchLen 为 0 表示块末尾只有字面量）
+void emitSequence(std::string& out, const char* literals, size_t literalLen, size_t offset, size_t matchLen) {
+    size_t token = out.size();
+    out.push_back(0);
+    unsigned char t = static_cast<unsigned char>(std::min<size_t>(literalLen, 15) << 4);
+    if (literalLen >= 15) writeLength(out, literalLen - 15);
+    out.append(literals, literalLen);
+    if (matchLen > 0) {
+        out.push_back(static_cast<char>(offset & 0xFF));
+        out.push_back(static_cast<char>(offset >> 8));
+        size_t extra = matchLen - MIN_MATCH;
+        t |= static_cast<unsigned char>(std::min<size_t>(extra, 15));
+        if (extra >= 15) writeLength(out, extra - 15);
+    }
+    out[token] = static_cast<char>(t);
+}
+
+uint32_t fnv1a(const std::string& data) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 内置字典：越常用的放得越靠后（离新数据越近）
+const char BUILTIN_DICTIONARY[] =
+    "好的，收到。没问题，我马上处理。稍等一下，我看看。谢谢！不客气。辛苦了。明天见。晚安。早上好！"
+    "今天下午三点开会，记得准时参加。会议室在三楼。文件已经发到群里了，大家看一下。"
+    "这个需求什么时候上线？测试环境已经部署好了。代码已经提交，麻烦帮忙 review 一下。"
+    "我在路上了，大概十分钟到。你到哪了？一起吃饭吗？周末有空吗？哈哈哈哈"
+    "ok, thanks! sounds good. see you tomorrow. let me check and get back to you. "
+    "meeting at 3pm, please review the document. on my way. "
+    "RESPONSE|ERROR|INVALID_FORMAT|RESPONSE|ERROR|SEND_FAILED|RESPONSE|ERROR|LOGIN_FAILED|"
+    "RESPONSE|SUCCESS|LOGOUT_OK|退出成功RESPONSE|SUCCESS|GROUP_SENT|群消息已发送|SEQ:"
+    "RESPONSE|OFFLINE_MESSAGES|COUNT|RESPONSE|SUCCESS|LOGIN_OK|登录成功|OFFLINE_COUNT:"
+    "MESSAGE_BATCH|RESPONSE|SUCCESS|MESSAGE_CACHED|消息已缓存|SEQ:"
+    "RESPONSE|SUCCESS|MESSAGE_SENT|消息发送成功|SEQ:|2026-01-01 00:00:00|SEQ:1"
+    "ACK|1174629945320407|2026-10-18 12:00:00"
+    "MESSAGE|1174629945320407|user|group|2026-10-18 12:00:00|SEQ:1174629945320407";
+
+} // namespace
+
+// ========================================================================================
+// CompressionDictionary
+// ========================================================================================
+
+CompressionDictionary::CompressionDictionary(std::string data) : m_data(std::move(data)) {
+    if (m_data.size() > HISTORY_SIZE) m_data.erase(0, m_data.size() - HISTORY_SIZE);
+    if (!m_data.empty()) {
+        char id[16];
+        std::snprintf(id, sizeof(id), "d%08x", fnv1a(m_data));
+        m_id = id;
+    }
+}
+
+const CompressionDictionary& CompressionDictionary::builtin() {
+    static const CompressionDictionary dictionary(std::string(BUILTIN_DICTIONARY, sizeof(BUILTIN_DICTIONARY) - 1));
+    return dictionary;
+}
+
+CompressionDictionary CompressionDictionary::train(const std::vector<std::string>& samples, size_t maxBytes) {
+    const size_t GRAM = 8;            // 统计单位：8 字节片段
+    const size_t SEGMENT = 32;        // 候选字典片段长度
+    const unsigned COUNT_LOG = 20;    // 片段按哈希计数（近似，冲突只会高估少数片段）
+    const size_t MAX_CORPUS = 4 * 1024 * 1024;
+    maxBytes = std::min(maxBytes, HISTORY_SIZE);
+
+    auto gramAt = [](const std::string& sample, size_t pos) {
+        uint64_t gram;
+        std::memcpy(&gram, sample.data() + pos, GRAM);
+        return static_cast<size_t>((gram * 0x9E3779B97F4A7C15ULL) >> (64 - COUNT_LOG));
+    };
+
+    // 1. 统计每个 8 字节片段出现的次数（只看前 4MB 样本）
+    std::vector<uint32_t> counts(size_t(1) << COUNT_LOG, 0);
+    size_t used = 0;
+    size_t sampleCount = 0;
+    for (const auto& sample : samples) {
+        if (used >= MAX_CORPUS) break;
+        used += sample.size();
+        ++sampleCount;
+        for (size_t i = 0; i + GRAM <= sample.size(); ++i) ++counts[gramAt(sample, i)];
+    }
+
+    // 2. 候选片段按所含片段的出现次数打分
+    struct Candidate {
+        size_t sample;
+        size_t pos;
+        size_t len;
+        uint64_t score;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t s = 0; s < sampleCount; ++s) {
+        const std::string& sample = samples[s];
+        for (size_t pos = 0; pos + GRAM <= sample.size(); pos += GRAM) {
+            size_t len = std::min(SEGMENT, sample.size() - pos);
+            uint64_t score = 0;
+            for (size_t i = pos; i + GRAM <= pos + len; ++i) {
+                uint32_t c = counts[gramAt(sample, i)];
+                if (c > 1) score += c;
+            }
+            if (score > 0) candidates.push_back(Candidate{ s, pos, len, score });
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) { return a.score > b.score; });
+
+    // 3. 贪心选取：已被选中片段覆盖的部分不再计分，避免字典里重复同样的内容
+    std::vector<bool> covered(counts.size(), false);
+    std::vector<const Candidate*> chosen;
+    size_t total = 0;
+    for (const auto& candidate : candidates) {
+        if (total + candidate.len > maxBytes) continue;
+        const std::string& sample = samples[candidate.sample];
+        uint64_t fresh = 0;
+        for (size_t i = candidate.pos; i + GRAM <= candidate.pos + candidate.len; ++i) {
+            size_t h = gramAt(sample, i);
+            if (!covered[h] && counts[h] > 1) fresh += counts[h];
+        }
+        if (fresh * 2 < candidate.score) continue;
+        for (size_t i = candidate.pos; i + GRAM <= candidate.pos + candidate.len; ++i) {
+            covered[gramAt(sample, i)] = true;
+        }
+        chosen.push_back(&candidate);
+        total += candidate.len;
+        if (total + GRAM > maxBytes) break;
+    }
+
+    // 4. 得分最高的放在最后
+    std::string data;
+    data.reserve(total);
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        data.append(samples[(*it)->sample], (*it)->pos, (*it)->len);
+    }
+    return CompressionDictionary(std::move(data));
+}
+
+bool CompressionDictionary::loadFile(const std::string& path, CompressionDictionary& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.empty()) return false;
+    out = CompressionDictionary(std::move(data));
+    return true;
+}
+
+bool CompressionDictionary::saveFile(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out.write(m_data.data(), static_cast<std::streamsize>(m_data.size()));
+    return static_cast<bool>(out);
+}
+
+// ========================================================================================
+// FrameCompressor
+// ========================================================================================
+
+FrameCompressor::FrameCompressor(const CompressionDictionary* dictionary, size_t minBytes)
+    : m_minBytes(std::max<size_t>(minBytes, MF_LIMIT + 1)),
+      m_window(HISTORY_SIZE + WINDOW_SLACK),
+      m_end(0),
+      m_table(size_t(1) << HASH_LOG, 0) {
+    if (dictionary && !dictionary->empty()) m_dictionary = dictionary->data();
+    reset();
+}
+
+void FrameCompressor::reset() {
+    std::fill(m_table.begin(), m_table.end(), 0);
+    std::memcpy(m_window.data(), m_dictionary.data(), m_dictionary.size());
+    m_end = m_dictionary.size();
+    for (size_t i = 0; i + MIN_MATCH <= m_end; ++i) {
+        m_table[hash4(read32(m_window.data() + i))] = static_cast<uint32_t>(i + 1);
+    }
+}
+
+// 窗口放不下新帧时只保留最近 32KB 历史，哈希表里的位置同步平移；仍放不下（大帧）就扩大窗口
+void FrameCompressor::slide(size_t incoming) {
+    if (m_end + incoming <= m_window.size()) return;
+    size_t keep = std::min(m_end, HISTORY_SIZE);
+    size_t shift = m_end - keep;
+    if (shift > 0) {
+        std::memmove(m_window.data(), m_window.data() + shift, keep);
+        m_end = keep;
+        for (auto& entry : m_table) {
+            entry = entry > shift ? static_cast<uint32_t>(entry - shift) : 0;
+        }
+    }
+    if (m_end + incoming > m_window.size()) m_window.resize(m_end + incoming);
+}
+
+bool FrameCompressor::compress(const char* data, size_t len, std::string& out) {
+    out.clear();
+    if (len < m_minBytes || len > MAX_FRAME_INPUT) return false;
+    slide(len);
+
+    char* base = m_window.data();
+    const size_t start = m_end;
+    const size_t end = start + len;
+    std::memcpy(base + start, data, len);
+
+    writeVarint(out, static_cast<uint32_t>(len));
+    size_t headerSize = out.size();
+    const size_t matchLimit = end - LAST_LITERALS;
+    const size_t mfLimit = end - MF_LIMIT;
+
+    size_t anchor = start;
+    size_t ip = start + 1;
+    m_table[hash4(read32(base + start))] = static_cast<uint32_t>(start + 1);
+
+    while (ip < mfLimit) {
+        // 找匹配：连续未命中时步长逐渐变大
+        size_t ref = 0;
+        unsigned attempts = 1u << SKIP_TRIGGER;
+        bool found = false;
+        while (ip < mfLimit) {
+            uint32_t sequence = read32(base + ip);
+            uint32_t h = hash4(sequence);
+            uint32_t candidate = m_table[h];
+            m_table[h] = static_cast<uint32_t>(ip + 1);
+            if (candidate != 0) {
+                ref = candidate - 1;
+                // 表里可能留着未采用的帧写过的位置：只接受当前位置之前、MAX_OFFSET 以内且内容相同的
+                if (ref < ip && ip - ref <= MAX_OFFSET && read32(base + ref) == sequence) {
+                    found = true;
+                    break;
+                }
+            }
+            ip += attempts++ >> SKIP_TRIGGER;
+        }
+        if (!found) break;
+
+        // 向前延伸匹配
+        while (ip > anchor && ref > 0 && base[ip - 1] == base[ref - 1]) {
+            --ip;
+            --ref;
+        }
+        size_t length = MIN_MATCH + matchLength(base + ip + MIN_MATCH, base + ref + MIN_MATCH, base + matchLimit);
+        emitSequence(out, base + anchor, ip - anchor, ip - ref, length);
+        ip += length;
+        anchor = ip;
+        // 不划算就提前放弃，避免继续做无用功
+        if (out.size() - headerSize >= len) return false;
+        if (ip < mfLimit) m_table[hash4(read32(base + ip - 2))] = static_cast<uint32_t>(ip - 2 + 1);
+    }
+    emitSequence(out, base + anchor, end - anchor, 0, 0);
+
+    if (out.size() >= len) return false;
+    m_end = end;
+    return true;
+}
+
+size_t FrameCompressor::compressFrames(const char* framed, size_t len, std::string& out, uint32_t compressedFlag) {
+    out.clear();
+    out.reserve(len);
+    size_t compressed = 0;
+    size_t pos = 0;
+    while (pos + sizeof(uint32_t) <= len) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(framed + pos);
+        uint32_t frameLen = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+                            (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+        if ((frameLen & compressedFlag) || pos + sizeof(uint32_t) + frameLen > len) break;
+        const char* payload = framed + pos + sizeof(uint32_t);
+        if (compress(payload, frameLen, m_scratch)) {
+            uint32_t header = static_cast<uint32_t>(m_scratch.size()) | compressedFlag;
+            char bytes[4] = {
+                static_cast<char>(header >> 24), static_cast<char>((header >> 16) & 0xFF),
+                static_cast<char>((header >> 8) & 0xFF), static_cast<char>(header & 0xFF)
+            };
+            out.append(bytes, sizeof(bytes));
+            out.append(m_scratch);
+            ++compressed;
+        } else {
+            out.append(framed + pos, sizeof(uint32_t) + frameLen);
+        }
+        pos += sizeof(uint32_t) + frameLen;
+    }
+    // 不是完整帧的尾部（不应出现）原样保留
+    if (pos < len) out.append(framed + pos, len - pos);
+    return compressed;
+}
+
+// ========================================================================================
+// FrameDecompressor
+// ========================================================================================
+
+FrameDecompressor::FrameDecompressor(const CompressionDictionary* dictionary)
+    : m_window(HISTORY_SIZE + WINDOW_SLACK), m_end(0) {
+    if (dictionary && !dictionary->empty()) m_dictionary = dictionary->data();
+    reset();
+}
+
+void FrameDecompressor::reset() {
+    std::memcpy(m_window.data(), m_dictionary.data(), m_dictionary.size());
+    m_end = m_dictionary.size();
+}
+
+// 与压缩端各自决定何时前移：偏移是相对当前位置的，两端最近 32KB 的内容始终一致
+void FrameDecompressor::slide(size_t incoming) {
+    if (m_end + incoming <= m_window.size()) return;
+    size_t keep = std::min(m_end, HISTORY_SIZE);
+    if (keep < m_end) {
+        std::memmove(m_window.data(), m_window.data() + (m_end - keep), keep);
+        m_end = keep;
+    }
+    if (m_end + incoming > m_window.size()) m_window.resize(m_end + incoming);
+}
+
+bool FrameDecompressor::decompress(const char* data, size_t len, std::string& out, size_t maxBytes) {
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* const end = ip + len;
+    uint32_t rawLen = 0;
+    if (!readVarint(ip, end, rawLen) || rawLen > maxBytes || rawLen > MAX_FRAME_INPUT) return false;
+    slide(rawLen);
+
+    char* base = m_window.data();
+    const size_t start = m_end;
+    const size_t outEnd = start + rawLen;
+    size_t op = start;
+
+    while (ip < end) {
+        unsigned token = *ip++;
+        size_t literalLen = token >> 4;
+        if (literalLen == 15) {
+            unsigned char b;
+            do {
+                if (ip >= end) return false;
+                b = *ip++;
+                literalLen += b;
+            } while (b == 255);
+        }
+        if (literalLen > static_cast<size_t>(end - ip) || literalLen > outEnd - op) return false;
+        std::memcpy(base + op, ip, literalLen);
+        ip += literalLen;
+        op += literalLen;
+        if (ip == end) break;    // 最后一段只有字面量
+
+        if (end - ip < 2) return false;
+        size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+        size_t matchLen = (token & 0x0F) + MIN_MATCH;
+        if ((token & 0x0F) == 15) {
+            unsigned char b;
+            do {
+                if (ip >= end) return false;
+                b = *ip++;
+                matchLen += b;
+            } while (b == 255);
+        }
+        if (matchLen > outEnd - op) return false;
+        // 偏移小于长度时源与目标重叠（重复模式），只能逐字节复制
+        const char* src = base + op - offset;
+        if (offset >= matchLen) {
+            std::memcpy(base + op, src, matchLen);
+        } else {
+            for (size_t i = 0; i < matchLen; ++i) base[op + i] = src[i];
+        }
+        op += matchLen;
+    }
+    if (op != outEnd) return false;
+
+    out.assign(base + start, rawLen);
+    m_end = outEnd;
+    return true;
+}
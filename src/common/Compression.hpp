@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ========================================================================================
+// Compression - 连接级流式压缩（LZ4 块格式，LZ4 级别的速度），可选预置字典
+// ========================================================================================
+// - 编码为 LZ4 块格式（token + 字面量 + 2 字节偏移 + 匹配长度），单趟贪心哈希匹配，
+//   未命中时逐步加大步长，不可压缩的数据很快跳过
+// - 流式：每个连接、每个方向一个上下文，保留最近 32KB 已压缩帧的原文作为历史窗口，
+//   后面的帧可以引用前面帧里的内容（用户名、消息ID前缀、时间戳等在相邻帧里高度重复）
+// - 字典：窗口初始内容，短消息在第一帧就能命中协议关键字和常用语；双方必须使用同一个字典，
+//   握手时用 id（内容哈希）核对
+// - 只压缩不小于 minBytes 的帧，压缩后不变小则原样发送；收发双方只把"按压缩发出"的帧
+//   追加进历史，未压缩的帧不影响两端窗口的一致
+// 上下文不是线程安全的：压缩端由持有写端的线程使用，解压端由读线程使用。
+// ========================================================================================
+
+// 字典：窗口初始内容（最多 32KB，超出时保留末尾）
+class CompressionDictionary {
+public:
+    CompressionDictionary() = default;
+    explicit CompressionDictionary(std::string data);
+
+    // 内置字典：协议字段、时间戳前缀和常用聊天短语
+    static const CompressionDictionary& builtin();
+
+    // 从样本帧中训练：统计高频片段，按出现次数 × 长度取最有价值的若干个，
+    // 最常用的放在末尾（离新数据最近）
+    static CompressionDictionary train(const std::vector<std::string>& samples, size_t maxBytes = 16 * 1024);
+
+    // 读写字典文件（原样字节）；读失败返回 false
+    static bool loadFile(const std::string& path, CompressionDictionary& out);
+    bool saveFile(const std::string& path) const;
+
+    const std::string& id() const { return m_id; }
+    const std::string& data() const { return m_data; }
+    bool empty() const { return m_data.empty(); }
+
+private:
+    std::string m_data;
+    std::string m_id;          // "d" + FNV-1a 32 位十六进制，握手时核对
+};
+
+class FrameCompressor {
+public:
+    // dictionary 可为空；上下文复制字典内容，不持有指针
+    FrameCompressor(const CompressionDictionary* dictionary, size_t minBytes);
+
+    // 压缩一帧负载：输出为 [原长度 varint][LZ4 块]。帧太小或压缩后不变小返回 false，
+    // 此时历史窗口不变，调用方原样发送
+    bool compress(const char* data, size_t len, std::string& out);
+
+    // 把若干完整帧（4 字节大端长度前缀 + 负载）逐帧改写：够大的帧压缩并在长度上置
+    // compressedFlag，其余原样复制。返回压缩的帧数
+    size_t compressFrames(const char* framed, size_t len, std::string& out, uint32_t compressedFlag);
+
+    size_t minBytes() const { return m_minBytes; }
+    // 丢弃历史，回到只有字典的初始状态（两端须同时 reset）
+    void reset();
+
+private:
+    void slide(size_t incoming);
+
+    size_t m_minBytes;
+    std::string m_dictionary;
+    std::vector<char> m_window;      // [0, m_end) 为历史（字典 + 已压缩帧原文），新帧追加在后面
+    size_t m_end;
+    std::vector<uint32_t> m_table;   // 4 字节哈希 -> 窗口位置 + 1，0 表示空
+    std::string m_scratch;
+};
+
+class FrameDecompressor {
+public:
+    explicit FrameDecompressor(const CompressionDictionary* dictionary);
+
+    // 解压 compress 的输出；数据损坏、偏移越界或原长度超过 maxBytes 返回 false
+    bool decompress(const char* data, size_t len, std::string& out, size_t maxBytes);
+    void reset();
+
+private:
+    void slide(size_t incoming);
+
+    std::string m_dictionary;
+    std::vector<char> m_window;
+    size_t m_end;
+};
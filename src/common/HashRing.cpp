@@ -0,0 +1,139 @@
+#include "HashRing.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+// splitmix64 终混：把相邻的输入打散到整个 64 位空间
+uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+uint64_t pointPosition(uint32_t node, uint32_t replica) {
+    return mix64((static_cast<uint64_t>(node) << 32) | replica);
+}
+
+} // namespace
+
+uint64_t HashRing::hashKey(const std::string& key) {
+    // FNV-1a 后再混合一次，前缀相同的用户ID（user1、user2 ...）不会挤在环上同一段
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001B3ULL;
+    }
+    return mix64(hash);
+}
+
+void HashRing::setNode(uint32_t node, uint32_t weight) {
+    if (weight == 0) {
+        removeNode(node);
+        return;
+    }
+    m_weights[node] = std::min(weight, MAX_WEIGHT);
+    rebuild();
+}
+
+bool HashRing::removeNode(uint32_t node) {
+    if (m_weights.erase(node) == 0) return false;
+    rebuild();
+    return true;
+}
+
+uint32_t HashRing::weightOf(uint32_t node) const {
+    auto it = m_weights.find(node);
+    return it == m_weights.end() ? 0 : it->second;
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> HashRing::nodes() const {
+    return std::vector<std::pair<uint32_t, uint32_t>>(m_weights.begin(), m_weights.end());
+}
+
+void HashRing::rebuild() {
+    m_points.clear();
+    for (const auto& entry : m_weights) {
+        for (uint32_t replica = 0; replica < entry.second; ++replica) {
+            m_points.emplace_back(pointPosition(entry.first, replica), entry.first);
+        }
+    }
+    std::sort(m_points.begin(), m_points.end());
+}
+
+uint32_t HashRing::ownerOfHash(uint64_t hash) const {
+    if (m_points.empty()) return 0;
+    auto it = std::lower_bound(m_points.begin(), m_points.end(), std::make_pair(hash, uint32_t(0)));
+    return it == m_points.end() ? m_points.front().second : it->second;
+}
+
+uint32_t HashRing::owner(const std::string& key) const {
+    return ownerOfHash(hashKey(key));
+}
+
+double HashRing::movedFraction(const HashRing& other) const {
+    if (m_points.empty() && other.m_points.empty()) return 0.0;
+    if (m_points.empty() || other.m_points.empty()) return 1.0;
+
+    // 两个环的虚拟节点位置合在一起把环切成若干段，每段 (上一个位置, 本位置] 在两个环上各归一个节点
+    std::vector<uint64_t> bounds;
+    bounds.reserve(m_points.size() + other.m_points.size());
+    for (const auto& point : m_points) bounds.push_back(point.first);
+    for (const auto& point : other.m_points) bounds.push_back(point.first);
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    long double moved = 0;
+    uint64_t previous = bounds.back();    // 第一段从最后一个位置绕过零点
+    for (uint64_t bound : bounds) {
+        if (ownerOfHash(bound) != other.ownerOfHash(bound)) {
+            uint64_t length = bound - previous;   // 无符号回绕即跨零点的长度
+            moved += bounds.size() == 1 ? 18446744073709551616.0L : static_cast<long double>(length);
+        }
+        previous = bound;
+    }
+    return static_cast<double>(moved / 18446744073709551616.0L);
+}
+
+std::string HashRing::toString() const {
+    std::string spec;
+    for (const auto& entry : m_weights) {
+        if (!spec.empty()) spec += ',';
+        spec += std::to_string(entry.first) + "=" + std::to_string(entry.second);
+    }
+    return spec;
+}
+
+bool HashRing::parseWeights(const std::string& spec, std::vector<std::pair<uint32_t, uint32_t>>& weights) {
+    weights.clear();
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t comma = spec.find(',', start);
+        if (comma == std::string::npos) comma = spec.size();
+        std::string entry = spec.substr(start, comma - start);
+        start = comma + 1;
+        if (entry.empty()) continue;
+        size_t eq = entry.find('=');
+        if (eq == std::string::npos || eq == 0 || eq + 1 == entry.size()) return false;
+        char* end = nullptr;
+        unsigned long node = std::strtoul(entry.c_str(), &end, 10);
+        if (end != entry.c_str() + eq || node == 0) return false;
+        unsigned long weight = std::strtoul(entry.c_str() + eq + 1, &end, 10);
+        if (*end != '\0') return false;
+        weights.emplace_back(static_cast<uint32_t>(node), static_cast<uint32_t>(std::min<unsigned long>(weight, MAX_WEIGHT)));
+    }
+    return true;
+}
+
+bool HashRing::parse(const std::string& spec, HashRing& ring) {
+    std::vector<std::pair<uint32_t, uint32_t>> weights;
+    if (!parseWeights(spec, weights)) return false;
+    HashRing parsed;
+    for (const auto& entry : weights) {
+        if (entry.second != 0) parsed.m_weights[entry.first] = entry.second;
+    }
+    parsed.rebuild();
+    ring = std::move(parsed);
+    return true;
+}
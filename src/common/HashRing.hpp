@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ========================================================================================
+// HashRing - 一致性哈希环：把用户ID映射到集群中的归属节点（分片）
+// ========================================================================================
+// - 每个节点按权重放若干虚拟节点，权重即虚拟节点数；虚拟节点的位置只由 (节点号, 副本号) 决定，
+//   与环上其他节点无关
+// - 加入节点只从各节点手里切走新虚拟节点前面的一小段；移除节点只把它的区间交给顺时针的下一个点；
+//   调整权重只增删该节点尾部的虚拟节点。其余键的归属保持不变
+// - 不加锁：由持有者（ClusterNode）整体替换，读取方拿副本
+// ========================================================================================
+
+class HashRing {
+public:
+    static constexpr uint32_t DEFAULT_WEIGHT = 100;
+    static constexpr uint32_t MAX_WEIGHT = 1000;
+
+    // weight 为 0 时移除该节点；超过 MAX_WEIGHT 按 MAX_WEIGHT 计
+    void setNode(uint32_t node, uint32_t weight);
+    bool removeNode(uint32_t node);
+    uint32_t weightOf(uint32_t node) const;
+    bool contains(uint32_t node) const { return m_weights.count(node) > 0; }
+    bool empty() const { return m_weights.empty(); }
+    size_t nodeCount() const { return m_weights.size(); }
+    // (节点号, 权重)，按节点号升序
+    std::vector<std::pair<uint32_t, uint32_t>> nodes() const;
+
+    // 键的归属节点；环为空时返回 0
+    uint32_t owner(const std::string& key) const;
+    // 两个环上归属不同的哈希空间占比（0~1），即一次变更需要搬迁的键的比例
+    double movedFraction(const HashRing& other) const;
+
+    // "1=100,2=100,3=50"；parse 在格式错误时返回 false 且不修改 ring
+    std::string toString() const;
+    static bool parse(const std::string& spec, HashRing& ring);
+    // 解析同样格式的 (节点号, 权重) 列表，权重可以为 0（用于描述变更：0 表示移除）
+    static bool parseWeights(const std::string& spec, std::vector<std::pair<uint32_t, uint32_t>>& weights);
+
+    bool operator==(const HashRing& o) const { return m_weights == o.m_weights; }
+    bool operator!=(const HashRing& o) const { return !(*this == o); }
+
+    static uint64_t hashKey(const std::string& key);
+
+private:
+    void rebuild();
+    // 哈希值落在哪个节点：第一个位置 >= hash 的虚拟节点，越过末尾回到开头
+    uint32_t ownerOfHash(uint64_t hash) const;
+
+    std::map<uint32_t, uint32_t> m_weights;                 // 节点号 -> 权重
+    std::vector<std::pair<uint64_t, uint32_t>> m_points;    // (位置, 节点号)，按位置升序
+};
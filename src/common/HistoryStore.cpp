@@ -0,0 +1,556 @@
+#include "HistoryStore.hpp"
+#include "Metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// 块：magic | 负载长度 | 校验和 | 会话名长度 | 条数 | 起始序号 | 会话名 | 负载（每条 u32 长度 + 字节）
+const uint32_t BLOCK_MAGIC = 0x4B4C4248;        // "HBLK"
+const size_t BLOCK_HEADER = 4 + 4 + 4 + 2 + 4 + 8;
+// journal 记录：magic | 帧长度 | 会话名长度 | 序号 | 校验和 | 会话名 | 帧
+const uint32_t JOURNAL_MAGIC = 0x4E524A48;      // "HJRN"
+const size_t JOURNAL_HEADER = 4 + 4 + 2 + 8 + 4;
+const size_t MAX_CONVERSATION_BYTES = 0xFFFF;
+
+struct HistoryMetrics {
+    Counter& appends;
+    Counter& blocksWritten;
+    Counter& bytesWritten;
+    Counter& pages;
+    Counter& diskReads;
+    Counter& bytesRead;
+    Counter& writeErrors;
+    Counter& readErrors;
+    Histogram& pageSeconds;
+};
+
+HistoryMetrics& historyMetrics() {
+    MetricsRegistry& r = MetricsRegistry::instance();
+    static HistoryMetrics metrics{
+        r.counter("chat_history_appends_total", "Messages appended to conversation history"),
+        r.counter("chat_history_blocks_written_total", "History blocks appended to segment files"),
+        r.counter("chat_history_bytes_written_total", "Bytes written to history segments and journal"),
+        r.counter("chat_history_pages_total", "HISTORY page queries served"),
+        r.counter("chat_history_disk_reads_total", "Positioned reads issued for history pages (adjacent blocks merged)"),
+        r.counter("chat_history_bytes_read_total", "Bytes read from history segments for pages"),
+        r.counter("chat_history_write_errors_total", "Failed history block or journal writes (retried next round)"),
+        r.counter("chat_history_read_errors_total", "History pages refused because a segment read failed"),
+        r.histogram("chat_history_page_seconds", "Time to assemble one history page, including disk reads"),
+    };
+    return metrics;
+}
+
+uint32_t checksum(const char* data, size_t size, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template<class T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<class T>
+T get(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+#ifndef _WIN32
+bool writeAll(int fd, const char* data, size_t size, uint64_t offset, bool positioned) {
+    while (size > 0) {
+        ssize_t n = positioned ? ::pwrite(fd, data, size, static_cast<off_t>(offset)) : ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool readAll(int fd, char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pread(fd, data, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0) errno = EIO;            // 文件比索引记录的短
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool readFile(int fd, std::string& out) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) return false;
+    out.resize(static_cast<size_t>(st.st_size));
+    return out.empty() || readAll(fd, &out[0], out.size(), 0);
+}
+#endif
+
+} // namespace
+
+HistoryStore::HistoryStore() : HistoryStore(Options()) {}
+
+HistoryStore::HistoryStore(const Options& options) : m_options(options), m_running(false) {
+    if (m_options.blockRecords == 0) m_options.blockRecords = 1;
+}
+
+HistoryStore::~HistoryStore() {
+    close();
+}
+
+std::string HistoryStore::segmentPath(uint32_t index) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/segment-%08u.log", index);
+    return m_options.directory + name;
+}
+
+std::string HistoryStore::journalPath() const {
+    return m_options.directory + "/journal.log";
+}
+
+// ==============================
+// 打开与恢复
+// ==============================
+
+bool HistoryStore::open(std::string& error) {
+#ifdef _WIN32
+    error = "当前平台不支持消息历史存储";
+    return false;
+#else
+    if (m_open) return true;
+    if (::mkdir(m_options.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        error = "无法创建目录 " + m_options.directory + ": " + std::strerror(errno);
+        return false;
+    }
+
+    // 段文件从 1 连续编号；只有最后一个段可能在崩溃时留下半个块
+    uint32_t count = 0;
+    while (::access(segmentPath(count + 1).c_str(), F_OK) == 0) ++count;
+    for (uint32_t index = 1; index <= count; ++index) {
+        if (!recoverSegment(index, index == count)) {
+            error = "无法读取 " + segmentPath(index) + ": " + std::strerror(errno);
+            return false;
+        }
+    }
+    if (count == 0 && !openSegment(1, true)) {
+        error = "无法创建 " + segmentPath(1) + ": " + std::strerror(errno);
+        return false;
+    }
+
+    m_journalFd = ::open(journalPath().c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_journalFd < 0 || !replayJournal()) {
+        error = "无法读取 " + journalPath() + ": " + std::strerror(errno);
+        return false;
+    }
+
+    size_t records = 0;
+    for (const auto& entry : m_conversations) records += entry.second.lastSeq;
+    std::cout << "[历史] 已加载 " << m_conversations.size() << " 个会话、" << records << " 条消息，"
+              << m_segmentFds.size() << " 个段文件 (" << m_options.directory << ")" << std::endl;
+
+    m_open = true;
+    m_running = true;
+    m_flushThread = std::thread(&HistoryStore::flushLoop, this);
+    return true;
+#endif
+}
+
+bool HistoryStore::openSegment(uint32_t index, bool create) {
+#ifdef _WIN32
+    (void)index;
+    (void)create;
+    return false;
+#else
+    int fd = ::open(segmentPath(index).c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+    if (fd < 0) return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_segmentFds.push_back(fd);
+    m_activeSize = 0;
+    return true;
+#endif
+}
+
+bool HistoryStore::recoverSegment(uint32_t index, bool verify) {
+#ifdef _WIN32
+    (void)index;
+    (void)verify;
+    return false;
+#else
+    if (!openSegment(index, false)) return false;
+    int fd = m_segmentFds.back();
+    std::string data;
+    if (!readFile(fd, data)) return false;
+
+    // 顺序解析块并登记索引；遇到不完整或校验失败的块即为崩溃时写了一半，截掉它及之后的内容
+    size_t offset = 0;
+    while (offset + BLOCK_HEADER <= data.size()) {
+        const char* p = data.data() + offset;
+        if (get<uint32_t>(p) != BLOCK_MAGIC) break;
+        uint32_t payload = get<uint32_t>(p + 4);
+        uint32_t sum = get<uint32_t>(p + 8);
+        uint16_t nameLength = get<uint16_t>(p + 12);
+        uint32_t count = get<uint32_t>(p + 14);
+        uint64_t firstSeq = get<uint64_t>(p + 18);
+        size_t length = BLOCK_HEADER + nameLength + payload;
+        if (offset + length > data.size()) break;
+        if (verify && checksum(p + BLOCK_HEADER, nameLength + payload) != sum) break;
+
+        std::string name(p + BLOCK_HEADER, nameLength);
+        Conversation& conversation = m_conversations[name];
+        conversation.blocks.push_back(BlockRef{ firstSeq, count, index, offset, static_cast<uint32_t>(length) });
+        conversation.lastSeq = std::max(conversation.lastSeq, firstSeq + count - 1);
+        conversation.tailFirstSeq = conversation.lastSeq + 1;
+        offset += length;
+    }
+    if (offset < data.size()) {
+        std::cerr << "[历史] " << segmentPath(index) << " 末尾 " << (data.size() - offset)
+                  << " 字节不完整，已截断" << std::endl;
+        if (::ftruncate(fd, static_cast<off_t>(offset)) != 0) return false;
+    }
+    m_activeSize = offset;
+    return true;
+#endif
+}
+
+bool HistoryStore::replayJournal() {
+#ifdef _WIN32
+    return false;
+#else
+    std::string data;
+    if (!readFile(m_journalFd, data)) return false;
+
+    size_t offset = 0;
+    size_t replayed = 0;
+    while (offset + JOURNAL_HEADER <= data.size()) {
+        const char* p = data.data() + offset;
+        if (get<uint32_t>(p) != JOURNAL_MAGIC) break;
+        uint32_t frameLength = get<uint32_t>(p + 4);
+        uint16_t nameLength = get<uint16_t>(p + 8);
+        uint64_t seq = get<uint64_t>(p + 10);
+        uint32_t sum = get<uint32_t>(p + 18);
+        size_t length = JOURNAL_HEADER + nameLength + frameLength;
+        if (offset + length > data.size()) break;
+        if (checksum(p + JOURNAL_HEADER, nameLength + frameLength) != sum) break;
+        offset += length;
+
+        // 已经封块写入段文件的记录跳过；其余按序号接回内存尾部
+        Conversation& conversation = m_conversations[std::string(p + JOURNAL_HEADER, nameLength)];
+        if (seq <= conversation.lastSeq) continue;
+        if (!conversation.tail.empty() && seq != conversation.lastSeq + 1) continue;
+        if (conversation.tail.empty()) conversation.tailFirstSeq = seq;
+        conversation.tail.push_back(MessageBuffer::copyOf(p + JOURNAL_HEADER + nameLength, frameLength));
+        conversation.lastSeq = seq;
+        ++replayed;
+    }
+    if (offset < data.size() && ::ftruncate(m_journalFd, static_cast<off_t>(offset)) != 0) return false;
+    m_journalSize = offset;
+    if (replayed > 0) std::cout << "[历史] 从 journal 恢复 " << replayed << " 条未封块的消息" << std::endl;
+    return true;
+#endif
+}
+
+void HistoryStore::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_open) return;
+        m_open = false;
+    }
+    m_running = false;
+    m_flushCv.notify_all();
+    if (m_flushThread.joinable()) m_flushThread.join();
+    // 全部封块写出，下次启动不必重放 journal
+    flush(true);
+#ifndef _WIN32
+    if (m_journalFd >= 0) ::close(m_journalFd);
+    for (int fd : m_segmentFds) ::close(fd);
+#endif
+    m_journalFd = -1;
+    m_segmentFds.clear();
+}
+
+// ==============================
+// 写入
+// ==============================
+
+uint64_t HistoryStore::append(const std::string& name, const MessageBuffer& record) {
+    if (name.size() > MAX_CONVERSATION_BYTES) return 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_open) return 0;
+    Conversation& conversation = m_conversations[name];
+    uint64_t seq = ++conversation.lastSeq;
+    if (conversation.tail.empty()) conversation.tailFirstSeq = seq;
+    conversation.tail.push_back(record);
+
+    size_t before = m_journalBuffer.size();
+    put(m_journalBuffer, JOURNAL_MAGIC);
+    put(m_journalBuffer, static_cast<uint32_t>(record.size()));
+    put(m_journalBuffer, static_cast<uint16_t>(name.size()));
+    put(m_journalBuffer, seq);
+    put(m_journalBuffer, checksum(record.data(), record.size(), checksum(name.data(), name.size())));
+    m_journalBuffer += name;
+    m_journalBuffer.append(record.data(), record.size());
+    m_journalSize += m_journalBuffer.size() - before;
+
+    if (conversation.tail.size() - conversation.sealed >= m_options.blockRecords) sealTail(name, conversation);
+    historyMetrics().appends.inc();
+    return seq;
+}
+
+void HistoryStore::sealTail(const std::string& name, Conversation& conversation) {
+    PendingBlock block;
+    block.conversation = name;
+    block.firstSeq = conversation.tailFirstSeq + conversation.sealed;
+    block.records.assign(conversation.tail.begin() + static_cast<std::ptrdiff_t>(conversation.sealed),
+                         conversation.tail.end());
+    conversation.sealed = conversation.tail.size();
+    m_pendingBlocks.push_back(std::move(block));
+}
+
+void HistoryStore::flushLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+        m_flushCv.wait_for(lock, std::chrono::milliseconds(m_options.flushIntervalMs));
+        if (!m_running) break;
+        bool rollover = m_journalSize >= m_options.journalBytes;
+        lock.unlock();
+        flush(rollover);
+        lock.lock();
+    }
+}
+
+// 只在刷盘线程（或它停止后的 close）上运行：文件写入不持锁，锁内只交换缓冲和登记结果
+void HistoryStore::flush(bool all) {
+    std::string journal;
+    std::vector<PendingBlock> blocks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (all) {
+            for (auto& entry : m_conversations) {
+                if (entry.second.tail.size() > entry.second.sealed) sealTail(entry.first, entry.second);
+            }
+        }
+        journal.swap(m_journalBuffer);
+        blocks.swap(m_pendingBlocks);
+    }
+    if (journal.empty() && blocks.empty()) return;
+
+    HistoryMetrics& metrics = historyMetrics();
+    std::vector<BlockRef> refs(blocks.size());
+    size_t written = 0;
+    while (written < blocks.size() && writeBlock(blocks[written], refs[written])) ++written;
+    bool complete = written == blocks.size();
+
+#ifndef _WIN32
+    // all：此前的记录都已在块里，journal 缓冲不必再写，文件直接清空；
+    // 有块没写成功时照常写 journal，保证那些记录仍可恢复
+    bool reset = all && complete;
+    bool journalOk = true;
+    if (reset) {
+        journalOk = ::ftruncate(m_journalFd, 0) == 0;
+    } else if (!journal.empty()) {
+        journalOk = writeAll(m_journalFd, journal.data(), journal.size(), 0, false);
+        if (journalOk) metrics.bytesWritten.inc(journal.size());
+    }
+    if (!journalOk) {
+        metrics.writeErrors.inc();
+        std::cerr << "[历史] journal 写入失败: " << std::strerror(errno) << std::endl;
+    }
+    if (m_options.sync) {
+        ::fdatasync(m_journalFd);
+        if (!m_segmentFds.empty()) ::fdatasync(m_segmentFds.back());
+    }
+#else
+    bool reset = false;
+#endif
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < written; ++i) {
+        Conversation& conversation = m_conversations[blocks[i].conversation];
+        size_t count = blocks[i].records.size();
+        conversation.blocks.push_back(refs[i]);
+        conversation.tail.erase(conversation.tail.begin(), conversation.tail.begin() + static_cast<std::ptrdiff_t>(count));
+        conversation.tailFirstSeq += count;
+        conversation.sealed -= count;
+    }
+    if (!complete) {
+        // 写失败的块和它之后的块放回队首，下一轮按原顺序重试
+        metrics.writeErrors.inc();
+        m_pendingBlocks.insert(m_pendingBlocks.begin(), std::make_move_iterator(blocks.begin() + static_cast<std::ptrdiff_t>(written)),
+                               std::make_move_iterator(blocks.end()));
+    }
+    if (reset) m_journalSize = m_journalBuffer.size();
+}
+
+bool HistoryStore::writeBlock(const PendingBlock& block, BlockRef& ref) {
+#ifdef _WIN32
+    (void)block;
+    (void)ref;
+    return false;
+#else
+    std::string payload;
+    for (const MessageBuffer& record : block.records) {
+        put(payload, static_cast<uint32_t>(record.size()));
+        payload.append(record.data(), record.size());
+    }
+    const std::string& name = block.conversation;
+    std::string data;
+    data.reserve(BLOCK_HEADER + name.size() + payload.size());
+    put(data, BLOCK_MAGIC);
+    put(data, static_cast<uint32_t>(payload.size()));
+    put(data, checksum(payload.data(), payload.size(), checksum(name.data(), name.size())));
+    put(data, static_cast<uint16_t>(name.size()));
+    put(data, static_cast<uint32_t>(block.records.size()));
+    put(data, block.firstSeq);
+    data += name;
+    data += payload;
+
+    // 当前段写满时换下一个段；单个块超过段大小时独占一个段
+    if (m_activeSize > 0 && m_activeSize + data.size() > m_options.segmentBytes) {
+        uint32_t next;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            next = static_cast<uint32_t>(m_segmentFds.size()) + 1;
+        }
+        if (!openSegment(next, true)) {
+            std::cerr << "[历史] 无法创建 " << segmentPath(next) << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    int fd;
+    uint32_t segment;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        fd = m_segmentFds.back();
+        segment = static_cast<uint32_t>(m_segmentFds.size());
+    }
+    if (!writeAll(fd, data.data(), data.size(), m_activeSize, true)) {
+        std::cerr << "[历史] 写入 " << segmentPath(segment) << " 失败: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    ref = BlockRef{ block.firstSeq, static_cast<uint32_t>(block.records.size()), segment, m_activeSize,
+                    static_cast<uint32_t>(data.size()) };
+    m_activeSize += data.size();
+    HistoryMetrics& metrics = historyMetrics();
+    metrics.blocksWritten.inc();
+    metrics.bytesWritten.inc(data.size());
+    return true;
+#endif
+}
+
+// ==============================
+// 读取
+// ==============================
+
+uint64_t HistoryStore::lastSeq(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_conversations.find(name);
+    return it == m_conversations.end() ? 0 : it->second.lastSeq;
+}
+
+bool HistoryStore::page(const std::string& name, uint64_t beforeSeq, size_t limit,
+                          std::vector<MessageBuffer>& out, uint64_t& firstSeq) {
+    HistoryMetrics& metrics = historyMetrics();
+    ScopedTimer timer(metrics.pageSeconds);
+    metrics.pages.inc();
+    out.clear();
+    firstSeq = 0;
+    limit = std::min(limit, MAX_PAGE);
+    if (limit == 0) return true;
+
+    uint64_t start;
+    uint64_t diskEnd;
+    std::vector<MessageBuffer> memory;
+    std::vector<BlockRef> blocks;
+    std::vector<int> fds;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_conversations.find(name);
+        if (it == m_conversations.end()) return true;
+        const Conversation& conversation = it->second;
+        uint64_t end = (beforeSeq == 0 || beforeSeq > conversation.lastSeq) ? conversation.lastSeq + 1 : beforeSeq;
+        if (end <= 1) return true;
+        start = end > limit ? end - limit : 1;
+
+        // 内存尾部：[max(start, tailFirstSeq), end)
+        for (uint64_t seq = std::max(start, conversation.tailFirstSeq); seq < end; ++seq) {
+            memory.push_back(conversation.tail[static_cast<size_t>(seq - conversation.tailFirstSeq)]);
+        }
+        // 段文件：[start, min(end, tailFirstSeq)) 覆盖到的块，从 firstSeq <= start 的那一块起
+        diskEnd = std::min(end, conversation.tailFirstSeq);
+        if (start < diskEnd) {
+            const auto& index = conversation.blocks;
+            auto first = std::upper_bound(index.begin(), index.end(), start,
+                                          [](uint64_t seq, const BlockRef& block) { return seq < block.firstSeq; });
+            if (first != index.begin()) --first;
+            for (auto block = first; block != index.end() && block->firstSeq < diskEnd; ++block) blocks.push_back(*block);
+            fds = m_segmentFds;
+        }
+    }
+
+#ifndef _WIN32
+    // 同一段里首尾相接的块合并成一次读取
+    std::string buffer;
+    for (size_t i = 0; i < blocks.size();) {
+        size_t j = i + 1;
+        uint64_t length = blocks[i].length;
+        while (j < blocks.size() && blocks[j].segment == blocks[i].segment &&
+               blocks[j].offset == blocks[i].offset + length) {
+            length += blocks[j].length;
+            ++j;
+        }
+        buffer.resize(static_cast<size_t>(length));
+        metrics.diskReads.inc();
+        if (!readAll(fds[blocks[i].segment - 1], &buffer[0], buffer.size(), blocks[i].offset)) {
+            std::cerr << "[历史] 读取 " << segmentPath(blocks[i].segment) << " 失败: " << std::strerror(errno) << std::endl;
+            metrics.readErrors.inc();
+            out.clear();
+            firstSeq = 0;
+            return false;
+        }
+        metrics.bytesRead.inc(buffer.size());
+
+        size_t offset = 0;
+        for (; i < j; ++i) {
+            const char* p = buffer.data() + offset;
+            size_t recordOffset = offset + BLOCK_HEADER + get<uint16_t>(p + 12);
+            for (uint32_t r = 0; r < blocks[i].count; ++r) {
+                uint32_t size = get<uint32_t>(buffer.data() + recordOffset);
+                uint64_t seq = blocks[i].firstSeq + r;
+                if (seq >= start && seq < diskEnd) {
+                    if (out.empty()) firstSeq = seq;
+                    out.push_back(MessageBuffer::copyOf(buffer.data() + recordOffset + 4, size));
+                }
+                recordOffset += 4 + size;
+            }
+            offset += blocks[i].length;
+        }
+    }
+#endif
+
+    if (!memory.empty()) {
+        if (out.empty()) firstSeq = std::max(start, diskEnd);
+        out.insert(out.end(), memory.begin(), memory.end());
+    }
+    return true;
+}
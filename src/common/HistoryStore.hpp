@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "MessageBuffer.hpp"
+
+// ========================================================================================
+// HistoryStore - 按会话持久化的消息历史，(会话, 序号) 寻址，分页倒序读取
+// ========================================================================================
+// - 每个会话的序号从 1 连续递增，由 append 分配；记录内容是已编码的消息帧，原样存取
+// - 写入：新记录先进内存尾部并写入 journal（刷盘线程按周期合并写出），尾部攒满 blockRecords 条后
+//   封成一个块，追加到当前段文件 <目录>/segment-<编号>.log；段写满后换下一个段。
+//   一个块只含一个会话的连续记录，journal 过大时把所有尾部封块后清空 journal
+// - 索引：每个会话在内存里只记块的 (起始序号, 条数, 段, 偏移, 长度)，每 blockRecords 条一项
+// - 读取：最新的一页大部分在内存尾部，其余落在最后一两个块里；
+//   每个块是一次定位 + 一次连续读取，同一段里相邻的块合并成一次读取。读文件不持锁
+// - 启动时顺序扫描段文件重建索引（截掉崩溃时写了一半的块），再重放 journal 恢复内存尾部
+// 文件按本机字节序写入，只在 POSIX 平台上提供；段文件不做删除（没有保留期限）。
+// ========================================================================================
+
+class HistoryStore {
+public:
+    static constexpr size_t MAX_PAGE = 200;
+
+    struct Options {
+        std::string directory = "data/history";
+        size_t blockRecords = 64;                   // 每块记录数，也是索引的稀疏度
+        uint64_t segmentBytes = 64ULL << 20;        // 段文件大小上限
+        uint64_t journalBytes = 16ULL << 20;        // journal 超过该大小时把所有尾部封块并清空
+        int flushIntervalMs = 50;                   // journal 合并写出的周期，也是崩溃时最多丢失的时间窗口
+        bool sync = false;                          // 每轮写出后 fdatasync
+    };
+
+    HistoryStore();
+    explicit HistoryStore(const Options& options);
+    ~HistoryStore();
+
+    // 创建目录、恢复已有数据并启动刷盘线程；失败返回 false
+    bool open(std::string& error);
+    // 写出所有尾部和 journal 后停止刷盘线程
+    void close();
+    const std::string& directory() const { return m_options.directory; }
+
+    // 追加一条记录，返回分配的序号；未打开时返回 0
+    uint64_t append(const std::string& conversation, const MessageBuffer& record);
+    // 取序号 < beforeSeq 的最近 limit 条（beforeSeq 为 0 表示从最新一条起），按序号升序放入 out；
+    // firstSeq 为 out 中第一条的序号，没有记录时为 0。读段文件失败时返回 false 且 out 为空，
+    // 不返回中间缺了一段的页
+    bool page(const std::string& conversation, uint64_t beforeSeq, size_t limit,
+              std::vector<MessageBuffer>& out, uint64_t& firstSeq);
+    uint64_t lastSeq(const std::string& conversation);
+
+private:
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+
+    struct BlockRef {
+        uint64_t firstSeq;
+        uint32_t count;
+        uint32_t segment;
+        uint64_t offset;
+        uint32_t length;
+    };
+
+    struct Conversation {
+        uint64_t lastSeq = 0;
+        std::vector<BlockRef> blocks;           // 按 firstSeq 升序
+        std::deque<MessageBuffer> tail;         // 序号 tailFirstSeq 起的内存记录（尚未写入段文件）
+        uint64_t tailFirstSeq = 1;
+        size_t sealed = 0;                      // tail 前 sealed 条已封块、等待写出
+    };
+
+    struct PendingBlock {
+        std::string conversation;
+        uint64_t firstSeq;
+        std::vector<MessageBuffer> records;
+    };
+
+    // 调用方持有 m_mutex
+    void sealTail(const std::string& name, Conversation& conversation);
+
+    void flushLoop();
+    // 写出 journal 缓冲与已封的块；all 为 true 时先把所有尾部封块并清空 journal
+    void flush(bool all);
+    bool writeBlock(const PendingBlock& block, BlockRef& ref);
+    bool openSegment(uint32_t index, bool create);
+    bool recoverSegment(uint32_t index, bool verify);
+    bool replayJournal();
+    std::string segmentPath(uint32_t index) const;
+    std::string journalPath() const;
+
+    Options m_options;
+
+    std::mutex m_mutex;
+    std::unordered_map<std::string, Conversation> m_conversations;
+    std::string m_journalBuffer;                 // 待写出的 journal 记录
+    uint64_t m_journalSize = 0;                  // journal 文件 + 缓冲的字节数
+    std::vector<PendingBlock> m_pendingBlocks;
+    std::vector<int> m_segmentFds;               // 下标 = 段编号 - 1；只增不减，读取方在锁内复制
+
+    // 以下只由刷盘线程（以及 open / close）访问
+    int m_journalFd = -1;
+    uint64_t m_activeSize = 0;                   // 当前段（最后一个）已写入的字节数
+
+    bool m_open = false;
+    std::atomic<bool> m_running;
+    std::condition_variable m_flushCv;
+    std::thread m_flushThread;
+};
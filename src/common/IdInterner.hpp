@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// ========================================================================================
+// IdInterner - 字符串ID到紧凑整数句柄的映射
+// ========================================================================================
+// 用户ID/群号在业务层是字符串，但集合运算（共同好友、群成员求交、位图）需要整数。
+// 句柄从 0 开始连续分配，一经分配不会回收，可直接作为数组下标/位图下标使用。
+// 线程安全：登录线程和索引构建可能同时分配句柄；名字存放在 deque 中，引用长期有效。
+// ========================================================================================
+
+class IdInterner {
+public:
+    static constexpr uint32_t INVALID_HANDLE = 0xFFFFFFFFu;
+
+    // 获取（必要时分配）句柄
+    uint32_t intern(const std::string& id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_handles.find(id);
+        if (it != m_handles.end()) return it->second;
+        uint32_t handle = static_cast<uint32_t>(m_names.size());
+        m_handles.emplace(id, handle);
+        m_names.push_back(id);
+        return handle;
+    }
+
+    // 只查找，不分配；不存在返回 INVALID_HANDLE
+    uint32_t lookup(const std::string& id) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_handles.find(id);
+        return it == m_handles.end() ? INVALID_HANDLE : it->second;
+    }
+
+    const std::string& name(uint32_t handle) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_names[handle];
+    }
+    bool contains(uint32_t handle) const { return handle < size(); }
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_names.size();
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, uint32_t> m_handles;
+    std::deque<std::string> m_names;
+};
@@ -0,0 +1,153 @@
+#include "MessageBuffer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace {
+
+// 分级：64B, 128B, ... 4KB（含块头）
+const size_t MIN_CLASS_SHIFT = 6;
+const size_t CLASS_COUNT = 7;
+const uint32_t HEAP_CLASS = 0xFFFFFFFFu;
+// 每级最多缓存的空闲块数，防止突发流量后长期占用内存
+const size_t MAX_FREE_PER_CLASS = 4096;
+
+struct SizeClass {
+    std::mutex mutex;
+    void* freeHead = nullptr;
+    size_t freeCount = 0;
+};
+
+struct PoolState {
+    SizeClass classes[CLASS_COUNT];
+    std::atomic<size_t> pooledAllocs{0};
+    std::atomic<size_t> reusedBlocks{0};
+    std::atomic<size_t> heapAllocs{0};
+    std::atomic<size_t> liveBlocks{0};
+};
+
+// 进程结束时不析构，避免静态析构顺序问题导致仍在用的缓冲访问到已销毁的池
+PoolState& pool() {
+    static PoolState* state = new PoolState();
+    return *state;
+}
+
+uint32_t classFor(size_t bytes) {
+    size_t cls = 0;
+    size_t classBytes = size_t(1) << MIN_CLASS_SHIFT;
+    while (classBytes < bytes) {
+        classBytes <<= 1;
+        if (++cls >= CLASS_COUNT) return HEAP_CLASS;
+    }
+    return static_cast<uint32_t>(cls);
+}
+
+size_t classBytes(uint32_t cls) { return size_t(1) << (MIN_CLASS_SHIFT + cls); }
+
+} // namespace
+
+MessageBuffer::Block* MessageBuffer::allocate(size_t capacity) {
+    PoolState& state = pool();
+    size_t total = sizeof(Block) + capacity;
+    uint32_t cls = classFor(total);
+
+    void* memory = nullptr;
+    if (cls == HEAP_CLASS) {
+        memory = ::operator new(total);
+        state.heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        SizeClass& sc = state.classes[cls];
+        {
+            std::lock_guard<std::mutex> lock(sc.mutex);
+            if (sc.freeHead) {
+                memory = sc.freeHead;
+                sc.freeHead = static_cast<Block*>(memory)->nextFree;
+                --sc.freeCount;
+            }
+        }
+        if (memory) {
+            static_cast<Block*>(memory)->~Block();
+            state.reusedBlocks.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            memory = ::operator new(classBytes(cls));
+        }
+        state.pooledAllocs.fetch_add(1, std::memory_order_relaxed);
+    }
+    state.liveBlocks.fetch_add(1, std::memory_order_relaxed);
+
+    Block* block = new (memory) Block();
+    block->refs.store(1, std::memory_order_relaxed);
+    block->size = 0;
+    block->sizeClass = cls;
+    block->nextFree = nullptr;
+    return block;
+}
+
+void MessageBuffer::deallocate(Block* block) {
+    PoolState& state = pool();
+    state.liveBlocks.fetch_sub(1, std::memory_order_relaxed);
+
+    uint32_t cls = block->sizeClass;
+    if (cls != HEAP_CLASS) {
+        SizeClass& sc = state.classes[cls];
+        std::lock_guard<std::mutex> lock(sc.mutex);
+        if (sc.freeCount < MAX_FREE_PER_CLASS) {
+            block->nextFree = static_cast<Block*>(sc.freeHead);
+            sc.freeHead = block;
+            ++sc.freeCount;
+            return;
+        }
+    }
+    block->~Block();
+    ::operator delete(static_cast<void*>(block));
+}
+
+MessageBuffer MessageBuffer::copyOf(const char* data, size_t len) {
+    Block* block = allocate(len);
+    if (len > 0) std::memcpy(block->bytes(), data, len);
+    block->size = static_cast<uint32_t>(len);
+    return MessageBuffer(block);
+}
+
+MessageBuffer::PoolStats MessageBuffer::poolStats() {
+    PoolState& state = pool();
+    PoolStats stats;
+    stats.pooledAllocs = state.pooledAllocs.load(std::memory_order_relaxed);
+    stats.reusedBlocks = state.reusedBlocks.load(std::memory_order_relaxed);
+    stats.heapAllocs = state.heapAllocs.load(std::memory_order_relaxed);
+    stats.liveBlocks = state.liveBlocks.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// ===== Builder =====
+
+MessageBuffer::Builder::Builder(size_t capacity)
+    : m_block(allocate(capacity)), m_capacity(capacity) {}
+
+MessageBuffer::Builder::~Builder() {
+    if (m_block) deallocate(m_block);
+}
+
+MessageBuffer::Builder& MessageBuffer::Builder::append(const char* data, size_t len) {
+    size_t used = m_block->size;
+    if (used + len > m_capacity) {
+        // 预估长度不足时整体搬迁（调用方通常按精确长度申请，不会走到这里）
+        size_t newCapacity = std::max(m_capacity * 2, used + len);
+        Block* bigger = allocate(newCapacity);
+        std::memcpy(bigger->bytes(), m_block->bytes(), used);
+        bigger->size = static_cast<uint32_t>(used);
+        deallocate(m_block);
+        m_block = bigger;
+        m_capacity = newCapacity;
+    }
+    if (len > 0) std::memcpy(m_block->bytes() + used, data, len);
+    m_block->size = static_cast<uint32_t>(used + len);
+    return *this;
+}
+
+MessageBuffer MessageBuffer::Builder::finish() {
+    Block* block = m_block;
+    m_block = nullptr;
+    return MessageBuffer(block);
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// ========================================================================================
+// MessageBuffer - 不可变、引用计数、池化分配的消息缓冲
+// ========================================================================================
+// 一条消息编码一次之后，在线转发、ACK 跟踪、离线队列、群扇出、登录捎带都只持有
+// 同一块缓冲的引用：复制 MessageBuffer 只是引用计数 +1，不复制消息字节。
+// - 内存块按 64B~4KB 的 2 的幂分级，从各级空闲链表复用；更大的消息直接走堆
+// - 引用计数为原子变量，可在线程间自由传递；内容构造完成后只读，无需加锁
+// ========================================================================================
+
+class MessageBuffer {
+    // 块头后紧跟消息字节
+    struct Block {
+        std::atomic<uint32_t> refs;
+        uint32_t size;
+        uint32_t sizeClass;
+        Block* nextFree;
+
+        char* bytes() noexcept { return reinterpret_cast<char*>(this + 1); }
+    };
+
+public:
+    MessageBuffer() noexcept = default;
+    MessageBuffer(const MessageBuffer& other) noexcept : m_block(other.m_block) { retain(); }
+    MessageBuffer(MessageBuffer&& other) noexcept : m_block(other.m_block) { other.m_block = nullptr; }
+    MessageBuffer& operator=(const MessageBuffer& other) noexcept {
+        if (m_block != other.m_block) {
+            release();
+            m_block = other.m_block;
+            retain();
+        }
+        return *this;
+    }
+    MessageBuffer& operator=(MessageBuffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            m_block = other.m_block;
+            other.m_block = nullptr;
+        }
+        return *this;
+    }
+    ~MessageBuffer() { release(); }
+
+    // 复制一份字节到新缓冲（解码入口处唯一的一次复制）
+    static MessageBuffer copyOf(const char* data, size_t len);
+    static MessageBuffer copyOf(std::string_view data) { return copyOf(data.data(), data.size()); }
+
+    // 分段写入：先按预估长度申请一次，再依次追加字段
+    class Builder {
+    public:
+        explicit Builder(size_t capacity);
+        ~Builder();
+        Builder(const Builder&) = delete;
+        Builder& operator=(const Builder&) = delete;
+
+        Builder& append(const char* data, size_t len);
+        Builder& append(std::string_view data) { return append(data.data(), data.size()); }
+        Builder& append(char c) { return append(&c, 1); }
+
+        // 结束写入，之后内容只读
+        MessageBuffer finish();
+
+    private:
+        Block* m_block;
+        size_t m_capacity;
+    };
+
+    const char* data() const noexcept { return m_block ? m_block->bytes() : ""; }
+    size_t size() const noexcept { return m_block ? m_block->size : 0; }
+    bool empty() const noexcept { return size() == 0; }
+    std::string_view view() const noexcept { return std::string_view(data(), size()); }
+    std::string str() const { return std::string(data(), size()); }
+    bool startsWith(std::string_view prefix) const noexcept {
+        return size() >= prefix.size() && view().compare(0, prefix.size(), prefix) == 0;
+    }
+
+    // 当前引用数（空缓冲为 0），用于调试/统计
+    uint32_t useCount() const noexcept { return m_block ? m_block->refs.load(std::memory_order_relaxed) : 0; }
+    // 两个对象是否共享同一块内存
+    bool sharesWith(const MessageBuffer& other) const noexcept { return m_block && m_block == other.m_block; }
+
+    bool operator==(const MessageBuffer& other) const noexcept { return view() == other.view(); }
+    bool operator!=(const MessageBuffer& other) const noexcept { return !(*this == other); }
+
+    // 池统计
+    struct PoolStats {
+        size_t pooledAllocs = 0;   // 从分级池取块
+        size_t reusedBlocks = 0;   // 其中复用空闲链表的次数
+        size_t heapAllocs = 0;     // 超过最大分级直接走堆
+        size_t liveBlocks = 0;     // 当前存活块数
+    };
+    static PoolStats poolStats();
+
+private:
+    explicit MessageBuffer(Block* block) noexcept : m_block(block) {}
+
+    void retain() noexcept {
+        if (m_block) m_block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    void release() noexcept {
+        if (m_block && m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) deallocate(m_block);
+        m_block = nullptr;
+    }
+
+    static Block* allocate(size_t capacity);
+    static void deallocate(Block* block);
+
+    Block* m_block = nullptr;
+};
@@ -0,0 +1,164 @@
+#include "MessageId.hpp"
+#include "CoarseClock.hpp"
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t SLOT_COUNT = 1u << MessageId::SLOT_BITS;
+constexpr uint32_t SHARED_SLOT = SLOT_COUNT - 1;       // 槽用尽后共用，加锁
+constexpr uint32_t NO_SLOT = 0xFFFFFFFFu;
+constexpr uint32_t SEQUENCE_LIMIT = 1u << MessageId::SEQUENCE_BITS;
+constexpr uint64_t TIMESTAMP_MASK = (uint64_t(1) << MessageId::TIMESTAMP_BITS) - 1;
+constexpr uint64_t FOREIGN_KEY_BIT = uint64_t(1) << 63;
+
+// 线程槽分配表；只在领取 / 归还线程槽时加锁
+struct SlotTable {
+    std::mutex mutex;
+    std::vector<uint32_t> released;       // 已归还、可再分配的槽
+    uint32_t nextUnused = 0;
+    uint64_t lastMs[SLOT_COUNT] = {};     // 每个槽用到的最后一毫秒，接手的线程从其后开始
+
+    std::mutex sharedMutex;               // 共享槽的生成状态
+    uint64_t sharedMs = 0;
+    uint32_t sharedSequence = 0;
+};
+
+// 故意不释放：线程退出（可能晚于静态对象析构）时还要归还线程槽
+SlotTable& slotTable() {
+    static SlotTable* table = new SlotTable();
+    return *table;
+}
+
+// 未设置 CHAT_NODE_ID 时随机取号，只适用于单实例（集群模式由服务器在启动时拒绝）
+uint32_t initialNodeId() {
+    if (const char* env = std::getenv("CHAT_NODE_ID")) {
+        return static_cast<uint32_t>(std::strtoul(env, nullptr, 10)) & ((1u << MessageId::NODE_BITS) - 1);
+    }
+    std::random_device rd;
+    return rd() & ((1u << MessageId::NODE_BITS) - 1);
+}
+
+std::atomic<uint32_t>& nodeIdSlot() {
+    static std::atomic<uint32_t> node{ initialNodeId() };
+    return node;
+}
+
+// 粗粒度时钟：一次原子加载；滞后的那一点由逻辑时钟的单调推进兜住
+uint64_t nowMs() noexcept {
+    return CoarseClock::nowMs() - MessageId::EPOCH_MS;
+}
+
+// 推进逻辑时钟：新的一毫秒序号归零；同一毫秒（或时钟回拨）序号加一，用完借用下一毫秒
+void advance(uint64_t& lastMs, uint32_t& sequence, uint64_t now) noexcept {
+    if (now > lastMs) {
+        lastMs = now;
+        sequence = 0;
+    } else if (++sequence == SEQUENCE_LIMIT) {
+        ++lastMs;
+        sequence = 0;
+    }
+}
+
+uint64_t compose(uint64_t ms, uint32_t node, uint32_t slot, uint32_t sequence) noexcept {
+    return ((ms & TIMESTAMP_MASK) << (MessageId::NODE_BITS + MessageId::SLOT_BITS + MessageId::SEQUENCE_BITS)) |
+           (uint64_t(node) << (MessageId::SLOT_BITS + MessageId::SEQUENCE_BITS)) |
+           (uint64_t(slot) << MessageId::SEQUENCE_BITS) | sequence;
+}
+
+struct ThreadState {
+    uint32_t slot = NO_SLOT;
+    uint64_t lastMs = 0;
+    uint32_t sequence = 0;
+
+    void acquire() {
+        SlotTable& table = slotTable();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        if (!table.released.empty()) {
+            slot = table.released.back();
+            table.released.pop_back();
+            lastMs = table.lastMs[slot];
+            sequence = SEQUENCE_LIMIT - 1;   // 下一个ID从 lastMs 之后的一毫秒开始
+        } else if (table.nextUnused < SHARED_SLOT) {
+            slot = table.nextUnused++;
+        } else {
+            slot = SHARED_SLOT;
+        }
+    }
+
+    ~ThreadState() {
+        if (slot == NO_SLOT || slot == SHARED_SLOT) return;
+        SlotTable& table = slotTable();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        table.lastMs[slot] = lastMs;
+        table.released.push_back(slot);
+    }
+};
+
+thread_local ThreadState t_state;
+
+} // namespace
+
+uint64_t MessageId::next() noexcept {
+    ThreadState& state = t_state;
+    if (state.slot == NO_SLOT) state.acquire();
+    uint32_t node = nodeIdSlot().load(std::memory_order_relaxed);
+    uint64_t now = nowMs();
+
+    if (state.slot == SHARED_SLOT) {
+        SlotTable& table = slotTable();
+        std::lock_guard<std::mutex> lock(table.sharedMutex);
+        advance(table.sharedMs, table.sharedSequence, now);
+        return compose(table.sharedMs, node, SHARED_SLOT, table.sharedSequence);
+    }
+    advance(state.lastMs, state.sequence, now);
+    return compose(state.lastMs, node, state.slot, state.sequence);
+}
+
+std::string MessageId::nextString() {
+    return toString(next());
+}
+
+size_t MessageId::format(uint64_t id, char* buf) noexcept {
+    auto result = std::to_chars(buf, buf + MAX_TEXT_LENGTH, id);
+    return static_cast<size_t>(result.ptr - buf);
+}
+
+std::string MessageId::toString(uint64_t id) {
+    char buf[MAX_TEXT_LENGTH];
+    return std::string(buf, format(id, buf));
+}
+
+bool MessageId::parse(std::string_view text, uint64_t& id) noexcept {
+    if (text.empty() || text.size() > 19) return false;   // 最高位恒为 0，不超过 19 位
+    uint64_t value = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()) return false;
+    if (value & FOREIGN_KEY_BIT) return false;
+    id = value;
+    return true;
+}
+
+uint64_t MessageId::key(std::string_view text) noexcept {
+    uint64_t id = 0;
+    if (parse(text, id)) return id;
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash | FOREIGN_KEY_BIT;
+}
+
+void MessageId::setNodeId(uint32_t nodeId) noexcept {
+    nodeIdSlot().store(nodeId & ((1u << NODE_BITS) - 1), std::memory_order_relaxed);
+}
+
+uint32_t MessageId::nodeId() noexcept {
+    return nodeIdSlot().load(std::memory_order_relaxed);
+}
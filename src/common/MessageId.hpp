@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// ========================================================================================
+// MessageId - 64 位消息ID生成器（Snowflake 风格）
+// ========================================================================================
+// 布局（最高位恒为 0）：
+//   [40 位 毫秒时间戳（自 2024-01-01 起，约 34 年）][8 位 节点号][10 位 线程槽][5 位 毫秒内序号]
+// - 每个线程第一次生成时领取一个线程槽，之后只读写自己的 thread_local 状态，没有共享的原子计数器
+// - 同一毫秒内序号用完时借用下一毫秒（逻辑时钟前移），同一线程的ID保持唯一且递增
+// - 线程退出时归还线程槽并记下用到的最后一毫秒，接手的线程从其后开始，不会与旧ID重复
+// - 超过 1023 个线程同时生成时，多出的线程共用最后一个槽（加锁）
+// - 节点号区分服务器实例：CHAT_NODE_ID 环境变量或 setNodeId()。都没有时随机选取，只适用于单实例：
+//   256 个取值里两个实例撞号的概率不可忽略，撞号后消息ID和会话流序号都可能重复，多实例部署必须显式配置
+// 内部一律按 uint64_t 处理，只在编码帧时格式化成十进制文本。
+// ========================================================================================
+
+class MessageId {
+public:
+    static constexpr unsigned SEQUENCE_BITS = 5;
+    static constexpr unsigned SLOT_BITS = 10;
+    static constexpr unsigned NODE_BITS = 8;
+    static constexpr unsigned TIMESTAMP_BITS = 40;
+    static constexpr uint64_t EPOCH_MS = 1704067200000ULL;   // 2024-01-01T00:00:00Z
+    static constexpr size_t MAX_TEXT_LENGTH = 20;            // uint64_t 十进制最长 20 位
+
+    static uint64_t next() noexcept;
+    static std::string nextString();
+
+    // 十进制文本写入 buf（至少 MAX_TEXT_LENGTH 字节），返回长度
+    static size_t format(uint64_t id, char* buf) noexcept;
+    static std::string toString(uint64_t id);
+    // 解析本生成器产生的十进制ID；旧客户端自定义的ID（如 "m1"、"时间_计数"）返回 false
+    static bool parse(std::string_view text, uint64_t& id) noexcept;
+    // 任意文本ID映射为 64 位键：本生成器的ID直接取值，其他按哈希并置最高位，两类不会重叠
+    static uint64_t key(std::string_view text) noexcept;
+    // key() 的结果是否来自哈希（可能碰撞，匹配时需再核对原文）
+    static bool isHashedKey(uint64_t key) noexcept { return (key >> 63) != 0; }
+
+    static void setNodeId(uint32_t nodeId) noexcept;
+    static uint32_t nodeId() noexcept;
+
+    static uint64_t timestampMs(uint64_t id) noexcept {
+        return (id >> (SEQUENCE_BITS + SLOT_BITS + NODE_BITS)) + EPOCH_MS;
+    }
+    static uint32_t nodeOf(uint64_t id) noexcept {
+        return static_cast<uint32_t>((id >> (SEQUENCE_BITS + SLOT_BITS)) & ((1u << NODE_BITS) - 1));
+    }
+};
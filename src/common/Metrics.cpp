@@ -0,0 +1,187 @@
+#include "Metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+uint64_t doubleBits(double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+double bitsDouble(uint64_t bits) {
+    double v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+std::string formatValue(double v) {
+    if (std::isinf(v)) return v > 0 ? "+Inf" : "-Inf";
+    if (std::isnan(v)) return "NaN";
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", v);
+    return buf;
+}
+
+// 名字 + 可选标签，histogram 额外拼上 le 标签
+std::string seriesName(const std::string& name, const std::string& labels, const std::string& extra = "") {
+    if (labels.empty() && extra.empty()) return name;
+    std::string out = name + "{" + labels;
+    if (!labels.empty() && !extra.empty()) out += ",";
+    out += extra + "}";
+    return out;
+}
+
+} // namespace
+
+// ===== Counter =====
+
+uint64_t Counter::value() const noexcept {
+    uint64_t total = 0;
+    for (const auto& shard : m_shards) total += shard.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+// ===== Histogram =====
+
+Histogram::Histogram(std::vector<double> bounds) : m_bounds(std::move(bounds)) {
+    std::sort(m_bounds.begin(), m_bounds.end());
+    m_bounds.erase(std::unique(m_bounds.begin(), m_bounds.end()), m_bounds.end());
+    // 桶数 = 上界数 + 1（+Inf），另加 count、sum 两个槽
+    size_t slots = m_bounds.size() + 3;
+    m_linesPerShard = (slots + 7) / 8;
+    m_lines.reset(new Line[m_linesPerShard * metrics_detail::SHARD_COUNT]);
+    for (size_t i = 0; i < m_linesPerShard * metrics_detail::SHARD_COUNT; ++i) {
+        for (auto& s : m_lines[i].slots) s.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::observe(double value) noexcept {
+    size_t shard = metrics_detail::shardIndex();
+    size_t bucket = static_cast<size_t>(std::lower_bound(m_bounds.begin(), m_bounds.end(), value) - m_bounds.begin());
+    size_t n = m_bounds.size();
+
+    slot(shard, bucket).fetch_add(1, std::memory_order_relaxed);
+    slot(shard, n + 1).fetch_add(1, std::memory_order_relaxed);
+
+    // 分片基本只有本线程写，CAS 几乎不会重试
+    std::atomic<uint64_t>& sum = slot(shard, n + 2);
+    uint64_t expected = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(expected, doubleBits(bitsDouble(expected) + value),
+                                      std::memory_order_relaxed)) {
+    }
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snap;
+    size_t n = m_bounds.size();
+    snap.bounds = m_bounds;
+    snap.buckets.assign(n + 1, 0);
+    for (size_t shard = 0; shard < metrics_detail::SHARD_COUNT; ++shard) {
+        for (size_t i = 0; i <= n; ++i) snap.buckets[i] += slot(shard, i).load(std::memory_order_relaxed);
+        snap.count += slot(shard, n + 1).load(std::memory_order_relaxed);
+        snap.sum += bitsDouble(slot(shard, n + 2).load(std::memory_order_relaxed));
+    }
+    return snap;
+}
+
+std::vector<double> Histogram::latencyBuckets() {
+    return { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+             0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0 };
+}
+
+// ===== MetricsRegistry =====
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry* registry = new MetricsRegistry();
+    return *registry;
+}
+
+MetricsRegistry::Series& MetricsRegistry::findOrAdd(const std::string& name, const std::string& help,
+                                                    Type type, const std::string& labels) {
+    Family* family = nullptr;
+    for (auto& f : m_families) {
+        if (f->name == name) { family = f.get(); break; }
+    }
+    if (family) {
+        if (family->type != type) {
+            throw std::logic_error("metric '" + name + "' already registered with a different type");
+        }
+        for (auto& s : family->series) {
+            if (s->labels == labels) return *s;
+        }
+    } else {
+        m_families.push_back(std::unique_ptr<Family>(new Family{ name, help, type, {} }));
+        family = m_families.back().get();
+    }
+    family->series.push_back(std::unique_ptr<Series>(new Series()));
+    family->series.back()->labels = labels;
+    return *family->series.back();
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Series& series = findOrAdd(name, help, Type::COUNTER, labels);
+    if (!series.counter) series.counter.reset(new Counter());
+    return *series.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Series& series = findOrAdd(name, help, Type::GAUGE, labels);
+    if (!series.gauge) series.gauge.reset(new Gauge());
+    return *series.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help,
+                                      const std::vector<double>& bounds, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Series& series = findOrAdd(name, help, Type::HISTOGRAM, labels);
+    if (!series.histogram) series.histogram.reset(new Histogram(bounds));
+    return *series.histogram;
+}
+
+std::string MetricsRegistry::renderPrometheus() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string out;
+    out.reserve(m_families.size() * 256);
+
+    for (const auto& family : m_families) {
+        const char* typeName = family->type == Type::COUNTER ? "counter"
+                             : family->type == Type::GAUGE ? "gauge" : "histogram";
+        out += "# HELP " + family->name + " " + family->help + "\n";
+        out += "# TYPE " + family->name + " " + typeName + "\n";
+
+        for (const auto& series : family->series) {
+            switch (family->type) {
+            case Type::COUNTER:
+                out += seriesName(family->name, series->labels) + " " +
+                       std::to_string(series->counter->value()) + "\n";
+                break;
+            case Type::GAUGE:
+                out += seriesName(family->name, series->labels) + " " +
+                       std::to_string(series->gauge->value()) + "\n";
+                break;
+            case Type::HISTOGRAM: {
+                Histogram::Snapshot snap = series->histogram->snapshot();
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < snap.buckets.size(); ++i) {
+                    cumulative += snap.buckets[i];
+                    std::string le = i < snap.bounds.size() ? formatValue(snap.bounds[i]) : "+Inf";
+                    out += seriesName(family->name + "_bucket", series->labels, "le=\"" + le + "\"") + " " +
+                           std::to_string(cumulative) + "\n";
+                }
+                out += seriesName(family->name + "_sum", series->labels) + " " + formatValue(snap.sum) + "\n";
+                // 分片是分别读取的，count 取桶累计值，保证与 +Inf 桶一致
+                out += seriesName(family->name + "_count", series->labels) + " " + std::to_string(cumulative) + "\n";
+                break;
+            }
+            }
+        }
+    }
+    return out;
+}
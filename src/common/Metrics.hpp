@@ -0,0 +1,163 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ========================================================================================
+// Metrics - 进程内指标注册表（计数器 / 仪表 / 直方图），可导出 Prometheus 文本格式
+// ========================================================================================
+// - 注册只在启动或首次使用时发生（持锁），返回的引用在进程生命周期内有效，
+//   热路径上调用方缓存引用，之后的更新只有原子操作，不加锁
+// - 计数器、直方图按线程分片：每个线程固定落在一个缓存行对齐的分片上，
+//   多线程同时累加时不争用同一缓存行；导出时再把各分片求和
+// - 仪表（当前值）需要支持 set，不分片，直接是一个原子变量
+// ========================================================================================
+
+namespace metrics_detail {
+
+const size_t SHARD_COUNT = 16;
+
+// 当前线程的分片号：首次调用时轮流分配，之后固定
+inline size_t shardIndex() noexcept {
+    static std::atomic<size_t> nextShard{0};
+    thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    return shard;
+}
+
+} // namespace metrics_detail
+
+// 单调递增计数器
+class Counter {
+public:
+    Counter() = default;
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    void inc(uint64_t n = 1) noexcept {
+        m_shards[metrics_detail::shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const noexcept;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+    Shard m_shards[metrics_detail::SHARD_COUNT];
+};
+
+// 可增可减的当前值（连接数、队列深度等）
+class Gauge {
+public:
+    Gauge() = default;
+    Gauge(const Gauge&) = delete;
+    Gauge& operator=(const Gauge&) = delete;
+
+    void set(int64_t v) noexcept { m_value.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) noexcept { m_value.fetch_add(n, std::memory_order_relaxed); }
+    void inc() noexcept { add(1); }
+    void dec() noexcept { add(-1); }
+    int64_t value() const noexcept { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> m_value{0};
+};
+
+// 固定桶直方图：桶上界升序，观测值落入第一个 >= 它的桶（Prometheus 的 le 语义）
+class Histogram {
+public:
+    explicit Histogram(std::vector<double> bounds);
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void observe(double value) noexcept;
+
+    // 以秒为单位记录 start 至今的耗时
+    void observeSince(std::chrono::steady_clock::time_point start) noexcept {
+        observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    struct Snapshot {
+        std::vector<double> bounds;
+        std::vector<uint64_t> buckets;   // 各桶计数（非累计），最后一个为 +Inf 桶
+        uint64_t count = 0;
+        double sum = 0.0;
+    };
+    Snapshot snapshot() const;
+
+    // 默认延迟桶：100us ~ 10s
+    static std::vector<double> latencyBuckets();
+
+private:
+    // 每个分片占若干完整缓存行：[桶0..桶n][count][sum 的位模式]
+    struct alignas(64) Line {
+        std::atomic<uint64_t> slots[8];
+    };
+    std::atomic<uint64_t>& slot(size_t shard, size_t index) const noexcept {
+        return m_lines[shard * m_linesPerShard + index / 8].slots[index % 8];
+    }
+
+    std::vector<double> m_bounds;
+    size_t m_linesPerShard;
+    std::unique_ptr<Line[]> m_lines;
+};
+
+// 作用域计时：析构时把耗时记入直方图
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram)
+        : m_histogram(histogram), m_start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { m_histogram.observeSince(m_start); }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+class MetricsRegistry {
+public:
+    // 进程级注册表（不析构，退出阶段仍可安全更新）
+    static MetricsRegistry& instance();
+
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    // 同名同标签重复注册返回已有指标；同名不同类型视为编程错误，抛出 std::logic_error。
+    // labels 形如 type="login",result="ok"（不含花括号）
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help,
+                         const std::vector<double>& bounds = Histogram::latencyBuckets(),
+                         const std::string& labels = "");
+
+    // Prometheus 文本格式（0.0.4），按注册顺序输出
+    std::string renderPrometheus() const;
+
+private:
+    enum class Type { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Series {
+        std::string labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+    struct Family {
+        std::string name;
+        std::string help;
+        Type type;
+        std::vector<std::unique_ptr<Series>> series;
+    };
+
+    Series& findOrAdd(const std::string& name, const std::string& help, Type type, const std::string& labels);
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<Family>> m_families;
+};
@@ -1,7 +1,7 @@
 #include "Protocol.hpp"
-#include <chrono>
-#include <iomanip>
-#include <atomic>
+#include "MessageId.hpp"
+#include "CoarseClock.hpp"
+#include <charconv>
 
 // ProtocolProcessor类的实现
 std::string ProtocolProcessor::serializeMessage(const MessageData& msg) {
@@ -16,10 +16,53 @@ std::string ProtocolProcessor::serializeMessage(const MessageData& msg) {
         << msg.receiverId << "|"
         << msg.content << "|"
         << (msg.timestamp.empty() ? getCurrentTimestamp() : msg.timestamp);
+    if (msg.seq != 0) {
+        oss << "|SEQ:" << msg.seq;
+    }
 
     return oss.str();
 }
 
+MessageBuffer ProtocolProcessor::encodeMessage(const MessageData& msg) {
+    if (!validateMessageFields(msg)) {
+        return MessageBuffer();
+    }
+
+    // 时间戳取粗粒度时钟的缓存文本，和序号字段一样在栈上准备，不额外分配
+    char nowText[CoarseClock::TIMESTAMP_LENGTH];
+    std::string_view timestamp = msg.timestamp;
+    if (timestamp.empty()) timestamp = std::string_view(nowText, CoarseClock::formatNow(nowText));
+    char seqField[32] = "|SEQ:";
+    size_t seqLength = 0;
+    if (msg.seq != 0) {
+        seqLength = static_cast<size_t>(std::to_chars(seqField + 5, seqField + sizeof(seqField), msg.seq).ptr - seqField);
+    }
+    size_t length = 8 + msg.messageId.size() + 1 + msg.senderId.size() + 1 +
+                    msg.receiverId.size() + 1 + msg.content.size() + 1 + timestamp.size() + seqLength;
+
+    MessageBuffer::Builder builder(length);
+    builder.append("MESSAGE|", 8)
+           .append(msg.messageId).append('|')
+           .append(msg.senderId).append('|')
+           .append(msg.receiverId).append('|')
+           .append(msg.content).append('|')
+           .append(timestamp.data(), timestamp.size()).append(seqField, seqLength);
+    return builder.finish();
+}
+
+std::string ProtocolProcessor::peekMessageId(const MessageBuffer& frame) {
+    std::string_view view = frame.view();
+    size_t first = view.find('|');
+    if (first == std::string_view::npos) {
+        return "";
+    }
+    size_t second = view.find('|', first + 1);
+    if (second == std::string_view::npos) {
+        return "";
+    }
+    return std::string(view.substr(first + 1, second - first - 1));
+}
+
 bool ProtocolProcessor::deserializeMessage(const std::string& rawData, MessageData& msg) {
     std::istringstream iss(rawData);
     std::string protocolType;
@@ -36,10 +79,18 @@ bool ProtocolProcessor::deserializeMessage(const std::string& rawData, MessageDa
         return false;
     }
 
-    // timestamp字段可选
-    std::getline(iss, timestamp);
+    // timestamp字段可选，其后可选 SEQ:n
+    std::getline(iss, timestamp, '|');
+    std::string seqField;
+    uint64_t seq = 0;
+    if (std::getline(iss, seqField) && seqField.compare(0, 4, "SEQ:") == 0) {
+        for (size_t i = 4; i < seqField.size() && seqField[i] >= '0' && seqField[i] <= '9'; ++i) {
+            seq = seq * 10 + static_cast<uint64_t>(seqField[i] - '0');
+        }
+    }
 
     MessageData tempMsg(messageId, sender, receiver, content);
+    tempMsg.seq = seq;
     if (!timestamp.empty()) {
         tempMsg.timestamp = timestamp;
     } else {
@@ -54,6 +105,61 @@ bool ProtocolProcessor::deserializeMessage(const std::string& rawData, MessageDa
     return true;
 }
 
+std::string ProtocolProcessor::serializeMessageBatch(const std::vector<std::string>& messageFrames) {
+    size_t length = 32;
+    for (const auto& frame : messageFrames) length += frame.size() + 12;
+
+    std::string out;
+    out.reserve(length);
+    out.append("MESSAGE_BATCH|").append(std::to_string(messageFrames.size())).append("|");
+    for (const auto& frame : messageFrames) {
+        out.append(std::to_string(frame.size())).append(":").append(frame);
+    }
+    return out;
+}
+
+bool ProtocolProcessor::deserializeMessageBatch(const std::string& rawData, std::vector<std::string>& messageFrames) {
+    const std::string prefix = "MESSAGE_BATCH|";
+    if (rawData.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    size_t countEnd = rawData.find('|', prefix.size());
+    if (countEnd == std::string::npos || countEnd == prefix.size()) {
+        return false;
+    }
+
+    size_t count = 0;
+    for (size_t i = prefix.size(); i < countEnd; ++i) {
+        if (rawData[i] < '0' || rawData[i] > '9') return false;
+        count = count * 10 + static_cast<size_t>(rawData[i] - '0');
+        if (count > rawData.size()) return false;   // 每条至少占 2 字节，条数不可能超过总长度
+    }
+
+    std::vector<std::string> frames;
+    frames.reserve(count);
+    size_t pos = countEnd + 1;
+    while (pos < rawData.size()) {
+        size_t len = 0;
+        size_t digits = 0;
+        while (pos < rawData.size() && rawData[pos] >= '0' && rawData[pos] <= '9' && digits < 8) {
+            len = len * 10 + static_cast<size_t>(rawData[pos] - '0');
+            ++pos;
+            ++digits;
+        }
+        if (digits == 0 || pos >= rawData.size() || rawData[pos] != ':') return false;
+        ++pos;
+        if (len > rawData.size() - pos) return false;
+        frames.emplace_back(rawData, pos, len);
+        pos += len;
+    }
+    if (frames.size() != count) {
+        return false;
+    }
+
+    messageFrames.swap(frames);
+    return true;
+}
+
 std::string ProtocolProcessor::serializeResponse(const ResponseData& resp) {
     std::ostringstream oss;
     oss << "RESPONSE|"
@@ -127,13 +233,9 @@ bool ProtocolProcessor::validateMessageFields(const MessageData& msg) {
            msg.content.length() <= 1000; // 消息长度限制
 }
 
+// 读粗粒度时钟缓存的本地时间文本（每秒由后台线程格式化一次），不再逐条 localtime + put_time
 std::string ProtocolProcessor::getCurrentTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t_now = std::chrono::system_clock::to_time_t(now);
-
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&time_t_now), "%Y-%m-%d %H:%M:%S");
-    return ss.str();
+    return CoarseClock::timestamp();
 }
 
 // ACK序列化
@@ -171,13 +273,9 @@ bool ProtocolProcessor::deserializeAck(const std::string& rawData, AckData& ack)
 }
 
 // 生成唯一消息ID
+// 64 位 Snowflake 风格ID的十进制文本，见 MessageId
 std::string ProtocolProcessor::generateMessageId() {
-    static std::atomic<size_t> counter{0};
-    std::stringstream ss;
-    ss << std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::system_clock::now().time_since_epoch()
-    ).count() << "_" << ++counter;
-    return ss.str();
+    return MessageId::nextString();
 }
 
 // 协议类的实现
@@ -1,8 +1,11 @@
+#pragma once
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <vector>
 #include <sstream>
 #include <string>
+#include "MessageBuffer.hpp"
 
 // 枚举类型定义
 enum Type { Login, Logout, Message, Response, Heartbeat, Ack};
@@ -17,6 +20,7 @@ struct MessageData {
     std::string receiverId;
     std::string content;
     std::string timestamp;
+    uint64_t seq = 0;       // 服务器分配的会话内序号（0 表示未分配），帧中为可选的 SEQ:n 字段
 
     MessageData() = default;
     MessageData(std::string sender, std::string receiver, std::string msg)
@@ -96,9 +100,20 @@ public:
 class ProtocolProcessor {
 public:
     // 消息序列化：MessageData -> 字符串
+    // 格式：MESSAGE|id|sender|receiver|content|timestamp[|SEQ:n]
     static std::string serializeMessage(const MessageData& msg);
     // 消息反序列化：字符串 -> MessageData
     static bool deserializeMessage(const std::string& rawData, MessageData& msg);
+    // 消息编码到共享缓冲：格式同 serializeMessage，按精确长度一次写入；字段无效时返回空缓冲
+    static MessageBuffer encodeMessage(const MessageData& msg);
+    // 从已编码的 MESSAGE 帧中取出消息ID，不解析其余字段
+    static std::string peekMessageId(const MessageBuffer& frame);
+
+    // 批量消息：MESSAGE_BATCH|count|<len>:<MESSAGE帧><len>:<MESSAGE帧>...
+    // 内嵌帧带十进制长度前缀，内容中的 '|' 不会造成错位；服务器一次处理整批并只回一条汇总响应
+    static std::string serializeMessageBatch(const std::vector<std::string>& messageFrames);
+    // 拆出内嵌的 MESSAGE 帧（不解析字段）；长度越界或条数不符返回 false
+    static bool deserializeMessageBatch(const std::string& rawData, std::vector<std::string>& messageFrames);
 
     // 响应序列化
     static std::string serializeResponse(const ResponseData& resp);
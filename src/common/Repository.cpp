@@ -10,12 +10,19 @@ bool Repository::loadUsers(const std::string& path, std::unordered_map<std::stri
     std::string line;
     while(std::getline(fin,line)){
         if(line.empty()) continue;
-        // 简单格式：id|nickname|location
+        // 简单格式：id|nickname|location|friend1,friend2（location 与好友列表可以为空或省略）
         std::istringstream ss(line);
-        std::string id,nick,loc;
-        if(std::getline(ss,id,'|') && std::getline(ss,nick,'|') && std::getline(ss,loc,'|')){
+        std::string id,nick,loc,friends;
+        if(std::getline(ss,id,'|') && std::getline(ss,nick,'|')){
+            std::getline(ss,loc,'|');
+            std::getline(ss,friends,'|');
             User u{id,nick};
             u.setLocation(loc);
+            std::istringstream fs(friends);
+            std::string fid;
+            while(std::getline(fs,fid,',')){
+                if(!fid.empty()) u.addFriend(fid);
+            }
             out[id]=u;
         }
     }
@@ -26,7 +33,14 @@ bool Repository::saveUsers(const std::string& path, const std::unordered_map<std
     std::ofstream fout(path);
     if(!fout) return false;
     for(const auto& kv : in){
-        fout << kv.first << '|' << kv.second.nickname() << '|' << kv.second.location() << "\n";
+        fout << kv.first << '|' << kv.second.nickname() << '|' << kv.second.location() << '|';
+        bool first = true;
+        for(const auto& fid : kv.second.friends()){
+            if(!first) fout << ',';
+            fout << fid;
+            first = false;
+        }
+        fout << "\n";
     }
     return true;
 }
@@ -43,6 +57,8 @@ bool Repository::loadGroups(const std::string& path, std::unordered_map<std::str
         if(std::getline(ss,gno,'|') && std::getline(ss,t,'|') && std::getline(ss,owner,'|')){
             Group g{gno, (t=="0"?GroupType::QQ:GroupType::WeChat)};
             g.setOwner(owner);
+            // 文件里只记群主，群主本身也是成员，能在群里发言、查历史
+            if(!owner.empty()) g.addMember(owner);
             out[gno]=g;
         }
     }
@@ -0,0 +1,370 @@
+#include "RoaringBitmap.hpp"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+inline uint16_t highBits(uint32_t v) { return static_cast<uint16_t>(v >> 16); }
+inline uint16_t lowBits(uint32_t v) { return static_cast<uint16_t>(v & 0xFFFF); }
+
+inline uint32_t popcount64(uint64_t w) {
+#if defined(__GNUC__)
+    return static_cast<uint32_t>(__builtin_popcountll(w));
+#else
+    uint32_t n = 0;
+    while (w) { w &= w - 1; ++n; }
+    return n;
+#endif
+}
+
+inline int countTrailingZeros(uint64_t w) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(w);
+#else
+    int n = 0;
+    while (!(w & 1)) { w >>= 1; ++n; }
+    return n;
+#endif
+}
+
+} // namespace
+
+// =====================================================================
+// Container
+// =====================================================================
+
+bool RoaringBitmap::Container::add(uint16_t low) {
+    if (isBitmap) {
+        uint64_t& word = bits[low >> 6];
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (word & mask) return false;
+        word |= mask;
+        ++cardinality;
+        return true;
+    }
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) return false;
+    array.insert(it, low);
+    ++cardinality;
+    if (cardinality > ARRAY_MAX) toBitmap();
+    return true;
+}
+
+bool RoaringBitmap::Container::remove(uint16_t low) {
+    if (isBitmap) {
+        uint64_t& word = bits[low >> 6];
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (!(word & mask)) return false;
+        word &= ~mask;
+        --cardinality;
+        if (cardinality <= ARRAY_MAX) toArray();
+        return true;
+    }
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low) return false;
+    array.erase(it);
+    --cardinality;
+    return true;
+}
+
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+    if (isBitmap) return (bits[low >> 6] >> (low & 63)) & 1;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void RoaringBitmap::Container::toBitmap() {
+    if (isBitmap) return;
+    bits.assign(BITMAP_WORDS, 0);
+    for (uint16_t v : array) bits[v >> 6] |= uint64_t(1) << (v & 63);
+    std::vector<uint16_t>().swap(array);
+    isBitmap = true;
+}
+
+void RoaringBitmap::Container::toArray() {
+    if (!isBitmap) return;
+    array.clear();
+    array.reserve(cardinality);
+    for (uint32_t w = 0; w < BITMAP_WORDS; ++w) {
+        uint64_t word = bits[w];
+        while (word) {
+            array.push_back(static_cast<uint16_t>(w * 64 + countTrailingZeros(word)));
+            word &= word - 1;
+        }
+    }
+    std::vector<uint64_t>().swap(bits);
+    isBitmap = false;
+}
+
+void RoaringBitmap::Container::normalize() {
+    if (isBitmap && cardinality <= ARRAY_MAX) toArray();
+    else if (!isBitmap && cardinality > ARRAY_MAX) toBitmap();
+}
+
+// =====================================================================
+// 容器两两运算
+// =====================================================================
+
+RoaringBitmap::Container RoaringBitmap::andContainers(const Container& a, const Container& b) {
+    Container out;
+    if (a.isBitmap && b.isBitmap) {
+        out.isBitmap = true;
+        out.bits.resize(BITMAP_WORDS);
+        uint32_t card = 0;
+        for (uint32_t w = 0; w < BITMAP_WORDS; ++w) {
+            out.bits[w] = a.bits[w] & b.bits[w];
+            card += popcount64(out.bits[w]);
+        }
+        out.cardinality = card;
+        out.normalize();
+        return out;
+    }
+    if (a.isBitmap || b.isBitmap) {
+        const Container& arr = a.isBitmap ? b : a;
+        const Container& bmp = a.isBitmap ? a : b;
+        out.array.reserve(arr.array.size());
+        for (uint16_t v : arr.array) {
+            if ((bmp.bits[v >> 6] >> (v & 63)) & 1) out.array.push_back(v);
+        }
+        out.cardinality = static_cast<uint32_t>(out.array.size());
+        return out;
+    }
+    out.array.reserve(std::min(a.array.size(), b.array.size()));
+    std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                          std::back_inserter(out.array));
+    out.cardinality = static_cast<uint32_t>(out.array.size());
+    return out;
+}
+
+uint32_t RoaringBitmap::andContainerCardinality(const Container& a, const Container& b) {
+    if (a.isBitmap && b.isBitmap) {
+        uint32_t card = 0;
+        for (uint32_t w = 0; w < BITMAP_WORDS; ++w) card += popcount64(a.bits[w] & b.bits[w]);
+        return card;
+    }
+    if (a.isBitmap || b.isBitmap) {
+        const Container& arr = a.isBitmap ? b : a;
+        const Container& bmp = a.isBitmap ? a : b;
+        uint32_t card = 0;
+        for (uint16_t v : arr.array) card += (bmp.bits[v >> 6] >> (v & 63)) & 1;
+        return card;
+    }
+    uint32_t card = 0;
+    size_t i = 0, j = 0;
+    while (i < a.array.size() && j < b.array.size()) {
+        uint16_t x = a.array[i], y = b.array[j];
+        card += (x == y);
+        i += (x <= y);
+        j += (y <= x);
+    }
+    return card;
+}
+
+RoaringBitmap::Container RoaringBitmap::andNotContainers(const Container& a, const Container& b) {
+    Container out;
+    if (a.isBitmap) {
+        out.isBitmap = true;
+        out.bits = a.bits;
+        if (b.isBitmap) {
+            for (uint32_t w = 0; w < BITMAP_WORDS; ++w) out.bits[w] &= ~b.bits[w];
+        } else {
+            for (uint16_t v : b.array) out.bits[v >> 6] &= ~(uint64_t(1) << (v & 63));
+        }
+        uint32_t card = 0;
+        for (uint32_t w = 0; w < BITMAP_WORDS; ++w) card += popcount64(out.bits[w]);
+        out.cardinality = card;
+        out.normalize();
+        return out;
+    }
+    out.array.reserve(a.array.size());
+    if (b.isBitmap) {
+        for (uint16_t v : a.array) {
+            if (!((b.bits[v >> 6] >> (v & 63)) & 1)) out.array.push_back(v);
+        }
+    } else {
+        std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                            std::back_inserter(out.array));
+    }
+    out.cardinality = static_cast<uint32_t>(out.array.size());
+    return out;
+}
+
+RoaringBitmap::Container RoaringBitmap::orContainers(const Container& a, const Container& b) {
+    Container out;
+    if (a.isBitmap || b.isBitmap) {
+        out.isBitmap = true;
+        out.bits.assign(BITMAP_WORDS, 0);
+        for (const Container* c : {&a, &b}) {
+            if (c->isBitmap) {
+                for (uint32_t w = 0; w < BITMAP_WORDS; ++w) out.bits[w] |= c->bits[w];
+            } else {
+                for (uint16_t v : c->array) out.bits[v >> 6] |= uint64_t(1) << (v & 63);
+            }
+        }
+        uint32_t card = 0;
+        for (uint32_t w = 0; w < BITMAP_WORDS; ++w) card += popcount64(out.bits[w]);
+        out.cardinality = card;
+        return out;
+    }
+    out.array.reserve(a.array.size() + b.array.size());
+    std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                   std::back_inserter(out.array));
+    out.cardinality = static_cast<uint32_t>(out.array.size());
+    out.normalize();
+    return out;
+}
+
+// =====================================================================
+// RoaringBitmap
+// =====================================================================
+
+long RoaringBitmap::findKey(uint16_t key) const {
+    auto it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+    if (it == m_keys.end() || *it != key) return -1;
+    return static_cast<long>(it - m_keys.begin());
+}
+
+bool RoaringBitmap::add(uint32_t value) {
+    uint16_t key = highBits(value);
+    auto it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+    size_t idx = static_cast<size_t>(it - m_keys.begin());
+    if (it == m_keys.end() || *it != key) {
+        m_keys.insert(it, key);
+        m_containers.insert(m_containers.begin() + static_cast<std::ptrdiff_t>(idx), Container());
+    }
+    return m_containers[idx].add(lowBits(value));
+}
+
+bool RoaringBitmap::remove(uint32_t value) {
+    long idx = findKey(highBits(value));
+    if (idx < 0) return false;
+    Container& c = m_containers[static_cast<size_t>(idx)];
+    if (!c.remove(lowBits(value))) return false;
+    if (c.cardinality == 0) {
+        m_keys.erase(m_keys.begin() + idx);
+        m_containers.erase(m_containers.begin() + idx);
+    }
+    return true;
+}
+
+bool RoaringBitmap::contains(uint32_t value) const {
+    long idx = findKey(highBits(value));
+    return idx >= 0 && m_containers[static_cast<size_t>(idx)].contains(lowBits(value));
+}
+
+uint64_t RoaringBitmap::cardinality() const {
+    uint64_t total = 0;
+    for (const auto& c : m_containers) total += c.cardinality;
+    return total;
+}
+
+RoaringBitmap RoaringBitmap::andOf(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+    size_t i = 0, j = 0;
+    while (i < a.m_keys.size() && j < b.m_keys.size()) {
+        if (a.m_keys[i] < b.m_keys[j]) { ++i; continue; }
+        if (b.m_keys[j] < a.m_keys[i]) { ++j; continue; }
+        Container c = andContainers(a.m_containers[i], b.m_containers[j]);
+        if (c.cardinality > 0) {
+            out.m_keys.push_back(a.m_keys[i]);
+            out.m_containers.push_back(std::move(c));
+        }
+        ++i; ++j;
+    }
+    return out;
+}
+
+uint64_t RoaringBitmap::andCardinality(const RoaringBitmap& a, const RoaringBitmap& b) {
+    uint64_t total = 0;
+    size_t i = 0, j = 0;
+    while (i < a.m_keys.size() && j < b.m_keys.size()) {
+        if (a.m_keys[i] < b.m_keys[j]) { ++i; continue; }
+        if (b.m_keys[j] < a.m_keys[i]) { ++j; continue; }
+        total += andContainerCardinality(a.m_containers[i], b.m_containers[j]);
+        ++i; ++j;
+    }
+    return total;
+}
+
+RoaringBitmap RoaringBitmap::andNotOf(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+    size_t j = 0;
+    for (size_t i = 0; i < a.m_keys.size(); ++i) {
+        while (j < b.m_keys.size() && b.m_keys[j] < a.m_keys[i]) ++j;
+        if (j < b.m_keys.size() && b.m_keys[j] == a.m_keys[i]) {
+            Container c = andNotContainers(a.m_containers[i], b.m_containers[j]);
+            if (c.cardinality > 0) {
+                out.m_keys.push_back(a.m_keys[i]);
+                out.m_containers.push_back(std::move(c));
+            }
+        } else {
+            out.m_keys.push_back(a.m_keys[i]);
+            out.m_containers.push_back(a.m_containers[i]);
+        }
+    }
+    return out;
+}
+
+RoaringBitmap RoaringBitmap::orOf(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+    size_t i = 0, j = 0;
+    while (i < a.m_keys.size() || j < b.m_keys.size()) {
+        if (j >= b.m_keys.size() || (i < a.m_keys.size() && a.m_keys[i] < b.m_keys[j])) {
+            out.m_keys.push_back(a.m_keys[i]);
+            out.m_containers.push_back(a.m_containers[i]);
+            ++i;
+        } else if (i >= a.m_keys.size() || b.m_keys[j] < a.m_keys[i]) {
+            out.m_keys.push_back(b.m_keys[j]);
+            out.m_containers.push_back(b.m_containers[j]);
+            ++j;
+        } else {
+            out.m_keys.push_back(a.m_keys[i]);
+            out.m_containers.push_back(orContainers(a.m_containers[i], b.m_containers[j]));
+            ++i; ++j;
+        }
+    }
+    return out;
+}
+
+void RoaringBitmap::forEach(const std::function<void(uint32_t)>& fn) const {
+    for (size_t k = 0; k < m_keys.size(); ++k) {
+        const uint32_t base = static_cast<uint32_t>(m_keys[k]) << 16;
+        const Container& c = m_containers[k];
+        if (c.isBitmap) {
+            for (uint32_t w = 0; w < BITMAP_WORDS; ++w) {
+                uint64_t word = c.bits[w];
+                while (word) {
+                    fn(base | (w * 64 + static_cast<uint32_t>(countTrailingZeros(word))));
+                    word &= word - 1;
+                }
+            }
+        } else {
+            for (uint16_t v : c.array) fn(base | v);
+        }
+    }
+}
+
+std::vector<uint32_t> RoaringBitmap::toVector() const {
+    std::vector<uint32_t> out;
+    out.reserve(static_cast<size_t>(cardinality()));
+    forEach([&out](uint32_t v) { out.push_back(v); });
+    return out;
+}
+
+size_t RoaringBitmap::memoryUsage() const {
+    size_t bytes = sizeof(*this) + m_keys.capacity() * sizeof(uint16_t);
+    for (const auto& c : m_containers) {
+        bytes += sizeof(Container) + c.array.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+bool RoaringBitmap::operator==(const RoaringBitmap& other) const {
+    if (m_keys != other.m_keys) return false;
+    for (size_t k = 0; k < m_keys.size(); ++k) {
+        const Container& a = m_containers[k];
+        const Container& b = other.m_containers[k];
+        if (a.cardinality != b.cardinality) return false;
+        if (andContainerCardinality(a, b) != a.cardinality) return false;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// ========================================================================================
+// RoaringBitmap - 压缩位图（roaring 风格），用于大群成员 / 在线用户等集合代数
+// ========================================================================================
+// 32 位句柄按高 16 位分桶，每个桶一个容器：
+//   - 数组容器：有序 uint16 数组，元素数 <= 4096 时使用（稀疏）
+//   - 位图容器：1024 个 uint64（8KB），元素数 > 4096 时使用（稠密）
+// 交/差/并按容器类型两两组合实现，结果容器会自动在两种表示之间转换。
+// 非线程安全，由持有者加锁。
+// ========================================================================================
+
+class RoaringBitmap {
+public:
+    static const uint32_t ARRAY_MAX = 4096;   // 数组容器上限
+    static const uint32_t BITMAP_WORDS = 1024; // 65536 / 64
+
+    RoaringBitmap() = default;
+
+    // ===== 单元素操作 =====
+    bool add(uint32_t value);      // 新增返回 true
+    bool remove(uint32_t value);   // 存在并删除返回 true
+    bool contains(uint32_t value) const;
+
+    void clear() { m_keys.clear(); m_containers.clear(); }
+    bool empty() const { return m_keys.empty(); }
+    uint64_t cardinality() const;
+
+    // ===== 集合代数 =====
+    static RoaringBitmap andOf(const RoaringBitmap& a, const RoaringBitmap& b);     // a ∩ b
+    static RoaringBitmap andNotOf(const RoaringBitmap& a, const RoaringBitmap& b);  // a − b
+    static RoaringBitmap orOf(const RoaringBitmap& a, const RoaringBitmap& b);      // a ∪ b
+    static uint64_t andCardinality(const RoaringBitmap& a, const RoaringBitmap& b); // |a ∩ b|，不物化结果
+
+    RoaringBitmap& operator&=(const RoaringBitmap& other) { return *this = andOf(*this, other); }
+    RoaringBitmap& operator|=(const RoaringBitmap& other) { return *this = orOf(*this, other); }
+    RoaringBitmap& operator-=(const RoaringBitmap& other) { return *this = andNotOf(*this, other); }
+
+    // ===== 遍历 =====
+    void forEach(const std::function<void(uint32_t)>& fn) const;
+    std::vector<uint32_t> toVector() const;
+
+    // 内存占用估算（字节）
+    size_t memoryUsage() const;
+
+    bool operator==(const RoaringBitmap& other) const;
+    bool operator!=(const RoaringBitmap& other) const { return !(*this == other); }
+
+private:
+    struct Container {
+        bool isBitmap = false;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> array;   // isBitmap == false 时使用
+        std::vector<uint64_t> bits;    // isBitmap == true 时使用
+
+        bool add(uint16_t low);
+        bool remove(uint16_t low);
+        bool contains(uint16_t low) const;
+        void toBitmap();
+        void toArray();
+        void normalize();  // 根据基数选择合适的表示
+    };
+
+    static Container andContainers(const Container& a, const Container& b);
+    static Container andNotContainers(const Container& a, const Container& b);
+    static Container orContainers(const Container& a, const Container& b);
+    static uint32_t andContainerCardinality(const Container& a, const Container& b);
+
+    // 返回 key 在 m_keys 中的下标，不存在返回 -1
+    long findKey(uint16_t key) const;
+
+    std::vector<uint16_t> m_keys;          // 有序的高 16 位
+    std::vector<Container> m_containers;   // 与 m_keys 一一对应
+};
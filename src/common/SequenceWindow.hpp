@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// ========================================================================================
+// SequenceWindow - 序号滑动窗口去重（类似 IPsec 防重放窗口）
+// ========================================================================================
+// 记录最近 WIDTH 个序号是否出现过：窗口右端是见过的最大序号，第 i 位表示 (最大序号 - i)。
+// 更大的序号到来时窗口右移；比窗口左端还旧的序号无法判断，insert/contains 一律按重复处理，
+// seen 则只对窗口内确实出现过的序号返回 true。
+// 固定 40 字节，插入/查询只有几次位运算，不涉及字符串比较。非线程安全，由持有者加锁。
+// ========================================================================================
+
+// 会话流序号的布局（时间戳、节点号与 MessageId 一致）：
+//   [40 位 毫秒时间戳（自 2024-01-01 起）][8 位 节点号][16 位 纪元内计数]
+// 高 48 位是纪元：给流编号的节点在建流时取当前毫秒和自己的节点号，计数从 1 开始，用完时换新纪元。
+// 同一个流可能由多个节点编号（群成员分布在多个节点、发送者重连到其他节点、流被淘汰后重建），
+// 每个纪元内序号连续递增，不同纪元之间没有先后可言；去重和重排都按 (流, 纪元) 分开做，
+// 某个节点的序号再大也不会把另一个节点的序号挤出窗口
+struct StreamSequence {
+    static constexpr unsigned COUNTER_BITS = 16;
+    static constexpr unsigned NODE_BITS = 8;
+    static constexpr uint64_t COUNTER_MASK = (uint64_t(1) << COUNTER_BITS) - 1;
+
+    // 纪元 epochMs（自 2024-01-01 起的毫秒数）、节点 node 的序号基准，第一个序号为基准 + 1
+    static uint64_t base(uint64_t epochMs, uint32_t node) noexcept {
+        return ((epochMs << NODE_BITS) | (node & ((1u << NODE_BITS) - 1))) << COUNTER_BITS;
+    }
+    static uint64_t epochOf(uint64_t seq) noexcept { return seq >> COUNTER_BITS; }
+    static uint64_t epochMsOf(uint64_t seq) noexcept { return seq >> (COUNTER_BITS + NODE_BITS); }
+    static uint64_t counterOf(uint64_t seq) noexcept { return seq & COUNTER_MASK; }
+    // 按 (流, 纪元) 区分的去重窗口键；混合后碰撞只会让两个纪元共用窗口（多补发），不会误判重复
+    static uint64_t windowKey(uint64_t streamKey, uint64_t seq) noexcept {
+        return streamKey ^ (epochOf(seq) * 0x9E3779B97F4A7C15ULL);
+    }
+};
+
+class SequenceWindow {
+public:
+    static constexpr uint64_t WIDTH = 256;
+
+    // 记录 seq；返回 false 表示重复（已出现过或早于窗口）。seq 为 0 表示没有序号，总是接受
+    bool insert(uint64_t seq) noexcept {
+        if (seq == 0) return true;
+        if (seq > m_highest) {
+            shift(seq - m_highest);
+            m_highest = seq;
+            m_bits[0] |= 1;
+            return true;
+        }
+        uint64_t offset = m_highest - seq;
+        if (offset >= WIDTH) return false;
+        uint64_t mask = uint64_t(1) << (offset % 64);
+        uint64_t& word = m_bits[offset / 64];
+        if (word & mask) return false;
+        word |= mask;
+        return true;
+    }
+
+    // 已出现过或早于窗口
+    bool contains(uint64_t seq) const noexcept {
+        if (seq == 0 || seq > m_highest) return false;
+        uint64_t offset = m_highest - seq;
+        if (offset >= WIDTH) return true;
+        return (m_bits[offset / 64] >> (offset % 64)) & 1;
+    }
+
+    // 确实出现过：早于窗口的序号无法判断，返回 false
+    bool seen(uint64_t seq) const noexcept {
+        if (seq == 0 || seq > m_highest) return false;
+        uint64_t offset = m_highest - seq;
+        if (offset >= WIDTH) return false;
+        return (m_bits[offset / 64] >> (offset % 64)) & 1;
+    }
+
+    uint64_t highest() const noexcept { return m_highest; }
+    bool empty() const noexcept { return m_highest == 0; }
+
+    void reset() noexcept {
+        m_highest = 0;
+        for (auto& word : m_bits) word = 0;
+    }
+
+private:
+    static constexpr size_t WORDS = WIDTH / 64;
+
+    // 窗口右移 n 位：已有的位离右端更远，移出左端的丢弃
+    void shift(uint64_t n) noexcept {
+        if (n >= WIDTH) {
+            for (auto& word : m_bits) word = 0;
+            return;
+        }
+        size_t wordShift = static_cast<size_t>(n / 64);
+        unsigned bitShift = static_cast<unsigned>(n % 64);
+        for (size_t w = WORDS; w-- > 0;) {
+            uint64_t value = 0;
+            if (w >= wordShift) {
+                value = m_bits[w - wordShift] << bitShift;
+                if (bitShift != 0 && w > wordShift) value |= m_bits[w - wordShift - 1] >> (64 - bitShift);
+            }
+            m_bits[w] = value;
+        }
+    }
+
+    uint64_t m_highest = 0;
+    uint64_t m_bits[WORDS] = {};
+};
@@ -0,0 +1,246 @@
+#include "SetIntersect.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SETOPS_X86 1
+#include <immintrin.h>
+#else
+#define SETOPS_X86 0
+#endif
+
+namespace {
+
+// ===== 标量归并 =====
+template<bool Write>
+size_t mergeScalar(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    size_t i = 0, j = 0, n = 0;
+    while (i < na && j < nb) {
+        uint32_t x = a[i], y = b[j];
+        if (x == y) {
+            if (Write) out[n] = x;
+            ++n; ++i; ++j;
+        } else {
+            // 无分支推进，较小的一侧前进一步
+            i += (x < y);
+            j += (y < x);
+        }
+    }
+    return n;
+}
+
+// ===== Galloping：small 中的每个元素在 large 上做指数探测 + 二分 =====
+template<bool Write>
+size_t gallop(const uint32_t* small, size_t ns, const uint32_t* large, size_t nl, uint32_t* out) {
+    size_t n = 0, lo = 0;
+    for (size_t i = 0; i < ns && lo < nl; ++i) {
+        uint32_t x = small[i];
+        size_t step = 1, hi = lo;
+        while (hi < nl && large[hi] < x) {
+            lo = hi + 1;
+            hi += step;
+            step <<= 1;
+        }
+        if (hi > nl) hi = nl;
+        lo = static_cast<size_t>(std::lower_bound(large + lo, large + hi, x) - large);
+        if (lo < nl && large[lo] == x) {
+            if (Write) out[n] = x;
+            ++n;
+            ++lo;
+        }
+    }
+    return n;
+}
+
+#if SETOPS_X86
+
+// pshufb 压缩表：mask 的每一位表示该 32 位通道是否命中
+struct SseShuffleTable {
+    alignas(16) uint8_t masks[16][16];
+    SseShuffleTable() {
+        for (int m = 0; m < 16; ++m) {
+            int k = 0;
+            for (int lane = 0; lane < 4; ++lane) {
+                if (m & (1 << lane)) {
+                    for (int byte = 0; byte < 4; ++byte) masks[m][k * 4 + byte] = static_cast<uint8_t>(lane * 4 + byte);
+                    ++k;
+                }
+            }
+            for (int rest = k * 4; rest < 16; ++rest) masks[m][rest] = 0x80;
+        }
+    }
+};
+
+// vpermd 压缩表
+struct AvxPermuteTable {
+    alignas(32) uint32_t idx[256][8];
+    AvxPermuteTable() {
+        for (int m = 0; m < 256; ++m) {
+            int k = 0;
+            for (int lane = 0; lane < 8; ++lane) {
+                if (m & (1 << lane)) idx[m][k++] = static_cast<uint32_t>(lane);
+            }
+            for (; k < 8; ++k) idx[m][k] = 0;
+        }
+    }
+};
+
+const SseShuffleTable g_sseTable;
+const AvxPermuteTable g_avxTable;
+
+template<bool Write>
+__attribute__((target("sse4.2,popcnt")))
+size_t intersectSse(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    size_t i = 0, j = 0, n = 0;
+    if (na >= 4 && nb >= 4) {
+        const size_t endA = na & ~size_t(3), endB = nb & ~size_t(3);
+        while (i < endA && j < endB) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+
+            // 4 次旋转比较覆盖全部 4x4 组合
+            __m128i hit = _mm_cmpeq_epi32(va, vb);
+            vb = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi32(va, vb));
+            vb = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi32(va, vb));
+            vb = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi32(va, vb));
+
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(hit));
+            if (Write && mask) {
+                __m128i packed = _mm_shuffle_epi8(va, _mm_load_si128(reinterpret_cast<const __m128i*>(g_sseTable.masks[mask])));
+                alignas(16) uint32_t tmp[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(tmp), packed);
+                std::memcpy(out + n, tmp, sizeof(uint32_t) * static_cast<size_t>(_mm_popcnt_u32(static_cast<unsigned>(mask))));
+            }
+            n += static_cast<size_t>(_mm_popcnt_u32(static_cast<unsigned>(mask)));
+
+            uint32_t maxA = a[i + 3], maxB = b[j + 3];
+            i += (maxA <= maxB) ? 4 : 0;
+            j += (maxB <= maxA) ? 4 : 0;
+        }
+    }
+    return n + mergeScalar<Write>(a + i, na - i, b + j, nb - j, Write ? out + n : nullptr);
+}
+
+template<bool Write>
+__attribute__((target("avx2,popcnt")))
+size_t intersectAvx2(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    size_t i = 0, j = 0, n = 0;
+    if (na >= 8 && nb >= 8) {
+        const size_t endA = na & ~size_t(7), endB = nb & ~size_t(7);
+        const __m256i rot = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+        while (i < endA && j < endB) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+
+            __m256i hit = _mm256_cmpeq_epi32(va, vb);
+            for (int r = 1; r < 8; ++r) {
+                vb = _mm256_permutevar8x32_epi32(vb, rot);
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi32(va, vb));
+            }
+
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+            int hits = _mm_popcnt_u32(static_cast<unsigned>(mask));
+            if (Write && mask) {
+                __m256i perm = _mm256_load_si256(reinterpret_cast<const __m256i*>(g_avxTable.idx[mask]));
+                alignas(32) uint32_t tmp[8];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(tmp), _mm256_permutevar8x32_epi32(va, perm));
+                std::memcpy(out + n, tmp, sizeof(uint32_t) * static_cast<size_t>(hits));
+            }
+            n += static_cast<size_t>(hits);
+
+            uint32_t maxA = a[i + 7], maxB = b[j + 7];
+            i += (maxA <= maxB) ? 8 : 0;
+            j += (maxB <= maxA) ? 8 : 0;
+        }
+    }
+    return n + mergeScalar<Write>(a + i, na - i, b + j, nb - j, Write ? out + n : nullptr);
+}
+
+#endif // SETOPS_X86
+
+template<bool Write>
+size_t run(SetIntersect::Kernel kernel, const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    switch (kernel) {
+        case SetIntersect::Kernel::Galloping:
+            return na <= nb ? gallop<Write>(a, na, b, nb, out) : gallop<Write>(b, nb, a, na, out);
+#if SETOPS_X86
+        case SetIntersect::Kernel::SSE:
+            return intersectSse<Write>(a, na, b, nb, out);
+        case SetIntersect::Kernel::AVX2:
+            return intersectAvx2<Write>(a, na, b, nb, out);
+#endif
+        default:
+            return mergeScalar<Write>(a, na, b, nb, out);
+    }
+}
+
+} // namespace
+
+bool SetIntersect::isAvailable(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Auto:
+        case Kernel::Scalar:
+        case Kernel::Galloping:
+            return true;
+#if SETOPS_X86
+        case Kernel::SSE:
+            return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+        case Kernel::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* SetIntersect::kernelName(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Auto: return "auto";
+        case Kernel::Scalar: return "scalar";
+        case Kernel::Galloping: return "galloping";
+        case Kernel::SSE: return "sse4.2";
+        case Kernel::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+SetIntersect::Kernel SetIntersect::bestKernel() {
+    static const Kernel best = isAvailable(Kernel::AVX2) ? Kernel::AVX2
+                             : isAvailable(Kernel::SSE)  ? Kernel::SSE
+                             : Kernel::Scalar;
+    return best;
+}
+
+SetIntersect::Kernel SetIntersect::resolve(Kernel kernel, size_t na, size_t nb) {
+    if (kernel != Kernel::Auto) {
+        return isAvailable(kernel) ? kernel : Kernel::Scalar;
+    }
+    size_t lo = std::min(na, nb), hi = std::max(na, nb);
+    if (lo == 0) return Kernel::Scalar;
+    if (hi / lo >= GALLOP_RATIO) return Kernel::Galloping;
+    return bestKernel();
+}
+
+size_t SetIntersect::count(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, Kernel kernel) {
+    if (na == 0 || nb == 0) return 0;
+    // 值域不重叠时直接返回
+    if (a[na - 1] < b[0] || b[nb - 1] < a[0]) return 0;
+    return run<false>(resolve(kernel, na, nb), a, na, b, nb, nullptr);
+}
+
+size_t SetIntersect::intersect(const uint32_t* a, size_t na, const uint32_t* b, size_t nb,
+                               uint32_t* out, Kernel kernel) {
+    if (na == 0 || nb == 0) return 0;
+    if (a[na - 1] < b[0] || b[nb - 1] < a[0]) return 0;
+    return run<true>(resolve(kernel, na, nb), a, na, b, nb, out);
+}
+
+std::vector<uint32_t> SetIntersect::intersect(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                                              Kernel kernel) {
+    std::vector<uint32_t> out(std::min(a.size(), b.size()));
+    out.resize(intersect(a.data(), a.size(), b.data(), b.size(), out.data(), kernel));
+    return out;
+}
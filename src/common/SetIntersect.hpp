@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ========================================================================================
+// SetIntersect - 有序 uint32 数组的集合求交引擎
+// ========================================================================================
+// 输入要求：两个数组都严格递增（无重复）。
+// 内核：
+//   - Scalar    : 分支较少的归并
+//   - Galloping : 两边规模悬殊时对大数组做指数+二分查找
+//   - SSE       : 4x4 全对比较（SSE4.2），结果用 pshufb 压缩写出
+//   - AVX2      : 8x8 全对比较，结果用 vpermd 压缩写出
+// Auto 根据 CPU 能力（运行时检测）和规模比选择内核；非 x86 平台只有标量实现。
+// ========================================================================================
+
+class SetIntersect {
+public:
+    enum class Kernel { Auto, Scalar, Galloping, SSE, AVX2 };
+
+    // 两边长度比超过该值时 Auto 改用 galloping
+    static const size_t GALLOP_RATIO = 32;
+
+    // 只求交集大小
+    static size_t count(const uint32_t* a, size_t na, const uint32_t* b, size_t nb,
+                        Kernel kernel = Kernel::Auto);
+    static size_t count(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                        Kernel kernel = Kernel::Auto) {
+        return count(a.data(), a.size(), b.data(), b.size(), kernel);
+    }
+
+    // 求交集并写入 out（容量至少 min(na, nb)），返回写入个数
+    static size_t intersect(const uint32_t* a, size_t na, const uint32_t* b, size_t nb,
+                            uint32_t* out, Kernel kernel = Kernel::Auto);
+    static std::vector<uint32_t> intersect(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                                           Kernel kernel = Kernel::Auto);
+
+    // 内核可用性（用于基准测试和日志）
+    static bool isAvailable(Kernel kernel);
+    static const char* kernelName(Kernel kernel);
+    static Kernel bestKernel();
+
+private:
+    static Kernel resolve(Kernel kernel, size_t na, size_t nb);
+};
@@ -0,0 +1,264 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// ========================================================================================
+// SlabPool - 对象池（按 slab 批量分配槽位）+ 带代数校验的句柄
+// ========================================================================================
+// - 槽位按 SlabSize 个一组分配，地址稳定；释放的槽位进入空闲链表复用，热路径不走 malloc
+// - Handle = (槽位下标, 代数)。destroy() 后代数递增，旧句柄 acquire() 得到空 Ref，
+//   不会误用到复用后的新对象
+// - Ref 是 RAII "钉住" 引用：持有 Ref 期间对象即使被 destroy() 也不会析构，
+//   最后一个 Ref 释放时才真正析构并回收槽位，避免跨线程的 use-after-free
+// - 池分成 ShardCount 个分片，各自有锁、slab 和空闲链表；create() 轮流选分片，
+//   槽位下标的低位即分片号，acquire / unpin / destroy 只锁句柄所在的分片
+// ========================================================================================
+
+// 句柄与对象类型无关，对象内部也可以保存自己的句柄
+struct SlabHandle {
+    static const uint32_t NO_INDEX = 0xFFFFFFFFu;
+
+    uint32_t index = NO_INDEX;
+    uint32_t generation = 0;
+
+    bool valid() const { return index != NO_INDEX; }
+    bool operator==(const SlabHandle& o) const { return index == o.index && generation == o.generation; }
+    bool operator!=(const SlabHandle& o) const { return !(*this == o); }
+};
+
+template<class T, size_t SlabSize = 64, size_t ShardCount = 16>
+class SlabPool {
+    static_assert(ShardCount > 0 && (ShardCount & (ShardCount - 1)) == 0, "ShardCount must be a power of two");
+
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        uint32_t generation = 0;
+        uint32_t pins = 0;
+        uint32_t nextFree = 0;
+        bool live = false;      // 对象已构造且未析构
+        bool retired = false;   // 已 destroy()，等待最后一个 Ref 释放
+
+        T* object() { return reinterpret_cast<T*>(storage); }
+    };
+
+    // 分片按缓存行对齐，相邻分片的锁不共享缓存行
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<Slot[]>> slabs;
+        uint32_t slotCount = 0;      // 已使用过的槽位数（高水位）
+        uint32_t freeHead = SlabHandle::NO_INDEX;
+        size_t liveCount = 0;
+
+        Slot& at(uint32_t local) { return slabs[local / SlabSize][local % SlabSize]; }
+    };
+
+public:
+    static const uint32_t NO_INDEX = SlabHandle::NO_INDEX;
+    using Handle = SlabHandle;
+
+    class Ref {
+    public:
+        Ref() = default;
+        Ref(const Ref&) = delete;
+        Ref& operator=(const Ref&) = delete;
+        Ref(Ref&& o) noexcept : m_pool(o.m_pool), m_slot(o.m_slot), m_handle(o.m_handle) {
+            o.m_pool = nullptr;
+            o.m_slot = nullptr;
+        }
+        Ref& operator=(Ref&& o) noexcept {
+            if (this != &o) {
+                reset();
+                m_pool = o.m_pool;
+                m_slot = o.m_slot;
+                m_handle = o.m_handle;
+                o.m_pool = nullptr;
+                o.m_slot = nullptr;
+            }
+            return *this;
+        }
+        ~Ref() { reset(); }
+
+        T* get() const { return m_slot ? m_slot->object() : nullptr; }
+        T* operator->() const { return get(); }
+        T& operator*() const { return *get(); }
+        explicit operator bool() const { return m_slot != nullptr; }
+        Handle handle() const { return m_handle; }
+
+        void reset() {
+            if (m_pool && m_slot) m_pool->unpin(m_slot, m_handle.index);
+            m_pool = nullptr;
+            m_slot = nullptr;
+        }
+
+    private:
+        friend class SlabPool;
+        Ref(SlabPool* pool, Slot* slot, Handle h) : m_pool(pool), m_slot(slot), m_handle(h) {}
+
+        SlabPool* m_pool = nullptr;
+        Slot* m_slot = nullptr;
+        Handle m_handle;
+    };
+
+    SlabPool() = default;
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    ~SlabPool() {
+        for (Shard& shard : m_shards) {
+            for (auto& slab : shard.slabs) {
+                for (size_t i = 0; i < SlabSize; ++i) {
+                    if (slab[i].live) slab[i].object()->~T();
+                }
+            }
+        }
+    }
+
+    // 在池中构造对象，返回句柄
+    template<class... Args>
+    Handle create(Args&&... args) {
+        uint32_t shardIndex = m_nextShard.fetch_add(1, std::memory_order_relaxed) & SHARD_MASK;
+        Shard& shard = m_shards[shardIndex];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        uint32_t local = takeFreeSlot(shard);
+        Slot& slot = shard.at(local);
+        new (slot.storage) T(std::forward<Args>(args)...);
+        slot.live = true;
+        slot.retired = false;
+        slot.pins = 0;
+        ++shard.liveCount;
+        return Handle{globalIndex(shardIndex, local), slot.generation};
+    }
+
+    // 钉住句柄对应的对象；句柄过期或已 destroy() 时返回空 Ref
+    Ref acquire(Handle h) {
+        if (!h.valid()) return Ref();
+        Shard& shard = shardOf(h.index);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Slot* slot = lookup(shard, h);
+        if (!slot) return Ref();
+        ++slot->pins;
+        return Ref(this, slot, h);
+    }
+
+    // 使句柄立即失效；没有 Ref 时立刻析构，否则由最后一个 Ref 析构
+    bool destroy(Handle h) {
+        if (!h.valid()) return false;
+        Shard& shard = shardOf(h.index);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Slot* slot = lookup(shard, h);
+        if (!slot) return false;
+        ++slot->generation;
+        slot->retired = true;
+        --shard.liveCount;
+        if (slot->pins == 0) release(shard, localIndex(h.index), *slot);
+        return true;
+    }
+
+    bool contains(Handle h) const {
+        if (!h.valid()) return false;
+        Shard& shard = const_cast<SlabPool*>(this)->shardOf(h.index);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return lookup(shard, h) != nullptr;
+    }
+
+    // 逐个分片在分片锁内查找第一个满足 pred 的存活对象并钉住（线性扫描，只用于冷路径）
+    template<class Pred>
+    Ref findIf(Pred pred) {
+        for (uint32_t s = 0; s < ShardCount; ++s) {
+            Shard& shard = m_shards[s];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (uint32_t i = 0; i < shard.slotCount; ++i) {
+                Slot& slot = shard.at(i);
+                if (slot.live && !slot.retired && pred(*slot.object())) {
+                    ++slot.pins;
+                    return Ref(this, &slot, Handle{globalIndex(s, i), slot.generation});
+                }
+            }
+        }
+        return Ref();
+    }
+
+    // 当前所有存活对象的句柄快照
+    std::vector<Handle> handles() const {
+        std::vector<Handle> out;
+        for (uint32_t s = 0; s < ShardCount; ++s) {
+            Shard& shard = const_cast<Shard&>(m_shards[s]);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            out.reserve(out.size() + shard.liveCount);
+            for (uint32_t i = 0; i < shard.slotCount; ++i) {
+                const Slot& slot = shard.at(i);
+                if (slot.live && !slot.retired) out.push_back(Handle{globalIndex(s, i), slot.generation});
+            }
+        }
+        return out;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const Shard& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.liveCount;
+        }
+        return total;
+    }
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Shard& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.slabs.size() * SlabSize;
+        }
+        return total;
+    }
+
+private:
+    static const uint32_t SHARD_MASK = static_cast<uint32_t>(ShardCount - 1);
+
+    static uint32_t globalIndex(uint32_t shard, uint32_t local) {
+        return local * static_cast<uint32_t>(ShardCount) + shard;
+    }
+    static uint32_t localIndex(uint32_t index) { return index / static_cast<uint32_t>(ShardCount); }
+    Shard& shardOf(uint32_t index) { return m_shards[index & SHARD_MASK]; }
+
+    static Slot* lookup(Shard& shard, Handle h) {
+        uint32_t local = localIndex(h.index);
+        if (local >= shard.slotCount) return nullptr;
+        Slot& slot = shard.at(local);
+        if (!slot.live || slot.retired || slot.generation != h.generation) return nullptr;
+        return &slot;
+    }
+
+    static uint32_t takeFreeSlot(Shard& shard) {
+        if (shard.freeHead != NO_INDEX) {
+            uint32_t local = shard.freeHead;
+            shard.freeHead = shard.at(local).nextFree;
+            return local;
+        }
+        if (shard.slotCount == shard.slabs.size() * SlabSize) {
+            shard.slabs.emplace_back(new Slot[SlabSize]);
+        }
+        return shard.slotCount++;
+    }
+
+    static void release(Shard& shard, uint32_t local, Slot& slot) {
+        slot.object()->~T();
+        slot.live = false;
+        slot.retired = false;
+        slot.nextFree = shard.freeHead;
+        shard.freeHead = local;
+    }
+
+    void unpin(Slot* slot, uint32_t index) {
+        Shard& shard = shardOf(index);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (--slot->pins == 0 && slot->retired) release(shard, localIndex(index), *slot);
+    }
+
+    Shard m_shards[ShardCount];
+    std::atomic<uint32_t> m_nextShard{0};
+};
@@ -0,0 +1,235 @@
+#include "Task.hpp"
+
+#if CHAT_HAVE_COROUTINES
+
+#include "Metrics.hpp"
+#include <iostream>
+#include <new>
+
+namespace {
+
+// 协程指标
+struct CoroutineMetrics {
+    Counter& framesAllocated;
+    Counter& framePoolMisses;
+    Counter& resumes;
+    Counter& timersFired;
+    Gauge& liveFrames;
+};
+
+CoroutineMetrics& coroutineMetrics() {
+    MetricsRegistry& r = MetricsRegistry::instance();
+    static CoroutineMetrics metrics{
+        r.counter("chat_coro_frames_allocated_total", "Coroutine frames allocated"),
+        r.counter("chat_coro_frame_pool_misses_total", "Coroutine frame allocations that fell through to the heap"),
+        r.counter("chat_coro_resumes_total", "Coroutines posted to worker threads for resumption"),
+        r.counter("chat_coro_timers_fired_total", "Scheduler timers that reached their deadline"),
+        r.gauge("chat_coro_live_frames", "Coroutine frames currently allocated"),
+    };
+    return metrics;
+}
+
+// ==============================
+// 帧分配
+// ==============================
+
+struct FreeFrame {
+    FreeFrame* next;
+};
+
+// 线程本地的分级空闲链表；线程退出时把缓存的帧还给堆
+struct FrameCache {
+    FreeFrame* heads[FramePool::CLASS_COUNT] = {};
+    size_t counts[FramePool::CLASS_COUNT] = {};
+
+    ~FrameCache() {
+        for (size_t c = 0; c < FramePool::CLASS_COUNT; ++c) {
+            while (FreeFrame* frame = heads[c]) {
+                heads[c] = frame->next;
+                ::operator delete(frame);
+            }
+        }
+    }
+};
+
+thread_local FrameCache t_frameCache;
+
+// 大小所在的级别；超过最大级别返回 CLASS_COUNT
+size_t frameClass(size_t size) {
+    size_t bytes = FramePool::MIN_CLASS_BYTES;
+    size_t c = 0;
+    while (c < FramePool::CLASS_COUNT && bytes < size) {
+        bytes <<= 1;
+        ++c;
+    }
+    return c;
+}
+
+} // namespace
+
+void* FramePool::allocate(size_t size) {
+    CoroutineMetrics& metrics = coroutineMetrics();
+    metrics.framesAllocated.inc();
+    metrics.liveFrames.inc();
+    size_t c = frameClass(size);
+    if (c == CLASS_COUNT) {
+        metrics.framePoolMisses.inc();
+        return ::operator new(size);
+    }
+    FrameCache& cache = t_frameCache;
+    if (FreeFrame* frame = cache.heads[c]) {
+        cache.heads[c] = frame->next;
+        --cache.counts[c];
+        return frame;
+    }
+    metrics.framePoolMisses.inc();
+    return ::operator new(MIN_CLASS_BYTES << c);
+}
+
+void FramePool::deallocate(void* frame, size_t size) noexcept {
+    coroutineMetrics().liveFrames.dec();
+    size_t c = frameClass(size);
+    FrameCache& cache = t_frameCache;
+    if (c == CLASS_COUNT || cache.counts[c] >= MAX_CACHED_PER_CLASS) {
+        ::operator delete(frame);
+        return;
+    }
+    FreeFrame* node = static_cast<FreeFrame*>(frame);
+    node->next = cache.heads[c];
+    cache.heads[c] = node;
+    ++cache.counts[c];
+}
+
+// ==============================
+// 调度器
+// ==============================
+
+namespace {
+
+// 投递到线程池的恢复任务
+class ResumeTask : public TaskBase {
+public:
+    explicit ResumeTask(std::coroutine_handle<> handle) : m_handle(handle) {}
+
+    void execute() override {
+        status_ = TaskStatus::RUNNING;
+        m_handle.resume();
+        status_ = TaskStatus::COMPLETED;
+    }
+
+private:
+    std::coroutine_handle<> m_handle;
+};
+
+} // namespace
+
+bool Wakeup::fire(int reason) {
+    if (m_fired.exchange(true, std::memory_order_acq_rel)) return false;
+    m_reason = reason;
+    m_scheduler.post(m_handle);
+    return true;
+}
+
+CoroutineScheduler::CoroutineScheduler(ThreadPool& pool)
+    : m_pool(pool), m_timerOrder(0), m_stopping(false) {
+    m_timerThread = std::thread([this] { timerLoop(); });
+}
+
+CoroutineScheduler::~CoroutineScheduler() {
+    stop();
+}
+
+void CoroutineScheduler::post(std::coroutine_handle<> handle) {
+    coroutineMetrics().resumes.inc();
+    std::shared_ptr<TaskBase> task = std::make_shared<ResumeTask>(handle);
+    m_pool.submit(std::move(task));
+}
+
+void CoroutineScheduler::at(Clock::time_point deadline, std::function<void()> callback) {
+    bool earliest = false;
+    bool stopped = false;
+    {
+        std::lock_guard<std::mutex> lock(m_timerMutex);
+        stopped = m_stopping;
+        if (!stopped) {
+            earliest = m_timers.empty() || deadline < m_timers.top().deadline;
+            m_timers.push(TimerEntry{ deadline, m_timerOrder++, std::move(callback) });
+        }
+    }
+    // 已停止：没有定时器线程了，立即按到期处理，协程不会永远挂着
+    if (stopped) {
+        callback();
+        return;
+    }
+    // 只有新的最早截止时间才需要叫醒定时器线程重新计时
+    if (earliest) m_timerCv.notify_one();
+}
+
+void CoroutineScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_timerMutex);
+        if (m_stopping) return;
+        m_stopping = true;
+    }
+    m_timerCv.notify_one();
+    if (m_timerThread.joinable()) m_timerThread.join();
+    // 未到期的定时器立即触发：挂起在上面的协程（等 ACK、sleep）按超时恢复，
+    // 走完自己的收尾后结束，帧和它持有的会话引用随之释放
+    std::vector<std::function<void()>> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_timerMutex);
+        while (!m_timers.empty()) {
+            pending.push_back(std::move(const_cast<TimerEntry&>(m_timers.top()).callback));
+            m_timers.pop();
+        }
+    }
+    coroutineMetrics().timersFired.inc(pending.size());
+    for (auto& callback : pending) callback();
+}
+
+void CoroutineScheduler::timerLoop() {
+    std::vector<std::function<void()>> due;
+    std::unique_lock<std::mutex> lock(m_timerMutex);
+    while (!m_stopping) {
+        if (m_timers.empty()) {
+            m_timerCv.wait(lock);
+            continue;
+        }
+        Clock::time_point next = m_timers.top().deadline;
+        if (Clock::now() < next) {
+            m_timerCv.wait_until(lock, next);
+            continue;
+        }
+        // 一次取走所有到期的回调，在锁外执行
+        Clock::time_point now = Clock::now();
+        while (!m_timers.empty() && m_timers.top().deadline <= now) {
+            due.push_back(std::move(const_cast<TimerEntry&>(m_timers.top()).callback));
+            m_timers.pop();
+        }
+        lock.unlock();
+        coroutineMetrics().timersFired.inc(due.size());
+        for (auto& callback : due) callback();
+        due.clear();
+        lock.lock();
+    }
+}
+
+// ==============================
+// 顶层协程
+// ==============================
+
+void coro_detail::DetachedTask::promise_type::unhandled_exception() const noexcept {
+    try {
+        throw;
+    } catch (const std::exception& e) {
+        std::cerr << "[Coroutine] Unhandled exception in spawned task: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "[Coroutine] Unknown exception in spawned task" << std::endl;
+    }
+}
+
+coro_detail::DetachedTask coro_detail::runDetached(Task<void> task) {
+    co_await std::move(task);
+}
+
+#endif // CHAT_HAVE_COROUTINES
@@ -0,0 +1,302 @@
+#pragma once
+
+// ========================================================================================
+// Task - C++20 协程任务与等待器：连接处理写成顺序代码，等待下一帧 / ACK / 定时器时挂起协程，
+// 不占线程
+// ========================================================================================
+// - Task<T>：惰性启动，被 co_await 时才开始运行；结束时对称转移回等待者，不经过调度器、不增长栈
+// - spawn(task)：启动一个顶层协程（如一个连接的处理循环），不等待它结束
+// - CoroutineScheduler：把可以继续的协程投递到 ThreadPool 上恢复；自带一个定时器线程，
+//   sleepFor / sleepUntil 与带截止时间的等待（ACK）都由它触发
+// - Wakeup：一次挂起只恢复一次——ACK、超时、连接可读等多个来源竞争时第一个生效
+// - 协程帧从 FramePool 分配：按 2 的幂分级，线程本地空闲链表，热路径不走 malloc
+// 只在以 C++20 编译时可用（CHAT_HAVE_COROUTINES 为 1）；C++17 构建里本文件只定义这个宏，
+// 服务器继续用每连接一个线程的处理方式。
+// 约定：协程的引用参数在 co_await 结束前必须有效；不能跨 co_await 持有 std::mutex。
+// ========================================================================================
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define CHAT_HAVE_COROUTINES 1
+#else
+#define CHAT_HAVE_COROUTINES 0
+#endif
+
+#if CHAT_HAVE_COROUTINES
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ThreadPool.hpp"
+
+// 协程帧分配器：128B ~ 8KB 共 7 级，每级每线程最多缓存 MAX_CACHED_PER_CLASS 个空闲帧。
+// 帧在 A 线程分配、在 B 线程释放（协程换了线程恢复）时进入 B 的缓存，超出上限的还给全局堆
+class FramePool {
+public:
+    static constexpr size_t MIN_CLASS_BYTES = 128;
+    static constexpr size_t CLASS_COUNT = 7;
+    static constexpr size_t MAX_CLASS_BYTES = MIN_CLASS_BYTES << (CLASS_COUNT - 1);
+    static constexpr size_t MAX_CACHED_PER_CLASS = 1024;
+
+    static void* allocate(size_t size);
+    static void deallocate(void* frame, size_t size) noexcept;
+};
+
+namespace coro_detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    static void* operator new(size_t size) { return FramePool::allocate(size); }
+    static void operator delete(void* frame, size_t size) noexcept { FramePool::deallocate(frame, size); }
+
+    // 结束时直接转到等待者；没有等待者（被 spawn 的任务由包装协程等待，不会走到这里）时停在终点
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template<class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> self) noexcept {
+            std::coroutine_handle<> next = self.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template<class T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+    template<class U>
+    void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+    T take() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    void return_void() const noexcept {}
+    void take() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace coro_detail
+
+template<class T = void>
+class [[nodiscard]] Task {
+public:
+    struct promise_type : coro_detail::Promise<T> {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+    Task() = default;
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (m_handle) m_handle.destroy();
+    }
+
+    // co_await task：开始运行（惰性启动），完成后在完成它的线程上继续等待者
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiter) noexcept {
+                handle.promise().continuation = waiter;
+                return handle;
+            }
+            T await_resume() { return handle.promise().take(); }
+        };
+        return Awaiter{ m_handle };
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// ========================================================================================
+// 调度
+// ========================================================================================
+
+// 一次挂起的唤醒：多个来源（ACK、定时器、连接可读）调用 fire，第一个把协程投递到调度器，
+// 其余的什么也不做；reason 记下是哪个来源。由 shared_ptr 持有，来源各自保留一份引用
+class CoroutineScheduler;
+class Wakeup {
+public:
+    Wakeup(CoroutineScheduler& scheduler, std::coroutine_handle<> handle)
+        : m_scheduler(scheduler), m_handle(handle), m_fired(false), m_reason(0) {}
+
+    // 返回是否由本次调用恢复协程
+    bool fire(int reason);
+    int reason() const { return m_reason; }
+
+private:
+    CoroutineScheduler& m_scheduler;
+    std::coroutine_handle<> m_handle;
+    std::atomic<bool> m_fired;
+    int m_reason;                 // fire 成功者在投递前写入，协程恢复后读取
+};
+
+class CoroutineScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // 协程在 pool 的工作线程上恢复；pool 由调用方拥有，生命周期长于调度器
+    explicit CoroutineScheduler(ThreadPool& pool);
+    ~CoroutineScheduler();
+
+    // 在工作线程上恢复 handle
+    void post(std::coroutine_handle<> handle);
+    // 到 deadline 时在定时器线程上调用 callback（应当很短，通常是 Wakeup::fire）；
+    // 调度器已停止时在调用线程上立即调用
+    void at(Clock::time_point deadline, std::function<void()> callback);
+    // 停止定时器线程；未到期的回调立即执行，挂起在上面的协程按超时恢复，自行结束并释放帧
+    void stop();
+
+    ThreadPool& pool() { return m_pool; }
+
+    // co_await scheduler.schedule()：切到工作线程上继续（顶层协程从 reactor / 接收线程出发时用）
+    auto schedule() noexcept {
+        struct Awaiter {
+            CoroutineScheduler& scheduler;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { scheduler.post(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{ *this };
+    }
+
+    // co_await scheduler.sleepUntil(t) / sleepFor(d)：挂起到时间点，不占线程
+    auto sleepUntil(Clock::time_point deadline) {
+        struct Awaiter {
+            CoroutineScheduler& scheduler;
+            Clock::time_point deadline;
+            bool await_ready() const noexcept { return Clock::now() >= deadline; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                auto wakeup = std::make_shared<Wakeup>(scheduler, handle);
+                scheduler.at(deadline, [wakeup] { wakeup->fire(0); });
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{ *this, deadline };
+    }
+    template<class Rep, class Period>
+    auto sleepFor(std::chrono::duration<Rep, Period> delay) {
+        return sleepUntil(Clock::now() + std::chrono::duration_cast<Clock::duration>(delay));
+    }
+
+private:
+    CoroutineScheduler(const CoroutineScheduler&) = delete;
+    CoroutineScheduler& operator=(const CoroutineScheduler&) = delete;
+
+    struct TimerEntry {
+        Clock::time_point deadline;
+        uint64_t order;           // 同一时刻按登记顺序触发
+        std::function<void()> callback;
+        bool operator>(const TimerEntry& o) const {
+            return deadline != o.deadline ? deadline > o.deadline : order > o.order;
+        }
+    };
+
+    void timerLoop();
+
+    ThreadPool& m_pool;
+    std::mutex m_timerMutex;
+    std::condition_variable m_timerCv;
+    std::priority_queue<TimerEntry, std::vector<TimerEntry>, std::greater<TimerEntry>> m_timers;
+    uint64_t m_timerOrder;
+    bool m_stopping;
+    std::thread m_timerThread;
+};
+
+// 等待外部回调的通用等待器：arm(callback) 登记一个会在条件满足时被调用一次的回调，
+// 返回 false 表示条件已经满足、不必挂起。deadline 非空时同时登记超时；
+// co_await 的结果为 true 表示由回调唤醒，false 表示超时
+template<class Arm>
+class CallbackAwaiter {
+public:
+    CallbackAwaiter(CoroutineScheduler& scheduler, Arm arm,
+                    std::optional<CoroutineScheduler::Clock::time_point> deadline = std::nullopt)
+        : m_scheduler(scheduler), m_arm(std::move(arm)), m_deadline(deadline) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        // 回调登记之后可能马上在别的线程上恢复协程、销毁本对象，之后只用局部变量
+        CoroutineScheduler& scheduler = m_scheduler;
+        std::optional<CoroutineScheduler::Clock::time_point> deadline = m_deadline;
+        std::shared_ptr<Wakeup> wakeup = std::make_shared<Wakeup>(scheduler, handle);
+        m_wakeup = wakeup;
+        if (!m_arm([wakeup] { wakeup->fire(SIGNALED); })) {
+            m_wakeup.reset();
+            return false;
+        }
+        if (deadline) scheduler.at(*deadline, [wakeup] { wakeup->fire(TIMED_OUT); });
+        return true;
+    }
+    bool await_resume() const noexcept { return !m_wakeup || m_wakeup->reason() == SIGNALED; }
+
+private:
+    static constexpr int SIGNALED = 1;
+    static constexpr int TIMED_OUT = 2;
+
+    CoroutineScheduler& m_scheduler;
+    Arm m_arm;
+    std::optional<CoroutineScheduler::Clock::time_point> m_deadline;
+    std::shared_ptr<Wakeup> m_wakeup;
+};
+
+// ========================================================================================
+// 顶层协程
+// ========================================================================================
+
+namespace coro_detail {
+
+// spawn 的包装协程：立即开始，结束时自行销毁帧；被包装的任务抛出的异常在这里记录后丢弃
+struct DetachedTask {
+    struct promise_type {
+        static void* operator new(size_t size) { return FramePool::allocate(size); }
+        static void operator delete(void* frame, size_t size) noexcept { FramePool::deallocate(frame, size); }
+        DetachedTask get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept;
+    };
+};
+
+DetachedTask runDetached(Task<void> task);
+
+} // namespace coro_detail
+
+// 启动 task 并立即返回；task 在调用线程上运行到第一个挂起点（通常先 co_await scheduler.schedule()）
+inline void spawn(Task<void> task) {
+    coro_detail::runDetached(std::move(task));
+}
+
+#endif // CHAT_HAVE_COROUTINES
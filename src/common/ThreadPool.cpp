@@ -1,7 +1,35 @@
 #include "ThreadPool.hpp"
+#include "Metrics.hpp"
 #include <iostream>
 #include <chrono>
 
+namespace {
+
+// 线程池指标（进程内所有线程池汇总）
+struct PoolMetrics {
+    Counter& submitted;
+    Counter& completed;
+    Counter& failed;
+    Gauge& queueDepth;
+    Gauge& activeTasks;
+    Histogram& taskSeconds;
+};
+
+PoolMetrics& poolMetrics() {
+    MetricsRegistry& r = MetricsRegistry::instance();
+    static PoolMetrics metrics{
+        r.counter("chat_threadpool_tasks_submitted_total", "Tasks queued to thread pools"),
+        r.counter("chat_threadpool_tasks_completed_total", "Tasks that finished executing"),
+        r.counter("chat_threadpool_tasks_failed_total", "Tasks whose execute() threw"),
+        r.gauge("chat_threadpool_queue_depth", "Tasks waiting in thread pool queues"),
+        r.gauge("chat_threadpool_active_tasks", "Tasks currently executing"),
+        r.histogram("chat_threadpool_task_seconds", "Task execution time"),
+    };
+    return metrics;
+}
+
+} // namespace
+
 /**
  * ===============================================================================
  * ThreadPool 构造函数 - std::thread实现
@@ -78,9 +106,11 @@ void ThreadPool::submit(std::shared_ptr<TaskBase> task) {
         std::unique_lock<std::mutex> lock(queue_mutex_);
         task_queue_.push(task);
     }
+    poolMetrics().submitted.inc();
+    poolMetrics().queueDepth.inc();
 
+    // 协程恢复也走这里，热路径上不打日志
     condition_.notify_one();
-    std::cout << "[ThreadPool] Task submitted - Queue size: " << getQueuedTasks() << std::endl;
 }
 
 /**
@@ -112,6 +142,8 @@ void ThreadPool::submitBatch(const std::vector<std::shared_ptr<TaskBase>>& tasks
             task_queue_.push(task);
         }
     }
+    poolMetrics().submitted.inc(tasks.size());
+    poolMetrics().queueDepth.add(static_cast<int64_t>(tasks.size()));
 
     condition_.notify_all();
     std::cout << "[ThreadPool] Batch submitted - " << tasks.size() << " tasks" << std::endl;
@@ -185,20 +217,28 @@ void ThreadPool::workerLoop() {
         }
 
         if (task) {
+            PoolMetrics& metrics = poolMetrics();
+            metrics.queueDepth.dec();
+            metrics.activeTasks.inc();
+
             // 执行任务
             auto start_time = std::chrono::steady_clock::now();
 
             try {
                 task->execute();
                 completed_tasks_++;
+                metrics.completed.inc();
             } catch (...) {
                 failed_tasks_++;
+                metrics.failed.inc();
                 std::cout << "[ThreadPool] Task execution failed" << std::endl;
             }
 
             auto end_time = std::chrono::steady_clock::now();
             total_execution_time_ += end_time - start_time;
+            metrics.taskSeconds.observe(std::chrono::duration<double>(end_time - start_time).count());
 
+            metrics.activeTasks.dec();
             active_tasks_--;
         }
     }
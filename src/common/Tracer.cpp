@@ -0,0 +1,210 @@
+#include "Tracer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+std::atomic<uint32_t> Tracer::s_sampleEvery{0};
+
+namespace {
+
+struct TraceEvent {
+    uint64_t startNs;
+    uint64_t durationNs;
+    const char* stage;      // 埋点处的字符串字面量
+    uint32_t idLength;
+    char id[40];
+};
+
+// 每个线程一个环形缓冲；写入方只有所属线程，锁只会和 dump 争用
+struct ThreadRing {
+    std::mutex mutex;
+    TraceEvent events[Tracer::RING_CAPACITY];
+    uint64_t written = 0;
+    uint32_t tid = 0;
+    bool inUse = false;
+};
+
+// 缓冲在线程退出后保留（事件仍可导出），新线程优先复用空闲缓冲，
+// 每连接一线程的模型下缓冲总数约等于同时存活的线程数
+struct RingRegistry {
+    std::mutex mutex;
+    std::vector<ThreadRing*> rings;
+};
+
+RingRegistry& registry() {
+    static RingRegistry* instance = new RingRegistry();
+    return *instance;
+}
+
+ThreadRing* acquireRing() {
+    RingRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (ThreadRing* ring : reg.rings) {
+        if (!ring->inUse) {
+            ring->inUse = true;
+            return ring;
+        }
+    }
+    ThreadRing* ring = new ThreadRing();
+    ring->tid = static_cast<uint32_t>(reg.rings.size() + 1);
+    ring->inUse = true;
+    reg.rings.push_back(ring);
+    return ring;
+}
+
+// 线程第一次记录事件时才分配缓冲，线程退出时归还
+struct RingOwner {
+    ThreadRing* ring = nullptr;
+    ~RingOwner() {
+        if (!ring) return;
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        ring->inUse = false;
+    }
+};
+
+ThreadRing& currentRing() {
+    thread_local RingOwner owner;
+    if (!owner.ring) owner.ring = acquireRing();
+    return *owner.ring;
+}
+
+void appendJsonString(std::string& out, const char* data, size_t len) {
+    out += '"';
+    for (size_t i = 0; i < len; ++i) {
+        char c = data[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void appendMicros(std::string& out, uint64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%llu.%03llu",
+                  static_cast<unsigned long long>(ns / 1000), static_cast<unsigned long long>(ns % 1000));
+    out += buf;
+}
+
+} // namespace
+
+bool Tracer::sampled(std::string_view messageId) noexcept {
+    uint32_t every = sampleRate();
+    if (every <= 1) return every == 1;
+    // FNV-1a 后再混合一次，避免递增的ID尾数让采样扎堆
+    uint64_t h = 1469598103934665603ull;
+    for (char c : messageId) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h % every == 0;
+}
+
+uint64_t Tracer::nowNs() noexcept {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Tracer::record(const char* stage, std::string_view messageId, uint64_t startNs, uint64_t endNs) noexcept {
+    ThreadRing& ring = currentRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    TraceEvent& ev = ring.events[ring.written % RING_CAPACITY];
+    ev.startNs = startNs;
+    ev.durationNs = endNs > startNs ? endNs - startNs : 0;
+    ev.stage = stage;
+    ev.idLength = static_cast<uint32_t>(std::min(messageId.size(), sizeof(ev.id)));
+    messageId.copy(ev.id, ev.idLength);
+    ++ring.written;
+}
+
+void Tracer::markSlow(const char* stage, std::string_view messageId) noexcept {
+    if (!sampled(messageId)) return;
+    uint64_t now = nowNs();
+    record(stage, messageId, now, now);
+}
+
+std::string Tracer::dumpChromeTrace() {
+    struct Collected {
+        uint32_t tid;
+        TraceEvent event;
+    };
+    std::vector<Collected> collected;
+    std::vector<uint32_t> tids;
+    {
+        RingRegistry& reg = registry();
+        std::lock_guard<std::mutex> regLock(reg.mutex);
+        for (ThreadRing* ring : reg.rings) {
+            std::lock_guard<std::mutex> lock(ring->mutex);
+            uint64_t count = std::min<uint64_t>(ring->written, RING_CAPACITY);
+            if (count == 0) continue;
+            tids.push_back(ring->tid);
+            for (uint64_t i = ring->written - count; i < ring->written; ++i) {
+                collected.push_back(Collected{ ring->tid, ring->events[i % RING_CAPACITY] });
+            }
+        }
+    }
+    std::sort(collected.begin(), collected.end(), [](const Collected& a, const Collected& b) {
+        return a.event.startNs < b.event.startNs;
+    });
+    uint64_t base = collected.empty() ? 0 : collected.front().event.startNs;
+
+    std::string out;
+    out.reserve(collected.size() * 128 + 256);
+    out += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (uint32_t tid : tids) {
+        if (!first) out += ',';
+        first = false;
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(tid) +
+               ",\"args\":{\"name\":\"thread-" + std::to_string(tid) + "\"}}";
+    }
+    for (const auto& item : collected) {
+        const TraceEvent& ev = item.event;
+        if (!first) out += ',';
+        first = false;
+        out += "{\"name\":";
+        appendJsonString(out, ev.stage, std::char_traits<char>::length(ev.stage));
+        out += ",\"cat\":\"message\",\"pid\":1,\"tid\":" + std::to_string(item.tid) + ",\"ts\":";
+        appendMicros(out, ev.startNs - base);
+        if (ev.durationNs > 0) {
+            out += ",\"ph\":\"X\",\"dur\":";
+            appendMicros(out, ev.durationNs);
+        } else {
+            out += ",\"ph\":\"i\",\"s\":\"t\"";
+        }
+        out += ",\"args\":{\"messageId\":";
+        appendJsonString(out, ev.id, ev.idLength);
+        out += "}}";
+    }
+    out += "]}\n";
+    return out;
+}
+
+bool Tracer::dumpChromeTrace(const std::string& path) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+    file << dumpChromeTrace();
+    return static_cast<bool>(file);
+}
+
+void Tracer::clear() {
+    RingRegistry& reg = registry();
+    std::lock_guard<std::mutex> regLock(reg.mutex);
+    for (ThreadRing* ring : reg.rings) {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        ring->written = 0;
+    }
+}
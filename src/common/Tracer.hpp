@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// ========================================================================================
+// Tracer - 按消息ID采样的生命周期追踪，导出 Chrome trace / Perfetto JSON
+// ========================================================================================
+// 一条消息在 decode / route / write / ack_wait / offline_enqueue 等阶段各记一个时间段，
+// 写入当前线程自己的环形缓冲（满了覆盖最旧的），dump 时合并所有线程导出。
+// - 采样率为 0 时关闭：每个埋点只有一次原子读 + 一个几乎总是不跳转的分支
+// - 采样按消息ID哈希决定，同一条消息在收发、ACK 等不同线程上的判定一致，
+//   因此一条被采样的消息能看到完整的跨线程时间线
+// - 时间取 steady_clock（纳秒），不同线程的时间戳可直接比较
+// ========================================================================================
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define TRACE_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#  define TRACE_UNLIKELY(x) (x)
+#endif
+
+class Tracer {
+public:
+    // everyN: 0 关闭；1 追踪全部消息；N 约每 N 条消息追踪一条
+    static void setSampleRate(uint32_t everyN) noexcept { s_sampleEvery.store(everyN, std::memory_order_relaxed); }
+    static uint32_t sampleRate() noexcept { return s_sampleEvery.load(std::memory_order_relaxed); }
+    static bool enabled() noexcept { return s_sampleEvery.load(std::memory_order_relaxed) != 0; }
+
+    // 该消息是否被采样（调用前应已判断 enabled()）
+    static bool sampled(std::string_view messageId) noexcept;
+
+    static uint64_t nowNs() noexcept;
+
+    // 记录一个阶段：[startNs, endNs]；endNs == startNs 时导出为瞬时事件
+    static void record(const char* stage, std::string_view messageId, uint64_t startNs, uint64_t endNs) noexcept;
+
+    // 瞬时事件埋点（如收到 ACK）
+    static void mark(const char* stage, std::string_view messageId) noexcept {
+        if (TRACE_UNLIKELY(enabled())) markSlow(stage, messageId);
+    }
+
+    // 导出所有线程缓冲中的事件（Chrome trace event 格式，可直接拖进 Perfetto / chrome://tracing）
+    static std::string dumpChromeTrace();
+    static bool dumpChromeTrace(const std::string& path);
+    static void clear();
+
+    // 每个线程环形缓冲的事件数
+    static constexpr size_t RING_CAPACITY = 2048;
+
+private:
+    static void markSlow(const char* stage, std::string_view messageId) noexcept;
+
+    static std::atomic<uint32_t> s_sampleEvery;
+};
+
+// 作用域时间段：构造时开始计时，析构（或 finish）时若消息被采样则写入缓冲。
+// 消息ID可以在构造时给出，也可以在解析出来之后用 bind() 补上；没有ID的时间段丢弃。
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* stage) noexcept {
+        if (TRACE_UNLIKELY(Tracer::enabled())) {
+            m_stage = stage;
+            m_start = Tracer::nowNs();
+        }
+    }
+    // 已知消息ID：先判定采样，未命中的消息不读时钟
+    TraceSpan(const char* stage, std::string_view messageId) noexcept {
+        if (TRACE_UNLIKELY(Tracer::enabled()) && Tracer::sampled(messageId)) {
+            m_stage = stage;
+            bind(messageId);
+            m_start = Tracer::nowNs();
+        }
+    }
+    ~TraceSpan() {
+        if (m_stage) finish();
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    // 追踪开启时才为 true；需要额外计算消息ID时先判断它
+    bool active() const noexcept { return m_stage != nullptr; }
+
+    // 绑定消息ID；未被采样的消息在这里放弃记录
+    void bind(std::string_view messageId) noexcept {
+        if (!m_stage) return;
+        if (messageId.empty() || !Tracer::sampled(messageId)) {
+            m_stage = nullptr;
+            return;
+        }
+        m_idLength = messageId.size() < sizeof(m_id) ? messageId.size() : sizeof(m_id);
+        messageId.copy(m_id, m_idLength);
+    }
+
+    // 提前结束时间段（之后析构不再记录）
+    void finish() noexcept {
+        if (!m_stage) return;
+        if (m_idLength > 0) Tracer::record(m_stage, std::string_view(m_id, m_idLength), m_start, Tracer::nowNs());
+        m_stage = nullptr;
+    }
+
+private:
+    const char* m_stage = nullptr;
+    uint64_t m_start = 0;
+    size_t m_idLength = 0;
+    char m_id[40];
+};
@@ -0,0 +1,185 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// ========================================================================================
+// FlatSet - 基于有序连续内存的集合（替代 node-based 的 std::unordered_set）
+// ========================================================================================
+// - 元素按 Compare 有序存放在一段连续内存中，遍历（群消息扇出）是线性扫描
+// - 前 N 个元素存放在对象内部（small-size inline），小好友列表/小群不触发堆分配
+// - 对外保留 insert/erase/count/find/size/empty/begin/end，调用方无需改动
+// - std::string 自带 SSO，短用户ID直接内联在数组元素中，扫描时不再追指针
+// ========================================================================================
+
+template<class T, std::size_t N = 4, class Compare = std::less<T>>
+class FlatSet {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using const_iterator = const T*;
+    using iterator = const_iterator;  // 元素有序，不允许通过迭代器修改
+
+    FlatSet() = default;
+    FlatSet(std::initializer_list<T> init) {
+        for (const auto& v : init) insert(v);
+    }
+
+    FlatSet(const FlatSet& other) { copyFrom(other); }
+    FlatSet(FlatSet&& other) noexcept(std::is_nothrow_move_constructible<T>::value) { moveFrom(other); }
+
+    FlatSet& operator=(const FlatSet& other) {
+        if (this != &other) {
+            clear();
+            copyFrom(other);
+        }
+        return *this;
+    }
+    FlatSet& operator=(FlatSet&& other) noexcept(std::is_nothrow_move_constructible<T>::value) {
+        if (this != &other) {
+            clear();
+            releaseHeap();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~FlatSet() {
+        clear();
+        releaseHeap();
+    }
+
+    // ===== 查询 =====
+    size_type size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    size_type capacity() const { return m_capacity; }
+    bool isInline() const { return m_data == inlineData(); }
+
+    const_iterator begin() const { return m_data; }
+    const_iterator end() const { return m_data + m_size; }
+    const T* data() const { return m_data; }
+    const T& operator[](size_type i) const { return m_data[i]; }
+
+    const_iterator find(const T& value) const {
+        const_iterator it = lowerBound(value);
+        return (it != end() && !m_comp(value, *it)) ? it : end();
+    }
+    size_type count(const T& value) const { return find(value) != end() ? 1 : 0; }
+    bool contains(const T& value) const { return find(value) != end(); }
+
+    // ===== 修改 =====
+    std::pair<const_iterator, bool> insert(const T& value) { return emplaceSorted(value); }
+    std::pair<const_iterator, bool> insert(T&& value) { return emplaceSorted(std::move(value)); }
+
+    size_type erase(const T& value) {
+        const_iterator it = find(value);
+        if (it == end()) return 0;
+        eraseAt(static_cast<size_type>(it - begin()));
+        return 1;
+    }
+
+    void clear() {
+        for (size_type i = 0; i < m_size; ++i) m_data[i].~T();
+        m_size = 0;
+    }
+
+    void reserve(size_type n) {
+        if (n > m_capacity) grow(n);
+    }
+
+    bool operator==(const FlatSet& other) const {
+        return m_size == other.m_size && std::equal(begin(), end(), other.begin());
+    }
+    bool operator!=(const FlatSet& other) const { return !(*this == other); }
+
+private:
+    T* inlineData() { return reinterpret_cast<T*>(m_inline); }
+    const T* inlineData() const { return reinterpret_cast<const T*>(m_inline); }
+
+    const_iterator lowerBound(const T& value) const {
+        return std::lower_bound(begin(), end(), value, m_comp);
+    }
+
+    template<class V>
+    std::pair<const_iterator, bool> emplaceSorted(V&& value) {
+        size_type pos = static_cast<size_type>(lowerBound(value) - begin());
+        if (pos < m_size && !m_comp(value, m_data[pos])) {
+            return {m_data + pos, false};
+        }
+        if (m_size == m_capacity) grow(m_capacity * 2);
+
+        // 尾部先构造一个空位，再把 [pos, size) 整体后移一格
+        if (pos == m_size) {
+            new (m_data + m_size) T(std::forward<V>(value));
+        } else {
+            new (m_data + m_size) T(std::move(m_data[m_size - 1]));
+            std::move_backward(m_data + pos, m_data + m_size - 1, m_data + m_size);
+            m_data[pos] = T(std::forward<V>(value));
+        }
+        ++m_size;
+        return {m_data + pos, true};
+    }
+
+    void eraseAt(size_type pos) {
+        std::move(m_data + pos + 1, m_data + m_size, m_data + pos);
+        m_data[--m_size].~T();
+    }
+
+    void grow(size_type newCap) {
+        if (newCap < N) newCap = N;
+        T* newData = static_cast<T*>(::operator new(newCap * sizeof(T)));
+        for (size_type i = 0; i < m_size; ++i) {
+            new (newData + i) T(std::move(m_data[i]));
+            m_data[i].~T();
+        }
+        releaseHeap();
+        m_data = newData;
+        m_capacity = newCap;
+    }
+
+    void releaseHeap() {
+        if (!isInline()) {
+            ::operator delete(m_data);
+            m_data = inlineData();
+            m_capacity = N;
+        }
+    }
+
+    void copyFrom(const FlatSet& other) {
+        reserve(other.m_size);
+        for (size_type i = 0; i < other.m_size; ++i) new (m_data + i) T(other.m_data[i]);
+        m_size = other.m_size;
+    }
+
+    void moveFrom(FlatSet& other) {
+        if (other.isInline()) {
+            for (size_type i = 0; i < other.m_size; ++i) new (m_data + i) T(std::move(other.m_data[i]));
+            m_size = other.m_size;
+            other.clear();
+        } else {
+            // 堆上存储直接接管指针
+            m_data = other.m_data;
+            m_size = other.m_size;
+            m_capacity = other.m_capacity;
+            other.m_data = other.inlineData();
+            other.m_size = 0;
+            other.m_capacity = N;
+        }
+    }
+
+    static_assert(N > 0, "FlatSet inline capacity must be positive");
+
+    alignas(T) unsigned char m_inline[N * sizeof(T)];
+    T* m_data = inlineData();
+    size_type m_size = 0;
+    size_type m_capacity = N;
+    Compare m_comp{};
+};
+
+// 用户ID / 群号集合的默认类型
+using IdSet = FlatSet<std::string>;
@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
-#include <unordered_set>
+#include "FlatSet.hpp"
+#include "../common/IdInterner.hpp"
+#include "../common/RoaringBitmap.hpp"
 #include <unordered_map>
 
 enum class GroupType { QQ, WeChat };
@@ -18,13 +20,29 @@ public:
 
     void addAdmin(const std::string& uid) { m_adminIds.insert(uid); }
     void removeAdmin(const std::string& uid) { m_adminIds.erase(uid); }
-    const std::unordered_set<std::string>& admins() const { return m_adminIds; }
+    const IdSet& admins() const { return m_adminIds; }
 
     bool addMember(const std::string& uid) {
-        return m_memberIds.insert(uid).second;
+        bool added = m_memberIds.insert(uid).second;
+        if (added && m_handles) m_memberBitmap.add(m_handles->intern(uid));
+        return added;
     }
-    void removeMember(const std::string& uid) { m_memberIds.erase(uid); }
-    const std::unordered_set<std::string>& members() const { return m_memberIds; }
+    void removeMember(const std::string& uid) {
+        if (m_memberIds.erase(uid) && m_handles) m_memberBitmap.remove(m_handles->lookup(uid));
+    }
+    const IdSet& members() const { return m_memberIds; }
+
+    // ===== 可选的位图成员索引（大群使用）=====
+    // 开启后成员同时以用户句柄存入压缩位图，"在线成员" / "成员 − 禁言" 等
+    // 集合代数直接做位图 AND / ANDNOT；handles 由 Platform 持有，生命周期长于群
+    void enableMemberBitmap(IdInterner* handles) {
+        m_handles = handles;
+        m_memberBitmap.clear();
+        if (!m_handles) return;
+        for (const auto& uid : m_memberIds) m_memberBitmap.add(m_handles->intern(uid));
+    }
+    bool hasMemberBitmap() const { return m_handles != nullptr; }
+    const RoaringBitmap& memberBitmap() const { return m_memberBitmap; }
 
     // ===== 群管理特色策略 =====
     // QQ：可申请加入；WeChat：仅邀请加入
@@ -38,6 +56,8 @@ private:
     std::string m_groupNo;           // 1001/1002/...
     GroupType m_type{GroupType::QQ};
     std::string m_ownerId;
-    std::unordered_set<std::string> m_adminIds;
-    std::unordered_set<std::string> m_memberIds;
+    IdSet m_adminIds;
+    IdSet m_memberIds;               // 群消息扇出时线性扫描的连续内存
+    IdInterner* m_handles = nullptr; // 非空表示开启位图索引
+    RoaringBitmap m_memberBitmap;
 };
@@ -2,7 +2,7 @@
 
 #include <string>
 #include <chrono>
-#include <ctime>
+#include "../common/CoarseClock.hpp"
 
 struct Message {
     std::string fromId;    // 发送者ID
@@ -15,12 +15,8 @@ struct Message {
         timestamp = std::chrono::system_clock::now();
     }
 
-    // 获取格式化的时间字符串
+    // 获取格式化的时间字符串（与粗粒度时钟缓存同一秒时直接复制缓存文本）
     std::string getFormattedTime() const {
-        auto t = std::chrono::system_clock::to_time_t(timestamp);
-        std::tm tm = *std::localtime(&t);
-        char buffer[20];
-        std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
-        return std::string(buffer);
+        return CoarseClock::toString(timestamp);
     }
 };
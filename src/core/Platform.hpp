@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <iterator>
 #include <unordered_map>
 #include <memory>
 #include <set>
@@ -6,6 +8,7 @@
 #include <functional>
 #include "User.hpp"
 #include "Group.hpp"
+#include "SocialIndex.hpp"
 #include "../common/Service.h"
 #include "../common/Repository.hpp"
 
@@ -45,10 +48,105 @@ public:
         if(it1==users.end()||it2==users.end()) return res;
         const auto& A = it1->second.friends();
         const auto& B = it2->second.friends();
-        for(const auto& x: A) if(B.count(x)) res.push_back(x);
+        // 两个好友集合都是有序连续存储，直接线性归并求交
+        std::set_intersection(A.begin(), A.end(), B.begin(), B.end(), std::back_inserter(res));
         return res;
     }
 
+    // ===== 用户句柄 =====
+    // 全平台共享的 用户ID -> 整数句柄 映射，供社交索引、群成员位图、在线位图使用
+    IdInterner userHandles;
+
+    // 为成员数不少于 minMembers 的群开启位图成员索引
+    void enableGroupBitmaps(size_t minMembers = 0) {
+        for (auto& kv : groups) {
+            if (kv.second.members().size() >= minMembers) kv.second.enableMemberBitmap(&userHandles);
+        }
+    }
+
+    // ===== 社交关系索引（批量推荐查询）=====
+    // load() 之后自动构建；经下面的关系变更接口修改时同步维护。
+    // 直接改动 users/groups 后需调用 rebuildSocialIndex()，之后的查询都走整数句柄 + SIMD 求交
+    SocialIndex socialIndex;
+
+    void rebuildSocialIndex() { socialIndex.build(users, groups, userHandles); }
+
+    // ===== 关系变更（同时更新 User/Group 与社交索引）=====
+    // 好友关系是双向的；任一用户不存在时返回 false
+    bool addFriendship(const std::string& u1, const std::string& u2) {
+        auto it1 = users.find(u1), it2 = users.find(u2);
+        if (it1 == users.end() || it2 == users.end() || u1 == u2) return false;
+        it1->second.addFriend(u2);
+        it2->second.addFriend(u1);
+        if (!socialIndex.built()) { rebuildSocialIndex(); return true; }
+        uint32_t h1 = userHandles.intern(u1), h2 = userHandles.intern(u2);
+        socialIndex.addFriend(h1, h2);
+        socialIndex.addFriend(h2, h1);
+        return true;
+    }
+
+    void removeFriendship(const std::string& u1, const std::string& u2) {
+        auto it1 = users.find(u1), it2 = users.find(u2);
+        if (it1 != users.end()) it1->second.removeFriend(u2);
+        if (it2 != users.end()) it2->second.removeFriend(u1);
+        if (!socialIndex.built()) return;
+        uint32_t h1 = userHandles.lookup(u1), h2 = userHandles.lookup(u2);
+        if (h1 == IdInterner::INVALID_HANDLE || h2 == IdInterner::INVALID_HANDLE) return;
+        socialIndex.removeFriend(h1, h2);
+        socialIndex.removeFriend(h2, h1);
+    }
+
+    // 群不存在时返回 false；用户存在时同步记入其群列表
+    bool addGroupMember(const std::string& groupId, const std::string& userId) {
+        auto group = groups.find(groupId);
+        if (group == groups.end()) return false;
+        group->second.addMember(userId);
+        auto user = users.find(userId);
+        if (user != users.end()) user->second.joinGroup(groupId);
+        if (!socialIndex.built()) { rebuildSocialIndex(); return true; }
+        socialIndex.addGroupMember(groupId, userHandles.intern(userId));
+        return true;
+    }
+
+    void removeGroupMember(const std::string& groupId, const std::string& userId) {
+        auto group = groups.find(groupId);
+        if (group != groups.end()) group->second.removeMember(userId);
+        auto user = users.find(userId);
+        if (user != users.end()) user->second.leaveGroup(groupId);
+        uint32_t h = userHandles.lookup(userId);
+        if (socialIndex.built() && h != IdInterner::INVALID_HANDLE) socialIndex.removeGroupMember(groupId, h);
+    }
+
+    size_t mutualFriendCount(const std::string& u1, const std::string& u2) const {
+        auto h1 = socialIndex.handleOf(u1), h2 = socialIndex.handleOf(u2);
+        if (h1 == IdInterner::INVALID_HANDLE || h2 == IdInterner::INVALID_HANDLE) return 0;
+        return socialIndex.mutualFriendCount(h1, h2);
+    }
+
+    // 批量共同好友数，结果与 pairs 一一对应
+    std::vector<size_t> mutualFriendCounts(const std::vector<std::pair<std::string, std::string>>& pairs) const {
+        std::vector<size_t> res;
+        res.reserve(pairs.size());
+        for (const auto& p : pairs) res.push_back(mutualFriendCount(p.first, p.second));
+        return res;
+    }
+
+    // 可能认识的人：好友的好友按共同好友数取前 k 个
+    std::vector<std::pair<std::string, size_t>> peopleYouMayKnow(const std::string& userId, size_t k) const {
+        std::vector<std::pair<std::string, size_t>> res;
+        auto h = socialIndex.handleOf(userId);
+        if (h == IdInterner::INVALID_HANDLE) return res;
+        for (const auto& item : socialIndex.friendOfFriendTopK(h, k)) {
+            res.emplace_back(socialIndex.userIdOf(item.first), item.second);
+        }
+        return res;
+    }
+
+    // 两个群的共同成员数
+    size_t groupOverlap(const std::string& g1, const std::string& g2) const {
+        return socialIndex.groupOverlap(g1, g2);
+    }
+
     // 查找服务
     Service* getService(const std::string& serviceName, const std::string& userId) {
         std::string k = key(serviceName, userId);
@@ -59,7 +157,9 @@ public:
 
     // 文件 I/O
     bool load(const std::string& userPath, const std::string& groupPath) {
-        return Repository::loadUsers(userPath, users) && Repository::loadGroups(groupPath, groups);
+        bool ok = Repository::loadUsers(userPath, users) && Repository::loadGroups(groupPath, groups);
+        rebuildSocialIndex();
+        return ok;
     }
     bool save(const std::string& userPath, const std::string& groupPath) {
         return Repository::saveUsers(userPath, users) && Repository::saveGroups(groupPath, groups);
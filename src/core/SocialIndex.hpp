@@ -0,0 +1,194 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "User.hpp"
+#include "Group.hpp"
+#include "../common/IdInterner.hpp"
+#include "../common/SetIntersect.hpp"
+
+// ========================================================================================
+// SocialIndex - 好友关系/群成员的整数索引（只读快照）
+// ========================================================================================
+// 从 Platform 的 users/groups 构建：每个用户的好友列表、每个群的成员列表都转换为
+// 有序的 uint32 句柄数组，交给 SetIntersect 做 SIMD 求交。
+// 句柄来自 Platform 共享的 IdInterner，重建索引不会改变已有句柄。
+// build() 之后的单条关系变更用 addFriend / removeFriend / addGroupMember / removeGroupMember
+// 原地维护（有序插入/删除）；批量改动 users/groups 后重新 build()。
+// ========================================================================================
+
+class SocialIndex {
+public:
+    using Handle = uint32_t;
+    using IdList = std::vector<Handle>;
+
+    void build(const std::unordered_map<std::string, User>& users,
+               const std::unordered_map<std::string, Group>& groups,
+               IdInterner& handles) {
+        m_handles = &handles;
+        m_friends.clear();
+        m_groupSlots.clear();
+        m_groupMembers.clear();
+
+        // 先为所有用户分配句柄，保证好友列表里的句柄有效
+        for (const auto& kv : users) handles.intern(kv.first);
+        for (const auto& kv : users) {
+            for (const auto& fid : kv.second.friends()) handles.intern(fid);
+        }
+        for (const auto& kv : groups) {
+            for (const auto& uid : kv.second.members()) handles.intern(uid);
+        }
+
+        m_friends.resize(handles.size());
+        for (const auto& kv : users) {
+            IdList& list = m_friends[handles.lookup(kv.first)];
+            list.reserve(kv.second.friends().size());
+            for (const auto& fid : kv.second.friends()) list.push_back(handles.lookup(fid));
+            std::sort(list.begin(), list.end());
+        }
+
+        m_groupMembers.reserve(groups.size());
+        for (const auto& kv : groups) {
+            m_groupSlots[kv.first] = m_groupMembers.size();
+            IdList list;
+            list.reserve(kv.second.members().size());
+            for (const auto& uid : kv.second.members()) list.push_back(handles.lookup(uid));
+            std::sort(list.begin(), list.end());
+            m_groupMembers.push_back(std::move(list));
+        }
+    }
+
+    bool built() const { return m_handles != nullptr; }
+
+    // ===== 增量维护（build() 之后调用）=====
+    void addFriend(Handle user, Handle friendHandle) {
+        IdList& list = slotOf(user);
+        auto pos = std::lower_bound(list.begin(), list.end(), friendHandle);
+        if (pos == list.end() || *pos != friendHandle) list.insert(pos, friendHandle);
+        if (friendHandle >= m_friends.size()) m_friends.resize(friendHandle + 1);
+    }
+    void removeFriend(Handle user, Handle friendHandle) {
+        if (user >= m_friends.size()) return;
+        IdList& list = m_friends[user];
+        auto pos = std::lower_bound(list.begin(), list.end(), friendHandle);
+        if (pos != list.end() && *pos == friendHandle) list.erase(pos);
+    }
+    void addGroupMember(const std::string& groupId, Handle user) {
+        auto slot = m_groupSlots.find(groupId);
+        if (slot == m_groupSlots.end()) {
+            slot = m_groupSlots.emplace(groupId, m_groupMembers.size()).first;
+            m_groupMembers.emplace_back();
+        }
+        IdList& list = m_groupMembers[slot->second];
+        auto pos = std::lower_bound(list.begin(), list.end(), user);
+        if (pos == list.end() || *pos != user) list.insert(pos, user);
+        if (user >= m_friends.size()) m_friends.resize(user + 1);
+    }
+    void removeGroupMember(const std::string& groupId, Handle user) {
+        auto slot = m_groupSlots.find(groupId);
+        if (slot == m_groupSlots.end()) return;
+        IdList& list = m_groupMembers[slot->second];
+        auto pos = std::lower_bound(list.begin(), list.end(), user);
+        if (pos != list.end() && *pos == user) list.erase(pos);
+    }
+
+    // 在 build() 之前调用 handleOf 返回 INVALID_HANDLE
+    Handle handleOf(const std::string& userId) const {
+        return m_handles ? m_handles->lookup(userId) : IdInterner::INVALID_HANDLE;
+    }
+    const std::string& userIdOf(Handle h) const { return m_handles->name(h); }
+
+    const IdList& friendsOf(Handle h) const {
+        return h < m_friends.size() ? m_friends[h] : m_empty;
+    }
+    const IdList& membersOf(const std::string& groupId) const {
+        auto it = m_groupSlots.find(groupId);
+        return it == m_groupSlots.end() ? m_empty : m_groupMembers[it->second];
+    }
+
+    // ===== 单次查询 =====
+    size_t mutualFriendCount(Handle u1, Handle u2) const {
+        return SetIntersect::count(friendsOf(u1), friendsOf(u2));
+    }
+
+    IdList mutualFriends(Handle u1, Handle u2) const {
+        return SetIntersect::intersect(friendsOf(u1), friendsOf(u2));
+    }
+
+    size_t groupOverlap(const std::string& g1, const std::string& g2) const {
+        return SetIntersect::count(membersOf(g1), membersOf(g2));
+    }
+
+    // ===== 批量查询 =====
+    // 一次计算多对用户的共同好友数，结果与 pairs 一一对应
+    std::vector<size_t> mutualFriendCounts(const std::vector<std::pair<Handle, Handle>>& pairs) const {
+        std::vector<size_t> result;
+        result.reserve(pairs.size());
+        for (const auto& p : pairs) result.push_back(mutualFriendCount(p.first, p.second));
+        return result;
+    }
+
+    // 用户与若干群的成员重叠度（群推荐：好友在群里的人数）
+    std::vector<size_t> friendsInGroups(Handle user, const std::vector<std::string>& groupIds) const {
+        std::vector<size_t> result;
+        result.reserve(groupIds.size());
+        const IdList& mine = friendsOf(user);
+        for (const auto& gid : groupIds) result.push_back(SetIntersect::count(mine, membersOf(gid)));
+        return result;
+    }
+
+    // 好友的好友 Top-K（"可能认识的人"）：候选人按与 user 的共同好友数降序，
+    // 数量相同时按句柄升序，结果不含 user 本人和已有好友
+    std::vector<std::pair<Handle, size_t>> friendOfFriendTopK(Handle user, size_t k) const {
+        std::vector<std::pair<Handle, size_t>> ranked;
+        if (k == 0 || user >= m_friends.size()) return ranked;
+
+        const IdList& mine = m_friends[user];
+        std::vector<uint8_t> seen(m_friends.size(), 0);
+        seen[user] = 1;
+        for (Handle f : mine) seen[f] = 1;
+
+        // 先收集候选人，再逐个用 SIMD 求交打分
+        IdList candidates;
+        for (Handle f : mine) {
+            for (Handle c : friendsOf(f)) {
+                if (!seen[c]) {
+                    seen[c] = 1;
+                    candidates.push_back(c);
+                }
+            }
+        }
+
+        ranked.reserve(candidates.size());
+        for (Handle c : candidates) {
+            size_t score = SetIntersect::count(mine, friendsOf(c));
+            if (score > 0) ranked.emplace_back(c, score);
+        }
+
+        auto better = [](const std::pair<Handle, size_t>& x, const std::pair<Handle, size_t>& y) {
+            return x.second != y.second ? x.second > y.second : x.first < y.first;
+        };
+        if (ranked.size() > k) {
+            std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(k), ranked.end(), better);
+            ranked.resize(k);
+        } else {
+            std::sort(ranked.begin(), ranked.end(), better);
+        }
+        return ranked;
+    }
+
+private:
+    IdList& slotOf(Handle h) {
+        if (h >= m_friends.size()) m_friends.resize(h + 1);
+        return m_friends[h];
+    }
+
+    IdInterner* m_handles = nullptr;
+    std::vector<IdList> m_friends;                       // handle -> 有序好友句柄
+    std::unordered_map<std::string, size_t> m_groupSlots; // groupNo -> m_groupMembers 下标
+    std::vector<IdList> m_groupMembers;
+    IdList m_empty;
+};
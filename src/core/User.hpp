@@ -1,6 +1,6 @@
 #pragma once
 #include <string>
-#include <unordered_set>
+#include "FlatSet.hpp"
 
 struct Birthday {
     int year{}, month{}, day{};
@@ -23,17 +23,17 @@ public:
 
     void addFriend(const std::string& uid) { m_friendIds.insert(uid); }
     void removeFriend(const std::string& uid) { m_friendIds.erase(uid); }
-    const std::unordered_set<std::string>& friends() const { return m_friendIds; }
+    const IdSet& friends() const { return m_friendIds; }
 
     void joinGroup(const std::string& gid) { m_groupIds.insert(gid); }
     void leaveGroup(const std::string& gid) { m_groupIds.erase(gid); }
-    const std::unordered_set<std::string>& groups() const { return m_groupIds; }
+    const IdSet& groups() const { return m_groupIds; }
 
 private:
     std::string m_id;
     std::string m_nickname;
     Birthday m_birthday{};
     std::string m_location;
-    std::unordered_set<std::string> m_friendIds;
-    std::unordered_set<std::string> m_groupIds;
+    IdSet m_friendIds;   // 有序连续存储，遍历为线性扫描
+    IdSet m_groupIds;
 };
@@ -0,0 +1,600 @@
+#include "file_transfer.hpp"
+#include "../common/Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// 文件传输指标（所有连接汇总）
+struct FileTransferMetrics {
+    Counter& uploadsCompleted;
+    Counter& uploadBytes;
+    Counter& downloads;
+    Counter& downloadBytes;
+    Counter& zeroCopyBytes;
+    Counter& errors;
+};
+
+static FileTransferMetrics& fileMetrics() {
+    MetricsRegistry& r = MetricsRegistry::instance();
+    static FileTransferMetrics metrics{
+        r.counter("chat_file_uploads_completed_total", "Files fully uploaded to the blob store"),
+        r.counter("chat_file_upload_bytes_total", "File bytes written to the blob store"),
+        r.counter("chat_file_downloads_total", "File downloads started"),
+        r.counter("chat_file_download_bytes_total", "File bytes sent to downloaders"),
+        r.counter("chat_file_zero_copy_bytes_total", "File bytes moved by splice/sendfile without a user-space copy"),
+        r.counter("chat_file_transfer_errors_total", "File transfer requests that failed"),
+    };
+    return metrics;
+}
+
+// 回退路径（以及接收缓冲里已读入的数据）每次搬运的字节数
+static const size_t COPY_CHUNK = 64 * 1024;
+#ifdef __linux__
+// 每次 splice / sendfile 搬运的上限，pipe 容量尽量调到同样大小
+static const size_t ZERO_COPY_CHUNK = 1024 * 1024;
+#endif
+
+#ifndef _WIN32
+namespace {
+
+// 数据搬运：socket 设了 1 秒收发超时，超时算一次空闲，累计 IDLE_TIMEOUT_SEC 次或服务停止时放弃
+class TransferIo {
+public:
+    TransferIo(int socketFd, const std::atomic<bool>& running)
+        : m_socket(socketFd), m_running(running), m_idle(0) {}
+
+    // 超时或被打断可以重试时返回 true
+    bool retry(int err) {
+        if (err == EINTR) return true;
+        if ((err == EAGAIN || err == EWOULDBLOCK) && m_running && ++m_idle < FileTransferServer::IDLE_TIMEOUT_SEC) return true;
+        error = (err == EAGAIN || err == EWOULDBLOCK) ? "传输超时" : std::strerror(err);
+        return false;
+    }
+    void progress() { m_idle = 0; }
+
+    bool pwriteAll(int fd, const char* data, size_t len, uint64_t offset) {
+        while (len > 0) {
+            ssize_t n = ::pwrite(fd, data, len, static_cast<off_t>(offset));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                error = std::string("写文件失败: ") + std::strerror(errno);
+                return false;
+            }
+            data += n;
+            len -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    bool sendAll(const char* data, size_t len) {
+        while (len > 0) {
+            ssize_t n = ::send(m_socket, data, len, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (retry(errno)) continue;
+                return false;
+            }
+            progress();
+            data += n;
+            len -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // socket -> 文件：收 length 字节写到 offset 处，返回实际写入的字节数（中断时小于 length）
+    uint64_t receiveToFile(int fd, uint64_t offset, uint64_t length, uint64_t& zeroCopied) {
+        uint64_t done = 0;
+#ifdef __linux__
+        int pipeFds[2];
+        if (::pipe2(pipeFds, O_CLOEXEC) == 0) {
+            ::fcntl(pipeFds[1], F_SETPIPE_SZ, static_cast<int>(ZERO_COPY_CHUNK));
+            bool fallback = false;
+            while (done < length && !fallback) {
+                size_t want = static_cast<size_t>(std::min<uint64_t>(length - done, ZERO_COPY_CHUNK));
+                ssize_t in = ::splice(m_socket, nullptr, pipeFds[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (in == 0) { error = "连接已关闭"; break; }
+                if (in < 0) {
+                    if (errno == EINVAL && done == 0) { fallback = true; break; }
+                    if (retry(errno)) continue;
+                    break;
+                }
+                progress();
+                // pipe -> 文件；文件系统不支持 splice 时把 pipe 里这一段读出来 pwrite，之后改走回退路径
+                size_t pending = static_cast<size_t>(in);
+                while (pending > 0) {
+                    loff_t fileOffset = static_cast<loff_t>(offset + done);
+                    ssize_t out = ::splice(pipeFds[0], nullptr, fd, &fileOffset, pending, SPLICE_F_MOVE);
+                    if (out > 0) {
+                        done += static_cast<uint64_t>(out);
+                        zeroCopied += static_cast<uint64_t>(out);
+                        pending -= static_cast<size_t>(out);
+                        continue;
+                    }
+                    if (out < 0 && errno == EINTR) continue;
+                    if (out < 0 && errno == EINVAL) {
+                        fallback = true;
+                        if (!drainPipe(pipeFds[0], fd, offset, pending, done)) { ::close(pipeFds[0]); ::close(pipeFds[1]); return done; }
+                        break;
+                    }
+                    error = std::string("写文件失败: ") + std::strerror(out < 0 ? errno : EIO);
+                    ::close(pipeFds[0]);
+                    ::close(pipeFds[1]);
+                    return done;
+                }
+            }
+            ::close(pipeFds[0]);
+            ::close(pipeFds[1]);
+            if (!fallback) return done;
+        }
+#endif
+        std::vector<char> buffer(COPY_CHUNK);
+        while (done < length) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(length - done, buffer.size()));
+            ssize_t n = ::recv(m_socket, buffer.data(), want, 0);
+            if (n == 0) { error = "连接已关闭"; break; }
+            if (n < 0) {
+                if (retry(errno)) continue;
+                break;
+            }
+            progress();
+            if (!pwriteAll(fd, buffer.data(), static_cast<size_t>(n), offset + done)) break;
+            done += static_cast<uint64_t>(n);
+        }
+        return done;
+    }
+
+    // 文件 -> socket：从 offset 起发 length 字节，返回实际发出的字节数
+    uint64_t sendFromFile(int fd, uint64_t offset, uint64_t length, uint64_t& zeroCopied) {
+        uint64_t done = 0;
+#ifdef __linux__
+        while (done < length) {
+            off_t fileOffset = static_cast<off_t>(offset + done);
+            size_t want = static_cast<size_t>(std::min<uint64_t>(length - done, ZERO_COPY_CHUNK));
+            ssize_t n = ::sendfile(m_socket, fd, &fileOffset, want);
+            if (n > 0) {
+                progress();
+                done += static_cast<uint64_t>(n);
+                zeroCopied += static_cast<uint64_t>(n);
+                continue;
+            }
+            if (n == 0) { error = "文件被截断"; return done; }
+            if ((errno == EINVAL || errno == ENOSYS) && done == 0) break;   // 不支持 sendfile，走回退
+            if (retry(errno)) continue;
+            return done;
+        }
+        if (done == length) return done;
+#endif
+        std::vector<char> buffer(COPY_CHUNK);
+        while (done < length) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(length - done, buffer.size()));
+            ssize_t n = ::pread(fd, buffer.data(), want, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { error = n == 0 ? "文件被截断" : std::strerror(errno); break; }
+            if (!sendAll(buffer.data(), static_cast<size_t>(n))) break;
+            done += static_cast<uint64_t>(n);
+        }
+        return done;
+    }
+
+    std::string error;
+
+private:
+#ifdef __linux__
+    // 把 pipe 里剩下的 pending 字节读出来写进文件
+    bool drainPipe(int pipeFd, int fd, uint64_t offset, size_t pending, uint64_t& done) {
+        char buffer[COPY_CHUNK / 4];
+        while (pending > 0) {
+            ssize_t n = ::read(pipeFd, buffer, std::min(pending, sizeof(buffer)));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { error = "写文件失败"; return false; }
+            if (!pwriteAll(fd, buffer, static_cast<size_t>(n), offset + done)) return false;
+            done += static_cast<uint64_t>(n);
+            pending -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+#endif
+
+    int m_socket;
+    const std::atomic<bool>& m_running;
+    int m_idle;
+};
+
+std::vector<std::string> splitCommand(const std::string& command) {
+    std::vector<std::string> fields;
+    std::istringstream ss(command);
+    std::string field;
+    while (std::getline(ss, field, '|')) fields.push_back(field);
+    return fields;
+}
+
+bool parseNumber(const std::string& text, uint64_t& value) {
+    if (text.empty() || text.size() > 20) return false;
+    char* end = nullptr;
+    value = std::strtoull(text.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+bool sendError(TcpSocket& socket, const std::string& code, const std::string& text) {
+    fileMetrics().errors.inc();
+    socket.sendPipeMessage("ERROR|" + code + "|" + text);
+    return false;
+}
+
+} // namespace
+#endif
+
+FileTransferServer::FileTransferServer(BlobStore& store)
+    : m_store(store), m_running(false), m_connections(0), m_port(0) {}
+
+FileTransferServer::~FileTransferServer() {
+    stop();
+}
+
+bool FileTransferServer::start(uint16_t port, const std::string& ip) {
+    if (m_running) return true;
+#ifdef _WIN32
+    (void)port; (void)ip;
+    m_lastError = "当前平台不支持文件传输";
+    return false;
+#else
+    if (!m_store.open(m_lastError)) return false;
+    if (!m_listenSocket.init() || !m_listenSocket.create()) {
+        m_lastError = m_listenSocket.getLastError();
+        return false;
+    }
+    if (!m_listenSocket.bind(port, ip) || !m_listenSocket.listen(128)) {
+        m_lastError = m_listenSocket.getLastError();
+        m_listenSocket.close();
+        return false;
+    }
+    m_listenSocket.setListenNonBlocking(true);
+
+    m_port = port;
+    m_running = true;
+    m_thread = std::thread(&FileTransferServer::serveLoop, this);
+    std::cout << "[File] 文件传输端点已启动: " << ip << ":" << port << "，存储目录 " << m_store.directory() << std::endl;
+    return true;
+#endif
+}
+
+void FileTransferServer::stop() {
+    if (!m_running.exchange(false)) return;
+    if (m_thread.joinable()) m_thread.join();
+    m_listenSocket.close();
+    // 传输线程最多空等 1 秒就会看到停止标志
+    while (m_connections.load() != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    std::cout << "[File] 文件传输端点已停止" << std::endl;
+}
+
+void FileTransferServer::serveLoop() {
+    while (m_running) {
+        std::string clientIp;
+        uint16_t clientPort = 0;
+        SocketHandle handle = m_listenSocket.acceptNonBlocking(clientIp, clientPort, 200);
+        if (handle == -1) {
+            if (!m_running) break;
+            std::string error = m_listenSocket.getLastError();
+            if (error != "timeout" && error != "no data") {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            continue;
+        }
+        if (m_connections.load() >= MAX_CONNECTIONS) {
+            TcpSocket busy;
+            busy.setHandle(handle);
+            busy.sendPipeMessage("ERROR|BUSY|文件传输连接过多，请稍后再试");
+            continue;
+        }
+        ++m_connections;
+        try {
+            std::thread(&FileTransferServer::handleConnection, this, handle).detach();
+        } catch (const std::exception& e) {
+            --m_connections;
+            TcpSocket failed;
+            failed.setHandle(handle);
+            std::cerr << "[File] 无法创建传输线程: " << e.what() << std::endl;
+        }
+    }
+}
+
+void FileTransferServer::handleConnection(SocketHandle handle) {
+#ifndef _WIN32
+    {
+        TcpSocket socket;
+        socket.setHandle(handle);
+        socket.setNonBlockingMode(false);
+        // 1 秒收发超时，空闲计数到 IDLE_TIMEOUT_SEC 才断开，停止服务时很快退出
+        socket.setReceiveTimeout(1);
+        struct timeval tv = { 1, 0 };
+        setsockopt(handle, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+
+        int idle = 0;
+        while (m_running) {
+            std::string command;
+            if (!socket.receivePipeMessage(command, 1)) {
+                if (socket.getLastError() == "no data" && ++idle < IDLE_TIMEOUT_SEC) continue;
+                break;
+            }
+            idle = 0;
+            std::vector<std::string> fields = splitCommand(command);
+            bool keep = false;
+            if (fields.empty()) {
+                keep = sendError(socket, "PROTOCOL_ERROR", "空命令");
+            } else if (fields[0] == "PUT") {
+                keep = handleUpload(socket, fields);
+            } else if (fields[0] == "GET") {
+                keep = handleDownload(socket, fields);
+            } else if (fields[0] == "STAT") {
+                keep = handleStat(socket, fields);
+            } else {
+                keep = sendError(socket, "UNKNOWN_COMMAND", "未知命令");
+            }
+            if (!keep) break;
+        }
+    }
+#else
+    (void)handle;
+#endif
+    --m_connections;
+}
+
+bool FileTransferServer::handleUpload(TcpSocket& socket, const std::vector<std::string>& fields) {
+#ifndef _WIN32
+    uint64_t offset = 0, length = 0;
+    if (fields.size() != 5 || !parseNumber(fields[3], offset) || !parseNumber(fields[4], length)) {
+        return sendError(socket, "PROTOCOL_ERROR", "格式: PUT|fileId|token|offset|length");
+    }
+    const std::string& id = fields[1];
+    std::string error;
+    uint64_t remaining = 0;
+    int fd = m_store.beginUpload(id, fields[2], offset, remaining, error);
+    if (fd < 0) return sendError(socket, "UPLOAD_REJECTED", error);
+    if (length == 0 || length > remaining) {
+        BlobInfo info;
+        m_store.endUpload(id, fd, 0, info);
+        return sendError(socket, "UPLOAD_REJECTED", "长度应在 1 到 " + std::to_string(remaining) + " 之间");
+    }
+
+    // 命令帧之后的数据可能已经有一部分读进了接收缓冲：先把这部分写进文件，余下的直接从内核搬
+    TransferIo io(socket.nativeHandle(), m_running);
+    uint64_t written = 0, zeroCopied = 0;
+    const char* buffered = nullptr;
+    size_t available = socket.peekBuffered(buffered);
+    size_t head = static_cast<size_t>(std::min<uint64_t>(available, length));
+    bool ok = io.pwriteAll(fd, buffered, head, offset);
+    if (ok) {
+        socket.consumeBuffered(head);
+        written = head;
+        written += io.receiveToFile(fd, offset + written, length - written, zeroCopied);
+        ok = (written == length);
+    }
+
+    BlobInfo info;
+    bool completed = m_store.endUpload(id, fd, written, info);
+    FileTransferMetrics& metrics = fileMetrics();
+    metrics.uploadBytes.inc(written);
+    metrics.zeroCopyBytes.inc(zeroCopied);
+    if (!ok) {
+        std::cout << "[File] 上传中断 " << id << "：" << io.error << "，已收到 " << info.received << "/" << info.size << std::endl;
+        return sendError(socket, "UPLOAD_FAILED", io.error);
+    }
+    if (info.received == info.size && !completed) {
+        return sendError(socket, "STORE_FAILED", "保存文件失败");
+    }
+
+    bool sent = socket.sendPipeMessage("OK|" + std::to_string(info.received) + "|" + std::to_string(info.size));
+    if (completed) {
+        metrics.uploadsCompleted.inc();
+        std::cout << "[File] 文件上传完成 " << info.id << " (" << info.name << ", " << info.size << " 字节) "
+                  << info.ownerId << " -> " << info.receiverId << std::endl;
+        if (m_onComplete) m_onComplete(info);
+    }
+    return sent;
+#else
+    (void)socket; (void)fields;
+    return false;
+#endif
+}
+
+bool FileTransferServer::handleDownload(TcpSocket& socket, const std::vector<std::string>& fields) {
+#ifndef _WIN32
+    uint64_t offset = 0;
+    if (fields.size() != 4 || !parseNumber(fields[3], offset)) {
+        return sendError(socket, "PROTOCOL_ERROR", "格式: GET|fileId|token|offset");
+    }
+    std::string error;
+    uint64_t size = 0;
+    int fd = m_store.openForDownload(fields[1], fields[2], size, error);
+    if (fd < 0) return sendError(socket, "NOT_FOUND", error);
+    if (offset > size) {
+        ::close(fd);
+        return sendError(socket, "BAD_OFFSET", "偏移超过文件长度");
+    }
+
+    FileTransferMetrics& metrics = fileMetrics();
+    metrics.downloads.inc();
+    bool ok = socket.sendPipeMessage("OK|" + std::to_string(size) + "|" + std::to_string(offset));
+    uint64_t sent = 0, zeroCopied = 0;
+    if (ok) {
+        TransferIo io(socket.nativeHandle(), m_running);
+        sent = io.sendFromFile(fd, offset, size - offset, zeroCopied);
+        ok = (sent == size - offset);
+        if (!ok) std::cout << "[File] 下载中断 " << fields[1] << "：" << io.error << std::endl;
+    }
+    ::close(fd);
+    metrics.downloadBytes.inc(sent);
+    metrics.zeroCopyBytes.inc(zeroCopied);
+    if (!ok) metrics.errors.inc();
+    return ok;
+#else
+    (void)socket; (void)fields;
+    return false;
+#endif
+}
+
+bool FileTransferServer::handleStat(TcpSocket& socket, const std::vector<std::string>& fields) {
+#ifndef _WIN32
+    if (fields.size() != 3) return sendError(socket, "PROTOCOL_ERROR", "格式: STAT|fileId|token");
+    BlobInfo info;
+    std::string error;
+    if (!m_store.stat(fields[1], fields[2], info, error)) return sendError(socket, "NOT_FOUND", error);
+    return socket.sendPipeMessage("OK|" + std::to_string(info.received) + "|" + std::to_string(info.size));
+#else
+    (void)socket; (void)fields;
+    return false;
+#endif
+}
+
+// ---- 客户端 ----
+
+FileTransferClient::FileTransferClient() : m_active(true), m_bytes(0) {}
+
+FileTransferClient::~FileTransferClient() {
+    close();
+}
+
+bool FileTransferClient::connect(const std::string& host, uint16_t port) {
+    close();
+#ifdef _WIN32
+    (void)host; (void)port;
+    m_lastError = "当前平台不支持文件传输";
+    return false;
+#else
+    if (!m_socket.init() || !m_socket.connect(host, port)) {
+        m_lastError = m_socket.getLastError();
+        return false;
+    }
+    m_socket.setReceiveTimeout(1);
+    struct timeval tv = { 1, 0 };
+    setsockopt(m_socket.nativeHandle(), SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+    return true;
+#endif
+}
+
+void FileTransferClient::close() {
+    if (m_socket.isSocketValid()) m_socket.close();
+}
+
+bool FileTransferClient::readReply(std::vector<std::string>& fields) {
+#ifndef _WIN32
+    std::string reply;
+    int idle = 0;
+    while (!m_socket.receivePipeMessage(reply, 1)) {
+        if (m_socket.getLastError() != "no data" || ++idle >= FileTransferServer::IDLE_TIMEOUT_SEC) {
+            m_lastError = idle > 0 ? "等待应答超时" : m_socket.getLastError();
+            return false;
+        }
+    }
+    fields = splitCommand(reply);
+    if (fields.empty() || fields[0] != "OK") {
+        m_lastError = fields.size() >= 3 ? fields[1] + ": " + fields[2] : "无效的应答: " + reply;
+        return false;
+    }
+    return true;
+#else
+    (void)fields;
+    return false;
+#endif
+}
+
+bool FileTransferClient::upload(const std::string& fileId, const std::string& uploadToken, const std::string& path,
+                                uint64_t chunkBytes) {
+    m_lastError.clear();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { m_lastError = "无法打开 " + path + ": " + std::strerror(errno); return false; }
+
+    std::vector<std::string> fields;
+    uint64_t received = 0, size = 0;
+    bool ok = m_socket.sendPipeMessage("STAT|" + fileId + "|" + uploadToken) && readReply(fields) &&
+              fields.size() == 3 && parseNumber(fields[1], received) && parseNumber(fields[2], size);
+    if (ok) {
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) != size) {
+            m_lastError = "本地文件大小与登记的不一致";
+            ok = false;
+        }
+    } else if (m_lastError.empty()) {
+        m_lastError = "无效的应答";
+    }
+
+    TransferIo io(m_socket.nativeHandle(), m_active);
+    while (ok && received < size) {
+        uint64_t length = std::min(chunkBytes, size - received);
+        ok = m_socket.sendPipeMessage("PUT|" + fileId + "|" + uploadToken + "|" + std::to_string(received) +
+                                      "|" + std::to_string(length));
+        if (!ok) { m_lastError = m_socket.getWriteError(); break; }
+        uint64_t zeroCopied = 0;
+        uint64_t sent = io.sendFromFile(fd, received, length, zeroCopied);
+        m_bytes += sent;
+        if (sent != length) { m_lastError = io.error; ok = false; break; }
+        ok = readReply(fields) && fields.size() == 3 && parseNumber(fields[1], received);
+    }
+    ::close(fd);
+    return ok;
+#else
+    (void)fileId; (void)uploadToken; (void)path; (void)chunkBytes;
+    m_lastError = "当前平台不支持文件传输";
+    return false;
+#endif
+}
+
+bool FileTransferClient::download(const std::string& fileId, const std::string& downloadToken, const std::string& path) {
+    m_lastError.clear();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) { m_lastError = "无法创建 " + path + ": " + std::strerror(errno); return false; }
+    struct stat st;
+    uint64_t offset = (::fstat(fd, &st) == 0) ? static_cast<uint64_t>(st.st_size) : 0;
+
+    // 先 STAT 取文件长度：本地文件比它还长说明不是同一个文件的前半段，截断后从头下载
+    std::vector<std::string> fields;
+    uint64_t size = 0;
+    bool ok = m_socket.sendPipeMessage("STAT|" + fileId + "|" + downloadToken) && readReply(fields) &&
+              fields.size() == 3 && parseNumber(fields[2], size);
+    if (ok && offset > size) {
+        ok = ::ftruncate(fd, 0) == 0;
+        offset = 0;
+    }
+    if (ok && offset < size) {
+        ok = m_socket.sendPipeMessage("GET|" + fileId + "|" + downloadToken + "|" + std::to_string(offset)) &&
+             readReply(fields) && fields.size() == 3;
+    }
+    if (!ok && m_lastError.empty()) m_lastError = "无效的应答";
+
+    if (ok && offset < size) {
+        // 应答帧之后的数据可能已有一部分在接收缓冲里
+        TransferIo io(m_socket.nativeHandle(), m_active);
+        const char* buffered = nullptr;
+        size_t available = m_socket.peekBuffered(buffered);
+        size_t head = static_cast<size_t>(std::min<uint64_t>(available, size - offset));
+        ok = io.pwriteAll(fd, buffered, head, offset);
+        if (ok) {
+            m_socket.consumeBuffered(head);
+            uint64_t zeroCopied = 0;
+            uint64_t done = head + io.receiveToFile(fd, offset + head, size - offset - head, zeroCopied);
+            m_bytes += done;
+            ok = (done == size - offset);
+        }
+        if (!ok) m_lastError = io.error;
+    }
+    ::close(fd);
+    return ok;
+#else
+    (void)fileId; (void)downloadToken; (void)path;
+    m_lastError = "当前平台不支持文件传输";
+    return false;
+#endif
+}
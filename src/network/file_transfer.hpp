@@ -0,0 +1,97 @@
+#ifndef FILE_TRANSFER_HPP
+#define FILE_TRANSFER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tcp_socket.hpp"
+#include "../common/BlobStore.hpp"
+
+// 文件传输端点：独立端口，和指标端点一样不经过聊天连接，也不挂 io_uring / epoll transport，
+// 大文件传输不会挡住任何聊天连接上的消息。每个连接一个线程，连接上可以依次发多个请求；
+// 请求和应答都是 4 字节长度前缀的命令帧，文件数据紧跟在帧后面原样传输：
+//   PUT|fileId|uploadToken|offset|length   之后 length 字节文件内容   -> OK|received|size
+//   GET|fileId|downloadToken|offset        -> OK|size|offset，之后 size-offset 字节文件内容
+//   STAT|fileId|token                      -> OK|received|size
+// 出错回 ERROR|code|说明 并关闭连接。上传中断后用 STAT 取已收到的字节数，从那里续传。
+// 上传用 splice（socket -> pipe -> 文件）、下载用 sendfile，文件内容不经过用户态缓冲；
+// 不支持时（非 Linux、文件系统不支持 splice）退回到固定大小的缓冲 + pwrite / pread。
+class FileTransferServer {
+public:
+    // 文件收齐后在该上传连接的线程上调用（应答已发出），用于给接收方投递引用消息
+    using CompleteCallback = std::function<void(const BlobInfo&)>;
+
+    static constexpr size_t MAX_CONNECTIONS = 64;
+    static constexpr int IDLE_TIMEOUT_SEC = 30;          // 命令之间、数据传输中无进展的最长时间
+
+    explicit FileTransferServer(BlobStore& store);
+    ~FileTransferServer();
+
+    // start 之前设置
+    void onComplete(CompleteCallback callback) { m_onComplete = std::move(callback); }
+
+    bool start(uint16_t port, const std::string& ip = "0.0.0.0");
+    void stop();
+    bool isRunning() const { return m_running; }
+    uint16_t port() const { return m_port; }
+    std::string getLastError() const { return m_lastError; }
+
+private:
+    FileTransferServer(const FileTransferServer&) = delete;
+    FileTransferServer& operator=(const FileTransferServer&) = delete;
+
+    void serveLoop();
+    void handleConnection(SocketHandle handle);
+    // 处理一条命令；返回 false 时关闭连接
+    bool handleUpload(TcpSocket& socket, const std::vector<std::string>& fields);
+    bool handleDownload(TcpSocket& socket, const std::vector<std::string>& fields);
+    bool handleStat(TcpSocket& socket, const std::vector<std::string>& fields);
+
+    BlobStore& m_store;
+    CompleteCallback m_onComplete;
+    TcpSocket m_listenSocket;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<size_t> m_connections;                  // 正在处理的连接数，stop 等它归零
+    uint16_t m_port;
+    std::string m_lastError;
+};
+
+// 文件端口的客户端：阻塞调用，应在聊天连接的事件循环之外的线程上使用。
+// 上传用 sendfile 从文件直接写 socket，下载和服务器一样 splice 进文件；两者都支持断点续传。
+class FileTransferClient {
+public:
+    static constexpr uint64_t DEFAULT_CHUNK_BYTES = 4 * 1024 * 1024;   // 每个 PUT 的字节数
+
+    FileTransferClient();
+    ~FileTransferClient();
+
+    bool connect(const std::string& host, uint16_t port);
+    void close();
+
+    // 上传 path：先 STAT 取服务器已收到的字节数，从那里起按块 PUT，直到收齐
+    bool upload(const std::string& fileId, const std::string& uploadToken, const std::string& path,
+                uint64_t chunkBytes = DEFAULT_CHUNK_BYTES);
+    // 下载到 path；path 已存在且比文件短时从它的末尾续传
+    bool download(const std::string& fileId, const std::string& downloadToken, const std::string& path);
+
+    std::string getLastError() const { return m_lastError; }
+    uint64_t bytesTransferred() const { return m_bytes; }   // 本对象收发的文件字节数（不含已有的续传部分）
+
+private:
+    FileTransferClient(const FileTransferClient&) = delete;
+    FileTransferClient& operator=(const FileTransferClient&) = delete;
+
+    // 读一条应答帧并按 '|' 拆开；ERROR 应答记入 m_lastError 并返回 false
+    bool readReply(std::vector<std::string>& fields);
+
+    TcpSocket m_socket;
+    std::atomic<bool> m_active;
+    std::string m_lastError;
+    uint64_t m_bytes;
+};
+
+#endif // FILE_TRANSFER_HPP
@@ -0,0 +1,162 @@
+#include "listener_group.hpp"
+#include "../common/Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// 接收线程 poll 的超时：决定 stop() 最长等多久
+static const int ACCEPT_POLL_TIMEOUT_MS = 200;
+
+// 接收指标（所有监听 socket 汇总）
+struct ListenerMetrics {
+    Counter& accepted;
+    Counter& batches;
+    Counter& errors;
+    Histogram& batchSize;
+};
+
+static ListenerMetrics& listenerMetrics() {
+    MetricsRegistry& r = MetricsRegistry::instance();
+    static ListenerMetrics metrics{
+        r.counter("chat_listener_accepted_total", "Connections accepted by the listener group"),
+        r.counter("chat_listener_accept_batches_total", "Accept wakeups that drained a listener until EAGAIN"),
+        r.counter("chat_listener_accept_errors_total", "accept failures other than EAGAIN"),
+        r.histogram("chat_listener_accept_batch_size", "Connections accepted per wakeup",
+                    { 1, 2, 4, 8, 16, 32, 64, 128, 256 }),
+    };
+    return metrics;
+}
+
+ListenerGroup::ListenerGroup() : m_running(false) {}
+
+ListenerGroup::~ListenerGroup() {
+    stop();
+    close();
+}
+
+bool ListenerGroup::open(const Options& options) {
+    close();
+    m_options = options;
+    size_t count = options.listeners;
+    if (count == 0) count = std::max<size_t>(1, std::thread::hardware_concurrency());
+#ifndef SO_REUSEPORT
+    count = 1;
+#endif
+
+    m_sockets.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        TcpSocket& socket = m_sockets[i];
+        if (!socket.init() || !socket.create()) {
+            m_lastError = socket.getLastError();
+            close();
+            return false;
+        }
+        // 只有一个监听 socket 时不需要 SO_REUSEPORT
+        if (count > 1 && !socket.setReusePort(true)) {
+            m_lastError = "SO_REUSEPORT: " + socket.getLastError();
+            close();
+            return false;
+        }
+        if (!socket.bind(options.port, options.ip) || !socket.listen(options.backlog)) {
+            m_lastError = socket.getLastError();
+            close();
+            return false;
+        }
+    }
+    std::cout << "[Listener] " << count << " listening socket(s) on " << options.ip << ":" << options.port
+              << " (backlog " << options.backlog << ")" << std::endl;
+    return true;
+}
+
+bool ListenerGroup::start(AcceptCallback onAccept) {
+    if (m_sockets.empty()) { m_lastError = "listener group not open"; return false; }
+    if (m_running.exchange(true)) return true;
+    m_onAccept = std::move(onAccept);
+    for (size_t i = 0; i < m_sockets.size(); ++i) {
+#ifdef __linux__
+        m_sockets[i].setListenNonBlocking(true);
+#endif
+        m_threads.emplace_back(&ListenerGroup::acceptLoop, this, i);
+    }
+    return true;
+}
+
+void ListenerGroup::stop() {
+    if (!m_running.exchange(false)) return;
+#ifndef __linux__
+    // 非 Linux 平台 accept 是阻塞的，先关闭监听 socket 使其返回
+    close();
+#endif
+    for (auto& thread : m_threads) {
+        if (thread.joinable()) thread.join();
+    }
+    m_threads.clear();
+}
+
+void ListenerGroup::close() {
+    for (auto& socket : m_sockets) socket.close();
+    if (!m_running) m_sockets.clear();
+}
+
+void ListenerGroup::acceptLoop(size_t index) {
+#ifdef __linux__
+    pollfd pfd;
+    pfd.fd = m_sockets[index].nativeHandle();
+    pfd.events = POLLIN;
+    while (m_running) {
+        pfd.revents = 0;
+        int ready = ::poll(&pfd, 1, ACCEPT_POLL_TIMEOUT_MS);
+        if (ready <= 0 || !(pfd.revents & POLLIN)) continue;
+        size_t accepted = acceptBatch(index);
+        if (accepted > 0) {
+            ListenerMetrics& metrics = listenerMetrics();
+            metrics.batches.inc();
+            metrics.batchSize.observe(static_cast<double>(accepted));
+        }
+    }
+#else
+    while (m_running) {
+        std::string ip;
+        uint16_t port = 0;
+        SocketHandle fd = m_sockets[index].accept(ip, port);
+        if (fd == -1) {
+            if (!m_running) break;
+            listenerMetrics().errors.inc();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        listenerMetrics().accepted.inc();
+        m_onAccept(fd, ip, port);
+    }
+#endif
+}
+
+size_t ListenerGroup::acceptBatch(size_t index) {
+    size_t accepted = 0;
+#ifdef __linux__
+    int flags = SOCK_CLOEXEC | (m_options.nonBlockingClients ? SOCK_NONBLOCK : 0);
+    SocketHandle listenFd = m_sockets[index].nativeHandle();
+    while (m_running) {
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        SocketHandle fd = ::accept4(listenFd, reinterpret_cast<sockaddr*>(&addr), &len, flags);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            listenerMetrics().errors.inc();
+            std::cerr << "[Listener] accept4 failed: " << strerror(errno) << std::endl;
+            // 句柄耗尽（EMFILE/ENFILE）时连接留在队列里，稍后重试，避免空转
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            break;
+        }
+        char ip[INET_ADDRSTRLEN] = {0};
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        ++accepted;
+        m_onAccept(fd, ip, ntohs(addr.sin_port));
+    }
+    listenerMetrics().accepted.inc(accepted);
+#else
+    (void)index;
+#endif
+    return accepted;
+}
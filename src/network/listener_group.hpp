@@ -0,0 +1,61 @@
+#ifndef LISTENER_GROUP_HPP
+#define LISTENER_GROUP_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tcp_socket.hpp"
+
+// 监听组：同一端口开 N 个 SO_REUSEPORT 监听 socket，内核按四元组哈希把新连接分给各 socket，
+// 每个 socket 一个接收线程，重连风暴时各核并行 accept，互不争抢同一个接收队列。
+// - backlog 可配置（默认 TcpSocket::DEFAULT_BACKLOG，实际上限受 net.core.somaxconn 约束）
+// - 接收线程 poll 等待可读后用 accept4(SOCK_CLOEXEC [| SOCK_NONBLOCK]) 一直接到 EAGAIN，
+//   一次唤醒处理一批连接
+// - 也可以不启动接收线程，只把各监听句柄交给 SocketTransport（io_uring multishot accept / epoll）
+// 不支持 SO_REUSEPORT 的平台退化为单个监听 socket + 阻塞 accept。
+class ListenerGroup {
+public:
+    // 新连接回调，在接收线程上执行；fd 所有权归回调
+    using AcceptCallback = std::function<void(SocketHandle fd, const std::string& ip, uint16_t port)>;
+
+    struct Options {
+        uint16_t port = 0;
+        std::string ip = "0.0.0.0";
+        size_t listeners = 0;                        // 0 表示按 CPU 核数
+        int backlog = TcpSocket::DEFAULT_BACKLOG;
+        bool nonBlockingClients = true;              // 接到的连接是否设为非阻塞（reactor 需要）
+    };
+
+    ListenerGroup();
+    ~ListenerGroup();
+
+    bool open(const Options& options);
+    // 每个监听 socket 启动一个接收线程
+    bool start(AcceptCallback onAccept);
+    void stop();
+    void close();
+
+    size_t size() const { return m_sockets.size(); }
+    SocketHandle handle(size_t index) const { return m_sockets[index].nativeHandle(); }
+    std::string getLastError() const { return m_lastError; }
+
+private:
+    ListenerGroup(const ListenerGroup&) = delete;
+    ListenerGroup& operator=(const ListenerGroup&) = delete;
+
+    void acceptLoop(size_t index);
+    // 接到 EAGAIN 为止，返回本批接到的连接数
+    size_t acceptBatch(size_t index);
+
+    Options m_options;
+    std::vector<TcpSocket> m_sockets;
+    std::vector<std::thread> m_threads;
+    AcceptCallback m_onAccept;
+    std::atomic<bool> m_running;
+    std::string m_lastError;
+};
+
+#endif // LISTENER_GROUP_HPP
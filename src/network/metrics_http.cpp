@@ -0,0 +1,152 @@
+#include "metrics_http.hpp"
+#include "../common/Tracer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+
+// 请求头最多读这么多字节，抓取请求远小于此
+static const size_t MAX_REQUEST_SIZE = 8 * 1024;
+
+MetricsHttpServer::MetricsHttpServer(MetricsRegistry& registry)
+    : m_registry(registry), m_running(false) {}
+
+MetricsHttpServer::~MetricsHttpServer() {
+    stop();
+}
+
+bool MetricsHttpServer::start(uint16_t port, const std::string& ip) {
+    if (m_running) return true;
+
+    if (!m_listenSocket.init() || !m_listenSocket.create()) {
+        m_lastError = m_listenSocket.getLastError();
+        return false;
+    }
+    if (!m_listenSocket.bind(port, ip) || !m_listenSocket.listen(16)) {
+        m_lastError = m_listenSocket.getLastError();
+        m_listenSocket.close();
+        return false;
+    }
+    m_listenSocket.setListenNonBlocking(true);
+
+    m_running = true;
+    m_thread = std::thread(&MetricsHttpServer::serveLoop, this);
+    std::cout << "[Metrics] 指标端点已启动: http://" << ip << ":" << port << "/metrics" << std::endl;
+    return true;
+}
+
+void MetricsHttpServer::stop() {
+    if (!m_running.exchange(false)) return;
+#ifndef __linux__
+    // 非 Linux 平台 accept 是阻塞的，先关闭监听 socket 使其返回
+    m_listenSocket.close();
+#endif
+    // Linux 下 accept 带 200ms 超时，线程会自行退出
+    if (m_thread.joinable()) m_thread.join();
+    m_listenSocket.close();
+    std::cout << "[Metrics] 指标端点已停止" << std::endl;
+}
+
+void MetricsHttpServer::serveLoop() {
+    while (m_running) {
+        std::string clientIp;
+        uint16_t clientPort = 0;
+        SocketHandle handle = m_listenSocket.acceptNonBlocking(clientIp, clientPort, 200);
+        if (handle == -1) {
+            if (!m_running) break;
+            std::string error = m_listenSocket.getLastError();
+            if (error != "timeout" && error != "no data") {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            continue;
+        }
+        handleConnection(handle);
+    }
+}
+
+void MetricsHttpServer::handleConnection(SocketHandle handle) {
+    TcpSocket client;
+    client.setHandle(handle);
+    client.setReceiveTimeout(2);
+
+    // 读到请求头结束；POST 再按 Content-Length 读完请求体（与请求头合计不超过 MAX_REQUEST_SIZE）。不支持 keep-alive
+    std::string request;
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_SIZE) {
+        std::string chunk;
+        if (client.recv(chunk, 2048) <= 0) break;
+        request += chunk;
+    }
+    size_t headerEnd = request.find("\r\n\r\n");
+    std::string requestBody;
+    if (headerEnd != std::string::npos) {
+        size_t contentLength = 0;
+        std::string headers = request.substr(0, headerEnd);
+        for (char& c : headers) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        size_t lengthPos = headers.find("\r\ncontent-length:");
+        if (lengthPos != std::string::npos) {
+            contentLength = std::strtoul(headers.c_str() + lengthPos + 17, nullptr, 10);
+        }
+        size_t bodyBegin = headerEnd + 4;
+        contentLength = std::min(contentLength, MAX_REQUEST_SIZE);
+        while (request.size() - bodyBegin < contentLength) {
+            std::string chunk;
+            if (client.recv(chunk, 2048) <= 0) break;
+            request += chunk;
+        }
+        requestBody = request.substr(bodyBegin, contentLength);
+    }
+
+    std::string status;
+    std::string contentType = "text/plain; charset=utf-8";
+    std::string body;
+    bool headOnly = false;
+
+    size_t lineEnd = request.find("\r\n");
+    std::string requestLine = request.substr(0, lineEnd);
+    size_t methodEnd = requestLine.find(' ');
+    size_t pathEnd = methodEnd == std::string::npos ? std::string::npos : requestLine.find(' ', methodEnd + 1);
+
+    if (methodEnd == std::string::npos || pathEnd == std::string::npos) {
+        status = "400 Bad Request";
+        body = "bad request\n";
+    } else {
+        std::string method = requestLine.substr(0, methodEnd);
+        std::string path = requestLine.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+        std::string query;
+        size_t queryPos = path.find('?');
+        if (queryPos != std::string::npos) {
+            query = path.substr(queryPos + 1);
+            path.resize(queryPos);
+        }
+
+        if (method == "POST" && m_postHandlers.count(path)) {
+            status = "200 OK";
+            body = m_postHandlers[path](requestBody.empty() ? query : requestBody);
+        } else if (method != "GET" && method != "HEAD") {
+            status = "405 Method Not Allowed";
+            body = "method not allowed\n";
+        } else if (path == "/metrics") {
+            status = "200 OK";
+            contentType = "text/plain; version=0.0.4; charset=utf-8";
+            body = m_registry.renderPrometheus();
+        } else if (path == "/trace") {
+            // 只导出，不改采样率：指标端口对外监听，改状态的操作只走管理端口的 POST
+            status = "200 OK";
+            contentType = "application/json";
+            body = Tracer::dumpChromeTrace();
+        } else if (m_handlers.count(path)) {
+            status = "200 OK";
+            body = m_handlers[path](query);
+        } else {
+            status = "404 Not Found";
+            body = "not found\n";
+        }
+        headOnly = method == "HEAD";
+    }
+
+    std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType +
+                           "\r\nContent-Length: " + std::to_string(body.size()) +
+                           "\r\nConnection: close\r\n\r\n";
+    if (!headOnly) response += body;
+    client.send(response);
+}
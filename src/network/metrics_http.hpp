@@ -0,0 +1,52 @@
+#ifndef METRICS_HTTP_HPP
+#define METRICS_HTTP_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include "tcp_socket.hpp"
+#include "../common/Metrics.hpp"
+
+// 指标导出端点：独立端口上的极简 HTTP 服务。
+//   GET /metrics          Prometheus 文本格式
+//   GET /trace            当前缓冲中的消息追踪（Chrome trace JSON），只读；调整采样率由上层
+//                         登记为管理端口上的 POST /trace
+//   其他路径可由上层登记（如集群的 /ring），返回纯文本；改变状态的操作登记为 POST，
+//   由单独一个只监听回环地址的实例提供（管理端口），不放在对外的指标端口上
+// 单独一个线程逐个处理抓取请求，每次响应后关闭连接，不影响聊天端口。
+class MetricsHttpServer {
+public:
+    explicit MetricsHttpServer(MetricsRegistry& registry = MetricsRegistry::instance());
+    ~MetricsHttpServer();
+
+    // 登记额外的路径：handler 收到查询串（? 之后的部分），返回响应正文。start 之前调用
+    using Handler = std::function<std::string(const std::string& query)>;
+    void handle(const std::string& path, Handler handler) { m_handlers[path] = std::move(handler); }
+    // 登记 POST 路径：handler 收到请求体（表单格式，如 set=3=100），请求体为空时收到查询串
+    void handlePost(const std::string& path, Handler handler) { m_postHandlers[path] = std::move(handler); }
+
+    bool start(uint16_t port, const std::string& ip = "0.0.0.0");
+    void stop();
+    bool isRunning() const { return m_running; }
+    std::string getLastError() const { return m_lastError; }
+
+private:
+    MetricsHttpServer(const MetricsHttpServer&) = delete;
+    MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+    void serveLoop();
+    void handleConnection(SocketHandle handle);
+
+    MetricsRegistry& m_registry;
+    std::map<std::string, Handler> m_handlers;
+    std::map<std::string, Handler> m_postHandlers;
+    TcpSocket m_listenSocket;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::string m_lastError;
+};
+
+#endif // METRICS_HTTP_HPP
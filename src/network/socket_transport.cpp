@@ -0,0 +1,998 @@
+#include "socket_transport.hpp"
+#include "../common/Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#ifdef __linux__
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#  endif
+// multishot recv 与 provided buffer ring 同在 6.0 的头文件中出现
+#  if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#    define CHAT_HAVE_IO_URING 1
+#  endif
+#endif
+
+// ========================================================================================
+// TransportChannel
+// ========================================================================================
+
+TransportChannel::TransportChannel(SocketTransport& transport, SocketHandle fd, uint64_t id)
+    : m_transport(transport), m_fd(fd), m_id(id), m_flushScheduled(false), m_unsentBytes(0),
+      m_closed(false), m_closeRequested(false) {}
+
+bool TransportChannel::send(std::string&& bytes) {
+    size_t size = bytes.size();
+    if (m_unsentBytes.fetch_add(size, std::memory_order_relaxed) + size > MAX_UNSENT_BYTES) {
+        m_unsentBytes.fetch_sub(size, std::memory_order_relaxed);
+        markClosed("send queue overflow");
+        close();
+        return false;
+    }
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed.load(std::memory_order_relaxed)) return false;
+        m_outbound.push_back(std::move(bytes));
+        if (!m_flushScheduled) {
+            m_flushScheduled = true;
+            notify = true;
+        }
+    }
+    // 同一连接在 reactor 取走之前的多次发送只通知一次
+    if (notify) m_transport.schedule(shared_from_this());
+    return true;
+}
+
+TransportChannel::ReceiveStatus TransportChannel::receive(std::string& frame, bool& compressed, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_inbound.empty() && !m_closed.load(std::memory_order_relaxed) && timeoutMs > 0) {
+        m_readable.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] {
+            return !m_inbound.empty() || m_closed.load(std::memory_order_relaxed);
+        });
+    }
+    // 关闭前已收到的帧照常交付
+    if (!m_inbound.empty()) {
+        frame.swap(m_inbound.front().payload);
+        compressed = m_inbound.front().compressed;
+        m_inbound.pop_front();
+        return ReceiveStatus::Frame;
+    }
+    return m_closed.load(std::memory_order_relaxed) ? ReceiveStatus::Closed : ReceiveStatus::Timeout;
+}
+
+bool TransportChannel::notifyWhenReadable(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_inbound.empty() || m_closed.load(std::memory_order_relaxed)) return false;
+    m_onReadable = std::move(callback);
+    return true;
+}
+
+void TransportChannel::close() {
+    std::function<void()> onReadable;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closeRequested.load(std::memory_order_relaxed)) return;
+        m_closeRequested.store(true, std::memory_order_release);
+        if (!m_closed.load(std::memory_order_relaxed)) {
+            m_reason = "closed";
+            m_closed.store(true, std::memory_order_release);
+        }
+        onReadable.swap(m_onReadable);
+    }
+    m_readable.notify_all();
+    if (onReadable) onReadable();
+    m_transport.schedule(shared_from_this());
+}
+
+std::string TransportChannel::closeReason() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reason;
+}
+
+bool TransportChannel::feed(const char* data, size_t len) {
+    // 常见情况没有残留字节，直接在输入上切帧，只把末尾不完整的部分存起来
+    const char* base = data;
+    size_t size = len;
+    if (!m_partial.empty()) {
+        m_partial.append(data, len);
+        base = m_partial.data();
+        size = m_partial.size();
+    }
+
+    size_t pos = 0;
+    bool queued = false;
+    bool valid = true;
+    std::function<void()> onReadable;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+        while (size - pos >= sizeof(uint32_t)) {
+            uint32_t netlen = 0;
+            std::memcpy(&netlen, base + pos, sizeof(netlen));
+            uint32_t header = ntohl(netlen);
+            uint32_t payloadLen = header & ~TcpSocket::COMPRESSED_FRAME_FLAG;
+            if (payloadLen > TcpSocket::MAX_PIPE_MESSAGE_SIZE) {
+                valid = false;
+                break;
+            }
+            if (size - pos - sizeof(netlen) < payloadLen) break;
+            if (!lock.owns_lock()) lock.lock();
+            m_inbound.push_back(InboundFrame{ std::string(base + pos + sizeof(netlen), payloadLen),
+                                              (header & TcpSocket::COMPRESSED_FRAME_FLAG) != 0 });
+            pos += sizeof(netlen) + payloadLen;
+            queued = true;
+        }
+        if (queued) onReadable.swap(m_onReadable);
+    }
+    if (queued) m_readable.notify_one();
+    if (onReadable) onReadable();
+    if (!valid) return false;
+
+    if (m_partial.empty()) {
+        m_partial.assign(base + pos, size - pos);
+    } else {
+        m_partial.erase(0, pos);
+    }
+    return true;
+}
+
+void TransportChannel::takeOutbound(std::vector<std::string>& out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& bytes : m_outbound) out.push_back(std::move(bytes));
+    m_outbound.clear();
+    m_flushScheduled = false;
+}
+
+void TransportChannel::markClosed(const std::string& reason) {
+    std::function<void()> onReadable;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed.load(std::memory_order_relaxed)) return;
+        m_reason = reason;
+        m_closed.store(true, std::memory_order_release);
+        onReadable.swap(m_onReadable);
+    }
+    m_readable.notify_all();
+    if (onReadable) onReadable();
+}
+
+// ========================================================================================
+// SocketTransport
+// ========================================================================================
+
+SocketTransport::SocketTransport() : m_wakePending(false), m_nextChannelId(1) {}
+
+SocketTransport::~SocketTransport() = default;
+
+std::shared_ptr<TransportChannel> SocketTransport::attach(SocketHandle fd) {
+    auto channel = std::make_shared<TransportChannel>(*this, fd,
+        m_nextChannelId.fetch_add(1, std::memory_order_relaxed));
+    schedule(channel);
+    return channel;
+}
+
+void SocketTransport::schedule(std::shared_ptr<TransportChannel> channel) {
+    {
+        std::lock_guard<std::mutex> lock(m_scheduleMutex);
+        m_scheduled.push_back(std::move(channel));
+    }
+    // reactor 取走列表之前只唤醒一次
+    if (!m_wakePending.exchange(true, std::memory_order_acq_rel)) wake();
+}
+
+void SocketTransport::takeScheduled(std::vector<std::shared_ptr<TransportChannel>>& out) {
+    m_wakePending.store(false, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(m_scheduleMutex);
+    out.swap(m_scheduled);
+}
+
+#ifdef __linux__
+
+namespace {
+
+// 每个后端一组指标，用 backend 标签区分
+struct TransportMetrics {
+    Counter& syscalls;
+    Counter& wakeups;
+    Counter& sqesSubmitted;
+    Counter& bufferStarved;
+    Gauge& channels;
+
+    explicit TransportMetrics(const std::string& backend)
+        : syscalls(MetricsRegistry::instance().counter("chat_io_syscalls_total",
+              "System calls issued by the I/O transport (waits, reads, writes, submissions, wakeups)",
+              "backend=\"" + backend + "\"")),
+          wakeups(MetricsRegistry::instance().counter("chat_io_wakeups_total",
+              "eventfd writes to wake an idle reactor", "backend=\"" + backend + "\"")),
+          sqesSubmitted(MetricsRegistry::instance().counter("chat_io_sqes_submitted_total",
+              "Submission queue entries handed to io_uring", "backend=\"" + backend + "\"")),
+          bufferStarved(MetricsRegistry::instance().counter("chat_io_buffer_starved_total",
+              "Multishot receives that ran out of provided buffers", "backend=\"" + backend + "\"")),
+          channels(MetricsRegistry::instance().gauge("chat_io_channels",
+              "Connections attached to the I/O transport", "backend=\"" + backend + "\"")) {}
+};
+
+void peerAddress(SocketHandle fd, std::string& ip, uint16_t& port) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    ip.clear();
+    port = 0;
+    if (::getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0) {
+        char buf[INET_ADDRSTRLEN] = {0};
+        inet_ntop(AF_INET, &addr.sin_addr, buf, sizeof(buf));
+        ip = buf;
+        port = ntohs(addr.sin_port);
+    }
+}
+
+// ========================================================================================
+// EpollTransport - 水平触发 epoll：可读时读到 EAGAIN 或读不满缓冲区，发送走 sendmsg，
+// 写不动时才关注 EPOLLOUT
+// ========================================================================================
+
+class EpollTransport : public SocketTransport {
+public:
+    EpollTransport() : m_metrics("epoll"), m_epollFd(-1), m_eventFd(-1), m_running(false),
+                       m_readBuffer(READ_BUFFER_SIZE) {}
+
+    ~EpollTransport() override {
+        stop();
+        if (m_eventFd >= 0) ::close(m_eventFd);
+        if (m_epollFd >= 0) ::close(m_epollFd);
+    }
+
+    const char* name() const override { return "epoll"; }
+
+    bool init() {
+        m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        m_eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_epollFd < 0 || m_eventFd < 0) {
+            m_lastError = std::string("epoll setup: ") + strerror(errno);
+            return false;
+        }
+        return watch(m_eventFd, EPOLLIN, WAKE_TAG, EPOLL_CTL_ADD);
+    }
+
+    bool listen(SocketHandle listenFd, AcceptCallback onAccept) override {
+        int flags = fcntl(listenFd, F_GETFL, 0);
+        if (flags < 0 || fcntl(listenFd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+            !watch(listenFd, EPOLLIN, LISTENER_TAG | m_listeners.size(), EPOLL_CTL_ADD)) {
+            m_lastError = std::string("listen: ") + strerror(errno);
+            return false;
+        }
+        m_listeners.push_back(Listener{ listenFd, std::move(onAccept) });
+        return true;
+    }
+
+    bool start() override {
+        if (m_running.exchange(true)) return true;
+        m_thread = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop() override {
+        if (!m_running.exchange(false)) return;
+        wake();
+        if (m_thread.joinable()) m_thread.join();
+        for (auto& entry : m_connections) {
+            entry.second.channel->markClosed("transport stopped");
+            ::close(entry.second.channel->fd());
+        }
+        m_connections.clear();
+        m_metrics.channels.set(0);
+    }
+
+protected:
+    void wake() override {
+        // reactor 自己（accept 回调里挂新连接）不用唤醒，本轮结束就会处理
+        if (std::this_thread::get_id() == m_thread.get_id()) return;
+        uint64_t one = 1;
+        ssize_t r = ::write(m_eventFd, &one, sizeof(one));
+        (void)r;
+        m_metrics.syscalls.inc();
+        m_metrics.wakeups.inc();
+    }
+
+private:
+    static constexpr uint64_t WAKE_TAG = 0;
+    static constexpr uint64_t LISTENER_TAG = uint64_t(1) << 63;
+    static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+    static constexpr size_t MAX_EVENTS = 256;
+    static constexpr size_t MAX_IOV = 64;
+
+    struct Listener {
+        SocketHandle fd;
+        AcceptCallback onAccept;
+    };
+
+    struct Connection {
+        std::shared_ptr<TransportChannel> channel;
+        std::deque<std::string> pending;   // 已取出、尚未写完的发送数据
+        size_t offset = 0;                 // pending.front() 已写出的字节
+        bool watched = false;
+        bool wantWrite = false;
+        bool failed = false;
+    };
+
+    bool watch(SocketHandle fd, uint32_t events, uint64_t tag, int op) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = tag;
+        m_metrics.syscalls.inc();
+        return ::epoll_ctl(m_epollFd, op, fd, &ev) == 0;
+    }
+
+    void run() {
+        epoll_event events[MAX_EVENTS];
+        std::vector<std::shared_ptr<TransportChannel>> scheduled;
+        while (m_running.load(std::memory_order_acquire)) {
+            int n = ::epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+            m_metrics.syscalls.inc();
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "[Transport] epoll_wait failed: " << strerror(errno) << std::endl;
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                uint64_t tag = events[i].data.u64;
+                if (tag == WAKE_TAG) {
+                    uint64_t value = 0;
+                    ssize_t r = ::read(m_eventFd, &value, sizeof(value));
+                    (void)r;
+                    m_metrics.syscalls.inc();
+                } else if (tag & LISTENER_TAG) {
+                    acceptReady(m_listeners[tag & ~LISTENER_TAG]);
+                } else {
+                    auto it = m_connections.find(tag);
+                    if (it == m_connections.end()) continue;
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) readReady(it->second);
+                    if ((events[i].events & EPOLLOUT) && !it->second.failed) flush(it->second);
+                }
+            }
+            // 新挂上的连接、有待发数据或要关闭的连接
+            takeScheduled(scheduled);
+            for (auto& channel : scheduled) handleScheduled(channel);
+            scheduled.clear();
+        }
+    }
+
+    void acceptReady(Listener& listener) {
+        while (true) {
+            sockaddr_in addr{};
+            socklen_t len = sizeof(addr);
+            SocketHandle fd = ::accept4(listener.fd, reinterpret_cast<sockaddr*>(&addr), &len,
+                                        SOCK_NONBLOCK | SOCK_CLOEXEC);
+            m_metrics.syscalls.inc();
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    std::cerr << "[Transport] accept4 failed: " << strerror(errno) << std::endl;
+                }
+                return;
+            }
+            char ip[INET_ADDRSTRLEN] = {0};
+            inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+            listener.onAccept(fd, ip, ntohs(addr.sin_port));
+        }
+    }
+
+    void handleScheduled(const std::shared_ptr<TransportChannel>& channel) {
+        auto it = m_connections.find(channel->id());
+        if (it == m_connections.end()) {
+            if (channel->closeRequested()) {
+                ::close(channel->fd());
+                m_metrics.syscalls.inc();
+                return;
+            }
+            Connection conn;
+            conn.channel = channel;
+            int flags = fcntl(channel->fd(), F_GETFL, 0);
+            if (!(flags & O_NONBLOCK)) {
+                fcntl(channel->fd(), F_SETFL, flags | O_NONBLOCK);
+                m_metrics.syscalls.inc();
+            }
+            conn.watched = watch(channel->fd(), EPOLLIN | EPOLLRDHUP, channel->id(), EPOLL_CTL_ADD);
+            if (!conn.watched) {
+                conn.failed = true;
+                channel->markClosed(std::string("epoll_ctl: ") + strerror(errno));
+            }
+            it = m_connections.emplace(channel->id(), std::move(conn)).first;
+            m_metrics.channels.inc();
+        }
+        Connection& conn = it->second;
+        if (!conn.failed) flush(conn);
+        if (channel->closeRequested()) release(it);
+    }
+
+    void readReady(Connection& conn) {
+        char* buf = m_readBuffer.data();
+        while (!conn.failed) {
+            ssize_t r = ::recv(conn.channel->fd(), buf, m_readBuffer.size(), 0);
+            m_metrics.syscalls.inc();
+            if (r > 0) {
+                if (!conn.channel->feed(buf, static_cast<size_t>(r))) {
+                    fail(conn, "payload too large");
+                    return;
+                }
+                // 没读满说明内核缓冲已经读空，省掉一次必然返回 EAGAIN 的 recv
+                if (static_cast<size_t>(r) < m_readBuffer.size()) return;
+                continue;
+            }
+            if (r == 0) { fail(conn, "peer closed"); return; }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            fail(conn, strerror(errno));
+            return;
+        }
+    }
+
+    void flush(Connection& conn) {
+        std::vector<std::string> outbound;
+        conn.channel->takeOutbound(outbound);
+        for (auto& bytes : outbound) conn.pending.push_back(std::move(bytes));
+
+        struct iovec iov[MAX_IOV];
+        while (!conn.pending.empty()) {
+            size_t n = std::min(conn.pending.size(), MAX_IOV);
+            for (size_t i = 0; i < n; ++i) {
+                size_t skip = (i == 0) ? conn.offset : 0;
+                iov[i].iov_base = const_cast<char*>(conn.pending[i].data() + skip);
+                iov[i].iov_len = conn.pending[i].size() - skip;
+            }
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = n;
+            ssize_t sent = ::sendmsg(conn.channel->fd(), &msg, MSG_NOSIGNAL);
+            m_metrics.syscalls.inc();
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    if (!conn.wantWrite) {
+                        conn.wantWrite = watch(conn.channel->fd(), EPOLLIN | EPOLLRDHUP | EPOLLOUT,
+                                               conn.channel->id(), EPOLL_CTL_MOD);
+                    }
+                    return;
+                }
+                fail(conn, strerror(errno));
+                return;
+            }
+            size_t done = static_cast<size_t>(sent);
+            conn.channel->sent(done);
+            while (!conn.pending.empty() && done >= conn.pending.front().size() - conn.offset) {
+                done -= conn.pending.front().size() - conn.offset;
+                conn.pending.pop_front();
+                conn.offset = 0;
+            }
+            conn.offset += done;
+        }
+        if (conn.wantWrite) {
+            watch(conn.channel->fd(), EPOLLIN | EPOLLRDHUP, conn.channel->id(), EPOLL_CTL_MOD);
+            conn.wantWrite = false;
+        }
+    }
+
+    // 出错或对端关闭：通知业务线程，停止关注该句柄；句柄等业务侧 close 时再关
+    void fail(Connection& conn, const std::string& reason) {
+        conn.failed = true;
+        conn.pending.clear();
+        conn.channel->markClosed(reason);
+        if (conn.watched) {
+            epoll_event ev{};
+            ::epoll_ctl(m_epollFd, EPOLL_CTL_DEL, conn.channel->fd(), &ev);
+            m_metrics.syscalls.inc();
+            conn.watched = false;
+        }
+    }
+
+    void release(std::unordered_map<uint64_t, Connection>::iterator it) {
+        Connection& conn = it->second;
+        // close 会把句柄从 epoll 中移除，不需要先 EPOLL_CTL_DEL
+        ::close(conn.channel->fd());
+        m_metrics.syscalls.inc();
+        m_connections.erase(it);
+        m_metrics.channels.dec();
+    }
+
+    TransportMetrics m_metrics;
+    SocketHandle m_epollFd;
+    SocketHandle m_eventFd;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+    std::vector<Listener> m_listeners;
+    std::unordered_map<uint64_t, Connection> m_connections;   // 只由 reactor 线程访问
+    std::vector<char> m_readBuffer;
+};
+
+#ifdef CHAT_HAVE_IO_URING
+
+// ========================================================================================
+// IoUringTransport - 直接用 io_uring 系统调用（不依赖 liburing）
+// ========================================================================================
+// - 每个连接一个 multishot recv，从 provided buffer ring 取缓冲区，一次提交持续产生完成事件；
+//   数据切帧后立即把缓冲区还给 ring
+// - 每个监听 socket 一个 multishot accept
+// - 同一连接的待发数据按顺序拼成不超过 64KB 的块，每块一个 IORING_OP_SEND，用 IOSQE_IO_LINK 串成一条链；
+//   一条链完成前不提交下一条，链内任何一步失败其余步骤会被取消，连接按出错处理
+// - reactor 每一轮：处理待办连接 → 一次 io_uring_enter（提交本轮全部 SQE 并等待至少一个完成）
+//   → 收割全部完成事件；唤醒用挂在 ring 上的 eventfd 读
+// - 关闭：等在途发送完成 → 取消 recv → IORING_OP_CLOSE，都不额外进入内核
+// ========================================================================================
+
+class IoUringTransport : public SocketTransport {
+public:
+    IoUringTransport()
+        : m_metrics("io_uring"), m_ringFd(-1), m_eventFd(-1), m_running(false),
+          m_sqRing(nullptr), m_cqRing(nullptr), m_sqRingSize(0), m_cqRingSize(0),
+          m_sqes(nullptr), m_sqesSize(0), m_bufRing(nullptr), m_bufRingSize(0),
+          m_bufTail(0), m_sqLocalTail(0), m_toSubmit(0), m_wakeValue(0) {}
+
+    ~IoUringTransport() override {
+        stop();
+        if (m_bufRing) munmap(m_bufRing, m_bufRingSize);
+        if (m_sqes) munmap(m_sqes, m_sqesSize);
+        if (m_cqRing && m_cqRing != m_sqRing) munmap(m_cqRing, m_cqRingSize);
+        if (m_sqRing) munmap(m_sqRing, m_sqRingSize);
+        if (m_ringFd >= 0) ::close(m_ringFd);
+        if (m_eventFd >= 0) ::close(m_eventFd);
+    }
+
+    const char* name() const override { return "io_uring"; }
+
+    bool init() {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+        params.cq_entries = QUEUE_DEPTH * 4;   // multishot 一次提交产生多个完成事件
+        m_ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+        if (m_ringFd < 0 && errno == EINVAL) {
+            // COOP_TASKRUN 需要 5.19
+            params = io_uring_params{};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = QUEUE_DEPTH * 4;
+            m_ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+        }
+        if (m_ringFd < 0) return setupFailed("io_uring_setup");
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+
+        m_sqRing = mapRing(m_sqRingSize, IORING_OFF_SQ_RING);
+        if (!m_sqRing) return setupFailed("mmap sq ring");
+        m_cqRing = singleMmap ? m_sqRing : mapRing(m_cqRingSize, IORING_OFF_CQ_RING);
+        if (!m_cqRing) return setupFailed("mmap cq ring");
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = static_cast<io_uring_sqe*>(mapRing(m_sqesSize, IORING_OFF_SQES));
+        if (!m_sqes) return setupFailed("mmap sqes");
+
+        char* sq = static_cast<char*>(m_sqRing);
+        char* cq = static_cast<char*>(m_cqRing);
+        m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqEntries = params.sq_entries;
+        unsigned* sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < m_sqEntries; ++i) sqArray[i] = i;   // SQE 下标与环位置一一对应
+        m_sqLocalTail = *m_sqTail;
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // provided buffer ring：内核在数据到达时才挑缓冲区，空闲连接不占接收内存
+        m_bufRingSize = BUFFER_COUNT * sizeof(io_uring_buf);
+        void* ring = mmap(nullptr, m_bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) return setupFailed("mmap buffer ring");
+        m_bufRing = static_cast<io_uring_buf_ring*>(ring);
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(m_bufRing);
+        reg.ring_entries = BUFFER_COUNT;
+        reg.bgid = BUFFER_GROUP;
+        if (::syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            return setupFailed("register buffer ring");
+        }
+        m_buffers.resize(static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE);
+        for (uint16_t bid = 0; bid < BUFFER_COUNT; ++bid) provideBuffer(bid);
+        publishBuffers();
+
+        m_eventFd = ::eventfd(0, EFD_CLOEXEC);
+        if (m_eventFd < 0) return setupFailed("eventfd");
+        return true;
+    }
+
+    bool listen(SocketHandle listenFd, AcceptCallback onAccept) override {
+        m_listeners.push_back(Listener{ listenFd, std::move(onAccept) });
+        return true;
+    }
+
+    bool start() override {
+        if (m_running.exchange(true)) return true;
+        m_thread = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop() override {
+        if (!m_running.exchange(false)) return;
+        uint64_t one = 1;
+        ssize_t r = ::write(m_eventFd, &one, sizeof(one));
+        (void)r;
+        if (m_thread.joinable()) m_thread.join();
+        // ring 关闭时内核会取消其上全部请求；这里只需交还句柄
+        for (auto& entry : m_connections) {
+            entry.second.channel->markClosed("transport stopped");
+            ::close(entry.second.channel->fd());
+        }
+        m_connections.clear();
+        m_metrics.channels.set(0);
+    }
+
+protected:
+    void wake() override {
+        if (std::this_thread::get_id() == m_thread.get_id()) return;
+        uint64_t one = 1;
+        ssize_t r = ::write(m_eventFd, &one, sizeof(one));
+        (void)r;
+        m_metrics.syscalls.inc();
+        m_metrics.wakeups.inc();
+    }
+
+private:
+    static constexpr unsigned QUEUE_DEPTH = 1024;
+    static constexpr unsigned BUFFER_COUNT = 512;            // 2 的幂
+    static constexpr unsigned BUFFER_SIZE = 16 * 1024;
+    static constexpr uint16_t BUFFER_GROUP = 0;
+    static constexpr size_t SEND_CHUNK_SIZE = 64 * 1024;      // 一个 SEND 最多拼这么多字节
+    static constexpr size_t MAX_LINKED_SENDS = 32;            // 一条链最多几个 SEND，多出的并进最后一段
+
+    enum Op : uint64_t { OP_WAKE = 1, OP_ACCEPT, OP_RECV, OP_SEND, OP_CANCEL, OP_CLOSE };
+    static constexpr uint64_t ID_MASK = (uint64_t(1) << 56) - 1;
+
+    static uint64_t tag(Op op, uint64_t id) { return (uint64_t(op) << 56) | (id & ID_MASK); }
+
+    struct Listener {
+        SocketHandle fd;
+        AcceptCallback onAccept;
+    };
+
+    struct Connection {
+        std::shared_ptr<TransportChannel> channel;
+        std::deque<std::string> inflight;   // 已提交、未完成的发送链，完成前缓冲区必须保持有效
+        bool recvArmed = false;
+        bool cancelIssued = false;
+        bool failed = false;
+    };
+
+    bool setupFailed(const char* step) {
+        m_lastError = std::string(step) + ": " + strerror(errno);
+        return false;
+    }
+
+    void* mapRing(size_t size, uint64_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd,
+                         static_cast<off_t>(offset));
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    // 不用 io_uring_buf_ring::bufs：它在 C++ 下经 __DECLARE_FLEX_ARRAY 展开，前面多出一个
+    // 空结构体占位，偏移不再是 0。环本身就是 io_uring_buf 数组，tail 叠在第 0 项的 resv 上
+    void provideBuffer(uint16_t bid) {
+        io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(m_bufRing) + (m_bufTail & (BUFFER_COUNT - 1));
+        buf->addr = reinterpret_cast<uint64_t>(m_buffers.data() + static_cast<size_t>(bid) * BUFFER_SIZE);
+        buf->len = BUFFER_SIZE;
+        buf->bid = bid;
+        ++m_bufTail;
+    }
+
+    void publishBuffers() {
+        __atomic_store_n(&m_bufRing->tail, m_bufTail, __ATOMIC_RELEASE);
+    }
+
+    // ---- 提交队列 ----
+
+    unsigned sqSpace() const {
+        return m_sqEntries - (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE));
+    }
+
+    // 保证接下来 n 个 SQE 能放进同一次提交（链不能跨提交）
+    void reserve(unsigned n) {
+        if (sqSpace() < n) enter(0);
+    }
+
+    io_uring_sqe* nextSqe() {
+        if (sqSpace() == 0) enter(0);
+        io_uring_sqe* sqe = &m_sqes[m_sqLocalTail & m_sqMask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        ++m_sqLocalTail;
+        ++m_toSubmit;
+        return sqe;
+    }
+
+    // 提交全部已准备的 SQE，waitFor > 0 时等待完成事件
+    void enter(unsigned waitFor) {
+        __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+        unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+        int submitted = static_cast<int>(::syscall(__NR_io_uring_enter, m_ringFd, m_toSubmit, waitFor, flags,
+                                                   nullptr, 0));
+        m_metrics.syscalls.inc();
+        if (submitted > 0) {
+            m_metrics.sqesSubmitted.inc(static_cast<uint64_t>(submitted));
+            m_toSubmit -= std::min(m_toSubmit, static_cast<unsigned>(submitted));
+        } else if (submitted < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            std::cerr << "[Transport] io_uring_enter failed: " << strerror(errno) << std::endl;
+        }
+    }
+
+    void armWake() {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = m_eventFd;
+        sqe->addr = reinterpret_cast<uint64_t>(&m_wakeValue);
+        sqe->len = sizeof(m_wakeValue);
+        sqe->user_data = tag(OP_WAKE, 0);
+    }
+
+    void armAccept(size_t index) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = m_listeners[index].fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = tag(OP_ACCEPT, index);
+    }
+
+    void armRecv(Connection& conn) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = conn.channel->fd();
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = tag(OP_RECV, conn.channel->id());
+        conn.recvArmed = true;
+    }
+
+    void cancelRecv(Connection& conn) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = tag(OP_RECV, conn.channel->id());
+        sqe->user_data = tag(OP_CANCEL, conn.channel->id());
+        conn.cancelIssued = true;
+    }
+
+    void closeAsync(SocketHandle fd, uint64_t id) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd;
+        sqe->user_data = tag(OP_CLOSE, id);
+    }
+
+    // 取出待发数据，准备成一条链接的 SEND 链。小块先拼到 SEND_CHUNK_SIZE 再发，
+    // 避免一帧一个 SEND（一帧一个 TCP 段，对端每段一次唤醒）
+    void submitSends(Connection& conn) {
+        std::vector<std::string> outbound;
+        conn.channel->takeOutbound(outbound);
+        if (outbound.empty() || conn.failed) return;
+        std::vector<std::string> chunks;
+        for (auto& bytes : outbound) {
+            // 链已到上限时其余全部并进最后一段
+            if (!chunks.empty() && (chunks.back().size() + bytes.size() <= SEND_CHUNK_SIZE ||
+                                    chunks.size() == MAX_LINKED_SENDS)) {
+                chunks.back() += bytes;
+            } else {
+                chunks.push_back(std::move(bytes));
+            }
+        }
+        reserve(static_cast<unsigned>(chunks.size()));
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            conn.inflight.push_back(std::move(chunks[i]));
+            const std::string& bytes = conn.inflight.back();   // deque 尾插不移动已有元素
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = conn.channel->fd();
+            sqe->addr = reinterpret_cast<uint64_t>(bytes.data());
+            sqe->len = static_cast<uint32_t>(bytes.size());
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;   // 内核内部处理部分发送
+            sqe->user_data = tag(OP_SEND, conn.channel->id());
+            if (i + 1 < chunks.size()) sqe->flags = IOSQE_IO_LINK;
+        }
+    }
+
+    void fail(Connection& conn, const std::string& reason) {
+        conn.failed = true;
+        conn.channel->markClosed(reason);
+    }
+
+    // 推进一个连接：发送链空闲时提交下一条；要关闭时依次等发送完成、取消 recv、关闭句柄
+    void progress(uint64_t id) {
+        auto it = m_connections.find(id);
+        if (it == m_connections.end()) return;
+        Connection& conn = it->second;
+        if (conn.inflight.empty()) submitSends(conn);
+
+        if (!conn.channel->closeRequested()) return;
+        if (!conn.inflight.empty()) return;
+        if (conn.recvArmed) {
+            if (!conn.cancelIssued) cancelRecv(conn);
+            return;
+        }
+        closeAsync(conn.channel->fd(), id);
+        m_connections.erase(it);
+        m_metrics.channels.dec();
+    }
+
+    void handleScheduled(const std::shared_ptr<TransportChannel>& channel) {
+        uint64_t id = channel->id();
+        if (m_connections.find(id) == m_connections.end()) {
+            if (channel->closeRequested()) {
+                closeAsync(channel->fd(), id);
+                return;
+            }
+            Connection conn;
+            conn.channel = channel;
+            armRecv(m_connections.emplace(id, std::move(conn)).first->second);
+            m_metrics.channels.inc();
+        }
+        progress(id);
+    }
+
+    void handleRecv(uint64_t id, const io_uring_cqe& cqe) {
+        auto it = m_connections.find(id);
+        Connection* conn = (it == m_connections.end()) ? nullptr : &it->second;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (conn && !conn->failed && cqe.res > 0 &&
+                !conn->channel->feed(m_buffers.data() + static_cast<size_t>(bid) * BUFFER_SIZE,
+                                     static_cast<size_t>(cqe.res))) {
+                fail(*conn, "payload too large");
+            }
+            provideBuffer(bid);
+            publishBuffers();
+        }
+        if (!conn) return;
+        if (!(cqe.flags & IORING_CQE_F_MORE)) conn->recvArmed = false;
+
+        if (cqe.res == 0) {
+            fail(*conn, "peer closed");
+        } else if (cqe.res == -ENOBUFS) {
+            m_metrics.bufferStarved.inc();   // 缓冲区都在用：上面已归还，下面重新挂上
+        } else if (cqe.res < 0 && cqe.res != -ECANCELED) {
+            fail(*conn, strerror(-cqe.res));
+        }
+        if (!conn->recvArmed && !conn->failed && !conn->channel->closeRequested()) armRecv(*conn);
+        progress(id);
+    }
+
+    void handleSend(uint64_t id, const io_uring_cqe& cqe) {
+        auto it = m_connections.find(id);
+        if (it == m_connections.end()) return;
+        Connection& conn = it->second;
+        size_t expected = conn.inflight.empty() ? 0 : conn.inflight.front().size();
+        if (!conn.inflight.empty()) conn.inflight.pop_front();
+        if (cqe.res > 0) conn.channel->sent(static_cast<size_t>(cqe.res));
+        if (!conn.failed && (cqe.res < 0 || static_cast<size_t>(cqe.res) < expected)) {
+            fail(conn, cqe.res < 0 ? strerror(-cqe.res) : "short send");
+        }
+        if (conn.inflight.empty()) progress(id);
+    }
+
+    void handleAccept(size_t index, const io_uring_cqe& cqe) {
+        if (cqe.res >= 0) {
+            std::string ip;
+            uint16_t port = 0;
+            peerAddress(cqe.res, ip, port);   // multishot accept 不回填对端地址
+            m_metrics.syscalls.inc();
+            m_listeners[index].onAccept(cqe.res, ip, port);
+        } else if (cqe.res != -ECANCELED) {
+            std::cerr << "[Transport] accept failed: " << strerror(-cqe.res) << std::endl;
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE) && m_running.load(std::memory_order_acquire)) armAccept(index);
+    }
+
+    void reapCompletions() {
+        unsigned head = *m_cqHead;
+        while (true) {
+            unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+            if (head == tail) break;
+            io_uring_cqe cqe = m_cqes[head & m_cqMask];
+            ++head;
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+            uint64_t id = cqe.user_data & ID_MASK;
+            switch (static_cast<Op>(cqe.user_data >> 56)) {
+            case OP_WAKE:
+                if (m_running.load(std::memory_order_acquire)) armWake();
+                break;
+            case OP_ACCEPT: handleAccept(static_cast<size_t>(id), cqe); break;
+            case OP_RECV: handleRecv(id, cqe); break;
+            case OP_SEND: handleSend(id, cqe); break;
+            default: break;   // 取消、关闭的结果不需要处理
+            }
+        }
+    }
+
+    void run() {
+        armWake();
+        for (size_t i = 0; i < m_listeners.size(); ++i) armAccept(i);
+        std::vector<std::shared_ptr<TransportChannel>> scheduled;
+        while (m_running.load(std::memory_order_acquire)) {
+            takeScheduled(scheduled);
+            for (auto& channel : scheduled) handleScheduled(channel);
+            scheduled.clear();
+            enter(1);
+            reapCompletions();
+        }
+    }
+
+    TransportMetrics m_metrics;
+    int m_ringFd;
+    SocketHandle m_eventFd;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+
+    void* m_sqRing;
+    void* m_cqRing;
+    size_t m_sqRingSize;
+    size_t m_cqRingSize;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+
+    io_uring_buf_ring* m_bufRing;
+    size_t m_bufRingSize;
+    uint16_t m_bufTail;
+    std::vector<char> m_buffers;
+
+    unsigned m_sqLocalTail;    // 已准备、未发布给内核的 SQ 尾
+    unsigned m_toSubmit;
+    uint64_t m_wakeValue;      // eventfd 读的目标缓冲区
+
+    std::vector<Listener> m_listeners;
+    std::unordered_map<uint64_t, Connection> m_connections;   // 只由 reactor 线程访问
+};
+
+#endif // CHAT_HAVE_IO_URING
+
+} // namespace
+
+#endif // __linux__
+
+std::unique_ptr<SocketTransport> SocketTransport::create(const std::string& backend) {
+#ifdef __linux__
+    if (backend == "io_uring") {
+#ifdef CHAT_HAVE_IO_URING
+        std::unique_ptr<IoUringTransport> ring(new IoUringTransport());
+        if (ring->init()) return ring;
+        std::cerr << "[Transport] io_uring unavailable (" << ring->getLastError()
+                  << "), falling back to epoll" << std::endl;
+#else
+        std::cerr << "[Transport] built without io_uring support, falling back to epoll" << std::endl;
+#endif
+    } else if (backend != "epoll") {
+        return nullptr;
+    }
+    std::unique_ptr<EpollTransport> epoll(new EpollTransport());
+    if (epoll->init()) return epoll;
+    std::cerr << "[Transport] epoll unavailable: " << epoll->getLastError() << std::endl;
+    return nullptr;
+#else
+    (void)backend;
+    return nullptr;
+#endif
+}
@@ -0,0 +1,140 @@
+#ifndef SOCKET_TRANSPORT_HPP
+#define SOCKET_TRANSPORT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tcp_socket.hpp"
+
+// ========================================================================================
+// SocketTransport - 可选的 reactor 收发后端（io_uring / epoll），挂在 TcpSocket 的帧接口之后
+// ========================================================================================
+// 默认的 TcpSocket 是阻塞读写：每个连接的读线程自己 recv，写端由发送线程轮流持有、各自 sendmsg。
+// 挂上 transport 后由一个 reactor 线程代为收发，业务线程只和内存队列打交道：
+// - 接收：reactor 持续读取（io_uring: multishot recv + provided buffer ring；epoll: 可读时
+//   一次读尽），按长度前缀切帧放入连接的接收队列，receivePipeMessage 从队列取
+// - 发送：sendPipeMessage 把编码好的字节追加到连接的发送队列，reactor 一轮内把所有连接的
+//   待发数据一起提交（io_uring: 同一连接的多段用 IOSQE_IO_LINK 串成链保证顺序，整批一次
+//   io_uring_enter；epoll: 每个连接一次 sendmsg）
+// - 监听：io_uring 用 multishot accept，epoll 用 accept4 直到 EAGAIN
+// - 业务线程只在 reactor 空闲时写一次 eventfd 唤醒它，高负载下一轮提交覆盖很多帧
+// 连接挂上之后句柄归 transport：TcpSocket::close 只发出关闭请求，reactor 在在途操作完成后关闭句柄，
+// 避免句柄号被新连接复用后收到旧连接的操作。
+// 处理模型：每个连接由自己的 ClientHandler 线程处理业务和等待 ACK；以 C++20 编译时也可以由协程处理，
+// 等待下一帧时用 notifyWhenReadable 挂起，不占线程。
+// 指标：chat_io_syscalls_total{backend=...} 统计 reactor 与唤醒发出的系统调用，
+// 与 chat_socket_frames_*_total 相除即每帧系统调用数（不含业务线程间的 futex 唤醒）。
+// ========================================================================================
+
+class SocketTransport;
+
+// 一个连接在 reactor 中的收发队列：业务线程与 reactor 线程的交接点
+class TransportChannel : public std::enable_shared_from_this<TransportChannel> {
+public:
+    enum class ReceiveStatus { Frame, Timeout, Closed };
+    // 已排队、内核还没收下的字节上限：对端长期不读时按连接失败处理，不无限堆积
+    static constexpr size_t MAX_UNSENT_BYTES = 4 * 1024 * 1024;
+
+    TransportChannel(SocketTransport& transport, SocketHandle fd, uint64_t id);
+
+    // ---- 业务线程 ----
+    // 追加已编码的字节（若干完整帧，含长度前缀）；连接已关闭或积压超过上限（随即关闭连接）返回 false
+    bool send(std::string&& bytes);
+    // 取一帧；compressed 表示长度前缀带压缩标记（由 TcpSocket 解压）；timeoutMs 为 0 时不等待
+    ReceiveStatus receive(std::string& frame, bool& compressed, int timeoutMs);
+    // 有帧可取或连接关闭时调用一次 callback（在 reactor 或关闭连接的线程上，应当很短）；
+    // 已经可取 / 已关闭时不登记并返回 false。同一时刻只保留一个回调，供协程等待下一帧
+    bool notifyWhenReadable(std::function<void()> callback);
+    bool isOpen() const { return !m_closed.load(std::memory_order_acquire); }
+    // 停止收发并请求 reactor 关闭句柄（已排队的发送数据会先尝试写出）
+    void close();
+    std::string closeReason() const;
+
+    // ---- reactor 线程 ----
+    SocketHandle fd() const { return m_fd; }
+    uint64_t id() const { return m_id; }
+    // 收到的原始字节：按长度前缀切帧入队；帧长度非法返回 false
+    bool feed(const char* data, size_t len);
+    // 取走全部待发送数据（保持顺序），取完后新的 send 会再次通知 reactor
+    void takeOutbound(std::vector<std::string>& out);
+    // 内核收下了 bytes 字节
+    void sent(size_t bytes) { m_unsentBytes.fetch_sub(bytes, std::memory_order_relaxed); }
+    // 对端关闭或出错：唤醒等待接收的线程，之后的 send 失败
+    void markClosed(const std::string& reason);
+    bool closeRequested() const { return m_closeRequested.load(std::memory_order_acquire); }
+
+private:
+    struct InboundFrame {
+        std::string payload;
+        bool compressed;
+    };
+
+    SocketTransport& m_transport;
+    const SocketHandle m_fd;
+    const uint64_t m_id;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_readable;
+    std::deque<InboundFrame> m_inbound;
+    std::function<void()> m_onReadable;   // notifyWhenReadable 登记的回调，触发一次后清空
+    std::vector<std::string> m_outbound;
+    bool m_flushScheduled;                 // 已通知 reactor、尚未取走
+    std::atomic<size_t> m_unsentBytes;     // send 追加、reactor 写出后扣减
+    std::string m_reason;
+    std::atomic<bool> m_closed;
+    std::atomic<bool> m_closeRequested;
+
+    std::string m_partial;                 // reactor 独占：未凑齐一帧的字节
+};
+
+class SocketTransport {
+public:
+    // 新连接回调，在 reactor 线程上执行；fd 所有权归回调，通常直接 attach 到同一个 transport
+    using AcceptCallback = std::function<void(SocketHandle fd, const std::string& ip, uint16_t port)>;
+
+    virtual ~SocketTransport();
+
+    // backend: "io_uring" 或 "epoll"；io_uring 不可用（内核过旧、被 seccomp 禁用）时回退到 epoll。
+    // 其他名字或非 Linux 平台返回空，调用方继续用阻塞读写
+    static std::unique_ptr<SocketTransport> create(const std::string& backend);
+
+    virtual const char* name() const = 0;
+    // listen 需在 start 之前调用
+    virtual bool listen(SocketHandle listenFd, AcceptCallback onAccept) = 0;
+    virtual bool start() = 0;
+    virtual void stop() = 0;
+
+    // 接管已连接 socket；之后句柄由 transport 关闭
+    std::shared_ptr<TransportChannel> attach(SocketHandle fd);
+
+    std::string getLastError() const { return m_lastError; }
+
+protected:
+    friend class TransportChannel;
+
+    SocketTransport();
+
+    // 连接有新的待发数据 / 关闭请求 / 刚挂上：放入待处理列表，reactor 空闲时唤醒它
+    void schedule(std::shared_ptr<TransportChannel> channel);
+    // reactor 取走待处理列表；先清唤醒标记再取，之后的 schedule 会重新唤醒
+    void takeScheduled(std::vector<std::shared_ptr<TransportChannel>>& out);
+    // 写 eventfd；实现里计入系统调用数
+    virtual void wake() = 0;
+
+    std::string m_lastError;
+
+private:
+    std::mutex m_scheduleMutex;
+    std::vector<std::shared_ptr<TransportChannel>> m_scheduled;
+    std::atomic<bool> m_wakePending;
+    std::atomic<uint64_t> m_nextChannelId;
+};
+
+#endif // SOCKET_TRANSPORT_HPP
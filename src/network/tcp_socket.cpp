@@ -1,12 +1,48 @@
 #include "tcp_socket.hpp"
+#include "socket_transport.hpp"
+#include "../common/Compression.hpp"
+#include "../common/Metrics.hpp"
 #include <iostream>
 #include <vector>
 #include <chrono>
 #include <thread>
 #include <cstring>
+#include <algorithm>
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#include <poll.h>
+#endif
+
+// 分帧层指标（所有连接汇总）；引用在首次使用时注册一次
+struct SocketMetrics {
+    Counter& framesSent;
+    Counter& framesReceived;
+    Counter& bytesSent;
+    Counter& bytesReceived;
+    Counter& sendErrors;
+    Counter& sendWouldBlock;
+    Counter& framesCompressed;
+    Counter& compressionSavedBytes;
+    Counter& framesDecompressed;
+    Histogram& frameSendSeconds;
+};
 
-// 控制单条消息最大长度（可调整）
-static const uint32_t MAX_PIPE_MESSAGE_SIZE = 64 * 1024; // 64KB
+static SocketMetrics& socketMetrics() {
+    MetricsRegistry& r = MetricsRegistry::instance();
+    static SocketMetrics metrics{
+        r.counter("chat_socket_frames_sent_total", "Length-prefixed frames written to sockets"),
+        r.counter("chat_socket_frames_received_total", "Length-prefixed frames read from sockets"),
+        r.counter("chat_socket_bytes_sent_total", "Frame bytes written, including length prefix"),
+        r.counter("chat_socket_bytes_received_total", "Frame bytes read, including length prefix"),
+        r.counter("chat_socket_send_errors_total", "Frame sends that failed"),
+        r.counter("chat_socket_send_would_block_total", "Send retries after EAGAIN (peer not draining)"),
+        r.counter("chat_socket_frames_compressed_total", "Frames sent compressed on connections that negotiated compression"),
+        r.counter("chat_socket_compression_saved_bytes_total", "Bytes saved on the wire by frame compression"),
+        r.counter("chat_socket_frames_decompressed_total", "Compressed frames received and decompressed"),
+        r.histogram("chat_socket_frame_send_seconds", "Time to hand one frame to the kernel; tail shows backpressure"),
+    };
+    return metrics;
+}
 
 TcpSocket::TcpSocket()
     : m_socket(
@@ -17,11 +53,22 @@ TcpSocket::TcpSocket()
 #endif
       ),
       m_socketValid(false),
+      m_ioFailed(false),
+      m_writers(0),
+      m_writeQueue(nullptr),
+      m_queuedBytes(0),
+      m_writeBackpressure(false),
+      m_writeError(0),
+      m_compressor(nullptr),
       m_lastError(),
-      m_lastErrorCode(0) {}
+      m_lastErrorCode(0),
+      m_receiveTimeoutSec(-1),
+      m_readStart(0),
+      m_readEnd(0) {}
 
 TcpSocket::~TcpSocket() {
     close();
+    resetCompression();
 }
 
 bool TcpSocket::init() {
@@ -45,8 +92,9 @@ void TcpSocket::cleanup() {
 }
 
 bool TcpSocket::create() {
-    std::lock_guard<std::mutex> lk(m_socketMutex);
-    close(true); // 已持有锁，直接调用内部版本
+    close();
+    m_channel.reset();
+    resetCompression();
 
     m_socket = ::socket(AF_INET, SOCK_STREAM, 0);
 #ifdef _WIN32
@@ -81,6 +129,7 @@ bool TcpSocket::create() {
     }
     std::cout << "[DEBUG] SO_REUSEADDR set successfully" << std::endl;
 
+    resetState();
     setSocketValid(true);
     return true;
 }
@@ -137,6 +186,38 @@ bool TcpSocket::listen(int backlog) {
     return true;
 }
 
+bool TcpSocket::setReusePort(bool enable) {
+    if (!isSocketValid()) { m_lastError = "socket not created"; return false; }
+#ifdef SO_REUSEPORT
+    int opt = enable ? 1 : 0;
+    if (setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&opt), sizeof(opt)) < 0) {
+        m_lastErrorCode = errno;
+        m_lastError = errorToString(m_lastErrorCode);
+        return false;
+    }
+    return true;
+#else
+    (void)enable;
+    m_lastError = "SO_REUSEPORT not supported";
+    return false;
+#endif
+}
+
+bool TcpSocket::setNoDelay(bool enable) {
+    if (!isSocketValid()) { m_lastError = "socket not created"; return false; }
+    int opt = enable ? 1 : 0;
+    if (setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&opt), sizeof(opt)) < 0) {
+#ifdef _WIN32
+        m_lastErrorCode = WSAGetLastError();
+#else
+        m_lastErrorCode = errno;
+#endif
+        m_lastError = errorToString(m_lastErrorCode);
+        return false;
+    }
+    return true;
+}
+
 SocketHandle TcpSocket::accept(std::string& clientIp, uint16_t& clientPort) {
     if (!isSocketValid()) { m_lastError = "socket not created"; return -1; }
 
@@ -252,77 +333,85 @@ bool TcpSocket::connect(const std::string& ip, uint16_t port) {
         m_lastError = errorToString(m_lastErrorCode);
         return false;
     }
+    resetState();
     return true;
 }
 
-// helper: 完整发送
-bool TcpSocket::sendAll(const char* buf, size_t len) {
+// helper: 完整发送（写端持有者调用，不触碰读端的错误字段）
+// 非 Windows 下每次都不阻塞地写（MSG_DONTWAIT），写不动时 poll 等待，一直没有进展超过 SEND_TIMEOUT_MS 返回超时
+int TcpSocket::sendAll(const char* buf, size_t len) {
     size_t sent = 0;
+    std::chrono::steady_clock::time_point deadline;
     while (sent < len) {
 #ifdef _WIN32
         int n = ::send(m_socket, buf + sent, static_cast<int>(len - sent), 0);
 #else
-        ssize_t n = ::send(m_socket, buf + sent, len - sent, MSG_NOSIGNAL);
+        ssize_t n = ::send(m_socket, buf + sent, len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
 #endif
-        if (n > 0) { sent += static_cast<size_t>(n); continue; }
-        if (n == 0) { m_lastError = "peer closed"; return false; }
+        if (n > 0) {
+            sent += static_cast<size_t>(n);
+            deadline = std::chrono::steady_clock::time_point();
+            continue;
+        }
+        if (n == 0) return WRITE_ERROR_PEER_CLOSED;
 
 #ifdef _WIN32
         int err = WSAGetLastError();
         if (err == WSAEINTR) continue;
-        m_lastErrorCode = err;
+        return err;
 #else
         if (errno == EINTR) continue;
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            socketMetrics().sendWouldBlock.inc();
+            int error = waitWritable(deadline);
+            if (error != 0) return error;
             continue;
         }
-        m_lastErrorCode = errno;
+        return errno;
 #endif
-        m_lastError = errorToString(m_lastErrorCode);
-        return false;
     }
-    return true;
+    return 0;
 }
 
-// helper: 完整接收指定长度数据
-bool TcpSocket::recvAll(char* buf, size_t len) {
-    size_t got = 0;
-    while (got < len) {
-#ifdef _WIN32
-        int r = ::recv(m_socket, buf + got, static_cast<int>(len - got), 0);
-#else
-        ssize_t r = ::recv(m_socket, buf + got, len - got, 0);
-#endif
-        if (r > 0) { got += static_cast<size_t>(r); continue; }
-        if (r == 0) { m_lastError = "peer closed"; return false; }
-#ifdef _WIN32
-        int err = WSAGetLastError();
-        if (err == WSAEINTR) continue;
-        if (err == WSAEWOULDBLOCK || err == WSAETIMEDOUT) { m_lastError = "no data"; return false; }
-        m_lastErrorCode = err;
-#else
-        if (errno == EINTR) continue;
-        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ETIMEDOUT) { m_lastError = "no data"; return false; }
-        m_lastErrorCode = errno;
-#endif
-        m_lastError = errorToString(m_lastErrorCode);
-        return false;
+#ifndef _WIN32
+int TcpSocket::waitWritable(std::chrono::steady_clock::time_point& deadline) {
+    auto now = std::chrono::steady_clock::now();
+    if (deadline == std::chrono::steady_clock::time_point()) deadline = now + std::chrono::milliseconds(SEND_TIMEOUT_MS);
+    while (now < deadline) {
+        pollfd pfd;
+        pfd.fd = m_socket;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        int waitMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()) + 1;
+        int ret = ::poll(&pfd, 1, waitMs);
+        if (ret > 0) return 0;  // 可写或出错，都交给下一次 send 判断
+        if (ret < 0 && errno != EINTR) return errno;
+        now = std::chrono::steady_clock::now();
     }
-    return true;
+    return WRITE_ERROR_TIMEOUT;
 }
+#endif
 
 // 直接send包装（会尝试一次完整发送）
 ssize_t TcpSocket::send(const std::string& data) {
-    if (!isSocketValid()) { m_lastError = "invalid socket"; return -1; }
+    if (!isSocketValid()) return -1;
     if (data.empty()) return 0;
-    if (!sendAll(data.data(), data.size())) return -1;
+    PipeSegment segment = { data.data(), data.size() };
+    if (!writeSegments(&segment, 1, data.size(), false)) return -1;
     return static_cast<ssize_t>(data.size());
 }
 
 // recv：一次性读取可用数据（最多 maxLen）
 ssize_t TcpSocket::recv(std::string& data, size_t maxLen) {
     if (!isSocketValid()) { m_lastError = "invalid socket"; return -1; }
+    // 先交出分帧时多读进缓冲的字节
+    if (m_readEnd > m_readStart) {
+        size_t n = std::min(maxLen, m_readEnd - m_readStart);
+        data.assign(m_readBuffer.data() + m_readStart, n);
+        m_readStart += n;
+        if (m_readStart == m_readEnd) m_readStart = m_readEnd = 0;
+        return static_cast<ssize_t>(n);
+    }
     std::vector<char> buf(maxLen);
 #ifdef _WIN32
     int r = ::recv(m_socket, buf.data(), static_cast<int>(maxLen), 0);
@@ -333,7 +422,7 @@ ssize_t TcpSocket::recv(std::string& data, size_t maxLen) {
         data.assign(buf.data(), static_cast<size_t>(r));
         return r;
     }
-    if (r == 0) { data.clear(); return 0; } // orderly shutdown
+    if (r == 0) { data.clear(); m_ioFailed = true; return 0; } // orderly shutdown
 #ifdef _WIN32
     int err = WSAGetLastError();
     if (err == WSAEWOULDBLOCK || err == WSAETIMEDOUT) { m_lastError = "no data"; return -1; }
@@ -343,102 +432,449 @@ ssize_t TcpSocket::recv(std::string& data, size_t maxLen) {
     m_lastErrorCode = errno;
 #endif
     m_lastError = errorToString(m_lastErrorCode);
+    m_ioFailed = true;
     return -1;
 }
 
 // 长度前缀消息发送（4 字节网络序）
 bool TcpSocket::sendPipeMessage(const std::string& message) {
-    if (!isSocketValid()) { m_lastError = "invalid socket"; return false; }
-    if (message.size() > MAX_PIPE_MESSAGE_SIZE) { m_lastError = "message too large"; return false; }
-    uint32_t len = static_cast<uint32_t>(message.size());
-    uint32_t netlen = htonl(len);
-    if (!sendAll(reinterpret_cast<const char*>(&netlen), sizeof(netlen))) return false;
-    if (len > 0) {
-        if (!sendAll(message.data(), len)) return false;
+    return sendPipeMessage(message.data(), message.size());
+}
+
+bool TcpSocket::sendPipeMessage(const char* data, size_t len) {
+    PipeSegment segment = { data, len };
+    return sendPipeMessage(&segment, 1);
+}
+
+// 分段帧：长度前缀与各段一起提交（POSIX 下一次 sendmsg），小帧只需一次系统调用
+bool TcpSocket::sendPipeMessage(const PipeSegment* segments, size_t count) {
+    if (!isSocketValid()) return false;
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) total += segments[i].size;
+    if (total > MAX_PIPE_MESSAGE_SIZE) return false;
+
+    SocketMetrics& metrics = socketMetrics();
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t netlen = htonl(static_cast<uint32_t>(total));
+    std::vector<PipeSegment> frame;
+    frame.reserve(count + 1);
+    frame.push_back(PipeSegment{ reinterpret_cast<const char*>(&netlen), sizeof(netlen) });
+    for (size_t i = 0; i < count; ++i) {
+        if (segments[i].size > 0) frame.push_back(segments[i]);
+    }
+    if (!writeSegments(frame.data(), frame.size(), total + sizeof(netlen))) return false;
+    metrics.framesSent.inc();
+    metrics.bytesSent.inc(total + sizeof(netlen));
+    metrics.frameSendSeconds.observeSince(start);
+    return true;
+}
+
+// 多帧批量：长度前缀与帧交替排成一组段，一次 sendAllSegments（每 32 帧一次 sendmsg）
+bool TcpSocket::sendPipeMessages(const PipeSegment* frames, size_t count) {
+    if (!isSocketValid()) return false;
+    if (count == 0) return true;
+
+    SocketMetrics& metrics = socketMetrics();
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<uint32_t> headers(count);
+    std::vector<PipeSegment> segments;
+    segments.reserve(count * 2);
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (frames[i].size > MAX_PIPE_MESSAGE_SIZE) return false;
+        headers[i] = htonl(static_cast<uint32_t>(frames[i].size));
+        segments.push_back(PipeSegment{ reinterpret_cast<const char*>(&headers[i]), sizeof(uint32_t) });
+        if (frames[i].size > 0) segments.push_back(frames[i]);
+        bytes += frames[i].size + sizeof(uint32_t);
+    }
+    if (!writeSegments(segments.data(), segments.size(), bytes)) return false;
+    metrics.framesSent.inc(count);
+    metrics.bytesSent.inc(bytes);
+    metrics.frameSendSeconds.observeSince(start);
+    return true;
+}
+
+// 写端交接：计数从 0 变 1 的调用者持有写端。close 先清 m_socketValid 再等计数归零，
+// 持有者先登记计数再检查 m_socketValid（两边都是顺序一致的原子操作），所以 close 释放句柄后不会再有线程写它
+bool TcpSocket::writeSegments(PipeSegment* segments, size_t count, size_t bytes, bool framed) {
+    if (m_writeBackpressure.load(std::memory_order_acquire) && !waitForDrain()) {
+        socketMetrics().sendErrors.inc();
+        return false;
+    }
+    if (m_writers.fetch_add(1) != 0) {
+        // 写端在其他线程手里：拷贝成连续字节入队，持有者交还写端前按顺序写出。
+        // 积压超过上限时先打开背压（在入队前，持有者交还写端时一定看得到并关掉）
+        if (m_queuedBytes.fetch_add(bytes) + bytes > MAX_QUEUED_BYTES) {
+            m_writeBackpressure.store(true, std::memory_order_release);
+        }
+        WriteNode* node = new WriteNode;
+        node->framed = framed;
+        node->bytes.reserve(bytes);
+        for (size_t i = 0; i < count; ++i) node->bytes.append(segments[i].data, segments[i].size);
+        node->next = m_writeQueue.load(std::memory_order_relaxed);
+        while (!m_writeQueue.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                                   std::memory_order_relaxed)) {
+        }
+        return m_writeError.load(std::memory_order_acquire) == 0;
+    }
+
+    // 持有写端：直接从调用方内存写出，不拷贝；要压缩或交给 reactor 时才拼成连续字节
+    bool ok = false;
+    if (!isSocketValid()) {
+        failWrite(WRITE_ERROR_CLOSED);
+    } else if (m_writeError.load(std::memory_order_acquire) == 0) {
+        int error = 0;
+        if (!m_channel && !m_compressor.load(std::memory_order_acquire)) {
+            error = sendAllSegments(segments, count);
+        } else {
+            std::string raw;
+            const char* data = segments[0].data;
+            if (count > 1) {
+                raw.reserve(bytes);
+                for (size_t i = 0; i < count; ++i) raw.append(segments[i].data, segments[i].size);
+                data = raw.data();
+            }
+            std::string out;
+            appendEncoded(out, data, bytes, framed);
+            error = writeBytes(std::move(out));
+        }
+        if (error != 0) failWrite(error);
+        ok = (error == 0);
+    }
+    if (!ok) socketMetrics().sendErrors.inc();
+    drainWriteQueue(1);
+    return ok;
+}
+
+// 持有者代发的量超过 MAX_QUEUED_BYTES 后打开背压：新的写入不再入队，持有者写完已登记的帧就能交还写端
+void TcpSocket::drainWriteQueue(uint32_t done) {
+    std::vector<WriteNode*> nodes;
+    std::vector<PipeSegment> segments;
+    size_t drained = 0;
+    uint32_t remaining = m_writers.fetch_sub(done) - done;
+    while (remaining != 0) {
+        WriteNode* head = m_writeQueue.exchange(nullptr, std::memory_order_acquire);
+        if (!head) {
+            // 对方已登记计数、尚未入队
+            std::this_thread::yield();
+            continue;
+        }
+        nodes.clear();
+        for (WriteNode* node = head; node; node = node->next) nodes.push_back(node);
+        std::reverse(nodes.begin(), nodes.end());
+
+        // 排队的帧合并成一次分段写出；连接已失败则丢弃
+        if (isSocketValid() && m_writeError.load(std::memory_order_acquire) == 0) {
+            int error = 0;
+            if (!m_channel && !m_compressor.load(std::memory_order_acquire)) {
+                segments.clear();
+                for (WriteNode* node : nodes) {
+                    if (!node->bytes.empty()) segments.push_back(PipeSegment{ node->bytes.data(), node->bytes.size() });
+                }
+                error = sendAllSegments(segments.data(), segments.size());
+            } else {
+                std::string out;
+                for (WriteNode* node : nodes) appendEncoded(out, node->bytes.data(), node->bytes.size(), node->framed);
+                error = writeBytes(std::move(out));
+            }
+            if (error != 0) {
+                failWrite(error);
+                socketMetrics().sendErrors.inc(nodes.size());
+            }
+        } else {
+            socketMetrics().sendErrors.inc(nodes.size());
+        }
+        size_t bytes = 0;
+        for (WriteNode* node : nodes) {
+            bytes += node->bytes.size();
+            delete node;
+        }
+        m_queuedBytes.fetch_sub(bytes);
+        drained += bytes;
+        if (drained > MAX_QUEUED_BYTES) m_writeBackpressure.store(true, std::memory_order_release);
+        remaining = m_writers.fetch_sub(static_cast<uint32_t>(nodes.size())) - static_cast<uint32_t>(nodes.size());
+    }
+    if (drained > 0) m_writeBackpressure.store(false, std::memory_order_release);
+}
+
+bool TcpSocket::waitForDrain() {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SEND_TIMEOUT_MS);
+    while (m_writeBackpressure.load(std::memory_order_acquire)) {
+        if (!isSocketValid() || m_writeError.load(std::memory_order_acquire) != 0) return false;
+        if (std::chrono::steady_clock::now() >= deadline) {
+            // 对端长时间收不动：判定连接失败，持有者随后丢弃队列里剩下的帧
+            failWrite(WRITE_ERROR_TIMEOUT);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
     }
     return true;
 }
 
+// 写端错误只记第一次：之后的发送直接失败，读端也据此判断连接已断
+void TcpSocket::failWrite(int code) {
+    int expected = 0;
+    m_writeError.compare_exchange_strong(expected, code, std::memory_order_acq_rel);
+    m_ioFailed = true;
+}
+
+// 开启压缩时逐帧压缩（够大且压得动的帧置标记），否则原样追加
+void TcpSocket::appendEncoded(std::string& out, const char* data, size_t len, bool framed) {
+    FrameCompressor* compressor = m_compressor.load(std::memory_order_acquire);
+    if (!compressor || !framed) {
+        out.append(data, len);
+        return;
+    }
+    std::string encoded;
+    size_t compressed = compressor->compressFrames(data, len, encoded, COMPRESSED_FRAME_FLAG);
+    if (compressed > 0) {
+        SocketMetrics& metrics = socketMetrics();
+        metrics.framesCompressed.inc(compressed);
+        metrics.compressionSavedBytes.inc(len - encoded.size());
+    }
+    if (out.empty()) {
+        out.swap(encoded);
+    } else {
+        out.append(encoded);
+    }
+}
+
+// 挂了 transport 时整批作为一段交给 reactor（io_uring 下是一个 SEND），否则直接写
+int TcpSocket::writeBytes(std::string&& bytes) {
+    if (bytes.empty()) return 0;
+    if (m_channel) return m_channel->send(std::move(bytes)) ? 0 : WRITE_ERROR_CLOSED;
+    return sendAll(bytes.data(), bytes.size());
+}
+
+// helper: 分段完整发送，会修改 segments 记录进度；返回 0 或写端错误码
+int TcpSocket::sendAllSegments(PipeSegment* segments, size_t count) {
+#ifdef _WIN32
+    for (size_t i = 0; i < count; ++i) {
+        int error = sendAll(segments[i].data, segments[i].size);
+        if (error != 0) return error;
+    }
+    return 0;
+#else
+    const size_t MAX_IOV = 64;
+    struct iovec iov[MAX_IOV];
+    size_t first = 0;
+    std::chrono::steady_clock::time_point deadline;
+    while (first < count) {
+        size_t n = std::min(count - first, MAX_IOV);
+        for (size_t i = 0; i < n; ++i) {
+            iov[i].iov_base = const_cast<char*>(segments[first + i].data);
+            iov[i].iov_len = segments[first + i].size;
+        }
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+
+        ssize_t sent = ::sendmsg(m_socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                socketMetrics().sendWouldBlock.inc();
+                int error = waitWritable(deadline);
+                if (error != 0) return error;
+                continue;
+            }
+            return errno;
+        }
+        if (sent == 0) return WRITE_ERROR_PEER_CLOSED;
+        deadline = std::chrono::steady_clock::time_point();
+
+        // 跳过已发完的段，部分发送的段前移起点
+        size_t done = static_cast<size_t>(sent);
+        while (first < count && done >= segments[first].size) {
+            done -= segments[first].size;
+            ++first;
+        }
+        if (first < count) {
+            segments[first].data += done;
+            segments[first].size -= done;
+        }
+    }
+    return 0;
+#endif
+}
+
 // receivePipeMessage: timeoutSec == 0 => 非阻塞立刻返回； >0 => setsockopt 超时（秒）
 bool TcpSocket::receivePipeMessage(std::string& message, uint32_t timeoutSec) {
     message.clear();
     if (!isSocketValid()) { m_lastError = "invalid socket"; return false; }
-    // set receive timeout
-    setReceiveTimeout(static_cast<int>(timeoutSec));
+    if (m_channel) {
+        // reactor 已切好帧，这里只是从队列取，不进入内核
+        bool compressed = false;
+        switch (m_channel->receive(message, compressed, static_cast<int>(timeoutSec * 1000))) {
+        case TransportChannel::ReceiveStatus::Frame: {
+            SocketMetrics& metrics = socketMetrics();
+            metrics.framesReceived.inc();
+            metrics.bytesReceived.inc(message.size() + sizeof(uint32_t));
+            if (compressed) {
+                std::string packed;
+                packed.swap(message);
+                return inflateFrame(packed.data(), packed.size(), message);
+            }
+            return true;
+        }
+        case TransportChannel::ReceiveStatus::Timeout:
+            m_lastError = "no data";
+            return false;
+        case TransportChannel::ReceiveStatus::Closed:
+            m_lastError = m_channel->closeReason();
+            m_ioFailed = true;
+            return false;
+        }
+    }
+    // 超时不变时不重复 setsockopt（处理循环每次都用同一个超时）
+    if (static_cast<int>(timeoutSec) != m_receiveTimeoutSec) setReceiveTimeout(static_cast<int>(timeoutSec));
+
+    // 从接收缓冲切帧；不够一帧时 recv 一次，尽量多读，后面几帧不再进内核
+    while (true) {
+        size_t buffered = m_readEnd - m_readStart;
+        size_t need = sizeof(uint32_t);
+        if (buffered >= sizeof(uint32_t)) {
+            uint32_t netlen = 0;
+            std::memcpy(&netlen, m_readBuffer.data() + m_readStart, sizeof(netlen));
+            uint32_t header = ntohl(netlen);
+            uint32_t payloadLen = header & ~COMPRESSED_FRAME_FLAG;
+            if (payloadLen > MAX_PIPE_MESSAGE_SIZE) { m_lastError = "payload too large"; m_ioFailed = true; return false; }
+            need = sizeof(netlen) + payloadLen;
+            if (buffered >= need) {
+                const char* payload = m_readBuffer.data() + m_readStart + sizeof(netlen);
+                bool ok = true;
+                if (header & COMPRESSED_FRAME_FLAG) {
+                    ok = inflateFrame(payload, payloadLen, message);
+                } else {
+                    message.assign(payload, payloadLen);
+                }
+                m_readStart += need;
+                if (m_readStart == m_readEnd) m_readStart = m_readEnd = 0;
+
+                SocketMetrics& metrics = socketMetrics();
+                metrics.framesReceived.inc();
+                metrics.bytesReceived.inc(need);
+                return ok;
+            }
+        }
+        if (!fillReadBuffer(need)) return false;
+    }
+}
 
-    // peek 4 字节长度
-    uint32_t netlen = 0;
+bool TcpSocket::inflateFrame(const char* data, size_t len, std::string& message) {
+    if (!m_decompressor) {
+        m_lastError = "unexpected compressed frame";
+        m_ioFailed = true;
+        return false;
+    }
+    if (!m_decompressor->decompress(data, len, message, MAX_PIPE_MESSAGE_SIZE)) {
+        m_lastError = "corrupt compressed frame";
+        m_ioFailed = true;
+        return false;
+    }
+    socketMetrics().framesDecompressed.inc();
+    return true;
+}
+
+// 读一次：未读完的字节挪到缓冲开头，保证放得下 need 字节的整帧
+size_t TcpSocket::peekBuffered(const char*& data) const {
+    data = m_readBuffer.data() + m_readStart;
+    return m_readEnd - m_readStart;
+}
+
+void TcpSocket::consumeBuffered(size_t n) {
+    m_readStart += std::min(n, m_readEnd - m_readStart);
+    if (m_readStart == m_readEnd) m_readStart = m_readEnd = 0;
+}
+
+bool TcpSocket::fillReadBuffer(size_t need) {
+    if (m_readStart > 0) {
+        std::memmove(m_readBuffer.data(), m_readBuffer.data() + m_readStart, m_readEnd - m_readStart);
+        m_readEnd -= m_readStart;
+        m_readStart = 0;
+    }
+    size_t capacity = std::max(need, READ_BUFFER_SIZE);
+    if (m_readBuffer.size() < capacity) m_readBuffer.resize(capacity);
+
+    while (true) {
 #ifdef _WIN32
-    int peekR = ::recv(m_socket, reinterpret_cast<char*>(&netlen), sizeof(netlen), MSG_PEEK);
+        int r = ::recv(m_socket, m_readBuffer.data() + m_readEnd, static_cast<int>(m_readBuffer.size() - m_readEnd), 0);
 #else
-    ssize_t peekR = ::recv(m_socket, reinterpret_cast<char*>(&netlen), sizeof(netlen), MSG_PEEK);
+        ssize_t r = ::recv(m_socket, m_readBuffer.data() + m_readEnd, m_readBuffer.size() - m_readEnd, 0);
 #endif
-    if (peekR <= 0) {
-        // no data or error or closed
+        if (r > 0) { m_readEnd += static_cast<size_t>(r); return true; }
+        if (r == 0) { m_lastError = "peer closed"; m_ioFailed = true; return false; }
 #ifdef _WIN32
         int err = WSAGetLastError();
+        if (err == WSAEINTR) continue;
         if (err == WSAEWOULDBLOCK || err == WSAETIMEDOUT) { m_lastError = "no data"; return false; }
         m_lastErrorCode = err;
 #else
-        if (peekR == 0) { m_lastError = "peer closed"; return false; }
+        if (errno == EINTR) continue;
         if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ETIMEDOUT) { m_lastError = "no data"; return false; }
         m_lastErrorCode = errno;
 #endif
         m_lastError = errorToString(m_lastErrorCode);
+        m_ioFailed = true;
         return false;
     }
-
-    // 如果 peekR < 4，说明没有完整长度头：作为兼容性 fallback，直接读取一次 available 数据
-    if (static_cast<size_t>(peekR) < sizeof(netlen)) {
-        std::string tmp;
-        ssize_t r = recv(tmp, MAX_PIPE_MESSAGE_SIZE);
-        if (r > 0) { message = tmp; return true; }
-        return false;
-    }
-
-    // 读取并消费长度字段
-    if (!recvAll(reinterpret_cast<char*>(&netlen), sizeof(netlen))) return false;
-    uint32_t payloadLen = ntohl(netlen);
-    if (payloadLen == 0) { message.clear(); return true; }
-    if (payloadLen > MAX_PIPE_MESSAGE_SIZE) { m_lastError = "payload too large"; return false; }
-
-    std::vector<char> buf(payloadLen);
-    if (!recvAll(buf.data(), payloadLen)) return false;
-    message.assign(buf.data(), payloadLen);
-    return true;
 }
 
 void TcpSocket::close() {
-    std::lock_guard<std::mutex> lk(m_socketMutex);
-    close(true); // 已持有锁，直接调用内部版本
-}
-
-// 内部close函数：假设调用者已持有锁，无需再次锁定
-void TcpSocket::close(bool alreadyLocked) {
+    // 先让写端失效，再等正在写的线程交还写端，之后句柄只剩拥有者线程在用
+    setSocketValid(false);
+    if (m_channel) {
+        // 句柄归 transport，由 reactor 在在途操作完成后关闭；channel 本身留到 setHandle / 析构再替换，
+        // 其他线程的 send 仍可能在读这个指针
+        m_channel->close();
 #ifdef _WIN32
-    if (m_socket != INVALID_SOCKET) {
-        closesocket(m_socket);
         m_socket = INVALID_SOCKET;
-    }
 #else
-    if (m_socket >= 0) {
-        ::close(m_socket);
         m_socket = -1;
+#endif
+        return;
     }
+#ifdef _WIN32
+    if (m_socket == INVALID_SOCKET) return;
+    ::shutdown(m_socket, SD_BOTH);
+#else
+    if (m_socket < 0) return;
+    ::shutdown(m_socket, SHUT_RDWR);
+#endif
+    // shutdown 让阻塞中的写立即失败，持有者很快交还写端
+    while (m_writers.load() != 0) std::this_thread::yield();
+#ifdef _WIN32
+    closesocket(m_socket);
+    m_socket = INVALID_SOCKET;
+#else
+    ::close(m_socket);
+    m_socket = -1;
 #endif
-    setSocketValid(false);
 }
 
-void TcpSocket::setHandle(SocketHandle handle) {
-    std::lock_guard<std::mutex> lk(m_socketMutex);
-    // 关闭原 socket
-    if (isSocketValid()) {
+void TcpSocket::shutdown() {
+    if (!isSocketValid()) return;
+    m_ioFailed = true;
+    if (m_channel) {
+        m_channel->close();
+        return;
+    }
 #ifdef _WIN32
-        closesocket(m_socket);
+    ::shutdown(m_socket, SD_BOTH);
 #else
-        ::close(m_socket);
+    ::shutdown(m_socket, SHUT_RDWR);
 #endif
-    }
+}
+
+void TcpSocket::setHandle(SocketHandle handle) {
+    // 关闭原 socket
+    close();
+    m_channel.reset();
+    resetCompression();
+    resetState();
     m_socket = handle;
     setSocketValid(handle >= 0
 #ifdef _WIN32
@@ -451,6 +887,7 @@ void TcpSocket::setHandle(SocketHandle handle) {
 
 void TcpSocket::setReceiveTimeout(int seconds) {
     if (!isSocketValid()) return;
+    m_receiveTimeoutSec = seconds;
 #ifdef _WIN32
     DWORD ms = static_cast<DWORD>(seconds * 1000);
     setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&ms), sizeof(ms));
@@ -482,24 +919,58 @@ bool TcpSocket::setNonBlockingMode(bool enable) {
     return true;
 }
 
+// 只读原子标记，写端线程也可以调用（句柄本身由拥有者线程修改）
 bool TcpSocket::isSocketValid() const {
-#ifdef _WIN32
-    return m_socket != INVALID_SOCKET && m_socketValid.load();
-#else
-    return m_socket >= 0 && m_socketValid.load();
-#endif
+    return m_socketValid.load();
 }
 
 void TcpSocket::setSocketValid(bool v) {
     m_socketValid.store(v);
 }
 
+// 新句柄：清掉上一个连接的读写状态
+void TcpSocket::resetState() {
+    m_ioFailed = false;
+    m_writeError.store(0);
+    m_receiveTimeoutSec = -1;
+    m_readStart = m_readEnd = 0;
+}
+
+bool TcpSocket::enableCompression(const CompressionDictionary* dictionary, size_t minBytes) {
+    if (!isSocketValid()) { m_lastError = "invalid socket"; return false; }
+    if (isCompressing()) return true;
+    // 先准备好解压端：对端收到应答后发来的第一帧就可能是压缩的
+    m_decompressor.reset(new FrameDecompressor(dictionary));
+    m_compressor.store(new FrameCompressor(dictionary, minBytes), std::memory_order_release);
+    return true;
+}
+
+void TcpSocket::resetCompression() {
+    m_decompressor.reset();
+    FrameCompressor* compressor = m_compressor.load(std::memory_order_acquire);
+    if (!compressor) return;
+    while (m_writers.load() != 0) std::this_thread::yield();
+    m_compressor.store(nullptr, std::memory_order_release);
+    delete compressor;
+}
+
+bool TcpSocket::attachTransport(SocketTransport& transport) {
+    if (!isSocketValid()) { m_lastError = "invalid socket"; return false; }
+    if (m_channel) return true;
+    m_channel = transport.attach(m_socket);
+    return true;
+}
+
+bool TcpSocket::notifyWhenReadable(std::function<void()> callback) {
+    if (!m_channel) return false;
+    return m_channel->notifyWhenReadable(std::move(callback));
+}
+
+// 由读写结果维护，不查询 SO_ERROR
 bool TcpSocket::isConnected() const {
-    if (!isSocketValid()) return false;
-    int err = 0;
-    socklen_t len = sizeof(err);
-    if (getsockopt(m_socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len) < 0) return false;
-    return (err == 0);
+    if (!isSocketValid() || m_ioFailed.load()) return false;
+    if (m_channel) return m_channel->isOpen();
+    return true;
 }
 
 std::string TcpSocket::getLastError() const {
@@ -510,6 +981,15 @@ int TcpSocket::getLastErrorCode() const {
     return m_lastErrorCode;
 }
 
+std::string TcpSocket::getWriteError() const {
+    int code = m_writeError.load(std::memory_order_acquire);
+    if (code == 0) return std::string();
+    if (code == WRITE_ERROR_PEER_CLOSED) return "peer closed";
+    if (code == WRITE_ERROR_CLOSED) return m_channel ? m_channel->closeReason() : "socket closed";
+    if (code == WRITE_ERROR_TIMEOUT) return "send timed out";
+    return errorToString(code);
+}
+
 std::string TcpSocket::errorToString(int code) const {
 #ifdef _WIN32
     LPSTR msgBuf = nullptr;
@@ -529,13 +1009,26 @@ std::string TcpSocket::errorToString(int code) const {
 #endif
 }
 
-// move ctor
-TcpSocket::TcpSocket(TcpSocket&& other) noexcept {
-    std::lock_guard<std::mutex> lk(other.m_socketMutex);
-    m_socket = other.m_socket;
-    m_socketValid.store(other.m_socketValid.load());
-    m_lastError = std::move(other.m_lastError);
-    m_lastErrorCode = other.m_lastErrorCode;
+// move ctor：被移动的 socket 不能有其他线程在用
+TcpSocket::TcpSocket(TcpSocket&& other) noexcept
+    : m_socket(other.m_socket),
+      m_socketValid(other.m_socketValid.load()),
+      m_ioFailed(other.m_ioFailed.load()),
+      m_channel(std::move(other.m_channel)),
+      m_writers(0),
+      m_writeQueue(nullptr),
+      m_queuedBytes(0),
+      m_writeBackpressure(false),
+      m_writeError(other.m_writeError.load()),
+      m_compressor(other.m_compressor.exchange(nullptr)),
+      m_lastError(std::move(other.m_lastError)),
+      m_lastErrorCode(other.m_lastErrorCode),
+      m_receiveTimeoutSec(other.m_receiveTimeoutSec),
+      m_readBuffer(std::move(other.m_readBuffer)),
+      m_readStart(other.m_readStart),
+      m_readEnd(other.m_readEnd),
+      m_decompressor(std::move(other.m_decompressor)) {
+    other.m_readStart = other.m_readEnd = 0;
 #ifdef _WIN32
     other.m_socket = INVALID_SOCKET;
 #else
@@ -548,11 +1041,21 @@ TcpSocket::TcpSocket(TcpSocket&& other) noexcept {
 TcpSocket& TcpSocket::operator=(TcpSocket&& other) noexcept {
     if (this != &other) {
         close();
-        std::lock_guard<std::mutex> lk(other.m_socketMutex);
+        resetCompression();
         m_socket = other.m_socket;
         m_socketValid.store(other.m_socketValid.load());
+        m_ioFailed.store(other.m_ioFailed.load());
+        m_channel = std::move(other.m_channel);
+        m_writeError.store(other.m_writeError.load());
         m_lastError = std::move(other.m_lastError);
         m_lastErrorCode = other.m_lastErrorCode;
+        m_receiveTimeoutSec = other.m_receiveTimeoutSec;
+        m_readBuffer = std::move(other.m_readBuffer);
+        m_readStart = other.m_readStart;
+        m_readEnd = other.m_readEnd;
+        m_compressor.store(other.m_compressor.exchange(nullptr));
+        m_decompressor = std::move(other.m_decompressor);
+        other.m_readStart = other.m_readEnd = 0;
 #ifdef _WIN32
         other.m_socket = INVALID_SOCKET;
 #else
@@ -3,8 +3,11 @@
 
 #include <string>
 #include <cstdint>
-#include <mutex>
 #include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <chrono>
 
 #ifdef __linux__
 // 添加poll支持用于非阻塞accept
@@ -23,6 +26,7 @@ extern "C" {
    typedef SSIZE_T ssize_t; // Windows 上补上 ssize_t 类型
 #else
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  include <netinet/in.h>
 #  include <arpa/inet.h>
 #  include <unistd.h>
@@ -36,8 +40,29 @@ extern "C" {
    typedef int SocketHandle;
 #endif
 
+class SocketTransport;
+class TransportChannel;
+class CompressionDictionary;
+class FrameCompressor;
+class FrameDecompressor;
+
+// 线程归属：读端（receivePipeMessage / recv）与控制操作（create / connect / setHandle / attachTransport / close）
+// 属于同一个拥有者线程；写端（sendPipeMessage* / send）任何线程都可以调用，shutdown 也可以跨线程调用。
+// 收发都不加锁：写端由原子计数交接——计数从 0 变 1 的调用者持有写端，直接从调用方内存写出，
+// 期间其他线程的帧拷贝进无锁队列后立即返回，由持有者在交还写端前按顺序合并写出。
+// 队列有上限：排队字节超过 MAX_QUEUED_BYTES 或持有者代发超过同样的量后，新的写入先等队列写完（背压），
+// 写不动（EAGAIN 或背压）超过 SEND_TIMEOUT_MS 判定连接失败。
+// 连接状态取自读写结果（EOF / 硬错误），isConnected 不再发系统调用。
+// 协商压缩后（enableCompression）写端持有者逐帧压缩，读端按长度前缀的 COMPRESSED_FRAME_FLAG 解压。
 class TcpSocket {
 public:
+    // 单条消息最大长度（可调整）
+    static constexpr uint32_t MAX_PIPE_MESSAGE_SIZE = 64 * 1024; // 64KB
+    // 默认监听队列长度：重启后大量客户端同时重连，队列太短会丢 SYN（内核按 somaxconn 截断）
+    static constexpr int DEFAULT_BACKLOG = 4096;
+    // 长度前缀最高位：负载是压缩帧（[原长度 varint][LZ4 块]），低 31 位仍是线上长度
+    static constexpr uint32_t COMPRESSED_FRAME_FLAG = 0x80000000u;
+
     TcpSocket();
     ~TcpSocket();
 
@@ -48,7 +73,11 @@ public:
     // 基本 socket 操作
     bool create();
     bool bind(uint16_t port, const std::string& ip = "0.0.0.0");
-    bool listen(int backlog = 5);
+    bool listen(int backlog = DEFAULT_BACKLOG);
+    // SO_REUSEPORT：多个 socket 绑定同一端口，内核把新连接分散到各监听 socket（需在 bind 前设置）
+    bool setReusePort(bool enable);
+    // TCP_NODELAY：小帧立即发出，不等 Nagle 攒包（节点间链路等对延迟敏感、自己会合并写的连接）
+    bool setNoDelay(bool enable);
     SocketHandle accept(std::string& clientIp, uint16_t& clientPort);
 
     // 非阻塞accept with timeout (用于Linux兼容性)
@@ -63,19 +92,54 @@ public:
 
     // 高级消息管道：4 字节长度前缀（网络字节序）
     bool sendPipeMessage(const std::string& message);
+    bool sendPipeMessage(const char* data, size_t len);
+    // 分段发送：多段内容拼成一帧（共用一个长度前缀），无需先拷贝到连续内存
+    struct PipeSegment {
+        const char* data;
+        size_t size;
+    };
+    bool sendPipeMessage(const PipeSegment* segments, size_t count);
+    // 多帧连续发送：每个 frames[i] 是一整帧（各自带长度前缀），整批合并提交，减少系统调用
+    bool sendPipeMessages(const PipeSegment* frames, size_t count);
+    // 只有读端拥有者线程调用
     bool receivePipeMessage(std::string& message, uint32_t timeoutSec = 5);
+    // 接收缓冲里已读入、还没切成帧的字节（如命令帧后面紧跟的原始文件数据）：调用方直接使用，
+    // 再用 consumeBuffered 丢弃；之后可以绕过本对象直接读句柄。挂了 transport 时总是 0
+    size_t peekBuffered(const char*& data) const;
+    void consumeBuffered(size_t n);
 
     // 超时 / 非阻塞 控制
     void setReceiveTimeout(int seconds);
     bool setNonBlockingMode(bool enable);
 
     // 状态/工具
+    // 关闭并释放句柄：只由拥有者线程调用，会等正在写的线程退出后再关闭句柄，避免句柄号被复用后写错连接
     void close();
+    // 任意线程：停止收发（阻塞中的读写立即返回），句柄仍由拥有者 close
+    void shutdown();
     void setHandle(SocketHandle handle);
     bool isSocketValid() const;
     bool isConnected() const;
+    // 控制操作与读端的最近错误（拥有者线程读取）
     std::string getLastError() const;
     int getLastErrorCode() const;
+    // 写端错误：第一次写失败后保持不变，任何线程都可读取
+    std::string getWriteError() const;
+    // 底层句柄，供外部事件循环（poll）使用；所有权仍归本对象
+    SocketHandle nativeHandle() const { return m_socket; }
+
+    // 挂到 io_uring / epoll 收发后端：之后的帧收发经由 reactor 的内存队列，句柄所有权转交 transport，
+    // close() 只发出关闭请求。只影响 sendPipeMessage* / receivePipeMessage / isConnected
+    bool attachTransport(SocketTransport& transport);
+    bool hasTransport() const { return m_channel != nullptr; }
+    // 挂了 transport 时：下一帧到达或连接关闭时调用一次 callback（reactor 线程上），供协程挂起等待；
+    // 已有帧可读、已关闭或没有 transport 时不登记并返回 false
+    bool notifyWhenReadable(std::function<void()> callback);
+
+    // 开启连接级压缩（LOGIN 协商成功后、发出应答之前由拥有者线程调用）：之后收到的压缩帧自动解压，
+    // 不小于 minBytes 的发送帧由写端持有者压缩。两个方向各一个流式上下文，共用同一个字典
+    bool enableCompression(const CompressionDictionary* dictionary, size_t minBytes);
+    bool isCompressing() const { return m_compressor.load(std::memory_order_acquire) != nullptr; }
 
     // 允许移动操作
     TcpSocket(TcpSocket&& other) noexcept;
@@ -86,23 +150,70 @@ private:
     TcpSocket(const TcpSocket& other) = delete;
     TcpSocket& operator=(const TcpSocket& other) = delete;
 
-    // 内部close函数：假设调用者已持有锁，无需再次锁定
-    void close(bool alreadyLocked);
+    // 其他线程排入写队列的字节（若干完整帧）
+    struct WriteNode {
+        WriteNode* next;
+        std::string bytes;
+        bool framed;                               // false: send() 的原始字节，不按帧解析、不压缩
+    };
+
+    // 写端错误码：正数为 errno，负数为下面的内部原因
+    static constexpr int WRITE_ERROR_PEER_CLOSED = -1;
+    static constexpr int WRITE_ERROR_CLOSED = -2;
+    static constexpr int WRITE_ERROR_TIMEOUT = -3;
+    static constexpr size_t MAX_QUEUED_BYTES = 1024 * 1024;
+    static constexpr int SEND_TIMEOUT_MS = 5000;
+    // 接收缓冲初始大小，放不下一整帧时扩到帧长
+    static constexpr size_t READ_BUFFER_SIZE = 16 * 1024;
 
 private:
     SocketHandle m_socket;
-    std::atomic<bool> m_socketValid;
-    mutable std::mutex m_socketMutex;
-
+    std::atomic<bool> m_socketValid;               // 有句柄且未 close / shutdown
+    std::atomic<bool> m_ioFailed;                  // 读写遇到 EOF 或硬错误，连接已不可用
+    std::shared_ptr<TransportChannel> m_channel;   // 挂了 transport 时非空；只在拥有者线程上替换
+
+    // ---- 写端（任意线程）----
+    std::atomic<uint32_t> m_writers;               // 正在写或已排队的调用数，从 0 变 1 的调用者持有写端
+    std::atomic<WriteNode*> m_writeQueue;          // 后进先出的无锁栈，持有者取出后反转成入队顺序
+    std::atomic<size_t> m_queuedBytes;             // 队列中的字节数
+    std::atomic<bool> m_writeBackpressure;         // 为 true 时新的写入先等持有者交还写端
+    std::atomic<int> m_writeError;                 // 0 表示正常
+    std::atomic<FrameCompressor*> m_compressor;    // 开启压缩后非空，只由写端持有者使用
+
+    // ---- 读端 / 控制（拥有者线程）----
     std::string m_lastError;
     int m_lastErrorCode;
+    int m_receiveTimeoutSec;                       // 当前 SO_RCVTIMEO，不变时不重复 setsockopt
+    std::vector<char> m_readBuffer;                // 接收缓冲：一次 recv 读多帧，按长度前缀切出
+    size_t m_readStart;
+    size_t m_readEnd;
+    std::unique_ptr<FrameDecompressor> m_decompressor;
 
     void setSocketValid(bool v);
+    void resetState();
     std::string errorToString(int code) const;
 
-    // helper: 完全发送/接收
-    bool sendAll(const char* buf, size_t len);
-    bool recvAll(char* buf, size_t len);
+    // 写端：持有写端时直接写出 segments，否则拷贝入队；bytes 为 segments 总长，framed 表示内容是完整帧
+    bool writeSegments(PipeSegment* segments, size_t count, size_t bytes, bool framed = true);
+    // 交还 done 个已处理的调用，计数归零前代发队列里的帧
+    void drainWriteQueue(uint32_t done);
+    void failWrite(int code);
+    // 背压期间等待持有者写完；超时判定连接失败。返回能否继续写
+    bool waitForDrain();
+    // 持有者：帧内容需要改写（压缩）或交给 reactor 时先拼成连续字节；返回 0 或写端错误码
+    void appendEncoded(std::string& out, const char* data, size_t len, bool framed);
+    int writeBytes(std::string&& bytes);
+    // 释放压缩上下文：先等写端交还，保证没有线程还在用
+    void resetCompression();
+    // 解压一帧到 message；没有开启压缩或数据损坏时记错误并返回 false
+    bool inflateFrame(const char* data, size_t len, std::string& message);
+
+    // helper: 完全发送/接收；发送返回 0 或写端错误码
+    int sendAll(const char* buf, size_t len);
+    int sendAllSegments(PipeSegment* segments, size_t count);
+    // EAGAIN 时等到可写；deadline 为空时从现在起算 SEND_TIMEOUT_MS。返回 0 或写端错误码
+    int waitWritable(std::chrono::steady_clock::time_point& deadline);
+    bool fillReadBuffer(size_t need);
 };
 
 #endif // TCP_SOCKET_HPP